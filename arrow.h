@@ -0,0 +1,397 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <utility>
+#include <stdexcept>
+#include <climits>
+#include <cstdint>
+
+#include "ilf.h"
+#include "parser.h"
+#include "span.h"
+
+// Structures of the Arrow C Data Interface, defined as in the Arrow
+// specification so that they are compatible with arrow/c/abi.h
+//
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+    const char* format;
+    const char* name;
+    const char* metadata;
+    int64_t flags;
+    int64_t n_children;
+    struct ArrowSchema** children;
+    struct ArrowSchema* dictionary;
+    void (*release)(struct ArrowSchema*);
+    void* private_data;
+};
+
+struct ArrowArray {
+    int64_t length;
+    int64_t null_count;
+    int64_t offset;
+    int64_t n_buffers;
+    int64_t n_children;
+    const void** buffers;
+    struct ArrowArray** children;
+    struct ArrowArray* dictionary;
+    void (*release)(struct ArrowArray*);
+    void* private_data;
+};
+
+#endif
+
+namespace libilf {
+
+namespace detail {
+
+/**
+ * Children of an exported schema, freed by its release callback.
+ */
+struct ArrowSchemaData {
+    std::vector<ArrowSchema*> _children;
+    ArrowSchema *_dictionary;
+};
+
+inline void release_arrow_schema(ArrowSchema *schema) {
+    ArrowSchemaData *data = static_cast<ArrowSchemaData*>(schema->private_data);
+    for (size_t i = 0; i < data->_children.size(); i++) {
+        // The consumer may have moved a child out, releasing it itself
+        //
+        if (data->_children[i]->release != nullptr) {
+            data->_children[i]->release(data->_children[i]);
+        }
+        delete data->_children[i];
+    }
+    if (data->_dictionary != nullptr) {
+        if (data->_dictionary->release != nullptr) {
+            data->_dictionary->release(data->_dictionary);
+        }
+        delete data->_dictionary;
+    }
+    delete data;
+    schema->release = nullptr;
+}
+
+/**
+ * Fills in a schema. Formats and names are string literals, so only the
+ * children need freeing.
+ */
+inline ArrowSchema* init_arrow_schema(ArrowSchema *schema, char const* format, char const* name,
+    int64_t flags, std::vector<ArrowSchema*> children = std::vector<ArrowSchema*>(),
+    ArrowSchema *dictionary = nullptr) {
+    ArrowSchemaData *data = new ArrowSchemaData();
+    data->_children = std::move(children);
+    data->_dictionary = dictionary;
+    schema->format = format;
+    schema->name = name;
+    schema->metadata = nullptr;
+    schema->flags = flags;
+    schema->n_children = static_cast<int64_t>(data->_children.size());
+    schema->children = data->_children.empty() ? nullptr : data->_children.data();
+    schema->dictionary = dictionary;
+    schema->release = release_arrow_schema;
+    schema->private_data = data;
+    return schema;
+}
+
+/**
+ * Buffers and children of an exported array, freed by its release callback.
+ * Each array uses the buffers its layout needs.
+ */
+struct ArrowArrayData {
+    std::vector<uint8_t> _validity;
+    std::vector<int32_t> _int32s;
+    std::vector<int64_t> _int64s;
+    std::vector<char> _chars;
+    const void *_buffers[3];
+    std::vector<ArrowArray*> _children;
+    ArrowArray *_dictionary;
+};
+
+inline void release_arrow_array(ArrowArray *array) {
+    ArrowArrayData *data = static_cast<ArrowArrayData*>(array->private_data);
+    for (size_t i = 0; i < data->_children.size(); i++) {
+        if (data->_children[i]->release != nullptr) {
+            data->_children[i]->release(data->_children[i]);
+        }
+        delete data->_children[i];
+    }
+    if (data->_dictionary != nullptr) {
+        if (data->_dictionary->release != nullptr) {
+            data->_dictionary->release(data->_dictionary);
+        }
+        delete data->_dictionary;
+    }
+    delete data;
+    array->release = nullptr;
+}
+
+inline ArrowArray* init_arrow_array(ArrowArray *array, ArrowArrayData *data, int64_t length,
+    int64_t null_count, int64_t n_buffers) {
+    array->length = length;
+    array->null_count = null_count;
+    array->offset = 0;
+    array->n_buffers = n_buffers;
+    array->n_children = static_cast<int64_t>(data->_children.size());
+    array->buffers = data->_buffers;
+    array->children = data->_children.empty() ? nullptr : data->_children.data();
+    array->dictionary = data->_dictionary;
+    array->release = release_arrow_array;
+    array->private_data = data;
+    return array;
+}
+
+/**
+ * Returns a non-null pointer to the elements of a vector, even if it is
+ * empty, since only validity buffers may be null.
+ */
+template <class T>
+AE_FORCEINLINE const void* arrow_buffer(std::vector<T>& vec) {
+    vec.reserve(1);
+    return vec.data();
+}
+
+/**
+ * Column of UTF-8 strings: offsets into the concatenated characters, with
+ * offsets[i + 1] - offsets[i] the length of string i.
+ */
+struct ArrowStrings {
+    ArrowStrings() : _offsets(1, 0) { }
+
+    AE_FORCEINLINE void append(std::string const& str) {
+        if (UNLIKELY(_chars.size() + str.size() > INT32_MAX)) {
+            throw std::overflow_error("Arrow string column exceeds 2 GiB");
+        }
+        _chars.insert(_chars.end(), str.begin(), str.end());
+        _offsets.push_back(static_cast<int32_t>(_chars.size()));
+    }
+
+    AE_FORCEINLINE size_t size() const {
+        return _offsets.size() - 1;
+    }
+
+    /**
+     * Moves the column into a new array, leaving it empty.
+     */
+    ArrowArray* export_array() {
+        ArrowArrayData *data = new ArrowArrayData();
+        data->_int32s.swap(_offsets);
+        data->_chars.swap(_chars);
+        data->_buffers[0] = nullptr;
+        data->_buffers[1] = arrow_buffer(data->_int32s);
+        data->_buffers[2] = arrow_buffer(data->_chars);
+        data->_dictionary = nullptr;
+        _offsets.assign(1, 0);
+        return init_arrow_array(new ArrowArray(), data, data->_int32s.size() - 1, 0, 3);
+    }
+
+    std::vector<int32_t> _offsets;
+    std::vector<char> _chars;
+};
+
+/**
+ * Parses an ILF time as a decimal integer, returning false if it is not one.
+ */
+inline bool parse_arrow_time(std::string const& time, int64_t *value) {
+    size_t i = !time.empty() && time[0] == '-';
+    if (i == time.size() || time.size() - i > 18) {
+        return false;
+    }
+    int64_t result = 0;
+    for (; i < time.size(); i++) {
+        if (time[i] < '0' || time[i] > '9') {
+            return false;
+        }
+        result = result * 10 + (time[i] - '0');
+    }
+    *value = time[0] == '-' ? -result : result;
+    return true;
+}
+
+} // namespace detail
+
+/**
+ * Exports the Arrow schema of ILF batches:
+ *
+ *     struct<
+ *         event_t: dictionary<int32, utf8>,
+ *         sender: utf8,
+ *         receiver: utf8,
+ *         time: int64 (nullable),
+ *         pairs: map<utf8, utf8>
+ *     >
+ *
+ * The schema belongs to the caller, who releases it with schema->release.
+ */
+inline void export_ilf_schema(ArrowSchema *schema) {
+    using detail::init_arrow_schema;
+    std::vector<ArrowSchema*> entries;
+    entries.push_back(init_arrow_schema(new ArrowSchema(), "u", "key", 0));
+    entries.push_back(init_arrow_schema(new ArrowSchema(), "u", "value", 0));
+    std::vector<ArrowSchema*> pairs;
+    pairs.push_back(init_arrow_schema(new ArrowSchema(), "+s", "entries", 0, std::move(entries)));
+    std::vector<ArrowSchema*> columns;
+    columns.push_back(init_arrow_schema(new ArrowSchema(), "i", "event_t", 0, std::vector<ArrowSchema*>(),
+        init_arrow_schema(new ArrowSchema(), "u", "", 0)));
+    columns.push_back(init_arrow_schema(new ArrowSchema(), "u", "sender", 0));
+    columns.push_back(init_arrow_schema(new ArrowSchema(), "u", "receiver", 0));
+    columns.push_back(init_arrow_schema(new ArrowSchema(), "l", "time", ARROW_FLAG_NULLABLE));
+    columns.push_back(init_arrow_schema(new ArrowSchema(), "+m", "pairs", 0, std::move(pairs)));
+    init_arrow_schema(schema, "+s", "", 0, std::move(columns));
+}
+
+/**
+ * Builds columnar batches of ILF records and exports them through the Arrow
+ * C Data Interface, so that pyarrow, Polars, DuckDB or any other Arrow
+ * consumer in the same process can take them over without serializing and
+ * parsing text, and without this library depending on Arrow.
+ *
+ * Records are appended column by column: event types are dictionary-encoded,
+ * times are parsed into integers (null if a time is not an integer), and key-
+ * value pairs become a map column, dropping whether values were quoted.
+ * Exporting moves the buffers into the ArrowArray, so they are handed over
+ * without copying, and leaves the builder empty for the next batch.
+ */
+class ArrowBatchBuilder {
+public:
+    ArrowBatchBuilder() : _time_nulls(0), _pair_offsets(1, 0) { }
+
+    void append(ILF const& ilf) {
+        std::unordered_map<std::string, int32_t>::const_iterator it = _event_ids.find(ilf._event_t);
+        if (it == _event_ids.end()) {
+            it = _event_ids.insert(std::make_pair(ilf._event_t, static_cast<int32_t>(_event_names.size()))).first;
+            _event_names.append(ilf._event_t);
+        }
+        _event_indices.push_back(it->second);
+        _senders.append(ilf._sender);
+        _receivers.append(ilf._receiver);
+
+        const size_t row = _times.size();
+        if (row % 8 == 0) {
+            _time_validity.push_back(0);
+        }
+        int64_t time = 0;
+        if (detail::parse_arrow_time(ilf._time, &time)) {
+            _time_validity[row / 8] |= static_cast<uint8_t>(1 << (row % 8));
+        } else {
+            _time_nulls++;
+        }
+        _times.push_back(time);
+
+        for (size_t i = 0; i < ilf._pairs.size(); i++) {
+            _keys.append(ilf._pairs[i]._key);
+            _values.append(ilf._pairs[i]._value);
+        }
+        _pair_offsets.push_back(static_cast<int32_t>(_keys.size()));
+    }
+
+    void append(span<const ILF> ilfs) {
+        for (size_t i = 0; i < ilfs.size(); i++) {
+            append(ilfs[i]);
+        }
+    }
+
+    /**
+     * Pops up to max_records outputs of a parser into the batch and returns
+     * how many were popped.
+     */
+    template <class input_t, unsigned int N>
+    size_t pop_from(Parser<input_t, ILF, N>& parser, size_t max_records) {
+        size_t count = 0;
+        while (count < max_records && parser.pop(_ilf)) {
+            append(_ilf);
+            count++;
+        }
+        return count;
+    }
+
+    /**
+     * Returns the number of records in the batch.
+     */
+    AE_FORCEINLINE size_t size() const {
+        return _times.size();
+    }
+
+    /**
+     * Exports the batch as a struct array matching export_ilf_schema() and
+     * starts a new batch. The array belongs to the caller, who releases it
+     * with array->release.
+     */
+    void export_batch(ArrowArray *array) {
+        using detail::ArrowArrayData;
+        using detail::init_arrow_array;
+        const int64_t length = static_cast<int64_t>(size());
+
+        ArrowArrayData *event_t = new ArrowArrayData();
+        event_t->_int32s.swap(_event_indices);
+        event_t->_buffers[0] = nullptr;
+        event_t->_buffers[1] = detail::arrow_buffer(event_t->_int32s);
+        event_t->_dictionary = _event_names.export_array();
+        _event_ids.clear();
+
+        ArrowArrayData *time = new ArrowArrayData();
+        time->_validity.swap(_time_validity);
+        time->_int64s.swap(_times);
+        time->_buffers[0] = _time_nulls == 0 ? nullptr : time->_validity.data();
+        time->_buffers[1] = detail::arrow_buffer(time->_int64s);
+        time->_dictionary = nullptr;
+
+        ArrowArrayData *entries = new ArrowArrayData();
+        const int64_t num_pairs = static_cast<int64_t>(_keys.size());
+        entries->_children.push_back(_keys.export_array());
+        entries->_children.push_back(_values.export_array());
+        entries->_buffers[0] = nullptr;
+        entries->_dictionary = nullptr;
+        ArrowArrayData *pairs = new ArrowArrayData();
+        pairs->_int32s.swap(_pair_offsets);
+        pairs->_buffers[0] = nullptr;
+        pairs->_buffers[1] = detail::arrow_buffer(pairs->_int32s);
+        pairs->_children.push_back(init_arrow_array(new ArrowArray(), entries, num_pairs, 0, 1));
+        pairs->_dictionary = nullptr;
+        _pair_offsets.assign(1, 0);
+
+        ArrowArrayData *columns = new ArrowArrayData();
+        columns->_children.push_back(init_arrow_array(new ArrowArray(), event_t, length, 0, 2));
+        columns->_children.push_back(_senders.export_array());
+        columns->_children.push_back(_receivers.export_array());
+        columns->_children.push_back(init_arrow_array(new ArrowArray(), time, length, _time_nulls, 2));
+        columns->_children.push_back(init_arrow_array(new ArrowArray(), pairs, length, 0, 2));
+        columns->_buffers[0] = nullptr;
+        columns->_dictionary = nullptr;
+        _time_nulls = 0;
+        init_arrow_array(array, columns, length, 0, 1);
+    }
+
+private:
+    std::unordered_map<std::string, int32_t> _event_ids;
+    detail::ArrowStrings _event_names, _senders, _receivers, _keys, _values;
+    std::vector<int32_t> _event_indices;
+    std::vector<int64_t> _times;
+    std::vector<uint8_t> _time_validity;
+    int64_t _time_nulls;
+    std::vector<int32_t> _pair_offsets;
+    ILF _ilf;
+};
+
+} // namespace libilf
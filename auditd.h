@@ -0,0 +1,466 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <utility>
+#include <stdexcept>
+#include <cstring>
+#include <cstdint>
+
+#include "ilf.h"
+#include "encoding.h"
+#include "pipeline.h"
+
+namespace libilf {
+
+/**
+ * One logical auditd event: the lines sharing an event serial number, in the
+ * order they were read, without the EOE line ending them.
+ */
+struct AuditEvent {
+    AuditEvent() : _serial(0), _time_ms(0) { }
+
+    uint64_t _serial, _time_ms;
+    std::string _time;
+    std::vector<std::string> _lines;
+};
+
+namespace detail {
+
+/**
+ * Parses the "msg=audit(1364481363.243:24287):" header of an auditd line.
+ */
+inline bool parse_audit_header(std::string const& line, std::string *time, uint64_t *time_ms,
+    uint64_t *serial, char const** type, size_t *type_len) {
+    static const char MSG[] = "msg=audit(";
+    const size_t msg = line.find(MSG);
+    if (msg == std::string::npos) {
+        return false;
+    }
+    const size_t begin = msg + sizeof(MSG) - 1, colon = line.find(':', begin),
+        close = colon == std::string::npos ? colon : line.find(')', colon);
+    if (close == std::string::npos) {
+        return false;
+    }
+    time->assign(line, begin, colon - begin);
+    uint64_t seconds = 0, value = 0;
+    bool fraction = false;
+    for (size_t i = begin; i < colon; i++) {
+        if (line[i] == '.') {
+            seconds = value;
+            value = 0;
+            fraction = true;
+        } else if (line[i] >= '0' && line[i] <= '9') {
+            value = value * 10 + (line[i] - '0');
+        } else {
+            return false;
+        }
+    }
+    *time_ms = fraction ? seconds * 1000 + value : value * 1000;
+    *serial = 0;
+    for (size_t i = colon + 1; i < close; i++) {
+        if (line[i] < '0' || line[i] > '9') {
+            return false;
+        }
+        *serial = *serial * 10 + (line[i] - '0');
+    }
+    const size_t type_pos = line.find("type=");
+    *type = line.data();
+    *type_len = 0;
+    if (type_pos != std::string::npos && type_pos < msg) {
+        const size_t type_end = line.find(' ', type_pos);
+        *type = line.data() + type_pos + 5;
+        *type_len = (type_end == std::string::npos ? line.size() : type_end) - type_pos - 5;
+    }
+    return true;
+}
+
+AE_FORCEINLINE bool audit_key_is(char const* key, size_t key_len, char const* name) {
+    return strlen(name) == key_len && memcmp(key, name, key_len) == 0;
+}
+
+/**
+ * Returns whether a record of the given auditd type is a whole event, which
+ * auditd ends with no EOE line: user space messages (USER_*, CRED_*, ANOM_*
+ * other than the kernel's, account and role changes) and daemon and service
+ * messages. Kernel anomalies may come with the records of a system call and
+ * are grouped as usual.
+ */
+inline bool audit_single_record(char const* type, size_t type_len) {
+    static const char *const PREFIXES[] = {"USER_", "CRED_", "ANOM_", "DAEMON_", "SERVICE_", "SYSTEM_"};
+    static const char *const TYPES[] = {
+        "USER", "ADD_USER", "DEL_USER", "ADD_GROUP", "DEL_GROUP", "GRP_AUTH", "CHGRP_ID", "CHUSER_ID",
+        "ACCT_LOCK", "ACCT_UNLOCK", "ROLE_ASSIGN", "ROLE_REMOVE", "USYS_CONFIG", "TRUSTED_APP"
+    };
+    static const char *const KERNEL_ANOMALIES[] = {"ANOM_PROMISCUOUS", "ANOM_ABEND", "ANOM_LINK", "ANOM_CREAT"};
+    for (size_t i = 0; i < sizeof(KERNEL_ANOMALIES) / sizeof(KERNEL_ANOMALIES[0]); i++) {
+        if (audit_key_is(type, type_len, KERNEL_ANOMALIES[i])) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < sizeof(PREFIXES) / sizeof(PREFIXES[0]); i++) {
+        const size_t len = strlen(PREFIXES[i]);
+        if (type_len > len && memcmp(type, PREFIXES[i], len) == 0) {
+            return true;
+        }
+    }
+    for (size_t i = 0; i < sizeof(TYPES) / sizeof(TYPES[0]); i++) {
+        if (audit_key_is(type, type_len, TYPES[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace detail
+
+/**
+ * Source assembling auditd lines into events, for use with a Parser or a
+ * Pipeline of AuditEvent inputs and auditd_to_ilf().
+ *
+ * auditd writes one event as several lines (SYSCALL, EXECVE, CWD, PATH,
+ * PROCTITLE...) sharing a serial number, possibly interleaved with the lines
+ * of other events. This source groups them by serial number and hands over a
+ * group once its EOE line arrives. Records that are whole events, such as
+ * USER_* and CRED_* records (see detail::audit_single_record()), are handed
+ * over as soon as they are read. Other events without an EOE line, and lines
+ * whose EOE never comes, are handed over once they are timeout_ms older (in
+ * audit time) than the newest line, or once more than max_pending events are
+ * pending, oldest first; all pending events are handed over at the end of
+ * the stream. Lines without an audit header become events of their own.
+ *
+ * Only the header of each line is parsed here, so that assembly costs the
+ * producer little; fields are parsed and decoded by the workers.
+ */
+class AuditdSource : public Source<AuditEvent> {
+public:
+    AuditdSource(Source<std::string>& lines,
+        const size_t max_pending = 4096,
+        const uint64_t timeout_ms = 2000,
+        const size_t batch_size = 256) :
+        _lines(lines),
+        _max_pending(max_pending),
+        _timeout_ms(timeout_ms),
+        _batch(batch_size),
+        _latest_ms(0),
+        _sequence(0),
+        _end_of_stream(false)
+    {
+        if (max_pending == 0 || batch_size == 0) {
+            throw std::invalid_argument("max_pending and batch_size must be greater than 0");
+        }
+    }
+
+    size_t read(span<AuditEvent> events) override {
+        size_t count = 0;
+        while (count < events.size()) {
+            if (!_ready.empty()) {
+                events[count++] = std::move(_ready.front());
+                _ready.pop_front();
+            } else if (count > 0) {
+                break;
+            } else if (_end_of_stream) {
+                if (_order.empty()) {
+                    break;
+                }
+                hand_over_oldest();
+            } else {
+                size_t num_lines = _lines.read(_batch);
+                for (size_t i = 0; i < num_lines; i++) {
+                    add(_batch[i]);
+                }
+                _end_of_stream = num_lines == 0;
+            }
+        }
+        return count;
+    }
+
+    void close() override {
+        _lines.close();
+    }
+
+    /**
+     * Returns the number of events waiting for more lines.
+     */
+    size_t pending() const {
+        return _pending.size();
+    }
+
+private:
+    struct Pending {
+        AuditEvent _event;
+        uint64_t _sequence;
+    };
+
+    void add(std::string& line) {
+        AuditEvent event;
+        char const* type;
+        size_t type_len;
+        if (!detail::parse_audit_header(line, &event._time, &event._time_ms, &event._serial, &type, &type_len)) {
+            event._lines.push_back(std::move(line));
+            _ready.push_back(std::move(event));
+            return;
+        }
+        if (event._time_ms > _latest_ms) {
+            _latest_ms = event._time_ms;
+        }
+        std::unordered_map<uint64_t, Pending>::iterator it = _pending.find(event._serial);
+        const bool end_of_event = type_len == 3 && memcmp(type, "EOE", 3) == 0;
+        if (it == _pending.end() && !end_of_event && detail::audit_single_record(type, type_len)) {
+            event._lines.push_back(std::move(line));
+            _ready.push_back(std::move(event));
+            expire();
+            return;
+        }
+        if (it == _pending.end()) {
+            if (end_of_event) {
+                return;
+            }
+            Pending& pending = _pending[event._serial];
+            pending._event = std::move(event);
+            pending._sequence = _sequence;
+            _order.push_back(std::make_pair(pending._event._serial, _sequence++));
+            it = _pending.find(pending._event._serial);
+        }
+        if (end_of_event) {
+            _ready.push_back(std::move(it->second._event));
+            _pending.erase(it);
+        } else {
+            it->second._event._lines.push_back(std::move(line));
+        }
+        expire();
+    }
+
+    /**
+     * Hands over events that timed out or exceed the bound, oldest first.
+     */
+    void expire() {
+        while (!_order.empty()) {
+            std::unordered_map<uint64_t, Pending>::iterator it = _pending.find(_order.front().first);
+            if (it == _pending.end() || it->second._sequence != _order.front().second) {
+                _order.pop_front();
+            } else if (_pending.size() > _max_pending || it->second._event._time_ms + _timeout_ms < _latest_ms) {
+                hand_over_oldest();
+            } else {
+                break;
+            }
+        }
+    }
+
+    void hand_over_oldest() {
+        std::unordered_map<uint64_t, Pending>::iterator it = _pending.find(_order.front().first);
+        if (it != _pending.end() && it->second._sequence == _order.front().second) {
+            _ready.push_back(std::move(it->second._event));
+            _pending.erase(it);
+        }
+        _order.pop_front();
+    }
+
+    Source<std::string>& _lines;
+    const size_t _max_pending;
+    const uint64_t _timeout_ms;
+    std::vector<std::string> _batch;
+    std::unordered_map<uint64_t, Pending> _pending;
+    // Serial numbers and sequence numbers of pending events in arrival order,
+    // including events already handed over
+    //
+    std::deque<std::pair<uint64_t, uint64_t> > _order;
+    std::deque<AuditEvent> _ready;
+    uint64_t _latest_ms, _sequence;
+    bool _end_of_stream;
+};
+
+namespace detail {
+
+/**
+ * Calls field(key, key_len, value, value_len, quoted) for each field of an
+ * auditd line after its header. Values are in double quotes, in single
+ * quotes (the msg of user space events) or bare.
+ */
+template <class field_t>
+void for_each_audit_field(std::string const& line, field_t field) {
+    size_t pos = line.find("): ");
+    pos = pos == std::string::npos ? 0 : pos + 3;
+    char const* p = line.data() + pos, *end = line.data() + line.size();
+    while (p < end) {
+        while (p < end && *p == ' ') {
+            p++;
+        }
+        char const* key = p;
+        while (p < end && *p != '=' && *p != ' ') {
+            p++;
+        }
+        if (p == end || *p != '=') {
+            continue;
+        }
+        const size_t key_len = p - key;
+        p++;
+        char const* value = p;
+        if (p < end && (*p == '"' || *p == '\'')) {
+            const char quote = *p;
+            value = ++p;
+            while (p < end && *p != quote) {
+                p++;
+            }
+            field(key, key_len, value, static_cast<size_t>(p - value), true);
+            p += p < end;
+            continue;
+        }
+        while (p < end && *p != ' ') {
+            p++;
+        }
+        field(key, key_len, value, static_cast<size_t>(p - value), false);
+    }
+}
+
+/**
+ * Sets out to an untrusted auditd string: as is if it was quoted, or else
+ * hex-decoded, with NULs (which separate the arguments of a proctitle) turned
+ * into spaces. Bare values that are not hex, such as (null), are kept.
+ */
+inline void decode_audit_string(char const* value, size_t len, bool quoted, std::string& out) {
+    if (!quoted && len > 0 && len % 2 == 0) {
+        out.resize(len / 2);
+        if (hex_decode(value, len, reinterpret_cast<uint8_t*>(&out[0]))) {
+            for (size_t i = 0; i < out.size(); i++) {
+                if (out[i] == '\0') {
+                    out[i] = ' ';
+                }
+            }
+            while (!out.empty() && out.back() == ' ') {
+                out.pop_back();
+            }
+            return;
+        }
+    }
+    out.assign(value, len);
+}
+
+} // namespace detail
+
+/**
+ * Parser conversion function from an assembled auditd event to an ILF.
+ *
+ * Events with an EXECVE record become ProcessCreate ILFs, others take the
+ * type of their first record. The sender is the parent process ID and the
+ * receiver the executable. Pairs are taken from the SYSCALL (pid, ppid, uid,
+ * auid, tty, syscall, success, comm, exe, key), CWD (cwd), EXECVE
+ * (command_line, from the arguments) and first PATH (path) records, with the
+ * PROCTITLE as command_line if there is no EXECVE record. Hex-encoded
+ * strings are decoded.
+ */
+inline void auditd_to_ilf(AuditEvent const& event, ILF& ilf) {
+    static const char *NUMERIC[] = {"pid", "ppid", "uid", "auid", "tty", "syscall", "success"};
+    static const char *STRINGS[] = {"comm", "exe", "key"};
+    std::vector<KeyValue> syscall;
+    std::vector<std::string> args;
+    std::string first_type, cwd, path, proctitle, value;
+    bool execve = false, have_path = false;
+    ilf = ILF(std::string(), std::string(), std::string(), event._time);
+
+    for (size_t i = 0; i < event._lines.size(); i++) {
+        std::string const& line = event._lines[i];
+        const size_t type_pos = line.find("type=");
+        const std::string type = type_pos == std::string::npos ? std::string() :
+            line.substr(type_pos + 5, line.find(' ', type_pos) - type_pos - 5);
+        if (first_type.empty()) {
+            first_type = type;
+        }
+        if (type == "SYSCALL") {
+            detail::for_each_audit_field(line, [&](char const* key, size_t key_len, char const* val, size_t len, bool quoted) {
+                for (size_t j = 0; j < sizeof(NUMERIC) / sizeof(NUMERIC[0]); j++) {
+                    if (detail::audit_key_is(key, key_len, NUMERIC[j])) {
+                        syscall.push_back(KeyValue(NUMERIC[j], std::string(val, len), false));
+                    }
+                }
+                for (size_t j = 0; j < sizeof(STRINGS) / sizeof(STRINGS[0]); j++) {
+                    if (detail::audit_key_is(key, key_len, STRINGS[j])) {
+                        detail::decode_audit_string(val, len, quoted, value);
+                        syscall.push_back(KeyValue(STRINGS[j], value, true));
+                    }
+                }
+            });
+        } else if (type == "EXECVE") {
+            execve = true;
+            detail::for_each_audit_field(line, [&](char const* key, size_t key_len, char const* val, size_t len, bool quoted) {
+                // a1="..." or, for long arguments, a1_len=... a1[0]=... a1[1]=...
+                //
+                if (key_len < 2 || key[0] != 'a' || key[1] < '0' || key[1] > '9') {
+                    return;
+                }
+                size_t index = 0, k = 1;
+                for (; k < key_len && key[k] >= '0' && key[k] <= '9'; k++) {
+                    index = index * 10 + (key[k] - '0');
+                }
+                if (k < key_len && key[k] != '[') {
+                    return;
+                }
+                if (index >= args.size()) {
+                    args.resize(index + 1);
+                }
+                detail::decode_audit_string(val, len, quoted, value);
+                args[index] += value;
+            });
+        } else if (type == "CWD") {
+            detail::for_each_audit_field(line, [&](char const* key, size_t key_len, char const* val, size_t len, bool quoted) {
+                if (detail::audit_key_is(key, key_len, "cwd")) {
+                    detail::decode_audit_string(val, len, quoted, cwd);
+                }
+            });
+        } else if (type == "PATH" && !have_path) {
+            have_path = true;
+            detail::for_each_audit_field(line, [&](char const* key, size_t key_len, char const* val, size_t len, bool quoted) {
+                if (detail::audit_key_is(key, key_len, "name")) {
+                    detail::decode_audit_string(val, len, quoted, path);
+                }
+            });
+        } else if (type == "PROCTITLE") {
+            detail::for_each_audit_field(line, [&](char const* key, size_t key_len, char const* val, size_t len, bool quoted) {
+                if (detail::audit_key_is(key, key_len, "proctitle")) {
+                    detail::decode_audit_string(val, len, quoted, proctitle);
+                }
+            });
+        }
+    }
+
+    ilf._event_t = execve ? "ProcessCreate" : first_type;
+    ilf._pairs = std::move(syscall);
+    for (size_t i = 0; i < ilf._pairs.size(); i++) {
+        if (ilf._pairs[i]._key == "ppid") {
+            ilf._sender = ilf._pairs[i]._value;
+        } else if (ilf._pairs[i]._key == "exe") {
+            ilf._receiver = ilf._pairs[i]._value;
+        }
+    }
+    if (!cwd.empty()) {
+        ilf._pairs.push_back(KeyValue("cwd", cwd, true));
+    }
+    if (execve) {
+        std::string command_line;
+        for (size_t i = 0; i < args.size(); i++) {
+            command_line += (i == 0 ? "" : " ") + args[i];
+        }
+        ilf._pairs.push_back(KeyValue("command_line", command_line, true));
+    } else if (!proctitle.empty()) {
+        ilf._pairs.push_back(KeyValue("command_line", proctitle, true));
+    }
+    if (have_path) {
+        ilf._pairs.push_back(KeyValue("path", path, true));
+    }
+}
+
+} // namespace libilf
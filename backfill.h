@@ -0,0 +1,509 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <system_error>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "atomicops.h"
+#include "pipeline.h"
+#include "scheduler.h"
+
+namespace libilf {
+
+struct BackfillConfig {
+    BackfillConfig() :
+        _chunk_size(1 << 20),
+        _buffers(32),
+        _read_threads(4),
+        _direct(true),
+        _drop_cache(true),
+        _max_carry(64 << 10),
+        _delimiter('\n') { }
+
+    size_t _chunk_size;
+    size_t _buffers;
+    unsigned int _read_threads;
+    bool _direct, _drop_cache;
+    size_t _max_carry;
+    char _delimiter;
+};
+
+/**
+ * Source of chunks of many files for backfills, which read terabytes once
+ * and must neither evict the page cache that live services depend on nor be
+ * capped by one buffered read at a time.
+ *
+ * Files are read in order, as blocks of _chunk_size at consecutive offsets,
+ * by _read_threads threads with up to _buffers reads in flight, so the
+ * device sees a deep queue of large sequential reads. With _direct, files
+ * are opened with O_DIRECT into buffers aligned to ALIGNMENT, bypassing the
+ * page cache; where O_DIRECT is not supported (e.g. tmpfs), whether open(2)
+ * refuses it or reads fail with EINVAL, and without _direct, reads are
+ * buffered and, with _drop_cache, each range read is dropped from the page
+ * cache with posix_fadvise(POSIX_FADV_DONTNEED), which also drops pages of
+ * those files cached by other readers.
+ *
+ * Chunks are FileChunks as produced by FileScheduler, with the same
+ * guarantees: whole records, in order within each file, and one chunk per
+ * file with _last set. The partial record at the end of a block is copied
+ * into space reserved in front of the next one, so records are not copied
+ * otherwise, unless longer than _max_carry.
+ *
+ * The buffers are allocated up front and return to the pool when every copy
+ * of the _owner of their chunk is destroyed, which bounds memory at
+ * _buffers * (_chunk_size + _max_carry). As with FileScheduler, the Pipeline
+ * holds on to a batch of chunks, and a batch of outputs if they keep their
+ * _owner, so _buffers must leave room for a few batches.
+ *
+ * Throws a std::system_error exception from read() if a file cannot be
+ * opened or read.
+ */
+class BackfillReader : public Source<FileChunk> {
+public:
+    enum : size_t { ALIGNMENT = 4096 };
+
+    /**
+     * Rounds the chunk size and _max_carry up to a multiple of ALIGNMENT.
+     *
+     * Throws a std::invalid_argument exception if the chunk size, the number
+     * of buffers or the number of read threads is 0, and a std::bad_alloc
+     * exception if the buffers cannot be allocated.
+     */
+    explicit BackfillReader(std::vector<std::string> const& paths,
+        BackfillConfig const& config = BackfillConfig()) :
+        _paths(paths),
+        _config(config),
+        _pool(std::make_shared<Pool>()),
+        _next_file(0),
+        _next_block(0),
+        _current(-1),
+        _sequence(0),
+        _stopped(false),
+        _cancelled(false),
+        _bytes(0),
+        _files_done(0),
+        _direct_files(0)
+    {
+        if (config._chunk_size == 0 || config._buffers == 0 || config._read_threads == 0) {
+            throw std::invalid_argument("chunk size, buffers and read threads must be greater than 0");
+        }
+        _config._chunk_size = (config._chunk_size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        _config._max_carry = (config._max_carry + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        for (size_t i = 0; i < config._buffers; i++) {
+            void *buffer;
+            if (posix_memalign(&buffer, ALIGNMENT, _config._max_carry + _config._chunk_size) != 0) {
+                throw std::bad_alloc();
+            }
+            _pool->_free.push_back(static_cast<char*>(buffer));
+        }
+        for (unsigned int i = 0; i < config._read_threads; i++) {
+            _threads.push_back(std::thread(&BackfillReader::reader_routine, this));
+        }
+    }
+
+    ~BackfillReader() {
+        close();
+    }
+
+    BackfillReader(BackfillReader const&) = delete;
+    BackfillReader& operator=(BackfillReader const&) = delete;
+
+    size_t read(span<FileChunk> chunks) override {
+        // The chunks of the previous call, which were pushed already, must not
+        // hold on to their buffers
+        //
+        for (size_t i = 0; i < chunks.size(); i++) {
+            chunks[i]._owner.reset();
+        }
+        size_t count = 0;
+        Backoff backoff;
+        while (count < chunks.size()) {
+            issue();
+            if (_reads.empty()) {
+                if (_next_file == _paths.size()) {
+                    break;
+                }
+                // Every buffer is held by chunks further down the pipeline
+                //
+                if (count != 0 || _cancelled.load(std::memory_order_acquire)) {
+                    break;
+                }
+                backoff.wait();
+                continue;
+            }
+            backoff.reset();
+            std::shared_ptr<Read> read = _reads.front();
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                while (!read->_done) {
+                    if (count != 0 || _cancelled.load(std::memory_order_acquire)) {
+                        return count;
+                    }
+                    _done_cv.wait_for(lock, std::chrono::milliseconds(10));
+                }
+            }
+            _reads.pop_front();
+            if (next_chunk(*read, chunks[count])) {
+                _bytes += chunks[count]._size;
+                count++;
+            }
+        }
+        return count;
+    }
+
+    void cancel() override {
+        _cancelled.store(true, std::memory_order_release);
+        _done_cv.notify_all();
+    }
+
+    /**
+     * Stops the read threads and closes the files. Buffers still held by
+     * chunks are freed when the last chunk is destroyed.
+     */
+    void close() override {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopped = true;
+        }
+        _read_cv.notify_all();
+        for (size_t i = 0; i < _threads.size(); i++) {
+            _threads[i].join();
+        }
+        _threads.clear();
+        for (size_t i = 0; i < _reads.size(); i++) {
+            _pool->release(_reads[i]->_buffer);
+        }
+        _reads.clear();
+        _file.reset();
+    }
+
+    std::string const& path(size_t file) const {
+        return _paths[file];
+    }
+
+    uint64_t bytes() const {
+        return _bytes;
+    }
+
+    size_t files_done() const {
+        return _files_done;
+    }
+
+    /**
+     * Number of files read with O_DIRECT.
+     */
+    size_t direct_files() const {
+        return _direct_files;
+    }
+
+private:
+    /**
+     * Aligned buffers, shared with the deleters of chunks that may outlive
+     * the reader.
+     */
+    struct Pool {
+        ~Pool() {
+            for (size_t i = 0; i < _free.size(); i++) {
+                free(_free[i]);
+            }
+        }
+
+        char* acquire() {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_free.empty()) {
+                return nullptr;
+            }
+            char *buffer = _free.back();
+            _free.pop_back();
+            return buffer;
+        }
+
+        void release(char *buffer) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _free.push_back(buffer);
+        }
+
+        std::mutex _mutex;
+        std::vector<char*> _free;
+    };
+
+    /**
+     * An open file, read through _direct_fd while _direct is set and through
+     * _fd otherwise. Its fd with O_DIRECT stays open after a fall back to
+     * buffered reads, since other reader threads may still be using it.
+     */
+    struct File {
+        File() : _fd(-1), _direct_fd(-1), _size(0), _direct(false) { }
+
+        ~File() {
+            if (_fd >= 0) {
+                ::close(_fd);
+            }
+            if (_direct_fd >= 0) {
+                ::close(_direct_fd);
+            }
+        }
+
+        std::string _path;
+        int _fd, _direct_fd;
+        uint64_t _size;
+        std::atomic<bool> _direct;
+        std::mutex _mutex;
+    };
+
+    /**
+     * One block of a file, read into _buffer + _max_carry.
+     */
+    struct Read {
+        std::shared_ptr<File> _file;
+        size_t _index;
+        uint64_t _offset;
+        size_t _length;
+        bool _last;
+        char *_buffer;
+        size_t _size;
+        int _error;
+        bool _done;
+    };
+
+    /**
+     * Queues reads of the next blocks for as long as there are free buffers.
+     * Empty files are queued as one read of nothing, marked done.
+     */
+    void issue() {
+        while (_next_file < _paths.size()) {
+            if (!_file) {
+                open(_paths[_next_file]);
+            }
+            char *buffer = _pool->acquire();
+            if (buffer == nullptr) {
+                return;
+            }
+            std::shared_ptr<Read> read = std::make_shared<Read>();
+            read->_file = _file;
+            read->_index = _next_file;
+            read->_offset = _next_block * _config._chunk_size;
+            read->_length = static_cast<size_t>(std::min<uint64_t>(_config._chunk_size, _file->_size - read->_offset));
+            read->_last = read->_offset + read->_length == _file->_size;
+            read->_buffer = buffer;
+            read->_size = 0;
+            read->_error = 0;
+            read->_done = read->_length == 0;
+            _reads.push_back(read);
+            if (!read->_done) {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _queue.push_back(read);
+                _read_cv.notify_one();
+            }
+            _next_block++;
+            if (read->_last) {
+                _file.reset();
+                _next_file++;
+                _next_block = 0;
+            }
+        }
+    }
+
+    void open(std::string const& path) {
+        _file = std::make_shared<File>();
+        _file->_path = path;
+        if (_config._direct) {
+            _file->_direct_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT);
+            _file->_direct.store(_file->_direct_fd >= 0, std::memory_order_relaxed);
+        }
+        if (_file->_direct_fd < 0) {
+            _file->_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        }
+        const int fd = _file->_direct_fd >= 0 ? _file->_direct_fd : _file->_fd;
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            throw std::system_error(errno, std::system_category(), path);
+        }
+        _file->_size = st.st_size;
+        if (_file->_direct.load(std::memory_order_relaxed)) {
+            _direct_files++;
+        } else {
+            posix_fadvise(_file->_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        }
+    }
+
+    /**
+     * Switches a file opened with O_DIRECT to buffered reads, for file
+     * systems that accept O_DIRECT at open(2) but refuse reads with EINVAL.
+     * Returns false if the file cannot be reopened.
+     */
+    bool fall_back(File& file) {
+        std::lock_guard<std::mutex> lock(file._mutex);
+        if (!file._direct.load(std::memory_order_relaxed)) {
+            return true;
+        }
+        const int fd = ::open(file._path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        file._fd = fd;
+        file._direct.store(false, std::memory_order_release);
+        _direct_files--;
+        return true;
+    }
+
+    void reader_routine() {
+        while (true) {
+            std::shared_ptr<Read> read;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                while (_queue.empty() && !_stopped) {
+                    _read_cv.wait(lock);
+                }
+                if (_stopped) {
+                    return;
+                }
+                read = _queue.front();
+                _queue.pop_front();
+            }
+            File& file = *read->_file;
+            char *data = read->_buffer + _config._max_carry;
+            bool direct = file._direct.load(std::memory_order_acquire);
+            while (read->_size < read->_length) {
+                // O_DIRECT needs aligned lengths too; the last block of a
+                // file comes back short
+                //
+                const size_t length = direct ? (read->_length + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT : read->_length;
+                ssize_t count = pread(direct ? file._direct_fd : file._fd, data + read->_size,
+                    length - read->_size, read->_offset + read->_size);
+                if (count < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (count < 0 && errno == EINVAL && direct) {
+                    if (!fall_back(file)) {
+                        read->_error = errno;
+                        break;
+                    }
+                    direct = false;
+                    continue;
+                }
+                if (count <= 0 || (direct && read->_size + count < read->_length && count % ALIGNMENT != 0)) {
+                    read->_error = count < 0 ? errno : EIO;
+                    break;
+                }
+                read->_size += count;
+            }
+            read->_size = std::min(read->_size, read->_length);
+            if (!direct && _config._drop_cache) {
+                posix_fadvise(file._fd, read->_offset, read->_length, POSIX_FADV_DONTNEED);
+            }
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                read->_done = true;
+            }
+            _done_cv.notify_all();
+        }
+    }
+
+    /**
+     * Makes a chunk of the carried partial record and the block up to its
+     * last delimiter, or all of it at the end of the file. Returns false
+     * without a chunk if there is no delimiter, in which case everything is
+     * carried to the next block.
+     */
+    bool next_chunk(Read& read, FileChunk& chunk) {
+        if (read._error != 0) {
+            _pool->release(read._buffer);
+            throw std::system_error(read._error, std::system_category(), _paths[read._index]);
+        }
+        if (static_cast<long>(read._index) != _current) {
+            _current = read._index;
+            _sequence = 0;
+            _carry.clear();
+        }
+        char *data = read._buffer + _config._max_carry;
+        size_t size = read._size;
+        std::shared_ptr<Pool> pool = _pool;
+        char *buffer = read._buffer;
+        std::shared_ptr<const char> owner(buffer, [pool](char const* p) {
+            pool->release(const_cast<char*>(p));
+        });
+        if (_carry.size() <= _config._max_carry) {
+            data -= _carry.size();
+            memcpy(data, _carry.data(), _carry.size());
+            size += _carry.size();
+        } else {
+            // Too long to fit in front of the block
+            //
+            std::shared_ptr<char> copy(new char[_carry.size() + size], std::default_delete<char[]>());
+            memcpy(copy.get(), _carry.data(), _carry.size());
+            memcpy(copy.get() + _carry.size(), data, size);
+            data = copy.get();
+            size += _carry.size();
+            owner = copy;
+        }
+        size_t cut = size;
+        if (!read._last) {
+            char const* delimiter = static_cast<char const*>(memrchr(data, _config._delimiter, size));
+            cut = delimiter == nullptr ? 0 : delimiter - data + 1;
+        }
+        _carry.assign(data + cut, size - cut);
+        if (cut == 0 && !read._last) {
+            return false;
+        }
+        chunk._file = read._index;
+        chunk._sequence = _sequence++;
+        chunk._last = read._last;
+        chunk._owner = owner;
+        chunk._data = data;
+        chunk._size = cut;
+        if (read._last) {
+            _files_done++;
+        }
+        return true;
+    }
+
+    std::vector<std::string> _paths;
+    BackfillConfig _config;
+    std::shared_ptr<Pool> _pool;
+    std::vector<std::thread> _threads;
+    std::mutex _mutex;
+    std::condition_variable _read_cv, _done_cv;
+    std::deque<std::shared_ptr<Read>> _queue, _reads;
+    std::shared_ptr<File> _file;
+    size_t _next_file;
+    uint64_t _next_block;
+    long _current;
+    uint64_t _sequence;
+    std::string _carry;
+    bool _stopped;
+    std::atomic<bool> _cancelled;
+    uint64_t _bytes;
+    size_t _files_done;
+    std::atomic<size_t> _direct_files;
+};
+
+} // namespace libilf
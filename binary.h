@@ -0,0 +1,128 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+
+#include "atomicops.h"
+#include "ilf.h"
+
+namespace libilf {
+
+namespace detail {
+
+AE_FORCEINLINE void append_u32(std::string& out, uint32_t value) {
+    char bytes[4] = {
+        static_cast<char>(value), static_cast<char>(value >> 8),
+        static_cast<char>(value >> 16), static_cast<char>(value >> 24)
+    };
+    out.append(bytes, 4);
+}
+
+AE_FORCEINLINE uint32_t load_u32(char const* p) {
+    unsigned char const* bytes = reinterpret_cast<unsigned char const*>(p);
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+}
+
+AE_FORCEINLINE void append_field(std::string& out, std::string const& field) {
+    append_u32(out, static_cast<uint32_t>(field.size()));
+    out += field;
+}
+
+AE_FORCEINLINE bool read_field(char const*& p, char const* end, std::string& field) {
+    if (end - p < 4 || static_cast<size_t>(end - p - 4) < load_u32(p)) {
+        return false;
+    }
+    const uint32_t len = load_u32(p);
+    field.assign(p + 4, len);
+    p += 4 + len;
+    return true;
+}
+
+} // namespace detail
+
+/**
+ * Serializer of ILFs into length-prefixed binary records, which a reader
+ * can skip through without looking at their contents. All integers are
+ * 32-bit little-endian:
+ *
+ *     record length (excluding itself), number of pairs,
+ *     event_t, sender, receiver, time,
+ *     per pair: key, value, flags (bit 0: quoted)
+ *
+ * with every string written as its length followed by its bytes. Usable as
+ * the format_t of StreamSink and FdSink; read_binary_ilf() reads records
+ * back.
+ */
+class BinaryFormat {
+public:
+    void operator()(ILF const& ilf, std::string& out) {
+        const size_t start = out.size();
+        detail::append_u32(out, 0);
+        detail::append_u32(out, static_cast<uint32_t>(ilf._pairs.size()));
+        detail::append_field(out, ilf._event_t);
+        detail::append_field(out, ilf._sender);
+        detail::append_field(out, ilf._receiver);
+        detail::append_field(out, ilf._time);
+        for (size_t i = 0; i < ilf._pairs.size(); i++) {
+            detail::append_field(out, ilf._pairs[i]._key);
+            detail::append_field(out, ilf._pairs[i]._value);
+            detail::append_u32(out, ilf._pairs[i]._has_quotes ? 1 : 0);
+        }
+        const uint32_t len = static_cast<uint32_t>(out.size() - start - 4);
+        for (int i = 0; i < 4; i++) {
+            out[start + i] = static_cast<char>(len >> (8 * i));
+        }
+    }
+};
+
+/**
+ * Reads the binary record at p, written by BinaryFormat, into ilf and moves
+ * p past it. As with parse_ilf(), the strings and pairs of ilf are assigned
+ * rather than replaced.
+ *
+ * Returns false, leaving p unchanged, if the record is truncated or
+ * malformed.
+ */
+inline bool read_binary_ilf(char const*& p, char const* end, ILF& ilf) {
+    if (end - p < 8 || static_cast<size_t>(end - p - 4) < detail::load_u32(p)) {
+        return false;
+    }
+    char const* q = p + 8, *record_end = p + 4 + detail::load_u32(p);
+    const uint32_t count = detail::load_u32(p + 4);
+    if (count > static_cast<size_t>(record_end - q) / 12 ||
+        !detail::read_field(q, record_end, ilf._event_t) || !detail::read_field(q, record_end, ilf._sender) ||
+        !detail::read_field(q, record_end, ilf._receiver) || !detail::read_field(q, record_end, ilf._time)) {
+        return false;
+    }
+    ilf._pairs.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        KeyValue& pair = ilf._pairs[i];
+        if (!detail::read_field(q, record_end, pair._key) || !detail::read_field(q, record_end, pair._value) ||
+            record_end - q < 4) {
+            return false;
+        }
+        pair._has_quotes = (detail::load_u32(q) & 1) != 0;
+        q += 4;
+    }
+    if (q != record_end) {
+        return false;
+    }
+    p = record_end;
+    return true;
+}
+
+} // namespace libilf
@@ -0,0 +1,376 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+#include <utility>
+#include <type_traits>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+#include "atomicops.h"
+#include "span.h"
+
+namespace libilf {
+
+/**
+ * Maximum number of characters written by format_decimal(), which is the
+ * length of -9223372036854775808 and of 18446744073709551615 plus a sign.
+ */
+static const size_t MAX_DECIMAL_LENGTH = 21;
+
+/**
+ * Batch of strings packed back to back into one character buffer, with an
+ * offsets array giving where each string starts. String i spans
+ * [offsets()[i], offsets()[i + 1]) of chars().
+ *
+ * Used as the output type of batch formatters so that converting a batch of
+ * values costs no allocation per value. Clearing an arena keeps its capacity,
+ * so an arena reused across batches stops allocating altogether.
+ *
+ * Offsets are 32 bits, which limits an arena to 4 GiB of characters.
+ */
+class StringArena {
+public:
+    StringArena() : _chars(nullptr), _size(0), _capacity(0), _offsets(1, 0) { }
+
+    StringArena(StringArena const& other) :
+        _chars(nullptr),
+        _size(0),
+        _capacity(0),
+        _offsets(other._offsets)
+    {
+        if (other._size > 0) {
+            reserve(other._size);
+            memcpy(_chars, other._chars, other._size);
+        }
+        _size = other._size;
+    }
+
+    StringArena(StringArena&& other) :
+        _chars(other._chars),
+        _size(other._size),
+        _capacity(other._capacity),
+        _offsets(std::move(other._offsets))
+    {
+        other._chars = nullptr;
+        other._size = other._capacity = 0;
+        other._offsets.assign(1, 0);
+    }
+
+    StringArena& operator=(StringArena const& other) {
+        if (this != &other) {
+            if (other._size > 0) {
+                reserve(other._size);
+                memcpy(_chars, other._chars, other._size);
+            }
+            _size = other._size;
+            _offsets = other._offsets;
+        }
+        return *this;
+    }
+
+    StringArena& operator=(StringArena&& other) {
+        if (this != &other) {
+            free(_chars);
+            _chars = other._chars;
+            _size = other._size;
+            _capacity = other._capacity;
+            _offsets = std::move(other._offsets);
+            other._chars = nullptr;
+            other._size = other._capacity = 0;
+            other._offsets.assign(1, 0);
+        }
+        return *this;
+    }
+
+    ~StringArena() {
+        free(_chars);
+    }
+
+    /**
+     * Removes all strings, keeping the allocated capacity.
+     */
+    void clear() {
+        _size = 0;
+        _offsets.assign(1, 0);
+    }
+
+    /**
+     * Returns the number of strings.
+     */
+    AE_FORCEINLINE size_t size() const {
+        return _offsets.size() - 1;
+    }
+
+    AE_FORCEINLINE char const* data(size_t i) const {
+        return _chars + _offsets[i];
+    }
+
+    AE_FORCEINLINE size_t length(size_t i) const {
+        return _offsets[i + 1] - _offsets[i];
+    }
+
+    std::string str(size_t i) const {
+        return std::string(data(i), length(i));
+    }
+
+    /**
+     * Returns the packed characters of all strings and their total number.
+     */
+    AE_FORCEINLINE char const* chars() const {
+        return _chars;
+    }
+
+    AE_FORCEINLINE size_t bytes() const {
+        return _size;
+    }
+
+    AE_FORCEINLINE std::vector<uint32_t> const& offsets() const {
+        return _offsets;
+    }
+
+    void append(char const* str, size_t length) {
+        memcpy(begin_write(length), str, length);
+        end_write(_chars + _size + length);
+    }
+
+    /**
+     * Returns a pointer to at least max_length writable characters past the
+     * last string. Once a string has been written there, call
+     * StringArena::end_write() with a pointer past its end to add it.
+     *
+     * Throws a std::bad_alloc exception if memory allocation fails.
+     */
+    AE_FORCEINLINE char* begin_write(size_t max_length) {
+        if (_size + max_length > _capacity) {
+            reserve(_size + max_length);
+        }
+        return _chars + _size;
+    }
+
+    AE_FORCEINLINE void end_write(char const* end) {
+        _size = end - _chars;
+        _offsets.push_back(static_cast<uint32_t>(_size));
+    }
+
+    /**
+     * Adds count strings of at most max_length characters each, where string 
+     * i is written by write(i, out), which returns a pointer past its end. 
+     * Checks capacity once rather than once per string.
+     */
+    template <class write_t>
+    AE_FORCEINLINE void append_each(size_t count, size_t max_length, write_t write) {
+        char *out = begin_write(count * max_length);
+        size_t first = _offsets.size();
+        _offsets.resize(first + count);
+        uint32_t *offsets = _offsets.data() + first;
+        for (size_t i = 0; i < count; i++) {
+            out = write(i, out);
+            offsets[i] = static_cast<uint32_t>(out - _chars);
+        }
+        _size = out - _chars;
+    }
+
+    /**
+     * Ensures room for the given total number of characters and strings.
+     */
+    void reserve(size_t bytes, size_t strings = 0) {
+        _offsets.reserve(strings + 1);
+        if (bytes <= _capacity) {
+            return;
+        }
+        size_t capacity = _capacity < 64 ? 64 : _capacity;
+        while (capacity < bytes) {
+            capacity *= 2;
+        }
+        char *chars = static_cast<char*>(realloc(_chars, capacity));
+        if (chars == nullptr) {
+            throw std::bad_alloc();
+        }
+        _chars = chars;
+        _capacity = capacity;
+    }
+
+private:
+    char *_chars;
+    size_t _size, _capacity;
+    std::vector<uint32_t> _offsets;
+};
+
+namespace detail {
+
+/**
+ * Pairs of digits for 00 to 99.
+ */
+AE_FORCEINLINE char const* digit_pairs() {
+    static const char pairs[201] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+    return pairs;
+}
+
+/**
+ * Writes the len decimal digits of value ending at end, with leading zeros
+ * if value has fewer digits.
+ */
+AE_FORCEINLINE void write_digits_backward(uint64_t value, char *end, unsigned int len) {
+    char const* pairs = digit_pairs();
+    while (len >= 2) {
+        unsigned int pair = static_cast<unsigned int>(value % 100);
+        value /= 100;
+        end -= 2;
+        memcpy(end, pairs + 2 * pair, 2);
+        len -= 2;
+    }
+    if (len == 1) {
+        *--end = static_cast<char>('0' + value % 10);
+    }
+}
+
+#if defined(__SSSE3__)
+
+/**
+ * Converts a value below 10^8 into eight 16-bit lanes holding its decimal
+ * digits, most significant first.
+ *
+ * The value is split into abcd and efgh, and each half is broadcast to four
+ * lanes (times 4, so that every lane below needs a shift of at least 2).
+ * Two high multiplies then divide the lanes by 1000, 100, 10 and 1, giving
+ * [a, ab, abc, abcd, e, ef, efg, efgh], and subtracting ten times the lane
+ * to the left leaves one digit per lane.
+ */
+AE_FORCEINLINE __m128i decimal_digits8(uint32_t value) {
+    const uint16_t abcd = static_cast<uint16_t>(value / 10000),
+        efgh = static_cast<uint16_t>(value % 10000);
+    const __m128i pair = _mm_cvtsi32_si128((abcd * 4) | ((efgh * 4) << 16));
+    const __m128i twice = _mm_unpacklo_epi16(pair, pair);
+    const __m128i halves = _mm_unpacklo_epi32(twice, twice);
+    const __m128i divided = _mm_mulhi_epu16(_mm_mulhi_epu16(halves,
+        _mm_setr_epi16(8389, 5243, 13108, -32768, 8389, 5243, 13108, -32768)),
+        _mm_setr_epi16(1 << 7, 1 << 11, 1 << 13, -32768, 1 << 7, 1 << 11, 1 << 13, -32768));
+    const __m128i tens = _mm_slli_epi64(_mm_mullo_epi16(divided, _mm_set1_epi16(10)), 16);
+    return _mm_sub_epi16(divided, tens);
+}
+
+/**
+ * Stores 16 ASCII digits shifted left by skip characters, dropping leading
+ * zeros. Always writes 16 bytes.
+ */
+AE_FORCEINLINE void store_digits16(__m128i digits, unsigned int skip, char *out) {
+    static const char shifts[32] = {
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+        -128, -128, -128, -128, -128, -128, -128, -128,
+        -128, -128, -128, -128, -128, -128, -128, -128
+    };
+    const __m128i shift = _mm_loadu_si128(reinterpret_cast<__m128i const*>(shifts + skip));
+    digits = _mm_add_epi8(digits, _mm_set1_epi8('0'));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_shuffle_epi8(digits, shift));
+}
+
+#endif
+
+} // namespace detail
+
+/**
+ * Returns the number of decimal digits of value.
+ */
+AE_FORCEINLINE unsigned int decimal_length(uint64_t value) {
+    static const uint64_t powers[20] = {
+        1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+        100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+        10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+        100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+    };
+    // Approximates log10 from the bit length and corrects by one. Setting the
+    // lowest bit maps 0 to 1 and changes no other length since powers of 10
+    // are even.
+    //
+    value |= 1;
+    unsigned int approx = ((64 - __builtin_clzll(value)) * 1233) >> 12;
+    return approx + (value >= powers[approx]);
+}
+
+/**
+ * Writes the decimal representation of value at out and returns a pointer
+ * past its last character.
+ *
+ * With SSSE3, the digits are computed eight at a time in vector registers and
+ * written with 16-byte stores, so up to MAX_DECIMAL_LENGTH bytes past out may
+ * be overwritten regardless of the length of the result.
+ */
+AE_FORCEINLINE char* format_decimal(uint64_t value, char *out) {
+#if defined(__SSSE3__)
+    const unsigned int len = decimal_length(value);
+    if (len <= 8) {
+        const __m128i digits = detail::decimal_digits8(static_cast<uint32_t>(value));
+        detail::store_digits16(_mm_packus_epi16(digits, _mm_setzero_si128()), 8 - len, out);
+        return out + len;
+    }
+    if (len <= 16) {
+        const __m128i high = detail::decimal_digits8(static_cast<uint32_t>(value / 100000000)),
+            low = detail::decimal_digits8(static_cast<uint32_t>(value % 100000000));
+        detail::store_digits16(_mm_packus_epi16(high, low), 16 - len, out);
+        return out + len;
+    }
+    // The top 1 to 4 digits, then 16 more
+    //
+    const uint64_t bottom = value % 10000000000000000ULL;
+    detail::write_digits_backward(value / 10000000000000000ULL, out + len - 16, len - 16);
+    const __m128i high = detail::decimal_digits8(static_cast<uint32_t>(bottom / 100000000)),
+        low = detail::decimal_digits8(static_cast<uint32_t>(bottom % 100000000));
+    detail::store_digits16(_mm_packus_epi16(high, low), 0, out + len - 16);
+    return out + len;
+#else
+    const unsigned int len = decimal_length(value);
+    detail::write_digits_backward(value, out + len, len);
+    return out + len;
+#endif
+}
+
+/**
+ * Writes the decimal representation of a signed value, see above.
+ */
+AE_FORCEINLINE char* format_decimal(int64_t value, char *out) {
+    uint64_t magnitude = static_cast<uint64_t>(value);
+    if (value < 0) {
+        *out++ = '-';
+        magnitude = 0 - magnitude;
+    }
+    return format_decimal(magnitude, out);
+}
+
+/**
+ * Formats a batch of integers into an arena, one string per value, without
+ * allocating per value. The arena is not cleared first.
+ */
+template <class T>
+void format_decimals(span<const T> values, StringArena& arena) {
+    static_assert(std::is_integral<T>::value, "values must be integers");
+    typedef typename std::conditional<std::is_signed<T>::value, int64_t, uint64_t>::type wide_t;
+    T const* data = values.data();
+    arena.append_each(values.size(), MAX_DECIMAL_LENGTH, [data](size_t i, char *out) {
+        return format_decimal(static_cast<wide_t>(data[i]), out);
+    });
+}
+
+} // namespace libilf
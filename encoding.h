@@ -0,0 +1,342 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#pragma once
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+#include "atomicops.h"
+
+namespace libilf {
+
+namespace detail {
+
+AE_FORCEINLINE char const* hex_digits(bool upper) {
+    return upper ? "0123456789ABCDEF" : "0123456789abcdef";
+}
+
+/**
+ * Value of each base64 character, or 0xFF for characters outside the
+ * alphabet.
+ */
+inline uint8_t const* base64_values() {
+    struct Table {
+        Table() {
+            static const char alphabet[] =
+                "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+            memset(_values, 0xFF, sizeof(_values));
+            for (int i = 0; i < 64; i++) {
+                _values[static_cast<unsigned char>(alphabet[i])] = static_cast<uint8_t>(i);
+            }
+        }
+
+        uint8_t _values[256];
+    };
+    static const Table table;
+    return table._values;
+}
+
+#if defined(__SSSE3__)
+
+/**
+ * Converts 16 bytes into 32 hex digits.
+ */
+AE_FORCEINLINE void hex_encode16(__m128i input, __m128i digits, char *out) {
+    const __m128i low_nibbles = _mm_set1_epi8(0x0F);
+    const __m128i high = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(input, 4), low_nibbles)),
+        low = _mm_shuffle_epi8(digits, _mm_and_si128(input, low_nibbles));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi8(high, low));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16), _mm_unpackhi_epi8(high, low));
+}
+
+/**
+ * Converts 16 hex digits of either case into their values, or returns false
+ * if one of them is not a hex digit.
+ */
+AE_FORCEINLINE bool hex_values16(__m128i input, __m128i *values) {
+    const __m128i lower = _mm_or_si128(input, _mm_set1_epi8(0x20));
+    const __m128i digit = _mm_and_si128(
+        _mm_cmpgt_epi8(input, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(input, _mm_set1_epi8('9' + 1)));
+    const __m128i letter = _mm_and_si128(
+        _mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+    if (_mm_movemask_epi8(_mm_or_si128(digit, letter)) != 0xFFFF) {
+        return false;
+    }
+    *values = _mm_or_si128(
+        _mm_and_si128(digit, _mm_sub_epi8(input, _mm_set1_epi8('0'))),
+        _mm_andnot_si128(digit, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+    return true;
+}
+
+/**
+ * Encodes the first 12 of 16 bytes into 16 base64 characters, following
+ * Mula and Lemire ("Faster Base64 Encoding and Decoding Using AVX2
+ * Instructions", 2018) with 128-bit vectors.
+ */
+AE_FORCEINLINE __m128i base64_encode12(__m128i input) {
+    // Each 32-bit lane gets bytes [b, a, c, b] of a triple, so that the four
+    // 6-bit indices can be isolated with two masks and moved in place with
+    // two 16-bit multiplies
+    //
+    input = _mm_shuffle_epi8(input, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+    const __m128i ac = _mm_mulhi_epu16(_mm_and_si128(input, _mm_set1_epi32(0x0FC0FC00)), _mm_set1_epi32(0x04000040)),
+        bd = _mm_mullo_epi16(_mm_and_si128(input, _mm_set1_epi32(0x003F03F0)), _mm_set1_epi32(0x01000010));
+    const __m128i indices = _mm_or_si128(ac, bd);
+
+    // Maps each range of indices (A-Z, a-z, 0-9, +, /) to the offset from
+    // its index to its character
+    //
+    __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    range = _mm_or_si128(range,
+        _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices), _mm_set1_epi8(13)));
+    const __m128i offsets = _mm_setr_epi8(
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    return _mm_add_epi8(indices, _mm_shuffle_epi8(offsets, range));
+}
+
+/**
+ * Decodes 16 base64 characters into 12 bytes, stored in the first 12 bytes
+ * of 16 at out, or returns false if one of them is not in the alphabet.
+ */
+AE_FORCEINLINE bool base64_decode16(__m128i input, uint8_t *out) {
+    const __m128i low_nibbles = _mm_set1_epi8(0x0F);
+    const __m128i high = _mm_and_si128(_mm_srli_epi32(input, 4), low_nibbles),
+        low = _mm_and_si128(input, low_nibbles);
+
+    // A character is valid if the bit of its high nibble is set in the mask
+    // of its low nibble
+    //
+    const __m128i masks = _mm_shuffle_epi8(_mm_setr_epi8(
+        static_cast<char>(0xA8), static_cast<char>(0xF8), static_cast<char>(0xF8), static_cast<char>(0xF8),
+        static_cast<char>(0xF8), static_cast<char>(0xF8), static_cast<char>(0xF8), static_cast<char>(0xF8),
+        static_cast<char>(0xF8), static_cast<char>(0xF8), static_cast<char>(0xF0), 0x54,
+        0x50, 0x50, 0x50, 0x54), low);
+    const __m128i bits = _mm_shuffle_epi8(_mm_setr_epi8(
+        0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, static_cast<char>(0x80),
+        0, 0, 0, 0, 0, 0, 0, 0), high);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(masks, bits), _mm_setzero_si128())) != 0) {
+        return false;
+    }
+
+    // The offset from a character to its value only depends on its high
+    // nibble, except for '/'
+    //
+    const __m128i slash = _mm_cmpeq_epi8(input, _mm_set1_epi8('/'));
+    const __m128i offsets = _mm_or_si128(
+        _mm_andnot_si128(slash, _mm_shuffle_epi8(_mm_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0), high)),
+        _mm_and_si128(slash, _mm_set1_epi8(16)));
+    const __m128i values = _mm_add_epi8(input, offsets);
+
+    // Packs pairs of 6-bit values into 12 bits, then pairs of those into 24
+    //
+    const __m128i pairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    const __m128i triples = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_shuffle_epi8(triples,
+        _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1)));
+    return true;
+}
+
+#endif
+
+} // namespace detail
+
+AE_FORCEINLINE size_t hex_encoded_length(size_t len) {
+    return 2 * len;
+}
+
+/**
+ * Writes the hex digits of len bytes at out and returns a pointer past the
+ * last one.
+ */
+inline char* hex_encode(void const* data, size_t len, char *out, bool upper = false) {
+    uint8_t const* bytes = static_cast<uint8_t const*>(data);
+    char const* digits = detail::hex_digits(upper);
+    size_t i = 0;
+#if defined(__SSSE3__)
+    const __m128i table = _mm_loadu_si128(reinterpret_cast<__m128i const*>(digits));
+    for (; i + 16 <= len; i += 16) {
+        detail::hex_encode16(_mm_loadu_si128(reinterpret_cast<__m128i const*>(bytes + i)), table, out);
+        out += 32;
+    }
+#endif
+    for (; i < len; i++) {
+        *out++ = digits[bytes[i] >> 4];
+        *out++ = digits[bytes[i] & 0x0F];
+    }
+    return out;
+}
+
+/**
+ * Decodes len hex digits of either case into len / 2 bytes at out.
+ *
+ * Returns false if len is odd or a character is not a hex digit, in which
+ * case the contents of out are unspecified.
+ */
+inline bool hex_decode(char const* in, size_t len, uint8_t *out) {
+    if (len % 2 != 0) {
+        return false;
+    }
+    size_t i = 0;
+#if defined(__SSSE3__)
+    for (; i + 32 <= len; i += 32) {
+        __m128i first, second;
+        if (!detail::hex_values16(_mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i)), &first) ||
+            !detail::hex_values16(_mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i + 16)), &second)) {
+            return false;
+        }
+        // Each pair of digits becomes high * 16 + low
+        //
+        const __m128i weights = _mm_set1_epi16(0x0110);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(
+            _mm_maddubs_epi16(first, weights), _mm_maddubs_epi16(second, weights)));
+        out += 16;
+    }
+#endif
+    for (; i < len; i += 2) {
+        int value = 0;
+        for (int j = 0; j < 2; j++) {
+            const char c = in[i + j], lower = c | 0x20;
+            if (c >= '0' && c <= '9') {
+                value = value * 16 + (c - '0');
+            } else if (lower >= 'a' && lower <= 'f') {
+                value = value * 16 + (lower - 'a' + 10);
+            } else {
+                return false;
+            }
+        }
+        *out++ = static_cast<uint8_t>(value);
+    }
+    return true;
+}
+
+AE_FORCEINLINE size_t base64_encoded_length(size_t len) {
+    return 4 * ((len + 2) / 3);
+}
+
+/**
+ * Writes the padded base64 encoding (RFC 4648) of len bytes at out and
+ * returns a pointer past its last character.
+ */
+inline char* base64_encode(void const* data, size_t len, char *out) {
+    static const char alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    uint8_t const* bytes = static_cast<uint8_t const*>(data);
+    size_t i = 0;
+#if defined(__SSSE3__)
+    // Reads 16 bytes to encode 12
+    //
+    for (; i + 16 <= len; i += 12) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out),
+            detail::base64_encode12(_mm_loadu_si128(reinterpret_cast<__m128i const*>(bytes + i))));
+        out += 16;
+    }
+#endif
+    for (; i + 3 <= len; i += 3) {
+        const uint32_t triple = (bytes[i] << 16) | (bytes[i + 1] << 8) | bytes[i + 2];
+        *out++ = alphabet[triple >> 18];
+        *out++ = alphabet[(triple >> 12) & 0x3F];
+        *out++ = alphabet[(triple >> 6) & 0x3F];
+        *out++ = alphabet[triple & 0x3F];
+    }
+    if (i < len) {
+        const uint32_t triple = (bytes[i] << 16) | (i + 1 < len ? bytes[i + 1] << 8 : 0);
+        *out++ = alphabet[triple >> 18];
+        *out++ = alphabet[(triple >> 12) & 0x3F];
+        *out++ = i + 1 < len ? alphabet[(triple >> 6) & 0x3F] : '=';
+        *out++ = '=';
+    }
+    return out;
+}
+
+/**
+ * Returns the number of bytes encoded by len padded base64 characters.
+ */
+AE_FORCEINLINE size_t base64_decoded_length(char const* in, size_t len) {
+    if (len < 4 || len % 4 != 0) {
+        return len / 4 * 3;
+    }
+    return len / 4 * 3 - (in[len - 1] == '=') - (in[len - 2] == '=');
+}
+
+/**
+ * Decodes len padded base64 characters into base64_decoded_length() bytes at
+ * out.
+ *
+ * Returns false if len is not a multiple of 4 or a character is not in the
+ * alphabet or misplaced padding, in which case the contents of out are
+ * unspecified.
+ */
+inline bool base64_decode(char const* in, size_t len, uint8_t *out) {
+    if (len % 4 != 0) {
+        return false;
+    }
+    uint8_t const* values = detail::base64_values();
+    size_t i = 0;
+#if defined(__SSSE3__)
+    // Writes 16 bytes to decode 12, so stops while at least 8 characters,
+    // hence 4 bytes, are left
+    //
+    for (; i + 24 <= len; i += 16) {
+        if (!detail::base64_decode16(_mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i)), out)) {
+            return false;
+        }
+        out += 12;
+    }
+#endif
+    for (; i + 4 <= len; i += 4) {
+        const bool last = i + 4 == len;
+        const int padding = last ? (in[i + 3] == '=') + (in[i + 2] == '=' && in[i + 3] == '=') : 0;
+        uint32_t quad = 0;
+        for (int j = 0; j < 4 - padding; j++) {
+            const uint8_t value = values[static_cast<unsigned char>(in[i + j])];
+            if (value == 0xFF) {
+                return false;
+            }
+            quad |= static_cast<uint32_t>(value) << (18 - 6 * j);
+        }
+        *out++ = static_cast<uint8_t>(quad >> 16);
+        if (padding < 2) {
+            *out++ = static_cast<uint8_t>(quad >> 8);
+        }
+        if (padding < 1) {
+            *out++ = static_cast<uint8_t>(quad);
+        }
+    }
+    return true;
+}
+
+/**
+ * Appends the hex digits of len bytes to a string, e.g. a KeyValue value.
+ */
+inline void append_hex(std::string& out, void const* data, size_t len, bool upper = false) {
+    const size_t size = out.size();
+    out.resize(size + hex_encoded_length(len));
+    hex_encode(data, len, &out[size], upper);
+}
+
+/**
+ * Appends the padded base64 encoding of len bytes to a string.
+ */
+inline void append_base64(std::string& out, void const* data, size_t len) {
+    const size_t size = out.size();
+    out.resize(size + base64_encoded_length(len));
+    base64_encode(data, len, &out[size]);
+}
+
+} // namespace libilf
@@ -0,0 +1,880 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdexcept>
+#include <cstring>
+#include <cstdint>
+#include <arpa/inet.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "atomicops.h"
+#include "ilf.h"
+
+namespace libilf {
+
+namespace detail {
+
+/**
+ * Set of bytes, as a 256-bit bitmap.
+ */
+struct CharClass {
+    CharClass() {
+        memset(_bits, 0, sizeof(_bits));
+    }
+
+    /**
+     * Builds a class from a list of bytes and ranges such as "A-Za-z0-9_",
+     * or its complement.
+     */
+    CharClass(char const* spec, bool negate = false) {
+        memset(_bits, 0, sizeof(_bits));
+        for (; *spec != '\0'; spec++) {
+            unsigned char first = *spec, last = first;
+            if (spec[1] == '-' && spec[2] != '\0') {
+                last = spec[2];
+                spec += 2;
+            }
+            for (unsigned int c = first; c <= last; c++) {
+                add(static_cast<unsigned char>(c));
+            }
+        }
+        if (negate) {
+            for (size_t i = 0; i < 4; i++) {
+                _bits[i] = ~_bits[i];
+            }
+        }
+    }
+
+    AE_FORCEINLINE bool contains(unsigned char c) const {
+        return (_bits[c >> 6] >> (c & 63)) & 1;
+    }
+
+    AE_FORCEINLINE void add(unsigned char c) {
+        _bits[c >> 6] |= uint64_t(1) << (c & 63);
+    }
+
+    uint64_t _bits[4];
+};
+
+/**
+ * Returns a pointer to the first occurrence of a literal of at least one byte
+ * in [begin, end), or end.
+ *
+ * With SSE2, compares the first and last bytes of the literal against 16
+ * candidate positions at a time and only compares the rest at positions
+ * where both match (Muła, "SIMD-friendly algorithms for substring
+ * searching", 2016).
+ */
+inline char const* find_literal(char const* begin, char const* end, char const* literal, size_t len) {
+    if (static_cast<size_t>(end - begin) < len) {
+        return end;
+    }
+    char const* last = end - len;
+#if defined(__SSE2__)
+    const __m128i first_byte = _mm_set1_epi8(literal[0]), last_byte = _mm_set1_epi8(literal[len - 1]);
+    for (; begin + 16 <= last + 1; begin += 16) {
+        const __m128i firsts = _mm_loadu_si128(reinterpret_cast<__m128i const*>(begin));
+        const __m128i lasts = _mm_loadu_si128(reinterpret_cast<__m128i const*>(begin + len - 1));
+        unsigned int mask = _mm_movemask_epi8(_mm_and_si128(
+            _mm_cmpeq_epi8(firsts, first_byte), _mm_cmpeq_epi8(lasts, last_byte)));
+        while (mask != 0) {
+            const unsigned int i = __builtin_ctz(mask);
+            if (memcmp(begin + i + 1, literal + 1, len - 1) == 0) {
+                return begin + i;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; begin <= last; begin++) {
+        begin = static_cast<char const*>(memchr(begin, literal[0], last - begin + 1));
+        if (begin == nullptr) {
+            return end;
+        }
+        if (memcmp(begin + 1, literal + 1, len - 1) == 0) {
+            return begin;
+        }
+    }
+    return end;
+}
+
+/**
+ * Returns a pointer to the last occurrence of a literal in [begin, end), or
+ * end.
+ */
+inline char const* find_last_literal(char const* begin, char const* end, char const* literal, size_t len) {
+    if (static_cast<size_t>(end - begin) < len) {
+        return end;
+    }
+    for (char const* p = end - len; ; p--) {
+        if (*p == literal[0] && memcmp(p + 1, literal + 1, len - 1) == 0) {
+            return p;
+        }
+        if (p == begin) {
+            return end;
+        }
+    }
+}
+
+enum GrokKind {
+    GROK_LITERAL,
+    GROK_BEGIN,
+    GROK_END,
+    GROK_RUN,
+    GROK_INT,
+    GROK_NUMBER,
+    GROK_IPV4,
+    GROK_IPV6,
+    GROK_IP,
+    GROK_QUOTED,
+    GROK_UUID,
+    GROK_TIME,
+    GROK_SYSLOG_TIMESTAMP,
+    GROK_ISO8601,
+    GROK_DATA,
+    GROK_GREEDY_DATA
+};
+
+static const size_t GROK_FAIL = SIZE_MAX;
+
+AE_FORCEINLINE bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+AE_FORCEINLINE bool is_hex(char c) {
+    return is_digit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+/**
+ * Returns the number of digits at p, up to max.
+ */
+AE_FORCEINLINE size_t count_digits(char const* p, char const* end, size_t max = SIZE_MAX) {
+    size_t n = 0;
+    while (p + n < end && n < max && is_digit(p[n])) {
+        n++;
+    }
+    return n;
+}
+
+inline size_t match_int(char const* s, char const* end) {
+    size_t sign = s < end && (*s == '+' || *s == '-');
+    size_t digits = count_digits(s + sign, end);
+    return digits == 0 ? GROK_FAIL : sign + digits;
+}
+
+inline size_t match_number(char const* s, char const* end) {
+    size_t n = s < end && (*s == '+' || *s == '-');
+    size_t digits = count_digits(s + n, end);
+    n += digits;
+    if (s + n + 1 < end && s[n] == '.' && is_digit(s[n + 1])) {
+        size_t fraction = count_digits(s + n + 1, end);
+        n += 1 + fraction;
+        digits += fraction;
+    }
+    return digits == 0 ? GROK_FAIL : n;
+}
+
+inline size_t match_ipv4(char const* s, char const* end) {
+    char const* p = s;
+    for (int octet = 0; octet < 4; octet++) {
+        if (octet > 0) {
+            if (p == end || *p != '.') {
+                return GROK_FAIL;
+            }
+            p++;
+        }
+        size_t digits = count_digits(p, end, 3);
+        unsigned int value = 0;
+        for (size_t i = 0; i < digits; i++) {
+            value = value * 10 + (p[i] - '0');
+        }
+        if (digits == 0 || value > 255) {
+            return GROK_FAIL;
+        }
+        p += digits;
+    }
+    return p < end && is_digit(*p) ? GROK_FAIL : p - s;
+}
+
+inline size_t match_ipv6(char const* s, char const* end) {
+    char const* p = s;
+    bool colon = false;
+    while (p < end && (is_hex(*p) || *p == ':' || *p == '.') && p - s < INET6_ADDRSTRLEN - 1) {
+        colon |= *p == ':';
+        p++;
+    }
+    if (!colon) {
+        return GROK_FAIL;
+    }
+    // A trailing colon may belong to the text that follows
+    //
+    char address[INET6_ADDRSTRLEN];
+    unsigned char binary[16];
+    for (int attempt = 0; attempt < 2 && p > s; attempt++, p--) {
+        memcpy(address, s, p - s);
+        address[p - s] = '\0';
+        if (inet_pton(AF_INET6, address, binary) == 1) {
+            return p - s;
+        }
+        if (p[-1] != ':') {
+            break;
+        }
+    }
+    return GROK_FAIL;
+}
+
+inline size_t match_quoted(char const* s, char const* end) {
+    if (s == end || (*s != '"' && *s != '\'')) {
+        return GROK_FAIL;
+    }
+    const char quote = *s;
+    for (char const* p = s + 1; p < end; p++) {
+        if (*p == '\\') {
+            p++;
+        } else if (*p == quote) {
+            return p + 1 - s;
+        }
+    }
+    return GROK_FAIL;
+}
+
+inline size_t match_uuid(char const* s, char const* end) {
+    if (end - s < 36) {
+        return GROK_FAIL;
+    }
+    for (int i = 0; i < 36; i++) {
+        if (i == 8 || i == 13 || i == 18 || i == 23 ? s[i] != '-' : !is_hex(s[i])) {
+            return GROK_FAIL;
+        }
+    }
+    return 36;
+}
+
+/**
+ * Matches hh:mm:ss with an optional fraction, or hh:mm if seconds are
+ * optional.
+ */
+inline size_t match_clock(char const* s, char const* end, bool optional_seconds) {
+    if (end - s < 5 || count_digits(s, end, 2) != 2 || s[2] != ':' || count_digits(s + 3, end, 2) != 2) {
+        return GROK_FAIL;
+    }
+    size_t n = 5;
+    if (s + 8 <= end && s[5] == ':' && count_digits(s + 6, end, 2) == 2) {
+        n = 8;
+        if (s + n + 1 < end && (s[n] == '.' || s[n] == ',') && is_digit(s[n + 1])) {
+            n += 1 + count_digits(s + n + 1, end);
+        }
+    } else if (!optional_seconds) {
+        return GROK_FAIL;
+    }
+    return n;
+}
+
+/**
+ * Matches "Mmm dd hh:mm:ss", where the day may be padded with a space.
+ */
+inline size_t match_syslog_timestamp(char const* s, char const* end) {
+    if (end - s < 15) {
+        return GROK_FAIL;
+    }
+    for (int i = 0; i < 3; i++) {
+        if (!((s[i] >= 'A' && s[i] <= 'Z') || (s[i] >= 'a' && s[i] <= 'z'))) {
+            return GROK_FAIL;
+        }
+    }
+    char const* p = s + 3;
+    if (*p++ != ' ') {
+        return GROK_FAIL;
+    }
+    if (*p == ' ') {
+        p++;
+    }
+    size_t day = count_digits(p, end, 2);
+    if (day == 0 || p + day == end || p[day] != ' ') {
+        return GROK_FAIL;
+    }
+    p += day + 1;
+    size_t clock = match_clock(p, end, false);
+    return clock == GROK_FAIL ? GROK_FAIL : p + clock - s;
+}
+
+/**
+ * Matches yyyy-mm-dd[T ]hh:mm[:ss[.fraction]][Z|+hh[:]mm].
+ */
+inline size_t match_iso8601(char const* s, char const* end) {
+    if (end - s < 16 || count_digits(s, end, 4) != 4 || s[4] != '-' || count_digits(s + 5, end, 2) != 2 ||
+        s[7] != '-' || count_digits(s + 8, end, 2) != 2 || (s[10] != 'T' && s[10] != ' ')) {
+        return GROK_FAIL;
+    }
+    size_t clock = match_clock(s + 11, end, true);
+    if (clock == GROK_FAIL) {
+        return GROK_FAIL;
+    }
+    char const* p = s + 11 + clock;
+    if (p < end && *p == 'Z') {
+        p++;
+    } else if (p + 3 <= end && (*p == '+' || *p == '-') && count_digits(p + 1, end, 2) == 2) {
+        char const* q = p + 3;
+        if (q < end && *q == ':') {
+            q++;
+        }
+        if (count_digits(q, end, 2) == 2) {
+            p = q + 2;
+        }
+    }
+    return p - s;
+}
+
+} // namespace detail
+
+/**
+ * Extraction engine turning free-text log lines into ILFs with grok-style
+ * patterns, as a much faster replacement for std::regex.
+ *
+ * A pattern is literal text with %{SYNTAX}, %{SYNTAX:field} or
+ * %{SYNTAX:field:type} references, where SYNTAX is a built-in primitive or a
+ * definition added with GrokMatcher::define(), and a type of int or float
+ * makes the field an unquoted pair. A backslash makes the next character
+ * literal, so that patterns written for grok with escaped brackets work as
+ * is. Fields named sender, receiver and time fill those ILF members, and
+ * other fields become pairs in the order they appear in the pattern.
+ *
+ * Patterns are compiled into sequences of literals and primitive matchers
+ * rather than regular expressions. Primitives are possessive: they match
+ * the longest text they can and never give any back, except for DATA
+ * (lazy) and GREEDYDATA (greedy), which the matcher backtracks over by
+ * searching for the literal that follows them. Patterns are anchored at
+ * both ends of the line.
+ *
+ * All patterns are matched in one pass over the line: a table indexed by its
+ * first byte gives the only patterns that may match, each candidate must
+ * contain its longest inner literal, which is looked for with SIMD
+ * substring search, and the first candidate, in the order added, that
+ * matches the whole line wins.
+ *
+ * Matching is thread-safe and allocates nothing beyond the ILF's strings,
+ * so that GrokMatcher::match() can serve as a Parser conversion function.
+ */
+class GrokMatcher {
+public:
+    static const int NO_MATCH = -1;
+    static const size_t MAX_FIELDS = 32;
+    static const size_t MAX_PATTERNS = 256;
+
+    /**
+     * Built-in primitives:
+     *
+     * - INT, NUMBER (alias BASE10NUM): signed integers and decimals.
+     * - POSINT, NONNEGINT, MONTHDAY, YEAR, HOUR, MINUTE, SECOND: digits.
+     * - WORD: [A-Za-z0-9_]+. MONTH, DAY, LOGLEVEL: letters.
+     * - NOTSPACE: non-whitespace. SPACE: optional whitespace.
+     * - HOSTNAME, IPORHOST, HOST, USERNAME, USER: [A-Za-z0-9._-]+.
+     * - IPV4, IPV6, IP: validated addresses.
+     * - QUOTEDSTRING: single or double quoted, with backslash escapes.
+     * - UUID, TIME, SYSLOGTIMESTAMP, TIMESTAMP_ISO8601.
+     * - DATA, GREEDYDATA: any text, lazy and greedy.
+     *
+     * HTTPDATE is defined as %{MONTHDAY}/%{MONTH}/%{YEAR}:%{TIME} %{INT}.
+     */
+    GrokMatcher() : _words(0) {
+        static const detail::CharClass digits("0-9"), word("A-Za-z0-9_"), letters("A-Za-z"),
+            notspace(" \t\r\n\v\f", true), space(" \t\r\n\v\f"), host("A-Za-z0-9._-");
+        char const* digit_names[] = {"POSINT", "NONNEGINT", "MONTHDAY", "YEAR", "HOUR", "MINUTE", "SECOND"};
+        for (char const* name : digit_names) {
+            _primitives[name] = Primitive(detail::GROK_RUN, &digits, 1);
+        }
+        char const* letter_names[] = {"MONTH", "DAY", "LOGLEVEL"};
+        for (char const* name : letter_names) {
+            _primitives[name] = Primitive(detail::GROK_RUN, &letters, 1);
+        }
+        char const* host_names[] = {"HOSTNAME", "IPORHOST", "HOST", "USERNAME", "USER"};
+        for (char const* name : host_names) {
+            _primitives[name] = Primitive(detail::GROK_RUN, &host, 1);
+        }
+        _primitives["WORD"] = Primitive(detail::GROK_RUN, &word, 1);
+        _primitives["NOTSPACE"] = Primitive(detail::GROK_RUN, &notspace, 1);
+        _primitives["SPACE"] = Primitive(detail::GROK_RUN, &space, 0);
+        _primitives["INT"] = Primitive(detail::GROK_INT);
+        _primitives["NUMBER"] = _primitives["BASE10NUM"] = Primitive(detail::GROK_NUMBER);
+        _primitives["IPV4"] = Primitive(detail::GROK_IPV4);
+        _primitives["IPV6"] = Primitive(detail::GROK_IPV6);
+        _primitives["IP"] = Primitive(detail::GROK_IP);
+        _primitives["QUOTEDSTRING"] = Primitive(detail::GROK_QUOTED);
+        _primitives["UUID"] = Primitive(detail::GROK_UUID);
+        _primitives["SYSLOGTIMESTAMP"] = Primitive(detail::GROK_SYSLOG_TIMESTAMP);
+        _primitives["TIMESTAMP_ISO8601"] = Primitive(detail::GROK_ISO8601);
+        _primitives["DATA"] = Primitive(detail::GROK_DATA);
+        _primitives["GREEDYDATA"] = Primitive(detail::GROK_GREEDY_DATA);
+        _primitives["TIME"] = Primitive(detail::GROK_TIME);
+        _definitions["HTTPDATE"] = "%{MONTHDAY}/%{MONTH}/%{YEAR}:%{TIME} %{INT}";
+        memset(_first_any, 0, sizeof(_first_any));
+    }
+
+    /**
+     * Defines SYNTAX name as a pattern, which may reference primitives and
+     * other definitions, including ones defined later. Fields within a
+     * definition are extracted wherever it is used.
+     */
+    void define(std::string const& name, std::string const& pattern) {
+        _definitions[name] = pattern;
+    }
+
+    /**
+     * Compiles a pattern for lines of an ILF event type and returns its index.
+     *
+     * Throws a std::invalid_argument exception if the pattern is malformed,
+     * references an unknown or recursive definition, or has more than
+     * MAX_FIELDS fields, or if there are already MAX_PATTERNS patterns.
+     */
+    int add(std::string const& event_t, std::string const& pattern) {
+        Pattern compiled;
+        compiled._event_t = event_t;
+        std::vector<std::string> stack;
+        compile(pattern, compiled, stack);
+        if (compiled._fields.size() > MAX_FIELDS) {
+            throw std::invalid_argument("too many fields in grok pattern: " + pattern);
+        }
+        if (_patterns.size() == MAX_PATTERNS) {
+            throw std::invalid_argument("too many grok patterns");
+        }
+        // The longest literal past the start, which every match contains
+        //
+        for (size_t i = 1; i < compiled._tokens.size(); i++) {
+            Token const& token = compiled._tokens[i];
+            if (token._primitive._kind == detail::GROK_LITERAL && token._literal.size() > compiled._required.size()) {
+                compiled._required = token._literal;
+            }
+        }
+        _patterns.push_back(compiled);
+        index_first_bytes();
+        return static_cast<int>(_patterns.size() - 1);
+    }
+
+    AE_FORCEINLINE size_t size() const {
+        return _patterns.size();
+    }
+
+    /**
+     * Matches a line and fills an ILF with the fields of the first matching
+     * pattern, returning its index. A line that matches no pattern gives
+     * NO_MATCH and an ILF with an empty event type and the line as its
+     * message pair.
+     */
+    int match(char const* line, size_t len, ILF& ilf) const {
+        char const* end = line + len;
+        Capture captures[MAX_FIELDS];
+        // Without patterns there is no bitmap to index
+        //
+        const uint64_t* candidates = len == 0 || _patterns.empty() ? _first_any :
+            _first.data() + static_cast<unsigned char>(*line) * _words;
+        for (size_t word = 0; word < _words; word++) {
+            for (uint64_t bits = candidates[word]; bits != 0; bits &= bits - 1) {
+                const size_t index = word * 64 + __builtin_ctzll(bits);
+                Pattern const& pattern = _patterns[index];
+                if (!pattern._required.empty() && detail::find_literal(line, end,
+                    pattern._required.data(), pattern._required.size()) == end) {
+                    continue;
+                }
+                if (match_from(pattern, 0, line, end, captures)) {
+                    fill(pattern, captures, ilf);
+                    return static_cast<int>(index);
+                }
+            }
+        }
+        ilf._event_t.clear();
+        ilf._sender.clear();
+        ilf._receiver.clear();
+        ilf._time.clear();
+        ilf._pairs.resize(1);
+        ilf._pairs[0]._key = "message";
+        ilf._pairs[0]._value.assign(line, len);
+        ilf._pairs[0]._has_quotes = true;
+        return NO_MATCH;
+    }
+
+    AE_FORCEINLINE int match(std::string const& line, ILF& ilf) const {
+        return match(line.data(), line.size(), ilf);
+    }
+
+private:
+    enum Role {
+        ROLE_PAIR,
+        ROLE_SENDER,
+        ROLE_RECEIVER,
+        ROLE_TIME
+    };
+
+    /**
+     * Matcher of a primitive, with the class and minimum length of a run.
+     */
+    struct Primitive {
+        Primitive() : _kind(detail::GROK_LITERAL), _class(nullptr), _min(0) { }
+
+        Primitive(detail::GrokKind kind, detail::CharClass const* char_class = nullptr, size_t min = 0) :
+            _kind(kind),
+            _class(char_class),
+            _min(min) { }
+
+        detail::GrokKind _kind;
+        detail::CharClass const* _class;
+        size_t _min;
+    };
+
+    /**
+     * Literal, primitive, or beginning or end mark of a field.
+     */
+    struct Token {
+        Token() : _field(0) { }
+
+        Primitive _primitive;
+        std::string _literal;
+        size_t _field;
+    };
+
+    struct Field {
+        std::string _name;
+        Role _role;
+        bool _quoted;
+    };
+
+    struct Pattern {
+        std::string _event_t, _required;
+        std::vector<Token> _tokens;
+        std::vector<Field> _fields;
+    };
+
+    struct Capture {
+        char const* _begin;
+        char const* _end;
+    };
+
+    void compile(std::string const& pattern, Pattern& compiled, std::vector<std::string>& stack) {
+        size_t i = 0;
+        while (i < pattern.size()) {
+            if (pattern.compare(i, 2, "%{") != 0) {
+                if (pattern[i] == '\\' && i + 1 < pattern.size()) {
+                    i++;
+                }
+                if (compiled._tokens.empty() || compiled._tokens.back()._primitive._kind != detail::GROK_LITERAL) {
+                    compiled._tokens.push_back(Token());
+                }
+                compiled._tokens.back()._literal += pattern[i++];
+                continue;
+            }
+            const size_t close = pattern.find('}', i);
+            if (close == std::string::npos) {
+                throw std::invalid_argument("unterminated reference in grok pattern: " + pattern);
+            }
+            std::string reference = pattern.substr(i + 2, close - i - 2), name, field, type;
+            const size_t colon = reference.find(':');
+            name = reference.substr(0, colon);
+            if (colon != std::string::npos) {
+                field = reference.substr(colon + 1);
+                const size_t type_colon = field.find(':');
+                if (type_colon != std::string::npos) {
+                    type = field.substr(type_colon + 1);
+                    field.resize(type_colon);
+                }
+            }
+            i = close + 1;
+            if (!field.empty()) {
+                Field captured;
+                captured._name = field;
+                captured._role = field == "sender" ? ROLE_SENDER : field == "receiver" ? ROLE_RECEIVER :
+                    field == "time" ? ROLE_TIME : ROLE_PAIR;
+                captured._quoted = type != "int" && type != "float";
+                compiled._fields.push_back(captured);
+                push_mark(compiled, detail::GROK_BEGIN, compiled._fields.size() - 1);
+            }
+            const size_t field_index = compiled._fields.size() - 1;
+            std::unordered_map<std::string, Primitive>::const_iterator primitive = _primitives.find(name);
+            std::unordered_map<std::string, std::string>::const_iterator definition = _definitions.find(name);
+            if (definition != _definitions.end()) {
+                for (size_t j = 0; j < stack.size(); j++) {
+                    if (stack[j] == name) {
+                        throw std::invalid_argument("recursive grok definition: " + name);
+                    }
+                }
+                stack.push_back(name);
+                compile(definition->second, compiled, stack);
+                stack.pop_back();
+            } else if (primitive != _primitives.end()) {
+                Token token;
+                token._primitive = primitive->second;
+                compiled._tokens.push_back(token);
+            } else {
+                throw std::invalid_argument("unknown grok pattern: " + name);
+            }
+            if (!field.empty()) {
+                push_mark(compiled, detail::GROK_END, field_index);
+            }
+        }
+    }
+
+    static void push_mark(Pattern& compiled, detail::GrokKind kind, size_t field) {
+        Token token;
+        token._primitive._kind = kind;
+        token._field = field;
+        compiled._tokens.push_back(token);
+    }
+
+    /**
+     * Returns the set of bytes a match of a token may start with, and whether
+     * it may match the empty string.
+     */
+    static bool first_bytes(Token const& token, detail::CharClass& bytes) {
+        switch (token._primitive._kind) {
+        case detail::GROK_LITERAL:
+            bytes.add(token._literal[0]);
+            return false;
+        case detail::GROK_RUN:
+            for (size_t i = 0; i < 4; i++) {
+                bytes._bits[i] |= token._primitive._class->_bits[i];
+            }
+            return token._primitive._min == 0;
+        case detail::GROK_INT:
+        case detail::GROK_NUMBER:
+            bytes = merge(bytes, detail::CharClass("0-9+.-"));
+            return false;
+        case detail::GROK_IPV4:
+        case detail::GROK_TIME:
+        case detail::GROK_ISO8601:
+            bytes = merge(bytes, detail::CharClass("0-9"));
+            return false;
+        case detail::GROK_IPV6:
+        case detail::GROK_IP:
+        case detail::GROK_UUID:
+            bytes = merge(bytes, detail::CharClass("0-9a-fA-F:"));
+            return false;
+        case detail::GROK_QUOTED:
+            bytes = merge(bytes, detail::CharClass("\"'"));
+            return false;
+        case detail::GROK_SYSLOG_TIMESTAMP:
+            bytes = merge(bytes, detail::CharClass("A-Za-z"));
+            return false;
+        default:
+            return true;
+        }
+    }
+
+    static detail::CharClass merge(detail::CharClass a, detail::CharClass const& b) {
+        for (size_t i = 0; i < 4; i++) {
+            a._bits[i] |= b._bits[i];
+        }
+        return a;
+    }
+
+    /**
+     * Rebuilds the table of candidate patterns by first byte.
+     */
+    void index_first_bytes() {
+        _words = (_patterns.size() + 63) / 64;
+        _first.assign(256 * _words, 0);
+        memset(_first_any, 0, sizeof(_first_any));
+        for (size_t index = 0; index < _patterns.size(); index++) {
+            detail::CharClass bytes;
+            bool nullable = true;
+            std::vector<Token> const& tokens = _patterns[index]._tokens;
+            for (size_t i = 0; i < tokens.size() && nullable; i++) {
+                if (tokens[i]._primitive._kind != detail::GROK_BEGIN && tokens[i]._primitive._kind != detail::GROK_END) {
+                    nullable = first_bytes(tokens[i], bytes);
+                }
+            }
+            const uint64_t bit = uint64_t(1) << (index & 63);
+            for (unsigned int c = 0; c < 256; c++) {
+                if (nullable || bytes.contains(static_cast<unsigned char>(c))) {
+                    _first[c * _words + index / 64] |= bit;
+                }
+            }
+            if (nullable) {
+                _first_any[index / 64] |= bit;
+            }
+        }
+    }
+
+    /**
+     * Returns the length of the text a primitive matches at s, or GROK_FAIL.
+     */
+    static size_t match_primitive(Token const& token, char const* s, char const* end) {
+        switch (token._primitive._kind) {
+        case detail::GROK_RUN: {
+            detail::CharClass const& char_class = *token._primitive._class;
+            char const* p = s;
+            while (p < end && char_class.contains(static_cast<unsigned char>(*p))) {
+                p++;
+            }
+            return static_cast<size_t>(p - s) < token._primitive._min ? detail::GROK_FAIL : p - s;
+        }
+        case detail::GROK_INT:
+            return detail::match_int(s, end);
+        case detail::GROK_NUMBER:
+            return detail::match_number(s, end);
+        case detail::GROK_IPV4:
+            return detail::match_ipv4(s, end);
+        case detail::GROK_IPV6:
+            return detail::match_ipv6(s, end);
+        case detail::GROK_IP: {
+            size_t n = detail::match_ipv6(s, end);
+            return n != detail::GROK_FAIL ? n : detail::match_ipv4(s, end);
+        }
+        case detail::GROK_QUOTED:
+            return detail::match_quoted(s, end);
+        case detail::GROK_UUID:
+            return detail::match_uuid(s, end);
+        case detail::GROK_TIME:
+            return detail::match_clock(s, end, true);
+        case detail::GROK_SYSLOG_TIMESTAMP:
+            return detail::match_syslog_timestamp(s, end);
+        case detail::GROK_ISO8601:
+            return detail::match_iso8601(s, end);
+        default:
+            return detail::GROK_FAIL;
+        }
+    }
+
+    bool match_from(Pattern const& pattern, size_t t, char const* s, char const* end, Capture *captures) const {
+        std::vector<Token> const& tokens = pattern._tokens;
+        for (; t < tokens.size(); t++) {
+            Token const& token = tokens[t];
+            switch (token._primitive._kind) {
+            case detail::GROK_LITERAL:
+                if (static_cast<size_t>(end - s) < token._literal.size() ||
+                    memcmp(s, token._literal.data(), token._literal.size()) != 0) {
+                    return false;
+                }
+                s += token._literal.size();
+                break;
+            case detail::GROK_BEGIN:
+                captures[token._field]._begin = s;
+                break;
+            case detail::GROK_END:
+                captures[token._field]._end = s;
+                break;
+            case detail::GROK_DATA:
+            case detail::GROK_GREEDY_DATA:
+                return match_wildcard(pattern, t, s, end, captures);
+            default: {
+                size_t n = match_primitive(token, s, end);
+                if (n == detail::GROK_FAIL) {
+                    return false;
+                }
+                s += n;
+            }
+            }
+        }
+        return s == end;
+    }
+
+    /**
+     * Matches DATA or GREEDYDATA at token t followed by the rest of the
+     * pattern, trying the ends of the wildcard from the shortest (DATA) or
+     * the longest (GREEDYDATA). If a literal follows, only its occurrences
+     * are tried.
+     */
+    bool match_wildcard(Pattern const& pattern, size_t t, char const* s, char const* end, Capture *captures) const {
+        std::vector<Token> const& tokens = pattern._tokens;
+        const bool greedy = tokens[t]._primitive._kind == detail::GROK_GREEDY_DATA;
+        size_t next = t + 1;
+        while (next < tokens.size() && (tokens[next]._primitive._kind == detail::GROK_BEGIN || tokens[next]._primitive._kind == detail::GROK_END)) {
+            next++;
+        }
+        if (next == tokens.size()) {
+            return match_from(pattern, t + 1, end, end, captures);
+        }
+        if (tokens[next]._primitive._kind == detail::GROK_LITERAL) {
+            std::string const& literal = tokens[next]._literal;
+            if (greedy) {
+                char const* limit = end;
+                for (;;) {
+                    char const* q = detail::find_last_literal(s, limit, literal.data(), literal.size());
+                    if (q == limit) {
+                        return false;
+                    }
+                    if (match_from(pattern, t + 1, q, end, captures)) {
+                        return true;
+                    }
+                    limit = q + literal.size() - 1;
+                }
+            }
+            for (char const* q = s; ; q++) {
+                q = detail::find_literal(q, end, literal.data(), literal.size());
+                if (q == end) {
+                    return false;
+                }
+                if (match_from(pattern, t + 1, q, end, captures)) {
+                    return true;
+                }
+            }
+        }
+        for (size_t n = 0; n <= static_cast<size_t>(end - s); n++) {
+            char const* q = greedy ? end - n : s + n;
+            if (match_from(pattern, t + 1, q, end, captures)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static void fill(Pattern const& pattern, Capture const* captures, ILF& ilf) {
+        ilf._event_t = pattern._event_t;
+        ilf._sender.clear();
+        ilf._receiver.clear();
+        ilf._time.clear();
+        size_t pairs = 0;
+        for (size_t i = 0; i < pattern._fields.size(); i++) {
+            pairs += pattern._fields[i]._role == ROLE_PAIR;
+        }
+        ilf._pairs.resize(pairs);
+        pairs = 0;
+        for (size_t i = 0; i < pattern._fields.size(); i++) {
+            Field const& field = pattern._fields[i];
+            Capture const& capture = captures[i];
+            switch (field._role) {
+            case ROLE_SENDER:
+                ilf._sender.assign(capture._begin, capture._end - capture._begin);
+                break;
+            case ROLE_RECEIVER:
+                ilf._receiver.assign(capture._begin, capture._end - capture._begin);
+                break;
+            case ROLE_TIME:
+                ilf._time.assign(capture._begin, capture._end - capture._begin);
+                break;
+            default: {
+                KeyValue& pair = ilf._pairs[pairs++];
+                pair._key = field._name;
+                pair._value.assign(capture._begin, capture._end - capture._begin);
+                pair._has_quotes = field._quoted;
+            }
+            }
+        }
+    }
+
+    std::unordered_map<std::string, Primitive> _primitives;
+    std::unordered_map<std::string, std::string> _definitions;
+    std::vector<Pattern> _patterns;
+    // Bitmaps of candidate patterns by first byte, _words 64-bit words each,
+    // and for empty lines
+    //
+    std::vector<uint64_t> _first;
+    uint64_t _first_any[MAX_PATTERNS / 64];
+    size_t _words;
+};
+
+} // namespace libilf
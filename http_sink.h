@@ -0,0 +1,1010 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <utility>
+#include <stdexcept>
+#include <system_error>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(LIBILF_WITH_ZLIB)
+#include <zlib.h>
+#endif
+
+#include "pipeline.h"
+#include "span.h"
+#include "ilf.h"
+
+namespace libilf {
+
+namespace detail {
+
+/**
+ * Appends text as the contents of a JSON string, escaping quotes, backslashes
+ * and control characters. Other bytes, including UTF-8 sequences, are copied
+ * as they are.
+ *
+ * With SSE2, text is scanned 16 bytes at a time, so text that needs no
+ * escaping is appended with a single copy.
+ */
+inline void append_json(std::string& out, char const* data, size_t len) {
+    static char const hex[] = "0123456789abcdef";
+    size_t begin = 0, i = 0;
+    while (true) {
+#if defined(__SSE2__)
+        const __m128i quote = _mm_set1_epi8('"'), backslash = _mm_set1_epi8('\\'), control = _mm_set1_epi8(0x1f);
+        for (; i + 16 <= len; i += 16) {
+            const __m128i block = _mm_loadu_si128(reinterpret_cast<__m128i const*>(data + i));
+            const int mask = _mm_movemask_epi8(_mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(block, quote), _mm_cmpeq_epi8(block, backslash)),
+                _mm_cmpeq_epi8(_mm_max_epu8(block, control), control)));
+            if (mask != 0) {
+                i += __builtin_ctz(mask);
+                break;
+            }
+        }
+#endif
+        while (i < len && data[i] != '"' && data[i] != '\\' && static_cast<unsigned char>(data[i]) >= 0x20) {
+            i++;
+        }
+        if (i == len) {
+            break;
+        }
+        out.append(data + begin, i - begin);
+        const unsigned char c = data[i];
+        out.push_back('\\');
+        switch (c) {
+        case '"': out.push_back('"'); break;
+        case '\\': out.push_back('\\'); break;
+        case '\n': out.push_back('n'); break;
+        case '\r': out.push_back('r'); break;
+        case '\t': out.push_back('t'); break;
+        default:
+            out.append("u00", 3);
+            out.push_back(hex[c >> 4]);
+            out.push_back(hex[c & 15]);
+        }
+        begin = ++i;
+    }
+    out.append(data + begin, len - begin);
+}
+
+AE_FORCEINLINE void append_json_string(std::string& out, std::string const& str) {
+    out.push_back('"');
+    append_json(out, str.data(), str.size());
+    out.push_back('"');
+}
+
+/**
+ * Returns true if value is a JSON number, e.g. -12, 0.5 or 1e-3.
+ */
+inline bool is_json_number(std::string const& value) {
+    char const* p = value.data(), *end = p + value.size();
+    if (p < end && *p == '-') {
+        p++;
+    }
+    if (p == end || *p < '0' || *p > '9') {
+        return false;
+    }
+    if (*p++ != '0') {
+        while (p < end && *p >= '0' && *p <= '9') {
+            p++;
+        }
+    }
+    if (p < end && *p == '.') {
+        if (++p == end || *p < '0' || *p > '9') {
+            return false;
+        }
+        while (p < end && *p >= '0' && *p <= '9') {
+            p++;
+        }
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        if (++p < end && (*p == '+' || *p == '-')) {
+            p++;
+        }
+        if (p == end || *p < '0' || *p > '9') {
+            return false;
+        }
+        while (p < end && *p >= '0' && *p <= '9') {
+            p++;
+        }
+    }
+    return p == end;
+}
+
+/**
+ * Just enough of a JSON reader to find the item statuses of a bulk response:
+ * values that are not looked at are skipped without being decoded.
+ */
+class JsonCursor {
+public:
+    JsonCursor(char const* data, size_t len) :
+        _p(data),
+        _end(data + len) { }
+
+    /**
+     * Skips whitespace and consumes c if it is next.
+     */
+    bool consume(char c) {
+        skip_whitespace();
+        if (_p < _end && *_p == c) {
+            _p++;
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * Reads a string without decoding its escapes. A string cut off after a
+     * backslash is malformed.
+     */
+    bool string(char const** str, size_t *len) {
+        if (!consume('"')) {
+            return false;
+        }
+        *str = _p;
+        while (_p < _end && *_p != '"') {
+            if (*_p == '\\' && ++_p == _end) {
+                return false;
+            }
+            _p++;
+        }
+        if (_p >= _end) {
+            return false;
+        }
+        *len = _p++ - *str;
+        return true;
+    }
+
+    bool integer(int *value) {
+        skip_whitespace();
+        char const* begin = _p;
+        int result = 0;
+        while (_p < _end && *_p >= '0' && *_p <= '9' && _p - begin < 9) {
+            result = result * 10 + (*_p++ - '0');
+        }
+        *value = result;
+        return _p > begin;
+    }
+
+    bool literal(char const* word) {
+        skip_whitespace();
+        const size_t len = strlen(word);
+        if (static_cast<size_t>(_end - _p) < len || memcmp(_p, word, len) != 0) {
+            return false;
+        }
+        _p += len;
+        return true;
+    }
+
+    bool skip_value() {
+        skip_whitespace();
+        if (_p == _end) {
+            return false;
+        }
+        char const* str;
+        size_t len;
+        if (*_p == '"') {
+            return string(&str, &len);
+        }
+        if (*_p == '{' || *_p == '[') {
+            const bool object = *_p++ == '{';
+            if (consume(object ? '}' : ']')) {
+                return true;
+            }
+            do {
+                if (object && (!string(&str, &len) || !consume(':'))) {
+                    return false;
+                }
+                if (!skip_value()) {
+                    return false;
+                }
+            } while (consume(','));
+            return consume(object ? '}' : ']');
+        }
+        char const* begin = _p;
+        while (_p < _end && strchr(",]} \t\r\n", *_p) == nullptr) {
+            _p++;
+        }
+        return _p > begin;
+    }
+
+private:
+    AE_FORCEINLINE void skip_whitespace() {
+        while (_p < _end && (*_p == ' ' || *_p == '\t' || *_p == '\r' || *_p == '\n')) {
+            _p++;
+        }
+    }
+
+    char const* _p, *_end;
+};
+
+/**
+ * Reads the body of a bulk response, {"took":...,"errors":...,"items":[...]},
+ * setting errors and appending the status of every item in order. Items
+ * without a status get 0.
+ *
+ * Returns false if the body is malformed.
+ */
+inline bool parse_bulk_response(std::string const& body, bool *errors, std::vector<int>& statuses) {
+    JsonCursor cursor(body.data(), body.size());
+    char const* key;
+    size_t key_len;
+    *errors = false;
+    statuses.clear();
+    if (!cursor.consume('{')) {
+        return false;
+    }
+    if (cursor.consume('}')) {
+        return true;
+    }
+    do {
+        if (!cursor.string(&key, &key_len) || !cursor.consume(':')) {
+            return false;
+        }
+        if (key_len == 6 && memcmp(key, "errors", 6) == 0) {
+            *errors = cursor.literal("true");
+            if (!*errors && !cursor.literal("false")) {
+                return false;
+            }
+        } else if (key_len == 5 && memcmp(key, "items", 5) == 0) {
+            if (!cursor.consume('[')) {
+                return false;
+            }
+            if (cursor.consume(']')) {
+                continue;
+            }
+            do {
+                // {"index": {..., "status": 201, ...}}
+                //
+                int status = 0;
+                if (!cursor.consume('{') || !cursor.string(&key, &key_len) || !cursor.consume(':') ||
+                    !cursor.consume('{')) {
+                    return false;
+                }
+                if (!cursor.consume('}')) {
+                    do {
+                        if (!cursor.string(&key, &key_len) || !cursor.consume(':')) {
+                            return false;
+                        }
+                        if (key_len == 6 && memcmp(key, "status", 6) == 0) {
+                            if (!cursor.integer(&status)) {
+                                return false;
+                            }
+                        } else if (!cursor.skip_value()) {
+                            return false;
+                        }
+                    } while (cursor.consume(','));
+                    if (!cursor.consume('}')) {
+                        return false;
+                    }
+                }
+                if (!cursor.consume('}')) {
+                    return false;
+                }
+                statuses.push_back(status);
+            } while (cursor.consume(','));
+            if (!cursor.consume(']')) {
+                return false;
+            }
+        } else if (!cursor.skip_value()) {
+            return false;
+        }
+    } while (cursor.consume(','));
+    return cursor.consume('}');
+}
+
+struct HttpResponse {
+    HttpResponse() : _status(0), _close(false) { }
+
+    int _status;
+    std::string _body;
+    bool _close;
+};
+
+/**
+ * Client side of one HTTP/1.1 keep-alive connection, opened on the first
+ * request and again after the server or an error closed it.
+ *
+ * I/O errors and timeouts throw a std::system_error exception and malformed
+ * responses a std::runtime_error exception; either way the connection is
+ * closed and the next request reconnects.
+ */
+class HttpConnection {
+public:
+    HttpConnection(std::string const& host, uint16_t port, unsigned int timeout_ms) :
+        _host(host),
+        _port(port),
+        _timeout_ms(timeout_ms),
+        _fd(-1) { }
+
+    ~HttpConnection() {
+        close();
+    }
+
+    /**
+     * Sends a request, given as its head up to and including the blank line
+     * and its body, and reads the response.
+     */
+    void request(std::string const& head, char const* body, size_t len, HttpResponse& response) {
+        try {
+            if (_fd < 0) {
+                connect();
+            }
+            send(head, body, len);
+            receive(response);
+            if (response._close) {
+                close();
+            }
+        } catch (...) {
+            close();
+            throw;
+        }
+    }
+
+    void close() {
+        if (_fd >= 0) {
+            ::close(_fd);
+            _fd = -1;
+        }
+        _in.clear();
+    }
+
+private:
+    void connect() {
+        struct addrinfo hints, *addresses;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        const int error = getaddrinfo(_host.c_str(), std::to_string(_port).c_str(), &hints, &addresses);
+        if (error != 0) {
+            throw std::runtime_error("failed to resolve " + _host + ": " + gai_strerror(error));
+        }
+        int last_errno = ECONNREFUSED;
+        for (struct addrinfo *address = addresses; address != nullptr && _fd < 0; address = address->ai_next) {
+            _fd = socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC, address->ai_protocol);
+            if (_fd < 0) {
+                last_errno = errno;
+                continue;
+            }
+            struct timeval timeout;
+            timeout.tv_sec = _timeout_ms / 1000;
+            timeout.tv_usec = (_timeout_ms % 1000) * 1000;
+            const int one = 1;
+            setsockopt(_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            setsockopt(_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+            setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            if (::connect(_fd, address->ai_addr, address->ai_addrlen) < 0) {
+                last_errno = errno;
+                ::close(_fd);
+                _fd = -1;
+            }
+        }
+        freeaddrinfo(addresses);
+        if (_fd < 0) {
+            throw std::system_error(last_errno, std::system_category(), "connect");
+        }
+    }
+
+    /**
+     * Writes the head and the body with one gathering system call per round,
+     * so that the body is never copied into a request buffer.
+     */
+    void send(std::string const& head, char const* body, size_t len) {
+        struct iovec iov[2];
+        iov[0].iov_base = const_cast<char*>(head.data());
+        iov[0].iov_len = head.size();
+        iov[1].iov_base = const_cast<char*>(body);
+        iov[1].iov_len = len;
+        struct msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = iov;
+        message.msg_iovlen = 2;
+        while (message.msg_iovlen > 0) {
+            ssize_t count = sendmsg(_fd, &message, MSG_NOSIGNAL);
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::system_category(), "sendmsg");
+            }
+            while (message.msg_iovlen > 0 && static_cast<size_t>(count) >= message.msg_iov->iov_len) {
+                count -= message.msg_iov->iov_len;
+                message.msg_iov++;
+                message.msg_iovlen--;
+            }
+            if (message.msg_iovlen > 0) {
+                message.msg_iov->iov_base = static_cast<char*>(message.msg_iov->iov_base) + count;
+                message.msg_iov->iov_len -= count;
+            }
+        }
+    }
+
+    void receive(HttpResponse& response) {
+        size_t head_end;
+        while ((head_end = _in.find("\r\n\r\n")) == std::string::npos) {
+            read_more();
+        }
+        // Status line, then the headers that matter for framing
+        //
+        if (_in.compare(0, 5, "HTTP/") != 0 || _in.find(' ') == std::string::npos) {
+            throw std::runtime_error("malformed HTTP response");
+        }
+        response._status = atoi(_in.c_str() + _in.find(' ') + 1);
+        response._close = _in.compare(0, 8, "HTTP/1.0") == 0;
+        response._body.clear();
+        size_t content_length = 0;
+        bool chunked = false;
+        for (size_t line = _in.find("\r\n") + 2; line < head_end; line = _in.find("\r\n", line) + 2) {
+            const size_t colon = _in.find(':', line), line_end = _in.find("\r\n", line);
+            if (colon == std::string::npos || colon > line_end) {
+                continue;
+            }
+            std::string name = _in.substr(line, colon - line), value;
+            size_t begin = colon + 1;
+            while (begin < line_end && _in[begin] == ' ') {
+                begin++;
+            }
+            value = _in.substr(begin, line_end - begin);
+            for (size_t i = 0; i < name.size(); i++) {
+                name[i] = tolower(name[i]);
+            }
+            for (size_t i = 0; i < value.size(); i++) {
+                value[i] = tolower(value[i]);
+            }
+            if (name == "content-length") {
+                content_length = strtoull(value.c_str(), nullptr, 10);
+            } else if (name == "transfer-encoding") {
+                chunked = value.find("chunked") != std::string::npos;
+            } else if (name == "connection") {
+                response._close = value.find("close") != std::string::npos;
+            }
+        }
+        size_t pos = head_end + 4;
+        if (chunked) {
+            while (true) {
+                size_t line_end;
+                while ((line_end = _in.find("\r\n", pos)) == std::string::npos) {
+                    read_more();
+                }
+                const size_t size = strtoull(_in.c_str() + pos, nullptr, 16);
+                pos = line_end + 2;
+                while (_in.size() < pos + size + 2) {
+                    read_more();
+                }
+                response._body.append(_in, pos, size);
+                pos += size + 2;
+                if (size == 0) {
+                    break;
+                }
+            }
+        } else {
+            while (_in.size() < pos + content_length) {
+                read_more();
+            }
+            response._body.assign(_in, pos, content_length);
+            pos += content_length;
+        }
+        _in.erase(0, pos);
+    }
+
+    void read_more() {
+        char buf[1 << 16];
+        ssize_t count;
+        while ((count = read(_fd, buf, sizeof(buf))) < 0 && errno == EINTR) { }
+        if (count < 0) {
+            throw std::system_error(errno, std::system_category(), "read");
+        }
+        if (count == 0) {
+            throw std::system_error(ECONNRESET, std::system_category(), "connection closed by server");
+        }
+        _in.append(buf, count);
+    }
+
+    const std::string _host;
+    const uint16_t _port;
+    const unsigned int _timeout_ms;
+    int _fd;
+    std::string _in;
+};
+
+#if defined(LIBILF_WITH_ZLIB)
+
+/**
+ * Gzip compressor reusing one deflate stream across bodies.
+ */
+class Gzip {
+public:
+    explicit Gzip(int level) {
+        memset(&_stream, 0, sizeof(_stream));
+        if (deflateInit2(&_stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::bad_alloc();
+        }
+    }
+
+    ~Gzip() {
+        deflateEnd(&_stream);
+    }
+
+    Gzip(Gzip const&) = delete;
+    Gzip& operator=(Gzip const&) = delete;
+
+    void compress(std::string const& in, std::string& out) {
+        deflateReset(&_stream);
+        out.resize(deflateBound(&_stream, in.size()));
+        _stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+        _stream.avail_in = static_cast<uInt>(in.size());
+        _stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+        _stream.avail_out = static_cast<uInt>(out.size());
+        if (deflate(&_stream, Z_FINISH) != Z_STREAM_END) {
+            throw std::runtime_error("gzip compression failed");
+        }
+        out.resize(_stream.total_out);
+    }
+
+private:
+    z_stream _stream;
+};
+
+#endif
+
+} // namespace detail
+
+/**
+ * Serializer of ILFs into JSON lines (NDJSON):
+ *
+ *     {"event_t":"...","sender":"...","receiver":"...","time":"...","key":"value",...}
+ *
+ * Unquoted values that are JSON numbers are written as numbers, all other
+ * values as strings. Usable as the format_t of StreamSink and FdSink.
+ */
+class JsonFormat {
+public:
+    void operator()(ILF const& ilf, std::string& out) {
+        out += "{\"event_t\":";
+        detail::append_json_string(out, ilf._event_t);
+        out += ",\"sender\":";
+        detail::append_json_string(out, ilf._sender);
+        out += ",\"receiver\":";
+        detail::append_json_string(out, ilf._receiver);
+        out += ",\"time\":";
+        detail::append_json_string(out, ilf._time);
+        for (size_t i = 0; i < ilf._pairs.size(); i++) {
+            KeyValue const& pair = ilf._pairs[i];
+            out += ',';
+            detail::append_json_string(out, pair._key);
+            out += ':';
+            if (!pair._has_quotes && detail::is_json_number(pair._value)) {
+                out += pair._value;
+            } else {
+                detail::append_json_string(out, pair._value);
+            }
+        }
+        out += "}\n";
+    }
+};
+
+/**
+ * Options of HttpBulkSink:
+ *
+ * - _host, _port, _path: where bulk requests are posted.
+ * - _index: index named in the action line of every item, or empty for
+ *   {"index":{}}, e.g. when the path names the index.
+ * - _max_body_bytes: a body is sent once it holds this many bytes.
+ * - _max_in_flight: number of connections, each with one request in flight.
+ *   Up to as many full bodies wait for a connection before
+ *   HttpBulkSink::write() blocks.
+ * - _max_retries, _retry_backoff_ms: a request or item failing with 429 or a
+ *   5xx status, or a request failing on the connection, is retried up to
+ *   _max_retries times, after _retry_backoff_ms and then exponentially longer
+ *   pauses.
+ * - _timeout_ms: send and receive timeout of the connections.
+ * - _gzip, _gzip_level: compress bodies with gzip on the sending threads.
+ *   Needs LIBILF_WITH_ZLIB defined and -lz.
+ */
+struct HttpBulkConfig {
+    HttpBulkConfig() :
+        _host("127.0.0.1"),
+        _port(9200),
+        _path("/_bulk"),
+        _max_body_bytes(1 << 22),
+        _max_in_flight(4),
+        _max_retries(5),
+        _retry_backoff_ms(50),
+        _timeout_ms(30000),
+        _gzip(false),
+        _gzip_level(1) { }
+
+    std::string _host;
+    uint16_t _port;
+    std::string _path, _index;
+    size_t _max_body_bytes;
+    unsigned int _max_in_flight, _max_retries, _retry_backoff_ms, _timeout_ms;
+    bool _gzip;
+    int _gzip_level;
+};
+
+/**
+ * Counters of an HttpBulkSink: requests sent, including retries; items
+ * accepted by the server; items retried, or resent in halves of a request
+ * that was too large; items rejected in a bulk response with a status that
+ * is not retried, such as 400; and items given up on, after the last retry
+ * or with their whole request refused.
+ */
+struct HttpBulkStats {
+    HttpBulkStats() : _requests(0), _items(0), _retried(0), _rejected(0), _failed(0), _body_bytes(0) { }
+
+    uint64_t _requests, _items, _retried, _rejected, _failed, _body_bytes;
+};
+
+/**
+ * Sink posting ILFs to an HTTP endpoint that takes Elasticsearch-style bulk
+ * requests: an NDJSON body of an action line and a JsonFormat document per
+ * item, answered with the status of every item.
+ *
+ * HttpBulkSink::write() serializes ILFs into the body being filled on the
+ * calling thread. Full bodies go to a queue served by _max_in_flight sending
+ * threads. Each sending thread has its own keep-alive connection, compresses
+ * bodies if enabled, posts them, and parses the response. Items that failed
+ * with a retryable status are cut out into a new, smaller body and retried
+ * on their own. Delivery is at least once: items of a request whose
+ * response is lost are sent again.
+ *
+ * A request refused as too large (413) is split in two halves, sent on
+ * their own. Items given up on, including those of a request refused as a
+ * whole with any other status that is not retried, such as 401 or 404, make
+ * the next call to HttpBulkSink::write(), HttpBulkSink::flush() or
+ * HttpBulkSink::close() throw a std::runtime_error exception, which a
+ * Pipeline rethrows from Pipeline::wait(). Items rejected one by one in a
+ * bulk response are only counted.
+ */
+class HttpBulkSink : public Sink<ILF> {
+public:
+    /**
+     * Constructor for the HttpBulkSink class, which starts the sending
+     * threads. Connections are opened by the first requests.
+     *
+     * Throws a std::invalid_argument exception if _max_in_flight or
+     * _max_body_bytes is 0, or if gzip is enabled without LIBILF_WITH_ZLIB.
+     */
+    explicit HttpBulkSink(HttpBulkConfig const& config = HttpBulkConfig()) :
+        _config(config),
+        _closing(false),
+        _closed(false)
+    {
+        if (config._max_in_flight == 0 || config._max_body_bytes == 0) {
+            throw std::invalid_argument("bulk sink needs at least one request in flight and a body size");
+        }
+#if !defined(LIBILF_WITH_ZLIB)
+        if (config._gzip) {
+            throw std::invalid_argument("gzip needs LIBILF_WITH_ZLIB");
+        }
+#endif
+        _action = "{\"index\":{";
+        if (!config._index.empty()) {
+            _action += "\"_index\":";
+            detail::append_json_string(_action, config._index);
+        }
+        _action += "}}\n";
+        _current._body.reserve(config._max_body_bytes + (config._max_body_bytes >> 3));
+        for (unsigned int i = 0; i < config._max_in_flight; i++) {
+            _senders.push_back(std::thread(&HttpBulkSink::sender_routine, this));
+        }
+    }
+
+    ~HttpBulkSink() {
+        shut_down();
+    }
+
+    void write(span<const ILF> ilfs) override {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            throw_error();
+        }
+        for (size_t i = 0; i < ilfs.size(); i++) {
+            _current._offsets.push_back(static_cast<uint32_t>(_current._body.size()));
+            _current._body += _action;
+            _format(ilfs[i], _current._body);
+            if (_current._body.size() >= _config._max_body_bytes) {
+                submit();
+            }
+        }
+    }
+
+    /**
+     * Sends the body being filled if no request is waiting for a connection,
+     * so that a sink that is keeping up sends records right away while a
+     * busy one keeps filling large bodies.
+     */
+    void flush() override {
+        std::unique_lock<std::mutex> lock(_mutex);
+        throw_error();
+        if (_queue.empty() && !_current._offsets.empty()) {
+            lock.unlock();
+            submit();
+        }
+    }
+
+    /**
+     * Sends the body being filled, waits for every request to finish, and
+     * stops the sending threads.
+     */
+    void close() override {
+        if (!_current._offsets.empty()) {
+            submit();
+        }
+        shut_down();
+        std::unique_lock<std::mutex> lock(_mutex);
+        throw_error();
+    }
+
+    HttpBulkStats stats() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _stats;
+    }
+
+private:
+    /**
+     * Body of a request and where each of its items starts.
+     */
+    struct Batch {
+        std::string _body;
+        std::vector<uint32_t> _offsets;
+    };
+
+    void submit() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (_queue.size() >= _config._max_in_flight && _error.empty()) {
+            _done.wait(lock);
+        }
+        throw_error();
+        _queue.push_back(Batch());
+        _queue.back()._body.swap(_current._body);
+        _queue.back()._offsets.swap(_current._offsets);
+        _ready.notify_one();
+        lock.unlock();
+        _current._body.clear();
+        _current._offsets.clear();
+        _current._body.reserve(_config._max_body_bytes + (_config._max_body_bytes >> 3));
+    }
+
+    /**
+     * Throws the first error of the sending threads. The lock must be held.
+     */
+    void throw_error() {
+        if (!_error.empty()) {
+            std::string error;
+            error.swap(_error);
+            throw std::runtime_error(error);
+        }
+    }
+
+    void shut_down() {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (_closed) {
+                return;
+            }
+            _closed = _closing = true;
+            _ready.notify_all();
+        }
+        for (size_t i = 0; i < _senders.size(); i++) {
+            _senders[i].join();
+        }
+    }
+
+    /**
+     * The routine of every sending thread: takes bodies off the queue until
+     * the sink is closed and the queue is empty.
+     */
+    void sender_routine() {
+        detail::HttpConnection connection(_config._host, _config._port, _config._timeout_ms);
+#if defined(LIBILF_WITH_ZLIB)
+        std::unique_ptr<detail::Gzip> gzip(_config._gzip ? new detail::Gzip(_config._gzip_level) : nullptr);
+#endif
+        std::string compressed, head;
+        detail::HttpResponse response;
+        std::vector<int> statuses;
+        Batch batch, retry;
+        // Halves of batches that were too large, next one last
+        //
+        std::vector<Batch> halves;
+        while (true) {
+            if (!halves.empty()) {
+                batch._body.swap(halves.back()._body);
+                batch._offsets.swap(halves.back()._offsets);
+                halves.pop_back();
+            } else {
+                std::unique_lock<std::mutex> lock(_mutex);
+                while (_queue.empty() && !_closing) {
+                    _ready.wait(lock);
+                }
+                if (_queue.empty()) {
+                    return;
+                }
+                batch._body.swap(_queue.front()._body);
+                batch._offsets.swap(_queue.front()._offsets);
+                _queue.pop_front();
+                _done.notify_all();
+            }
+            for (unsigned int attempt = 0; !batch._offsets.empty(); attempt++) {
+                if (attempt > 0) {
+                    const unsigned int shift = attempt - 1 < 10 ? attempt - 1 : 10;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(
+                        static_cast<uint64_t>(_config._retry_backoff_ms) << shift));
+                }
+                char const* body = batch._body.data();
+                size_t body_len = batch._body.size();
+                std::string error;
+                try {
+#if defined(LIBILF_WITH_ZLIB)
+                    if (gzip) {
+                        gzip->compress(batch._body, compressed);
+                        body = compressed.data();
+                        body_len = compressed.size();
+                    }
+#endif
+                    request_head(body_len, head);
+                    connection.request(head, body, body_len, response);
+                } catch (std::exception const& e) {
+                    error = e.what();
+                }
+                bool errors = false;
+                if (error.empty() && response._status == 200 &&
+                    !detail::parse_bulk_response(response._body, &errors, statuses)) {
+                    error = "malformed bulk response";
+                }
+                std::unique_lock<std::mutex> lock(_mutex);
+                _stats._requests++;
+                _stats._body_bytes += body_len;
+                const size_t count = batch._offsets.size();
+                if (error.empty() && response._status != 200) {
+                    error = "bulk request failed with status " + std::to_string(response._status);
+                    if (response._status == 413 && count > 1) {
+                        // Too large for the server: each half is sent on its
+                        // own
+                        //
+                        split(batch, halves);
+                        _stats._retried += count;
+                        batch._offsets.clear();
+                        continue;
+                    }
+                    if (response._status != 429 && response._status < 500) {
+                        // The server refused the request as a whole, e.g.
+                        // for its credentials or path, which retrying does
+                        // not change
+                        //
+                        fail(count, error);
+                        batch._offsets.clear();
+                        continue;
+                    }
+                }
+                if (!error.empty() || (errors && statuses.size() != count)) {
+                    // The whole request failed, or its response is unusable
+                    //
+                    if (error.empty()) {
+                        error = "bulk response does not match the request";
+                    }
+                    if (attempt == _config._max_retries) {
+                        fail(count, error);
+                        batch._offsets.clear();
+                    } else {
+                        _stats._retried += count;
+                    }
+                    continue;
+                }
+                if (!errors) {
+                    _stats._items += count;
+                    batch._offsets.clear();
+                    continue;
+                }
+                // Cuts the items to retry out into a new body
+                //
+                retry._body.clear();
+                retry._offsets.clear();
+                for (size_t i = 0; i < count; i++) {
+                    const int status = statuses[i];
+                    if (status >= 200 && status < 300) {
+                        _stats._items++;
+                    } else if (status == 429 || status >= 500 || status == 0) {
+                        const size_t begin = batch._offsets[i],
+                            end = i + 1 < count ? batch._offsets[i + 1] : batch._body.size();
+                        retry._offsets.push_back(static_cast<uint32_t>(retry._body.size()));
+                        retry._body.append(batch._body, begin, end - begin);
+                    } else {
+                        _stats._rejected++;
+                    }
+                }
+                if (!retry._offsets.empty() && attempt == _config._max_retries) {
+                    fail(retry._offsets.size(), "bulk items failed after " + std::to_string(attempt + 1) + " attempts");
+                    retry._offsets.clear();
+                }
+                _stats._retried += retry._offsets.size();
+                batch._body.swap(retry._body);
+                batch._offsets.swap(retry._offsets);
+            }
+        }
+    }
+
+    /**
+     * Moves the two halves of a batch onto halves, the first half last.
+     */
+    static void split(Batch const& batch, std::vector<Batch>& halves) {
+        const size_t count = batch._offsets.size(), middle = count / 2;
+        const uint32_t cut = batch._offsets[middle];
+        halves.push_back(Batch());
+        halves.back()._body.assign(batch._body, cut, std::string::npos);
+        for (size_t i = middle; i < count; i++) {
+            halves.back()._offsets.push_back(batch._offsets[i] - cut);
+        }
+        halves.push_back(Batch());
+        halves.back()._body.assign(batch._body, 0, cut);
+        halves.back()._offsets.assign(batch._offsets.begin(), batch._offsets.begin() + middle);
+    }
+
+    /**
+     * Gives up on count items. The lock must be held.
+     */
+    void fail(size_t count, std::string const& error) {
+        _stats._failed += count;
+        if (_error.empty()) {
+            _error = error;
+        }
+        _done.notify_all();
+    }
+
+    void request_head(size_t body_len, std::string& head) const {
+        head = "POST " + _config._path + " HTTP/1.1\r\nHost: " + _config._host + ":" +
+            std::to_string(_config._port) + "\r\nContent-Type: application/x-ndjson\r\n";
+        if (_config._gzip) {
+            head += "Content-Encoding: gzip\r\n";
+        }
+        head += "Content-Length: " + std::to_string(body_len) + "\r\n\r\n";
+    }
+
+    const HttpBulkConfig _config;
+    JsonFormat _format;
+    std::string _action;
+    Batch _current;
+    std::vector<std::thread> _senders;
+    std::mutex _mutex;
+    std::condition_variable _ready, _done;
+    std::deque<Batch> _queue;
+    bool _closing, _closed;
+    std::string _error;
+    HttpBulkStats _stats;
+};
+
+} // namespace libilf
@@ -0,0 +1,602 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cstdint>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+#include "atomicops.h"
+#include "ilf.h"
+#include "perfect_hash.h"
+
+namespace libilf {
+
+namespace detail {
+
+/**
+ * Filter for the bytes of a set, which finds the next byte that may be in it
+ * 16 bytes at a time.
+ *
+ * With SSSE3, this is the shufti technique of Hyperscan: each byte is mapped
+ * to 8 buckets by two table lookups on its low and high nibbles, and is a
+ * candidate if both lookups share a bucket. High nibble h uses bucket h mod
+ * 8, so bytes whose high nibbles differ by 8 may give false positives, which
+ * callers must tolerate. Without SSSE3, a 256-entry table is exact.
+ */
+class ByteFilter {
+public:
+    ByteFilter() {
+        memset(_low, 0, sizeof(_low));
+        memset(_high, 0, sizeof(_high));
+        memset(_table, 0, sizeof(_table));
+    }
+
+    void add(unsigned char c) {
+        _low[c & 15] |= static_cast<uint8_t>(1 << ((c >> 4) & 7));
+        _high[c >> 4] = static_cast<uint8_t>(1 << ((c >> 4) & 7));
+        _table[c] = true;
+    }
+
+    /**
+     * Returns a pointer to the first byte in [begin, end) that may be in the
+     * set, or end.
+     */
+    AE_FORCEINLINE char const* find(char const* begin, char const* end) const {
+#if defined(__SSSE3__)
+        const __m128i low = _mm_loadu_si128(reinterpret_cast<__m128i const*>(_low)),
+            high = _mm_loadu_si128(reinterpret_cast<__m128i const*>(_high)),
+            nibble = _mm_set1_epi8(0x0F);
+        for (; begin + 16 <= end; begin += 16) {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<__m128i const*>(begin));
+            const __m128i buckets = _mm_and_si128(_mm_shuffle_epi8(low, _mm_and_si128(bytes, nibble)),
+                _mm_shuffle_epi8(high, _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble)));
+            const unsigned int mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(buckets, _mm_setzero_si128())) & 0xFFFF;
+            if (mask != 0) {
+                return begin + __builtin_ctz(mask);
+            }
+        }
+#endif
+        while (begin < end && !_table[static_cast<unsigned char>(*begin)]) {
+            begin++;
+        }
+        return begin;
+    }
+
+private:
+    uint8_t _low[16], _high[16];
+    bool _table[256];
+};
+
+} // namespace detail
+
+/**
+ * Immutable set of indicators of compromise (IOCs) matched against the
+ * values of ILFs.
+ *
+ * Substring indicators, such as domains or paths, match anywhere within a
+ * value and are found with an Aho-Corasick automaton (Aho and Corasick,
+ * "Efficient string matching: an aid to bibliographic search", 1975), so
+ * that scanning a value costs one transition per byte whatever the number of
+ * indicators. The automaton is laid out for cache efficiency:
+ *
+ * - Bytes are mapped to classes, one per byte that occurs in indicators and
+ *   one for all others, which shrinks transition tables to the alphabet of
+ *   the indicators.
+ * - States are numbered breadth-first, and the shallow states, which most
+ *   transitions lead to, have dense transition rows, with failure links
+ *   already followed, within a budget of DENSE_BYTES.
+ * - Deeper states keep their edges in flat arrays and fall back along their
+ *   failure links to a dense state.
+ * - Transitions into states at which an indicator ends are flagged, so that
+ *   scanning only reads the state itself on a match.
+ *
+ * While at the root, the scan skips to the next byte that can start an
+ * indicator with a SIMD byte filter, so values without indicator prefixes
+ * are mostly skipped 16 bytes at a time.
+ *
+ * Exact indicators, such as file hashes, match whole values only and are
+ * looked up in an open addressing hash set.
+ *
+ * Indicators are added with IocSet::add_substring() and IocSet::add_exact()
+ * and take effect with IocSet::build(). Matching of a built set is
+ * thread-safe, so Parser threads can share one set, e.g. through an
+ * RcuTable<IocSet> (see rcu.h) to reload it atomically.
+ */
+class IocSet {
+public:
+    static const size_t MAX_HITS = 16;
+    static const size_t DENSE_BYTES = 1 << 20;
+
+    /**
+     * If case_insensitive is set, indicators and values are compared with
+     * ASCII letters folded to lower case.
+     */
+    explicit IocSet(bool case_insensitive = true) {
+        for (unsigned int c = 0; c < 256; c++) {
+            _fold[c] = static_cast<unsigned char>(case_insensitive && c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c);
+        }
+    }
+
+    /**
+     * Adds an indicator matching anywhere within a value. Matches are tagged
+     * with tag, or with the indicator itself if tag is empty. Indicators that
+     * were already added keep their first tag.
+     *
+     * Throws a std::invalid_argument exception if the indicator is empty.
+     */
+    void add_substring(std::string const& indicator, std::string const& tag = std::string()) {
+        if (indicator.empty()) {
+            throw std::invalid_argument("empty indicator");
+        }
+        _substrings.push_back(Indicator(fold(indicator), tag.empty() ? indicator : tag));
+    }
+
+    /**
+     * Adds an indicator matching whole values only, see above.
+     */
+    void add_exact(std::string const& indicator, std::string const& tag = std::string()) {
+        if (indicator.empty()) {
+            throw std::invalid_argument("empty indicator");
+        }
+        _exacts.push_back(Indicator(fold(indicator), tag.empty() ? indicator : tag));
+    }
+
+    /**
+     * Builds the automaton and the hash set. The set must not be modified
+     * afterwards.
+     */
+    void build() {
+        build_automaton();
+        build_exact();
+    }
+
+    /**
+     * Returns the number of indicators.
+     */
+    AE_FORCEINLINE size_t size() const {
+        return _tags.size();
+    }
+
+    AE_FORCEINLINE std::string const& tag(uint32_t id) const {
+        return _tags[id];
+    }
+
+    /**
+     * Finds the indicators matching a value and writes their ids to hits,
+     * each once, up to MAX_HITS. Returns the number of ids written.
+     */
+    size_t match(char const* value, size_t len, uint32_t *hits) const {
+        size_t count = 0;
+        if (!_exact_slots.empty()) {
+            const uint32_t id = find_exact(value, len);
+            if (id != NONE) {
+                hits[count++] = id;
+            }
+        }
+        if (_states.size() <= 1) {
+            return count;
+        }
+        // Kept in locals, since stores to hits could alias the members
+        //
+        uint32_t const* dense = _dense.data();
+        uint8_t const* classes = _classes;
+        const uint32_t num_classes = _num_classes, num_dense = _num_dense;
+        char const* p = value, *end = value + len;
+        uint32_t state = ROOT;
+        while (p < end) {
+            if (state == ROOT) {
+                p = _first_bytes.find(p, end);
+                if (p == end) {
+                    break;
+                }
+            }
+            const uint8_t c = classes[static_cast<unsigned char>(*p++)];
+            const uint32_t target = state < num_dense ? dense[state * num_classes + c] : next_sparse(state, c);
+            state = target & ~MATCH;
+            if (target & MATCH) {
+                count = report(state, hits, count);
+            }
+        }
+        return count;
+    }
+
+    /**
+     * Tags an ILF whose sender, receiver or pair values match indicators: for
+     * each matching value, a pair ioc_<key> is appended, whose value lists the
+     * tags of the indicators found, separated by commas, where the key of the
+     * sender and receiver is sender and receiver. Returns the number of
+     * values that matched.
+     */
+    size_t tag(ILF& ilf) const {
+        const size_t num_pairs = ilf._pairs.size();
+        size_t tagged = 0;
+        tagged += tag_value(ilf, "sender", ilf._sender);
+        tagged += tag_value(ilf, "receiver", ilf._receiver);
+        for (size_t i = 0; i < num_pairs; i++) {
+            tagged += tag_value(ilf, ilf._pairs[i]._key, ilf._pairs[i]._value);
+        }
+        return tagged;
+    }
+
+private:
+    enum : uint32_t {
+        ROOT = 0,
+        NONE = UINT32_MAX,
+        // Flag of transitions into states at which an indicator ends
+        MATCH = 1u << 31
+    };
+
+    struct Indicator {
+        Indicator(std::string const& value, std::string const& tag) : _value(value), _tag(tag) { }
+
+        std::string _value, _tag;
+    };
+
+    /**
+     * State of the automaton, as visited on every transition: its failure
+     * link and its outgoing edges, sorted by class. Up to two edges, as on
+     * most states past the shallowest, are inline in _classes, _edges and
+     * _second. Otherwise, they are [_edges, _edges + _num_edges) of the edge
+     * arrays. Targets carry the MATCH flag. 16 bytes, so that a state never
+     * straddles two cache lines.
+     */
+    struct State {
+        uint32_t _edges;
+        uint32_t _second;
+        uint32_t _fail;
+        uint16_t _num_edges;
+        uint8_t _classes[2];
+    };
+
+    /**
+     * The indicator ending at a state, if any, and the nearest state along
+     * its failure links at which an indicator ends, or the root. Only read
+     * on matches.
+     */
+    struct Output {
+        uint32_t _output;
+        uint32_t _dictionary;
+    };
+
+    struct ExactSlot {
+        uint32_t _hash;
+        uint32_t _id;
+    };
+
+    std::string fold(std::string const& value) const {
+        std::string folded(value);
+        for (size_t i = 0; i < folded.size(); i++) {
+            folded[i] = static_cast<char>(_fold[static_cast<unsigned char>(folded[i])]);
+        }
+        return folded;
+    }
+
+    /**
+     * Appends the pair tagging one value of an ILF, which may be one of its
+     * own pairs: the new pair is built before it is appended.
+     */
+    size_t tag_value(ILF& ilf, std::string const& key, std::string const& value) const {
+        uint32_t hits[MAX_HITS];
+        const size_t count = match(value.data(), value.size(), hits);
+        if (count == 0) {
+            return 0;
+        }
+        std::string tags;
+        for (size_t i = 0; i < count; i++) {
+            if (i > 0) {
+                tags += ',';
+            }
+            tags += _tags[hits[i]];
+        }
+        ilf._pairs.push_back(KeyValue("ioc_" + key, tags, true));
+        return 1;
+    }
+
+    /**
+     * Adds every indicator ending at a state, along the chain of dictionary
+     * links, to hits and returns the new number of hits.
+     */
+    size_t report(uint32_t state, uint32_t *hits, size_t count) const {
+        for (uint32_t out = _outputs[state]._output != NONE ? state : _outputs[state]._dictionary;
+            out != ROOT; out = _outputs[out]._dictionary) {
+            const uint32_t id = _outputs[out]._output;
+            if (count < MAX_HITS && std::find(hits, hits + count, id) == hits + count) {
+                hits[count++] = id;
+            }
+        }
+        return count;
+    }
+
+    /**
+     * Returns the transition from a sparse state on byte class c, with the
+     * MATCH flag, following failure links until a dense state or one with an
+     * edge for c.
+     */
+    uint32_t next_sparse(uint32_t state, uint8_t c) const {
+        for (;;) {
+            if (state < _num_dense) {
+                return _dense[state * _num_classes + c];
+            }
+            State const& s = _states[state];
+            if (s._num_edges <= 2) {
+                if (s._num_edges > 0 && s._classes[0] == c) {
+                    return s._edges;
+                }
+                if (s._num_edges > 1 && s._classes[1] == c) {
+                    return s._second;
+                }
+            } else {
+                uint8_t const* classes = &_edge_classes[s._edges];
+                for (uint32_t i = 0; i < s._num_edges; i++) {
+                    if (classes[i] == c) {
+                        return _edge_targets[s._edges + i];
+                    }
+                    if (classes[i] > c) {
+                        break;
+                    }
+                }
+            }
+            if (state == ROOT) {
+                return ROOT;
+            }
+            state = s._fail;
+        }
+    }
+
+    uint32_t hash(char const* value, size_t len) const {
+        uint32_t h = FNV_OFFSET_BASIS;
+        for (size_t i = 0; i < len; i++) {
+            h = (h ^ _fold[static_cast<unsigned char>(value[i])]) * 16777619u;
+        }
+        return h;
+    }
+
+    uint32_t find_exact(char const* value, size_t len) const {
+        const uint32_t h = hash(value, len);
+        for (size_t slot = h & _exact_mask; ; slot = (slot + 1) & _exact_mask) {
+            ExactSlot const& entry = _exact_slots[slot];
+            if (entry._id == NONE) {
+                return NONE;
+            }
+            std::string const& indicator = _exact_values[entry._id - _exact_first];
+            if (entry._hash == h && indicator.size() == len) {
+                size_t i = 0;
+                while (i < len && _fold[static_cast<unsigned char>(value[i])] == static_cast<unsigned char>(indicator[i])) {
+                    i++;
+                }
+                if (i == len) {
+                    return entry._id;
+                }
+            }
+        }
+    }
+
+    void build_automaton() {
+        // Byte classes, 0 being bytes that occur in no indicator, if any
+        //
+        bool used[256] = {false};
+        unsigned int num_used = 0;
+        for (size_t i = 0; i < _substrings.size(); i++) {
+            for (size_t j = 0; j < _substrings[i]._value.size(); j++) {
+                unsigned char c = static_cast<unsigned char>(_substrings[i]._value[j]);
+                num_used += !used[c];
+                used[c] = true;
+            }
+        }
+        uint8_t folded_classes[256] = {0};
+        _num_classes = num_used < 256 ? 1 : 0;
+        for (unsigned int c = 0; c < 256; c++) {
+            if (used[c]) {
+                folded_classes[c] = static_cast<uint8_t>(_num_classes++);
+            }
+        }
+        for (unsigned int c = 0; c < 256; c++) {
+            _classes[c] = folded_classes[_fold[c]];
+        }
+
+        // Trie with unsorted edges, as (class, child) lists per node
+        //
+        std::vector<std::vector<std::pair<uint8_t, uint32_t>>> children(1);
+        std::vector<uint32_t> outputs(1, NONE);
+        _tags.clear();
+        for (size_t i = 0; i < _substrings.size(); i++) {
+            std::string const& value = _substrings[i]._value;
+            uint32_t node = ROOT;
+            for (size_t j = 0; j < value.size(); j++) {
+                const uint8_t c = folded_classes[static_cast<unsigned char>(value[j])];
+                uint32_t child = NONE;
+                for (size_t k = 0; k < children[node].size(); k++) {
+                    if (children[node][k].first == c) {
+                        child = children[node][k].second;
+                        break;
+                    }
+                }
+                if (child == NONE) {
+                    child = static_cast<uint32_t>(children.size());
+                    children[node].push_back(std::make_pair(c, child));
+                    children.push_back(std::vector<std::pair<uint8_t, uint32_t>>());
+                    outputs.push_back(NONE);
+                }
+                node = child;
+            }
+            if (outputs[node] == NONE) {
+                outputs[node] = static_cast<uint32_t>(_tags.size());
+                _tags.push_back(_substrings[i]._tag);
+            }
+        }
+        if (children.size() >= MATCH) {
+            throw std::length_error("too many indicator states");
+        }
+
+        // Renumbers the nodes breadth-first, with sorted edges
+        //
+        std::vector<uint32_t> order(1, ROOT), number(children.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            std::vector<std::pair<uint8_t, uint32_t>>& edges = children[order[i]];
+            std::sort(edges.begin(), edges.end());
+            for (size_t k = 0; k < edges.size(); k++) {
+                order.push_back(edges[k].second);
+            }
+        }
+        for (size_t i = 0; i < order.size(); i++) {
+            number[order[i]] = static_cast<uint32_t>(i);
+        }
+        std::vector<uint32_t> first_edge(order.size() + 1), edge_targets;
+        std::vector<uint8_t> edge_classes;
+        _outputs.assign(order.size(), Output());
+        for (size_t i = 0; i < order.size(); i++) {
+            std::vector<std::pair<uint8_t, uint32_t>> const& edges = children[order[i]];
+            first_edge[i] = static_cast<uint32_t>(edge_classes.size());
+            for (size_t k = 0; k < edges.size(); k++) {
+                edge_classes.push_back(edges[k].first);
+                edge_targets.push_back(number[edges[k].second]);
+            }
+            _outputs[i]._output = outputs[order[i]];
+            _outputs[i]._dictionary = ROOT;
+        }
+        first_edge[order.size()] = static_cast<uint32_t>(edge_classes.size());
+
+        // Failure and dictionary links in breadth-first order, so that
+        // shallower states are complete when used
+        //
+        std::vector<uint32_t> fails(order.size(), ROOT);
+        auto transition = [&](uint32_t state, uint8_t c) -> uint32_t {
+            for (;;) {
+                for (uint32_t k = first_edge[state]; k < first_edge[state + 1]; k++) {
+                    if (edge_classes[k] == c) {
+                        return edge_targets[k];
+                    }
+                }
+                if (state == ROOT) {
+                    return ROOT;
+                }
+                state = fails[state];
+            }
+        };
+        for (uint32_t state = 0; state < order.size(); state++) {
+            for (uint32_t k = first_edge[state]; k < first_edge[state + 1]; k++) {
+                const uint32_t child = edge_targets[k];
+                const uint32_t fail = state == ROOT ? ROOT : transition(fails[state], edge_classes[k]);
+                fails[child] = fail;
+                _outputs[child]._dictionary = _outputs[fail]._output != NONE ? fail : _outputs[fail]._dictionary;
+            }
+        }
+        auto flagged = [&](uint32_t target) -> uint32_t {
+            return _outputs[target]._output != NONE || _outputs[target]._dictionary != ROOT ? target | MATCH : target;
+        };
+
+        // States, with up to two edges inline
+        //
+        _states.assign(order.size(), State());
+        _edge_classes.clear();
+        _edge_targets.clear();
+        for (uint32_t s = 0; s < order.size(); s++) {
+            State& state = _states[s];
+            const uint32_t first = first_edge[s], num_edges = first_edge[s + 1] - first;
+            state._fail = fails[s];
+            state._num_edges = static_cast<uint16_t>(num_edges);
+            if (num_edges <= 2) {
+                for (uint32_t k = 0; k < num_edges; k++) {
+                    state._classes[k] = edge_classes[first + k];
+                    (k == 0 ? state._edges : state._second) = flagged(edge_targets[first + k]);
+                }
+            } else {
+                state._edges = static_cast<uint32_t>(_edge_classes.size());
+                for (uint32_t k = first; k < first + num_edges; k++) {
+                    _edge_classes.push_back(edge_classes[k]);
+                    _edge_targets.push_back(flagged(edge_targets[k]));
+                }
+            }
+        }
+
+        // Dense rows of the shallowest states, each the row of its failure
+        // state overridden by its own edges
+        //
+        const size_t num_dense = std::min(_states.size(), DENSE_BYTES / (_num_classes * sizeof(uint32_t)));
+        _dense.assign(num_dense * _num_classes, ROOT);
+        for (size_t s = 0; s < num_dense; s++) {
+            if (s != ROOT) {
+                std::copy(&_dense[fails[s] * _num_classes], &_dense[(fails[s] + 1) * _num_classes],
+                    &_dense[s * _num_classes]);
+            }
+            for (uint32_t k = first_edge[s]; k < first_edge[s + 1]; k++) {
+                _dense[s * _num_classes + edge_classes[k]] = flagged(edge_targets[k]);
+            }
+        }
+        _num_dense = static_cast<uint32_t>(num_dense);
+
+        // Bytes that leave the root
+        //
+        _first_bytes = detail::ByteFilter();
+        for (unsigned int c = 0; c < 256; c++) {
+            if ((_dense[_classes[c]] & ~MATCH) != ROOT) {
+                _first_bytes.add(static_cast<unsigned char>(c));
+            }
+        }
+    }
+
+    void build_exact() {
+        _exact_first = static_cast<uint32_t>(_tags.size());
+        _exact_values.clear();
+        size_t capacity = 16;
+        while (capacity < 2 * _exacts.size()) {
+            capacity *= 2;
+        }
+        ExactSlot empty = {0, NONE};
+        _exact_slots.assign(_exacts.empty() ? 0 : capacity, empty);
+        _exact_mask = capacity - 1;
+        for (size_t i = 0; i < _exacts.size(); i++) {
+            std::string const& value = _exacts[i]._value;
+            if (find_exact(value.data(), value.size()) != NONE) {
+                continue;
+            }
+            const uint32_t h = hash(value.data(), value.size());
+            size_t slot = h & _exact_mask;
+            while (_exact_slots[slot]._id != NONE) {
+                slot = (slot + 1) & _exact_mask;
+            }
+            _exact_slots[slot]._hash = h;
+            _exact_slots[slot]._id = static_cast<uint32_t>(_tags.size());
+            _exact_values.push_back(value);
+            _tags.push_back(_exacts[i]._tag);
+        }
+    }
+
+    unsigned char _fold[256];
+    std::vector<Indicator> _substrings, _exacts;
+    // Tags by id, substring indicators first
+    //
+    std::vector<std::string> _tags;
+    uint8_t _classes[256];
+    uint32_t _num_classes, _num_dense;
+    std::vector<State> _states;
+    std::vector<Output> _outputs;
+    std::vector<uint8_t> _edge_classes;
+    std::vector<uint32_t> _edge_targets;
+    std::vector<uint32_t> _dense;
+    detail::ByteFilter _first_bytes;
+    std::vector<ExactSlot> _exact_slots;
+    std::vector<std::string> _exact_values;
+    size_t _exact_mask;
+    uint32_t _exact_first;
+};
+
+} // namespace libilf
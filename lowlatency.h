@@ -0,0 +1,226 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <cstring>
+#include <cerrno>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "parser.h"
+#include "pipeline.h"
+
+namespace libilf {
+
+/**
+ * Scheduling of one thread: its policy (e.g., SCHED_FIFO or SCHED_OTHER), its
+ * priority within that policy (1 to 99 for SCHED_FIFO and SCHED_RR, 0
+ * otherwise) and the CPU it is pinned to, or -1 to leave it unpinned.
+ */
+struct ThreadPolicy {
+    ThreadPolicy() : _policy(SCHED_OTHER), _priority(0), _cpu(-1) { }
+
+    ThreadPolicy(int policy, int priority, int cpu) :
+        _policy(policy),
+        _priority(priority),
+        _cpu(cpu) { }
+
+    int _policy, _priority, _cpu;
+};
+
+/**
+ * Options of the opt-in low-latency deployment mode, which removes jitter
+ * sources from the hot path before traffic arrives:
+ *
+ * - _lock_memory: mlockall(MCL_CURRENT | MCL_FUTURE), so that no page of the
+ *   process, including thread stacks mapped later, is ever faulted in lazily
+ *   or swapped out.
+ * - _prefault: touches every preallocated queue slot with Parser::prefault().
+ * - _producer, _consumer: scheduling of the producer and consumer threads of
+ *   a Pipeline.
+ * - _workers: scheduling of the parser's threads. Worker i uses entry i, or
+ *   the last entry if there are fewer entries than threads.
+ *
+ * Realtime policies need CAP_SYS_NICE and locking memory may need
+ * CAP_IPC_LOCK or a large enough RLIMIT_MEMLOCK. Spinning threads under
+ * SCHED_FIFO should be pinned to isolated CPUs (see isolated_cpus()), since
+ * they never yield the CPU to anything else.
+ */
+struct LowLatencyConfig {
+    LowLatencyConfig() : _lock_memory(true), _prefault(true) { }
+
+    bool _lock_memory, _prefault;
+    ThreadPolicy _producer, _consumer;
+    std::vector<ThreadPolicy> _workers;
+};
+
+/**
+ * Parses a kernel CPU list such as "2-5,8".
+ */
+inline std::vector<int> parse_cpu_list(std::string const& list) {
+    std::vector<int> cpus;
+    std::istringstream stream(list);
+    std::string range;
+    while (std::getline(stream, range, ',')) {
+        if (range.find_first_not_of(" \t\n") == std::string::npos) {
+            continue;
+        }
+        size_t dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash)),
+            last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+/**
+ * Returns the CPUs isolated from the scheduler with the isolcpus kernel
+ * parameter, or an empty vector if there are none.
+ */
+inline std::vector<int> isolated_cpus() {
+    std::ifstream file("/sys/devices/system/cpu/isolated");
+    std::string list;
+    std::getline(file, list);
+    return parse_cpu_list(list);
+}
+
+/**
+ * Locks all current and future pages of the process into memory.
+ *
+ * Throws a std::system_error exception on failure.
+ */
+inline void lock_memory() {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        throw std::system_error(errno, std::system_category(), "mlockall");
+    }
+}
+
+/**
+ * Writes to every page of a buffer, such as an arena reserved up front, so
+ * that it is backed by memory before it is used.
+ */
+inline void prefault(void *buffer, size_t size) {
+    const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    volatile char *bytes = static_cast<volatile char*>(buffer);
+    for (size_t offset = 0; offset < size; offset += page_size) {
+        bytes[offset] = bytes[offset];
+    }
+}
+
+/**
+ * Applies a scheduling policy and CPU affinity to a thread.
+ *
+ * Throws a std::system_error exception on failure, e.g. with EPERM if the
+ * process may not use a realtime policy.
+ */
+inline void set_thread_policy(pthread_t thread, ThreadPolicy const& policy) {
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = policy._priority;
+    int error = pthread_setschedparam(thread, policy._policy, &param);
+    if (error != 0) {
+        throw std::system_error(error, std::system_category(), "pthread_setschedparam");
+    }
+    if (policy._cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(policy._cpu, &cpus);
+        error = pthread_setaffinity_np(thread, sizeof(cpus), &cpus);
+        if (error != 0) {
+            throw std::system_error(error, std::system_category(), "pthread_setaffinity_np");
+        }
+    }
+}
+
+namespace detail {
+
+template <class input_t, class output_t, unsigned int N>
+void set_worker_policies(Parser<input_t, output_t, N>& parser, LowLatencyConfig const& config) {
+    for (unsigned int i = 0; i < parser.num_threads() && !config._workers.empty(); i++) {
+        ThreadPolicy const& policy = config._workers[i < config._workers.size() ? i : config._workers.size() - 1];
+        set_thread_policy(parser.thread_handle(i), policy);
+    }
+}
+
+} // namespace detail
+
+/**
+ * Starts a parser in low-latency mode: locks memory and prefaults its queues
+ * as configured, starts its threads parked, applies the worker scheduling
+ * policies and only then lets the threads take input.
+ *
+ * Throws a std::system_error exception if a policy cannot be applied, e.g.
+ * with EPERM for a realtime policy without CAP_SYS_NICE or with EINVAL for a
+ * CPU that does not exist, in which case the parser is stopped again.
+ */
+template <class input_t, class output_t, unsigned int N>
+void start_low_latency(Parser<input_t, output_t, N>& parser, LowLatencyConfig const& config) {
+    if (config._lock_memory) {
+        lock_memory();
+    }
+    if (config._prefault) {
+        parser.prefault();
+    }
+    parser.start_parked();
+    try {
+        detail::set_worker_policies(parser, config);
+    } catch (...) {
+        parser.stop();
+        throw;
+    }
+    parser.release();
+}
+
+/**
+ * Starts a pipeline in low-latency mode: as above for its parser, and also
+ * applies the producer and consumer scheduling policies before any thread
+ * touches data.
+ *
+ * Throws a std::system_error exception if a policy cannot be applied, in
+ * which case the pipeline is cancelled and waited for again.
+ */
+template <class input_t, class output_t, unsigned int N>
+void start_low_latency(Pipeline<input_t, output_t, N>& pipeline, LowLatencyConfig const& config) {
+    Parser<input_t, output_t, N>& parser = pipeline.parser();
+    if (config._lock_memory) {
+        lock_memory();
+    }
+    if (config._prefault) {
+        parser.prefault();
+    }
+    pipeline.start_parked();
+    try {
+        set_thread_policy(pipeline.producer_handle(), config._producer);
+        set_thread_policy(pipeline.consumer_handle(), config._consumer);
+        detail::set_worker_policies(parser, config);
+    } catch (...) {
+        pipeline.cancel();
+        try {
+            pipeline.wait();
+        } catch (...) { }
+        throw;
+    }
+    pipeline.release();
+}
+
+} // namespace libilf
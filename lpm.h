@@ -0,0 +1,486 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <arpa/inet.h>
+
+#include "ilf.h"
+#include "pipeline.h"
+#include "span.h"
+
+namespace libilf {
+
+/**
+ * Longest prefix match table for IPv4 with the DIR-24-8 layout (Gupta,
+ * Lin and McKeown, "Routing Lookups in Hardware at Memory Access Speeds",
+ * 1998): a table indexed by the top 24 bits of an address holds either the
+ * value of the longest matching prefix of up to 24 bits or, for the /24s
+ * covered by longer prefixes, the index of a 256-entry group indexed by the
+ * last 8 bits. A lookup thus takes one or two memory accesses.
+ *
+ * Prefixes are added with Ipv4Table::add() and take effect with
+ * Ipv4Table::build(), which paints them in order of increasing length so
+ * that longer prefixes overwrite shorter ones. Lookups of a built table are
+ * thread-safe. The top-level table takes 64 MiB of address space, allocated
+ * zeroed with calloc(3) so that only the pages that prefixes are painted on
+ * are backed by memory; looking up unmatched addresses only reads the
+ * kernel's shared zero page.
+ */
+class Ipv4Table {
+public:
+    static const uint32_t NO_MATCH = 0;
+
+    /**
+     * Adds a prefix, in host byte order, with a nonzero value.
+     *
+     * Throws a std::invalid_argument exception if length exceeds 32 or value
+     * is NO_MATCH or too large.
+     */
+    void add(uint32_t prefix, unsigned int length, uint32_t value) {
+        if (length > 32 || value == NO_MATCH || value >= GROUP_FLAG) {
+            throw std::invalid_argument("invalid IPv4 prefix length or value");
+        }
+        _routes.push_back(Route(length == 0 ? 0 : prefix & (~0u << (32 - length)), length, value));
+    }
+
+    void build() {
+        std::stable_sort(_routes.begin(), _routes.end(), [](Route const& a, Route const& b) {
+            return a._length < b._length;
+        });
+        // NO_MATCH is 0, so a zeroed table matches nothing
+        //
+        _tbl24.reset();
+        _tbl24.reset(static_cast<uint32_t*>(calloc(1 << 24, sizeof(uint32_t))));
+        if (!_tbl24) {
+            throw std::bad_alloc();
+        }
+        _tbl8.clear();
+        for (size_t i = 0; i < _routes.size(); i++) {
+            Route const& route = _routes[i];
+            if (route._length <= 24) {
+                const uint32_t first = route._prefix >> 8, count = 1u << (24 - route._length);
+                for (uint32_t j = first; j < first + count; j++) {
+                    if (_tbl24[j] & GROUP_FLAG) {
+                        uint32_t *group = &_tbl8[(_tbl24[j] & ~GROUP_FLAG) << 8];
+                        std::fill(group, group + 256, route._value);
+                    } else {
+                        _tbl24[j] = route._value;
+                    }
+                }
+            } else {
+                uint32_t& entry = _tbl24[route._prefix >> 8];
+                if (!(entry & GROUP_FLAG)) {
+                    const uint32_t group = static_cast<uint32_t>(_tbl8.size() >> 8);
+                    _tbl8.resize(_tbl8.size() + 256, entry);
+                    entry = group | GROUP_FLAG;
+                }
+                const uint32_t first = ((entry & ~GROUP_FLAG) << 8) | (route._prefix & 0xFF),
+                    count = 1u << (32 - route._length);
+                std::fill(&_tbl8[first], &_tbl8[first] + count, route._value);
+            }
+        }
+    }
+
+    /**
+     * Returns the value of the longest prefix matching an address in host
+     * byte order, or NO_MATCH.
+     */
+    AE_FORCEINLINE uint32_t lookup(uint32_t address) const {
+        const uint32_t entry = _tbl24[address >> 8];
+        if (LIKELY(!(entry & GROUP_FLAG))) {
+            return entry;
+        }
+        return _tbl8[((entry & ~GROUP_FLAG) << 8) | (address & 0xFF)];
+    }
+
+    /**
+     * Looks up a batch of addresses, prefetching the table entries of the
+     * addresses a few positions ahead so that cache misses overlap.
+     */
+    void lookup(span<const uint32_t> addresses, span<uint32_t> values) const {
+        const size_t AHEAD = 8;
+        for (size_t i = 0; i < addresses.size() && i < AHEAD; i++) {
+            PREFETCH(&_tbl24[addresses[i] >> 8]);
+        }
+        for (size_t i = 0; i < addresses.size(); i++) {
+            if (i + AHEAD < addresses.size()) {
+                PREFETCH(&_tbl24[addresses[i + AHEAD] >> 8]);
+            }
+            values[i] = lookup(addresses[i]);
+        }
+    }
+
+    bool empty() const {
+        return _routes.empty();
+    }
+
+private:
+    static const uint32_t GROUP_FLAG = 1u << 31;
+
+    struct Route {
+        Route(uint32_t prefix, unsigned int length, uint32_t value) :
+            _prefix(prefix),
+            _length(length),
+            _value(value) { }
+
+        uint32_t _prefix;
+        unsigned int _length;
+        uint32_t _value;
+    };
+
+    struct Free {
+        void operator()(uint32_t *table) const {
+            free(table);
+        }
+    };
+
+    std::vector<Route> _routes;
+    std::unique_ptr<uint32_t[], Free> _tbl24;
+    std::vector<uint32_t> _tbl8;
+};
+
+/**
+ * Longest prefix match table for IPv6: a multibit trie with 8-bit strides,
+ * built by painting prefixes in order of increasing length like Ipv4Table.
+ * Each node has 256 entries holding the value of the longest prefix covering
+ * them and the index of their child node, if any. A lookup takes one memory
+ * access per byte of the longest prefix along its path.
+ */
+class Ipv6Table {
+public:
+    static const uint32_t NO_MATCH = 0;
+
+    /**
+     * Adds a prefix given as 16 bytes in network byte order, with a nonzero
+     * value.
+     *
+     * Throws a std::invalid_argument exception if length exceeds 128 or
+     * value is NO_MATCH.
+     */
+    void add(uint8_t const prefix[16], unsigned int length, uint32_t value) {
+        if (length > 128 || value == NO_MATCH) {
+            throw std::invalid_argument("invalid IPv6 prefix length or value");
+        }
+        Route route;
+        memcpy(route._prefix, prefix, 16);
+        for (unsigned int i = 0; i < 16; i++) {
+            const unsigned int bits = length > 8 * i ? std::min(8u, length - 8 * i) : 0;
+            route._prefix[i] &= static_cast<uint8_t>(0xFF00 >> bits);
+        }
+        route._length = length;
+        route._value = value;
+        _routes.push_back(route);
+    }
+
+    void build() {
+        std::stable_sort(_routes.begin(), _routes.end(), [](Route const& a, Route const& b) {
+            return a._length < b._length;
+        });
+        _nodes.assign(256, Entry());
+        for (size_t i = 0; i < _routes.size(); i++) {
+            Route const& route = _routes[i];
+            // Walks down to the node of the last, possibly partial, byte of
+            // the prefix, creating nodes that inherit their parent's value
+            //
+            uint32_t node = 0;
+            const unsigned int depth = route._length == 0 ? 0 : (route._length - 1) / 8;
+            for (unsigned int d = 0; d < depth; d++) {
+                const uint32_t index = node * 256 + route._prefix[d];
+                if (_nodes[index]._child == 0) {
+                    const uint32_t child = static_cast<uint32_t>(_nodes.size() / 256);
+                    const uint32_t value = _nodes[index]._value;
+                    _nodes.resize(_nodes.size() + 256);
+                    for (size_t j = 0; j < 256; j++) {
+                        _nodes[child * 256 + j]._value = value;
+                    }
+                    _nodes[index]._child = child;
+                }
+                node = _nodes[index]._child;
+            }
+            const unsigned int bits = route._length - 8 * depth;
+            const uint32_t first = route._prefix[depth], count = 1u << (8 - bits);
+            for (uint32_t j = first; j < first + count; j++) {
+                paint(node * 256 + j, route._value);
+            }
+        }
+    }
+
+    /**
+     * Returns the value of the longest prefix matching an address given as
+     * 16 bytes in network byte order, or NO_MATCH.
+     */
+    AE_FORCEINLINE uint32_t lookup(uint8_t const address[16]) const {
+        uint32_t node = 0, value = NO_MATCH;
+        for (unsigned int d = 0; d < 16; d++) {
+            Entry const& entry = _nodes[node * 256 + address[d]];
+            value = entry._value;
+            if (entry._child == 0) {
+                break;
+            }
+            node = entry._child;
+        }
+        return value;
+    }
+
+    bool empty() const {
+        return _routes.empty();
+    }
+
+private:
+    struct Route {
+        uint8_t _prefix[16];
+        unsigned int _length;
+        uint32_t _value;
+    };
+
+    struct Entry {
+        Entry() : _value(NO_MATCH), _child(0) { }
+
+        uint32_t _value, _child;
+    };
+
+    /**
+     * Sets the value of an entry and of the entries of its descendants, all
+     * of which are covered by the shorter prefixes painted so far.
+     */
+    void paint(uint32_t index, uint32_t value) {
+        _nodes[index]._value = value;
+        if (_nodes[index]._child != 0) {
+            const uint32_t child = _nodes[index]._child;
+            for (uint32_t j = 0; j < 256; j++) {
+                paint(child * 256 + j, value);
+            }
+        }
+    }
+
+    std::vector<Route> _routes;
+    std::vector<Entry> _nodes;
+};
+
+/**
+ * Parses a dotted IPv4 address into host byte order.
+ */
+AE_FORCEINLINE bool parse_ipv4(char const* str, size_t len, uint32_t *address) {
+    uint32_t result = 0, octet = 0;
+    unsigned int dots = 0, digits = 0;
+    for (size_t i = 0; i < len; i++) {
+        const char c = str[i];
+        if (c >= '0' && c <= '9') {
+            octet = octet * 10 + (c - '0');
+            if (++digits > 3 || octet > 255) {
+                return false;
+            }
+        } else if (c == '.' && digits > 0 && dots < 3) {
+            result = (result << 8) | octet;
+            octet = 0;
+            digits = 0;
+            dots++;
+        } else {
+            return false;
+        }
+    }
+    if (dots != 3 || digits == 0) {
+        return false;
+    }
+    *address = (result << 8) | octet;
+    return true;
+}
+
+/**
+ * Enrichment of ILFs with attributes of the networks their sender and
+ * receiver belong to, such as asset, subnet, zone or geo information.
+ *
+ * Networks are added in CIDR notation with their attributes, and take effect
+ * with Enricher::build(). Enricher::enrich() then appends the attributes of
+ * the longest matching network of the sender and of the receiver as pairs,
+ * with their keys prefixed by "sender_" and "receiver_". Senders and
+ * receivers that are not IP addresses, or match no network, get no pairs.
+ *
+ * Lookups of a built enricher are thread-safe, so conversion functions may
+ * enrich in the workers; EnrichingSink enriches batches in the consumer.
+ */
+class Enricher {
+public:
+    /**
+     * Adds a network, e.g. "10.1.0.0/16" or "2001:db8::/32"; a bare address
+     * is a /32 or /128.
+     *
+     * Throws a std::invalid_argument exception if the network is malformed,
+     * including a prefix length that is not 1 to 3 digits or exceeds 32 for
+     * IPv4 or 128 for IPv6.
+     */
+    void add(std::string const& cidr, std::vector<KeyValue> const& attributes) {
+        const size_t slash = cidr.find('/');
+        const std::string address = cidr.substr(0, slash);
+        int length = -1;
+        if (slash != std::string::npos) {
+            const size_t digits = cidr.size() - slash - 1;
+            if (digits == 0 || digits > 3) {
+                throw std::invalid_argument("malformed network " + cidr);
+            }
+            length = 0;
+            for (size_t i = slash + 1; i < cidr.size(); i++) {
+                if (cidr[i] < '0' || cidr[i] > '9') {
+                    throw std::invalid_argument("malformed network " + cidr);
+                }
+                length = length * 10 + (cidr[i] - '0');
+            }
+        }
+        const uint32_t value = static_cast<uint32_t>(_sender_pairs.size() + 1);
+        uint32_t ipv4;
+        uint8_t ipv6[16];
+        if (parse_ipv4(address.data(), address.size(), &ipv4)) {
+            if (length > 32) {
+                throw std::invalid_argument("malformed network " + cidr);
+            }
+            _ipv4.add(ipv4, length < 0 ? 32 : length, value);
+        } else if (inet_pton(AF_INET6, address.c_str(), ipv6) == 1 && length <= 128) {
+            _ipv6.add(ipv6, length < 0 ? 128 : length, value);
+        } else {
+            throw std::invalid_argument("malformed network " + cidr);
+        }
+        _sender_pairs.push_back(prefixed("sender_", attributes));
+        _receiver_pairs.push_back(prefixed("receiver_", attributes));
+    }
+
+    void build() {
+        _ipv4.build();
+        _ipv6.build();
+    }
+
+    /**
+     * Returns the value of the longest network matching an address, which is
+     * 1 + the position of the network in the order networks were added, or 0.
+     */
+    AE_FORCEINLINE uint32_t lookup(std::string const& address) const {
+        uint32_t ipv4;
+        if (parse_ipv4(address.data(), address.size(), &ipv4)) {
+            return _ipv4.lookup(ipv4);
+        }
+        uint8_t ipv6[16];
+        if (!_ipv6.empty() && address.find(':') != std::string::npos &&
+            inet_pton(AF_INET6, address.c_str(), ipv6) == 1) {
+            return _ipv6.lookup(ipv6);
+        }
+        return Ipv4Table::NO_MATCH;
+    }
+
+    void enrich(ILF& ilf) const {
+        append(ilf, lookup(ilf._sender), lookup(ilf._receiver));
+    }
+
+    /**
+     * Enriches a batch, looking IPv4 addresses up with Ipv4Table's prefetching
+     * batch lookup. Unlike single lookups, batches use scratch space of the
+     * enricher and must not be enriched concurrently.
+     */
+    void enrich(span<ILF> ilfs) {
+        const size_t count = 2 * ilfs.size();
+        _addresses.resize(count);
+        _values.resize(count);
+        _others.clear();
+        for (size_t i = 0; i < count; i++) {
+            std::string const& address = i % 2 == 0 ? ilfs[i / 2]._sender : ilfs[i / 2]._receiver;
+            if (!parse_ipv4(address.data(), address.size(), &_addresses[i])) {
+                _addresses[i] = 0;
+                _others.push_back(i);
+            }
+        }
+        _ipv4.lookup(_addresses, _values);
+        // Addresses that are not IPv4 are looked up on their own
+        //
+        for (size_t i = 0; i < _others.size(); i++) {
+            const size_t k = _others[i];
+            _values[k] = lookup(k % 2 == 0 ? ilfs[k / 2]._sender : ilfs[k / 2]._receiver);
+        }
+        for (size_t i = 0; i < ilfs.size(); i++) {
+            append(ilfs[i], _values[2 * i], _values[2 * i + 1]);
+        }
+    }
+
+private:
+    static std::vector<KeyValue> prefixed(char const* prefix, std::vector<KeyValue> const& attributes) {
+        std::vector<KeyValue> pairs(attributes);
+        for (size_t i = 0; i < pairs.size(); i++) {
+            pairs[i]._key = prefix + pairs[i]._key;
+        }
+        return pairs;
+    }
+
+    AE_FORCEINLINE void append(ILF& ilf, uint32_t sender, uint32_t receiver) const {
+        const size_t added = (sender != Ipv4Table::NO_MATCH ? _sender_pairs[sender - 1].size() : 0) +
+            (receiver != Ipv4Table::NO_MATCH ? _receiver_pairs[receiver - 1].size() : 0);
+        ilf._pairs.reserve(ilf._pairs.size() + added);
+        if (sender != Ipv4Table::NO_MATCH) {
+            ilf._pairs.insert(ilf._pairs.end(), _sender_pairs[sender - 1].begin(), _sender_pairs[sender - 1].end());
+        }
+        if (receiver != Ipv4Table::NO_MATCH) {
+            ilf._pairs.insert(ilf._pairs.end(), _receiver_pairs[receiver - 1].begin(), _receiver_pairs[receiver - 1].end());
+        }
+    }
+
+    Ipv4Table _ipv4;
+    Ipv6Table _ipv6;
+    std::vector<std::vector<KeyValue> > _sender_pairs, _receiver_pairs;
+    std::vector<uint32_t> _addresses, _values;
+    std::vector<size_t> _others;
+};
+
+/**
+ * Sink enriching each batch of ILFs with an Enricher before passing it on to
+ * another sink.
+ *
+ * Batches written by a Pipeline, through Sink::write_mutable(), are enriched
+ * in place, which only appends the pairs of the matching networks. Batches
+ * written through Sink::write() are const, so they are copied first.
+ */
+class EnrichingSink : public Sink<ILF> {
+public:
+    EnrichingSink(Enricher& enricher, Sink<ILF>& sink) :
+        _enricher(enricher),
+        _sink(sink) { }
+
+    void write(span<const ILF> ilfs) override {
+        _batch.assign(ilfs.begin(), ilfs.end());
+        write_mutable(span<ILF>(_batch));
+    }
+
+    void write_mutable(span<ILF> ilfs) override {
+        _enricher.enrich(ilfs);
+        _sink.write_mutable(ilfs);
+    }
+
+    void flush() override {
+        _sink.flush();
+    }
+
+    void close() override {
+        _sink.close();
+    }
+
+private:
+    Enricher& _enricher;
+    Sink<ILF>& _sink;
+    std::vector<ILF> _batch;
+};
+
+} // namespace libilf
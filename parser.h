@@ -14,20 +14,225 @@
 
 #define LIKELY(x)      __builtin_expect(!!(x), 1)
 #define UNLIKELY(x)    __builtin_expect(!!(x), 0)
+#define PREFETCH(x)    __builtin_prefetch((x), 0, 3)
 
 #include <iostream>
 #include <fstream>
 #include <thread>
+#include <atomic>
 #include <stdexcept>
 #include <ctime>
+#include <array>
+#include <vector>
+#include <utility>
+#include <type_traits>
 
 // Taken from https://github.com/cameron314/readerwriterqueue
 //
 #include "readerwriterqueue.h"
 #include "atomicops.h"
+#include "span.h"
 
 namespace libilf {
 
+namespace detail {
+
+/**
+ * Fixed-size array of cache line aligned slots holding the per-thread
+ * queues and threads of a Parser.
+ *
+ * When the number of slots N is known at compile time, the slots are stored
+ * inline in a std::array so that indexing folds to a constant offset from
+ * the Parser itself and every queue header sits on its own cache lines.
+ */
+template <class T, unsigned int N>
+class SlotArray {
+public:
+    explicit SlotArray(unsigned int) { }
+
+    AE_FORCEINLINE T& operator[](unsigned int i) {
+        return _slots[i]._val;
+    }
+
+private:
+    struct alignas(MOODYCAMEL_CACHE_LINE_SIZE) Slot {
+        T _val;
+    };
+
+    std::array<Slot, N> _slots;
+};
+
+/**
+ * Specialization for a number of slots only known at runtime (N = 0), in
+ * which case the slots are heap allocated.
+ */
+template <class T>
+class SlotArray<T, 0> {
+public:
+    explicit SlotArray(unsigned int size) : _slots(new T[size]) { }
+
+    ~SlotArray() {
+        delete[] _slots;
+    }
+
+    AE_FORCEINLINE T& operator[](unsigned int i) {
+        return _slots[i];
+    }
+
+private:
+    SlotArray(SlotArray const&);
+    SlotArray& operator=(SlotArray const&);
+
+    T *_slots;
+};
+
+/**
+ * Value followed by padding up to a cache line.
+ */
+template <class T>
+struct PaddedValue {
+    PaddedValue(T const& val) : _val(val) { }
+
+    T _val;
+    char _padding[MOODYCAMEL_CACHE_LINE_SIZE - sizeof(_val)];
+};
+
+/**
+ * Per-thread input queues of a parser with the round robin index of the
+ * producer, shared by Parser and SerializingParser (see serializing_parser.h).
+ *
+ * Throws a std::invalid_argument exception if the number of threads is 0 or
+ * not a power of 2, or if N is not 0 and the number of threads is not N.
+ */
+template <class input_t, unsigned int N>
+class InputQueues {
+public:
+    InputQueues(const unsigned int num_threads, const unsigned int init_size) :
+        _queues(num_threads),
+        _num_threads(num_threads),
+        _cur_index(0)
+    {
+        // Verify that num_threads is not 0 and is a power of two.
+        // We require that num_threads is a power of two to allow
+        // bitwise modular division.
+        //
+        if (num_threads == 0 || (num_threads & (num_threads - 1)) != 0) {
+            throw std::invalid_argument(
+                "number of threads must be greater than 0 and a power of 2"
+            );
+        }
+        if (N != 0 && num_threads != N) {
+            throw std::invalid_argument(
+                "number of threads must match the compile-time number of threads"
+            );
+        }
+
+        for (unsigned int i = 0; i < num_threads; i++) {
+            _queues[i] = moodycamel::ReaderWriterQueue<input_t>(init_size);
+        }
+    }
+
+    AE_FORCEINLINE unsigned int num_threads() const {
+        return N != 0 ? N : _num_threads;
+    }
+
+    AE_FORCEINLINE moodycamel::ReaderWriterQueue<input_t>& operator[](unsigned int i) {
+        return _queues[i];
+    }
+
+    AE_FORCEINLINE bool push(input_t const& input) {
+        bool success = _queues[_cur_index._val].enqueue(input);
+        if (LIKELY(success)) {
+            // Equivalent to _cur_index._val = (_cur_index._val + 1) % _num_threads;
+            //
+            _cur_index._val = (_cur_index._val + 1) & (num_threads() - 1);
+        }
+        return success;
+    }
+
+    size_t push(span<const input_t> inputs) {
+        size_t count = 0;
+        while (count < inputs.size() && push(inputs[count])) {
+            count++;
+        }
+        return count;
+    }
+
+    size_t size() {
+        size_t global_total = 0;
+        for (unsigned int i = 0; i < num_threads(); i++) {
+            global_total += _queues[i].size_approx();
+        }
+        return global_total;
+    }
+
+private:
+    // No need to worry about false sharing here since 
+    // sizeof(ReaderWriterQueue<T>) = 128, which is larger than
+    // x86-64 cache lines (64 bytes), and each slot is cache 
+    // line aligned
+    //
+    SlotArray<moodycamel::ReaderWriterQueue<input_t>, N> _queues;
+    const unsigned int _num_threads;
+    // Padded to avoid false sharing between the producer's index and the
+    // consumer's state that follows
+    //
+    PaddedValue<unsigned int> _cur_index;
+};
+
+/**
+ * Worker-local ring of inputs dequeued ahead of the input being converted, 
+ * so that their payloads can be prefetched while earlier inputs are 
+ * converted.
+ */
+template <class T>
+class Lookahead {
+public:
+    explicit Lookahead(unsigned int capacity) : 
+        _ring(capacity), 
+        _head(0), 
+        _count(0) { }
+
+    AE_FORCEINLINE bool full() const {
+        return _count == _ring.size();
+    }
+
+    /**
+     * Returns the free slot past the last element. Call Lookahead::push_back() 
+     * once it holds a value.
+     */
+    AE_FORCEINLINE T& back() {
+        return _ring[wrap(_head + _count)];
+    }
+
+    AE_FORCEINLINE void push_back() {
+        _count++;
+    }
+
+    /**
+     * Moves the first element into value. Returns false if the ring is empty.
+     */
+    AE_FORCEINLINE bool pop_front(T& value) {
+        if (_count == 0) {
+            return false;
+        }
+        value = std::move(_ring[_head]);
+        _head = wrap(_head + 1);
+        _count--;
+        return true;
+    }
+
+private:
+    AE_FORCEINLINE size_t wrap(size_t i) const {
+        return i < _ring.size() ? i : i - _ring.size();
+    }
+
+    std::vector<T> _ring;
+    size_t _head, _count;
+};
+
+} // namespace detail
+
 /**
  * Generic parser class for converting data of type input_t to data
  * of type output_t as defined by a given conversion function.
@@ -60,9 +265,18 @@ namespace libilf {
  *     was successfully popped, then call the given conversion function to 
  *     convert it into an output_t. Then, push the newly generated output_t 
  *     onto the thread's per-thread output queue.
+ *
+ * The number of threads is either given at runtime (N = 0, the default) or 
+ * fixed at compile time through N, e.g. Parser<input_t, output_t, 8>. In the 
+ * latter case the round robin wrap-around in Parser::push() and Parser::pop() 
+ * folds to a constant mask, loops over the queues can be unrolled, and the 
+ * queues are held inline in cache line aligned slots instead of being heap 
+ * allocated.
  */
-template <class input_t, class output_t>
+template <class input_t, class output_t, unsigned int N = 0>
 class Parser {
+    static_assert((N & (N - 1)) == 0, "number of threads must be a power of 2");
+
 public:
     /**
      * Constructor for the Parser class.
@@ -71,51 +285,105 @@ public:
      * spawn, and the initial size for each thread's input and output queues.
      *
      * Throws a std::invalid_argument exception if the number of threads is 0 
-     * or not a power of 2.
+     * or not a power of 2, or if N is not 0 and the number of threads is not N.
      *
      * Throws a std::bad_alloc exception if memory allocation fails (e.g., 
      * the initial size is too large).
      */
-    Parser(void (*conversion_function)(input_t const&, output_t&), 
-        const unsigned int num_threads, 
+    Parser(void (*conversion_function)(input_t const&, output_t&),
+        const unsigned int num_threads,
         const unsigned int init_size) :
-        _num_threads(num_threads), 
-        _cur_input_index(0), 
-        _cur_output_index(0),
-        _conversion_function(conversion_function),
-        _threads_active(false) 
-    {
-        // Verify that num_threads is not 0 and is a power of two.
-        // We require that num_threads is a power of two to allow
-        // bitwise modular division.
-        //
-        if (num_threads == 0 || (num_threads & (num_threads - 1)) != 0) {
-            throw std::invalid_argument(
-                "number of threads must be greater than 0 and a power of 2"
-            );
-        }
+        Parser(conversion_function, nullptr, num_threads, init_size, 0) { }
 
-        _threads = new std::thread[num_threads];
-        _input_queues = new moodycamel::ReaderWriterQueue<input_t>[_num_threads];
-        _output_queues = new moodycamel::ReaderWriterQueue<output_t>[_num_threads];
-        for (unsigned int i = 0; i < num_threads; i++) {
-            _input_queues[i] = moodycamel::ReaderWriterQueue<input_t>(init_size);
-            _output_queues[i] = moodycamel::ReaderWriterQueue<output_t>(init_size);
+    /**
+     * Constructor for a Parser with a batch conversion function.
+     *
+     * A batch conversion function converts a span of inputs into a span of
+     * outputs of the same size with a single call, which lets the compiler
+     * vectorize work across records. Each thread dequeues up to batch_size
+     * inputs from its input queue, fewer if the queue runs empty, converts
+     * them together, and pushes the outputs in order onto its output queue,
+     * so elements are still popped in the order they were pushed.
+     *
+     * Throws a std::invalid_argument exception if batch_size is 0, in addition
+     * to the exceptions thrown by the constructor above.
+     */
+    Parser(void (*batch_function)(span<const input_t>, span<output_t>),
+        const unsigned int num_threads,
+        const unsigned int init_size,
+        const unsigned int batch_size) :
+        Parser(nullptr, batch_function, num_threads, init_size, batch_size)
+    {
+        if (batch_size == 0) {
+            throw std::invalid_argument("batch size must be greater than 0");
         }
     }
 
+    /**
+     * Constructor for a Parser with a compile-time number of threads N.
+     *
+     * Calls the first constructor with N threads and the given initial size 
+     * for each thread's input and output queues.
+     */
+    template <unsigned int M = N, class = typename std::enable_if<M != 0>::type>
+    Parser(void (*conversion_function)(input_t const&, output_t&), 
+        const unsigned int init_size) :
+        Parser(conversion_function, N, init_size) { }
+
     /**
      * Constructor for the Parser class.
      *
-     * Calls the constructor above with the number of concurrent threads this 
-     * system supports as well as an initial size of 2^12 for each thread's 
-     * input and output queues.
+     * Calls the first constructor with N threads, or the number of concurrent 
+     * threads this system supports if N is 0, as well as an initial size of 
+     * 2^12 for each thread's input and output queues.
      *
      * Throws a std::invalid_argument exception if std::thread::hardware_concurrency() 
      * fails.
      */
     Parser(void (*conversion_function)(input_t const&, output_t&)) : 
-        Parser(conversion_function, std::thread::hardware_concurrency(), 4096) { } 
+        Parser(conversion_function, N != 0 ? N : std::thread::hardware_concurrency(), 4096) { } 
+
+    /**
+     * Returns the number of threads, which is a compile-time constant when N 
+     * is not 0.
+     */
+    AE_FORCEINLINE unsigned int num_threads() const {
+        return N != 0 ? N : _num_threads;
+    }
+
+    /**
+     * Enables software prefetching. Must be called before the parser is started.
+     *
+     * Each thread dequeues up to distance inputs ahead of the one it converts and 
+     * calls prefetch_function on each of them as soon as it is dequeued. The 
+     * prefetch function should issue PREFETCH() on the heap payloads of the 
+     * input (e.g., the data of its strings) so that they are in cache by the 
+     * time the input is converted. In addition, Parser::pop() prefetches the 
+     * front element of the next output queue in round robin order.
+     *
+     * A distance of 0 disables prefetching.
+     */
+    void set_prefetch_function(void (*prefetch_function)(input_t const&), 
+        const unsigned int distance) {
+        _prefetch_function = prefetch_function;
+        _prefetch_distance = prefetch_function != nullptr ? distance : 0;
+    }
+
+    /**
+     * Sets a function called by every thread with context and the thread's
+     * index: once when the thread starts, after every iteration of its loop,
+     * whether or not it converted anything, and once with stopping set when
+     * it exits. Must be called before the parser is started.
+     *
+     * Between two calls, a thread is within the conversion of its inputs, so
+     * each call is a quiescent point at which it holds no references to
+     * shared data, e.g. for QsbrDomain::parser_hook() (see rcu.h).
+     */
+    void set_iteration_function(void (*iteration_function)(void*, unsigned int, bool),
+        void *context) {
+        _iteration_function = iteration_function;
+        _iteration_context = context;
+    }
 
     /**
      * Attempts to push an element onto the parser.
@@ -123,14 +391,7 @@ public:
      * Returns false if memory allocation fails.
      */
     AE_FORCEINLINE bool push(input_t const& input) {
-        moodycamel::ReaderWriterQueue<input_t>& cur_input_queue = _input_queues[_cur_input_index._val];
-        bool success = cur_input_queue.enqueue(input);
-        if (LIKELY(success)) {
-            // Equivalent to _cur_input_index._val = (_cur_input_index._val + 1) % _num_threads;
-            //
-            _cur_input_index._val = (_cur_input_index._val + 1) & (_num_threads - 1);
-        }
-        return success;
+        return _input_queues.push(input);
     }
 
     /**
@@ -142,11 +403,38 @@ public:
         moodycamel::ReaderWriterQueue<output_t>& cur_output_queue = _output_queues[_cur_output_index._val];
         bool success = cur_output_queue.try_dequeue(output);
         if (success) {
-            _cur_output_index._val = (_cur_output_index._val + 1) & (_num_threads - 1);
+            _cur_output_index._val = (_cur_output_index._val + 1) & (num_threads() - 1);
+            if (_prefetch_distance != 0) {
+                prefetch_output(_cur_output_index._val);
+            }
         }
         return success;
     }
 
+    /**
+     * Attempts to push a span of elements onto the parser, in order.
+     *
+     * Returns the number of elements pushed, which is less than the size of
+     * the span only if memory allocation fails.
+     */
+    size_t push(span<const input_t> inputs) {
+        return _input_queues.push(inputs);
+    }
+
+    /**
+     * Attempts to pop up to outputs.size() elements off the parser, in order.
+     *
+     * Returns the number of elements popped, which is less than the size of
+     * the span if the next output queue in round robin order is empty.
+     */
+    size_t pop(span<output_t> outputs) {
+        size_t count = 0;
+        while (count < outputs.size() && pop(outputs[count])) {
+            count++;
+        }
+        return count;
+    }
+
     /**
      * Returns the number of input elements that are yet to be processed.
      *
@@ -154,12 +442,7 @@ public:
      * would be better to maintain a counter for the size of the input queue.
      */
     size_t input_size() {
-        size_t global_total = 0;
-        for (int i = 0; i < _num_threads; i++) {
-            moodycamel::ReaderWriterQueue<input_t>& cur_input_queue = _input_queues[i];
-            global_total += cur_input_queue.size_approx();
-        }
-        return global_total;
+        return _input_queues.size();
     }
 
     /**
@@ -171,7 +454,7 @@ public:
      */
     size_t output_size() {
         size_t global_total = 0;
-        for (unsigned int i = 0; i < _num_threads; i++) {
+        for (unsigned int i = 0; i < num_threads(); i++) {
             moodycamel::ReaderWriterQueue<output_t>& cur_output_queue = _output_queues[i];
             global_total += cur_output_queue.size_approx();
         }
@@ -184,18 +467,58 @@ public:
      */
     void start() {
         _threads_active = true;
-        for (unsigned int i = 0; i < _num_threads; i++) {
+        for (unsigned int i = 0; i < num_threads(); i++) {
             _threads[i] = std::thread(&Parser::thread_routine, this, i);
         }
     }
 
+    /**
+     * Starts the parser like Parser::start(), but with every thread parked
+     * before it dequeues anything until Parser::release() is called, e.g. so
+     * that the scheduling policy and affinity of the threads are in place
+     * before they take any input. Parser::stop() also stops parked threads.
+     */
+    void start_parked() {
+        _parked.store(true, std::memory_order_release);
+        start();
+    }
+
+    /**
+     * Lets the threads started by Parser::start_parked() run.
+     */
+    void release() {
+        _parked.store(false, std::memory_order_release);
+    }
+
+    /**
+     * Touches every preallocated slot of every empty input and output queue by
+     * filling it with default constructed elements and draining it again, so
+     * that the first elements pushed after the parser starts do not page fault.
+     * Must be called before the parser is started. Queues that already hold
+     * elements are skipped.
+     */
+    void prefault() {
+        for (unsigned int i = 0; i < num_threads(); i++) {
+            prefault_queue(_input_queues[i]);
+            prefault_queue(_output_queues[i]);
+        }
+    }
+
+    /**
+     * Returns the native handle of the given thread, valid while the parser is
+     * started, e.g. for setting its scheduling policy or affinity.
+     */
+    std::thread::native_handle_type thread_handle(unsigned int index) {
+        return _threads[index].native_handle();
+    }
+
     /**
      * Starts the parser for measuring throughput. The difference between this
      * method and Parser::start() is that threads will die when their input queues 
      * are empty.
      */
     void start_wait() {
-        for (unsigned int i = 0; i < _num_threads; i++) {
+        for (unsigned int i = 0; i < num_threads(); i++) {
             _threads[i] = std::thread(&Parser::thread_routine_wait, this, i);
         }
     }
@@ -210,7 +533,7 @@ public:
      */
     void start_sleep(const struct timespec *req) {
         _threads_active = true;
-        for (unsigned int i = 0; i < _num_threads; i++) {
+        for (unsigned int i = 0; i < num_threads(); i++) {
             _threads[i] = std::thread(&Parser::thread_routine_sleep, this, i, req);
         }
     }
@@ -221,7 +544,7 @@ public:
      */
     void stop() {
         _threads_active = false;
-        for (unsigned int i = 0; i < _num_threads; i++) {
+        for (unsigned int i = 0; i < num_threads(); i++) {
             _threads[i].join();
         }
     }
@@ -242,13 +565,141 @@ public:
         stop();
     }
 
-    ~Parser() {
-        delete[] _threads;
-        delete[] _input_queues;
-        delete[] _output_queues;
+private:
+    /**
+     * Common constructor, with exactly one of conversion_function and
+     * batch_function set.
+     */
+    Parser(void (*conversion_function)(input_t const&, output_t&),
+        void (*batch_function)(span<const input_t>, span<output_t>),
+        const unsigned int num_threads,
+        const unsigned int init_size,
+        const unsigned int batch_size) :
+        _threads(num_threads),
+        _input_queues(num_threads, init_size),
+        _output_queues(num_threads),
+        _num_threads(num_threads), 
+        _cur_output_index(0),
+        _conversion_function(conversion_function),
+        _batch_function(batch_function),
+        _batch_size(batch_size),
+        _prefetch_function(nullptr),
+        _prefetch_distance(0),
+        _iteration_function(nullptr),
+        _iteration_context(nullptr),
+        _threads_active(false),
+        _parked(false)
+    {
+        for (unsigned int i = 0; i < num_threads; i++) {
+            _output_queues[i] = moodycamel::ReaderWriterQueue<output_t>(init_size);
+        }
     }
 
-private:
+    /**
+     * State of a thread spawned by the parser: its per-thread queues, its
+     * lookahead ring and, with a batch conversion function, its batches of
+     * inputs and outputs.
+     */
+    class Worker {
+    public:
+        Worker(Parser& parser, int index) :
+            _parser(parser),
+            _index(index),
+            _input_queue(parser._input_queues[index]),
+            _output_queue(parser._output_queues[index]),
+            _lookahead(parser._prefetch_distance),
+            _inputs(parser._batch_size),
+            _outputs(parser._batch_size) { }
+
+        /**
+         * Dequeues and converts the next input, or the next batch of up to
+         * batch size inputs, and pushes the outputs onto the output queue.
+         * A batch is cut short when the input queue runs empty rather than
+         * waiting for it to fill. Returns false if there was no input.
+         *
+         * If dequeue is false, only inputs already dequeued ahead into the
+         * lookahead ring are converted.
+         */
+        AE_FORCEINLINE bool step(bool dequeue = true) {
+            if (_parser._batch_function == nullptr) {
+                if (!next_input(_input, dequeue)) {
+                    return false;
+                }
+                _parser._conversion_function(_input, _output);
+                enqueue(_output);
+                return true;
+            }
+            size_t count = 0;
+            while (count < _inputs.size() && next_input(_inputs[count], dequeue)) {
+                count++;
+            }
+            if (count == 0) {
+                return false;
+            }
+            _parser._batch_function(span<const input_t>(_inputs.data(), count),
+                span<output_t>(_outputs.data(), count));
+            for (size_t i = 0; i < count; i++) {
+                enqueue(_outputs[i]);
+            }
+            return true;
+        }
+
+        /**
+         * Converts the inputs dequeued ahead into the lookahead ring. They are
+         * no longer visible on the input queue, so finish them rather than
+         * dropping them when the thread stops.
+         */
+        void drain() {
+            while (step(false)) { }
+        }
+
+        /**
+         * Calls the parser's iteration function, if any.
+         */
+        AE_FORCEINLINE void iterate(bool stopping = false) {
+            if (_parser._iteration_function != nullptr) {
+                _parser._iteration_function(_parser._iteration_context, _index, stopping);
+            }
+        }
+
+    private:
+        /**
+         * Takes the next input. Without prefetching, this is a plain dequeue
+         * from the input queue. With prefetching, the lookahead ring is first
+         * topped up from the input queue, calling the prefetch function on
+         * every newly dequeued input, and the oldest input in the ring is
+         * returned.
+         */
+        AE_FORCEINLINE bool next_input(input_t& input, bool dequeue) {
+            if (_parser._prefetch_distance == 0) {
+                return dequeue && _input_queue.try_dequeue(input);
+            }
+            while (dequeue && !_lookahead.full() && _input_queue.try_dequeue(_lookahead.back())) {
+                _parser._prefetch_function(_lookahead.back());
+                _lookahead.push_back();
+            }
+            return _lookahead.pop_front(input);
+        }
+
+        AE_FORCEINLINE void enqueue(output_t const& output) {
+            bool success = _output_queue.enqueue(output);
+            if (UNLIKELY(!success)) {
+                std::cerr << "WARNING (template): thread " << std::this_thread::get_id() <<
+                    " failed to push data onto output queue" << std::endl;
+            }
+        }
+
+        Parser& _parser;
+        const unsigned int _index;
+        moodycamel::ReaderWriterQueue<input_t>& _input_queue;
+        moodycamel::ReaderWriterQueue<output_t>& _output_queue;
+        detail::Lookahead<input_t> _lookahead;
+        input_t _input;
+        output_t _output;
+        std::vector<input_t> _inputs;
+        std::vector<output_t> _outputs;
+    };
+
     /**
      * The routine for every thread spawned by the parser in Parser::start(). Every 
      * iteration, each thread attempts to dequeue an element from its per-thread input 
@@ -257,24 +708,18 @@ private:
      * is called.
      */
     void thread_routine(int index) {
-        moodycamel::ReaderWriterQueue<input_t>& my_input_queue = _input_queues[index];
-        moodycamel::ReaderWriterQueue<output_t>& my_output_queue = _output_queues[index];
-        input_t cur_input;
-        output_t cur_output;
-        bool success;
+        while (_parked.load(std::memory_order_acquire) && _threads_active) {
+            std::this_thread::yield();
+        }
+        Worker worker(*this, index);
 
+        worker.iterate();
         while (LIKELY(_threads_active)) {
-            success = my_input_queue.try_dequeue(cur_input);
-            if (!success) {
-                continue;
-            }
-            _conversion_function(cur_input, cur_output);
-            success = my_output_queue.enqueue(cur_output);
-            if (UNLIKELY(!success)) {
-                std::cerr << "WARNING (template): thread " << std::this_thread::get_id() <<
-                    " failed to push data onto output queue" << std::endl;
-            }
+            worker.step();
+            worker.iterate();
         }
+        worker.drain();
+        worker.iterate(true);
     }
 
     /**
@@ -284,24 +729,13 @@ private:
      * until the parser finishes and consuming CPU time.
      */
     void thread_routine_wait(int index) {
-        moodycamel::ReaderWriterQueue<input_t> &my_input_queue = _input_queues[index];
-        moodycamel::ReaderWriterQueue<output_t> &my_output_queue = _output_queues[index];
-        input_t cur_input;
-        output_t cur_output;
-        bool success;
-
-        while (true) {
-            success = my_input_queue.try_dequeue(cur_input);
-            if (!success) {
-                return;
-            }
-            _conversion_function(cur_input, cur_output);
-            success = my_output_queue.enqueue(cur_output);
-            if (UNLIKELY(!success)) {
-                std::cerr << "WARNING (template): thread " << std::this_thread::get_id() <<
-                    " failed to push data onto output queue" << std::endl;
-            }
+        Worker worker(*this, index);
+
+        worker.iterate();
+        while (worker.step()) {
+            worker.iterate();
         }
+        worker.iterate(true);
     }
 
     /**
@@ -309,49 +743,65 @@ private:
      * being that threads sleep when their input queues are empty.
      */
     void thread_routine_sleep(int index, const struct timespec *req) {
-        moodycamel::ReaderWriterQueue<input_t> &my_input_queue = _input_queues[index];
-        moodycamel::ReaderWriterQueue<output_t> &my_output_queue = _output_queues[index];
-        input_t cur_input;
-        output_t cur_output;
-        bool success;
+        Worker worker(*this, index);
 
+        worker.iterate();
         while (LIKELY(_threads_active)) {
-            success = my_input_queue.try_dequeue(cur_input);
-            if (!success) {
+            if (!worker.step()) {
                 nanosleep(req, nullptr);
-                continue;
-            }
-            _conversion_function(cur_input, cur_output);
-            success = my_output_queue.enqueue(cur_output);
-            if (UNLIKELY(!success)) {
-                std::cerr << "WARNING (template): thread " << std::this_thread::get_id() <<
-                    " failed to push data onto output queue" << std::endl;
             }
+            worker.iterate();
         }
+        worker.drain();
+        worker.iterate(true);
     }
 
-    template <class T>
-    struct PaddedValue {
-        PaddedValue(T const& val) : _val(val) { }
+    /**
+     * Called by Parser::pop() with the index of the output queue that will be 
+     * popped next. The header of that queue was prefetched by the previous 
+     * call, so peeking at its front element is cheap. Prefetch that element 
+     * and the header of the queue after it.
+     */
+    AE_FORCEINLINE void prefetch_output(unsigned int index) {
+        output_t *front = _output_queues[index].peek();
+        if (front != nullptr) {
+            PREFETCH(front);
+        }
+        PREFETCH(&_output_queues[(index + 1) & (num_threads() - 1)]);
+    }
 
-        T _val;
-        char _padding[MOODYCAMEL_CACHE_LINE_SIZE - sizeof(_val)];
-    };
+    /**
+     * Fills an empty queue up to its preallocated capacity, which never
+     * allocates, and drains it again.
+     */
+    template <class T>
+    static void prefault_queue(moodycamel::ReaderWriterQueue<T>& queue) {
+        if (queue.peek() != nullptr) {
+            return;
+        }
+        T value = T();
+        while (queue.try_enqueue(value)) { }
+        while (queue.try_dequeue(value)) { }
+    }
 
-    std::thread *_threads;
-    // No need to worry about false sharing here since 
-    // sizeof(ReaderWriterQueue<T>) = 128, which is larger than
-    // x86-64 cache lines (64 bytes)
+    detail::SlotArray<std::thread, N> _threads;
+    // The input queues hold the padded input index; the output index is
+    // padded too to avoid false sharing between calls to Parser::push() and
+    // Parser::pop()
     //
-    moodycamel::ReaderWriterQueue<input_t> *_input_queues;
-    moodycamel::ReaderWriterQueue<output_t> *_output_queues;
+    detail::InputQueues<input_t, N> _input_queues;
+    detail::SlotArray<moodycamel::ReaderWriterQueue<output_t>, N> _output_queues;
     const unsigned int _num_threads;
-    // We pad the input and output indices to avoid false sharing 
-    // between calls to Parser::push() and Parser::pop()
-    //
-    PaddedValue<unsigned int> _cur_input_index, _cur_output_index;
+    detail::PaddedValue<unsigned int> _cur_output_index;
     void (*_conversion_function)(input_t const&, output_t&);
+    void (*_batch_function)(span<const input_t>, span<output_t>);
+    unsigned int _batch_size;
+    void (*_prefetch_function)(input_t const&);
+    unsigned int _prefetch_distance;
+    void (*_iteration_function)(void*, unsigned int, bool);
+    void *_iteration_context;
     bool _threads_active;
+    std::atomic<bool> _parked;
 };
 
 } // namespace libilf
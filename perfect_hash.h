@@ -0,0 +1,254 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <initializer_list>
+#include <stdexcept>
+#include <cstring>
+#include <cstdint>
+
+#include "atomicops.h"
+
+namespace libilf {
+
+static const uint32_t FNV_OFFSET_BASIS = 2166136261u;
+
+namespace detail {
+
+constexpr uint32_t fnv1a(char const* str, size_t len, uint32_t hash) {
+    return len == 0 ? hash :
+        fnv1a(str + 1, len - 1, (hash ^ static_cast<unsigned char>(*str)) * 16777619u);
+}
+
+} // namespace detail
+
+/**
+ * FNV-1a hash of a name, usable in constant expressions, e.g. as case labels:
+ *
+ *     switch (hash_name(key, len)) {
+ *     case hash_name("Image"): ...
+ *
+ * Distinct names may share a hash, so such cases still need to compare the
+ * name itself.
+ */
+constexpr uint32_t hash_name(char const* str, size_t len, uint32_t seed = FNV_OFFSET_BASIS) {
+    return detail::fnv1a(str, len, seed);
+}
+
+template <size_t M>
+constexpr uint32_t hash_name(char const (&str)[M]) {
+    return detail::fnv1a(str, M - 1, FNV_OFFSET_BASIS);
+}
+
+/**
+ * Same hash as hash_name(), as a loop for names only known at runtime.
+ */
+AE_FORCEINLINE uint32_t hash_bytes(char const* str, size_t len, uint32_t seed = FNV_OFFSET_BASIS) {
+    uint32_t hash = seed;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ static_cast<unsigned char>(str[i])) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Collision-free hash table over a fixed list of names, mapping each name to
+ * its position in the list. A lookup costs one hash, one length comparison
+ * and one memcmp, however many names there are.
+ *
+ * The table is built once, when the object is constructed: seeds are tried
+ * until every name hashes to its own slot, doubling the table whenever a
+ * number of seeds in a row all collide. A function-local static PerfectHash
+ * therefore pays this cost once per process.
+ */
+class PerfectHash {
+public:
+    static const int NOT_FOUND = -1;
+
+    PerfectHash(std::initializer_list<char const*> names) {
+        for (char const* name : names) {
+            _names.push_back(name);
+        }
+        build();
+    }
+
+    /**
+     * Throws a std::invalid_argument exception if a name appears twice.
+     */
+    explicit PerfectHash(std::vector<std::string> const& names) : _names(names) {
+        build();
+    }
+
+    /**
+     * Returns the position of a name in the list, or NOT_FOUND.
+     */
+    AE_FORCEINLINE int find(char const* key, size_t len) const {
+        Slot const& slot = _slots[hash_bytes(key, len, _seed) & _mask];
+        if (slot._index == NOT_FOUND || slot._length != len ||
+            memcmp(_names[slot._index].data(), key, len) != 0) {
+            return NOT_FOUND;
+        }
+        return slot._index;
+    }
+
+    AE_FORCEINLINE int find(std::string const& key) const {
+        return find(key.data(), key.size());
+    }
+
+    AE_FORCEINLINE size_t size() const {
+        return _names.size();
+    }
+
+    AE_FORCEINLINE std::string const& name(size_t i) const {
+        return _names[i];
+    }
+
+    /**
+     * Returns the number of slots of the table.
+     */
+    AE_FORCEINLINE size_t capacity() const {
+        return _slots.size();
+    }
+
+private:
+    struct Slot {
+        Slot() : _index(NOT_FOUND), _length(0) { }
+
+        int _index;
+        size_t _length;
+    };
+
+    void build() {
+        for (size_t i = 0; i < _names.size(); i++) {
+            for (size_t j = 0; j < i; j++) {
+                if (_names[i] == _names[j]) {
+                    throw std::invalid_argument("duplicate name " + _names[i]);
+                }
+            }
+        }
+        size_t capacity = 4;
+        while (capacity < 2 * _names.size()) {
+            capacity *= 2;
+        }
+        for (;; capacity *= 2) {
+            _mask = static_cast<uint32_t>(capacity - 1);
+            for (uint32_t attempt = 0; attempt < 256; attempt++) {
+                _seed = hash_bytes(reinterpret_cast<char const*>(&attempt), sizeof(attempt));
+                if (try_seed(capacity)) {
+                    return;
+                }
+            }
+        }
+    }
+
+    bool try_seed(size_t capacity) {
+        _slots.assign(capacity, Slot());
+        for (size_t i = 0; i < _names.size(); i++) {
+            Slot& slot = _slots[hash_bytes(_names[i].data(), _names[i].size(), _seed) & _mask];
+            if (slot._index != NOT_FOUND) {
+                return false;
+            }
+            slot._index = static_cast<int>(i);
+            slot._length = _names[i].size();
+        }
+        return true;
+    }
+
+    std::vector<std::string> _names;
+    std::vector<Slot> _slots;
+    uint32_t _seed, _mask;
+};
+
+/**
+ * Fixed map from names to values over a PerfectHash, e.g. from source field
+ * names to ILF keys or schema slots:
+ *
+ *     static const NameMap<int> slots({{"Image", 0}, {"CommandLine", 1}});
+ *     int const* slot = slots.find(key, len);
+ */
+template <class value_t>
+class NameMap {
+public:
+    NameMap(std::initializer_list<std::pair<char const*, value_t>> entries) :
+        _hash(names(entries))
+    {
+        for (auto const& entry : entries) {
+            _values.push_back(entry.second);
+        }
+    }
+
+    /**
+     * Returns the value of a name, or nullptr if the name is not in the map.
+     */
+    AE_FORCEINLINE value_t const* find(char const* key, size_t len) const {
+        int index = _hash.find(key, len);
+        return index == PerfectHash::NOT_FOUND ? nullptr : &_values[index];
+    }
+
+    AE_FORCEINLINE value_t const* find(std::string const& key) const {
+        return find(key.data(), key.size());
+    }
+
+    AE_FORCEINLINE size_t size() const {
+        return _values.size();
+    }
+
+private:
+    static std::vector<std::string> names(std::initializer_list<std::pair<char const*, value_t>> entries) {
+        std::vector<std::string> result;
+        for (auto const& entry : entries) {
+            result.push_back(entry.first);
+        }
+        return result;
+    }
+
+    PerfectHash _hash;
+    std::vector<value_t> _values;
+};
+
+/**
+ * Fixed set of ILF event types, giving each a dense ID (its position in the
+ * list) so that conversion functions can carry IDs around and only look up
+ * the event type name, without allocating, when writing the record.
+ */
+class EventTypes {
+public:
+    EventTypes(std::initializer_list<char const*> names) : _hash(names) { }
+
+    /**
+     * Returns the ID of an event type name, or PerfectHash::NOT_FOUND.
+     */
+    AE_FORCEINLINE int id(char const* name, size_t len) const {
+        return _hash.find(name, len);
+    }
+
+    AE_FORCEINLINE int id(std::string const& name) const {
+        return _hash.find(name);
+    }
+
+    AE_FORCEINLINE std::string const& name(int id) const {
+        return _hash.name(id);
+    }
+
+    AE_FORCEINLINE size_t size() const {
+        return _hash.size();
+    }
+
+private:
+    PerfectHash _hash;
+};
+
+} // namespace libilf
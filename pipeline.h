@@ -0,0 +1,605 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <exception>
+#include <stdexcept>
+#include <system_error>
+#include <cerrno>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "parser.h"
+#include "span.h"
+#include "ilf.h"
+
+namespace libilf {
+
+/**
+ * Producer side of a Pipeline: reads inputs in bulk.
+ */
+template <class input_t>
+class Source {
+public:
+    virtual ~Source() { }
+
+    /**
+     * Reads up to inputs.size() inputs into inputs and returns the number read.
+     * May block until at least one input is available. Returns 0 only at the
+     * end of the stream.
+     *
+     * Errors are reported by throwing an exception, which the Pipeline
+     * rethrows from Pipeline::wait().
+     */
+    virtual size_t read(span<input_t> inputs) = 0;
+
+    /**
+     * Asks a read() blocked in another thread to return as soon as possible.
+     * Called by the Pipeline when it stops early, since a source that waits
+     * for its inputs to be consumed would otherwise wait forever.
+     */
+    virtual void cancel() { }
+
+    /**
+     * Releases the underlying resource. Called once by the Pipeline after the
+     * producer finishes.
+     */
+    virtual void close() { }
+};
+
+/**
+ * Consumer side of a Pipeline: writes outputs in bulk.
+ */
+template <class output_t>
+class Sink {
+public:
+    virtual ~Sink() { }
+
+    /**
+     * Writes outputs, which are in the order their inputs were read. Errors
+     * are reported by throwing an exception.
+     */
+    virtual void write(span<const output_t> outputs) = 0;
+
+    /**
+     * Writes outputs that the sink may modify, e.g. to add to them in place
+     * rather than copy them. The Pipeline writes through this method, since
+     * it no longer needs its outputs afterwards. Defaults to Sink::write().
+     */
+    virtual void write_mutable(span<output_t> outputs) {
+        write(span<const output_t>(outputs.data(), outputs.size()));
+    }
+
+    /**
+     * Writes out anything buffered. Called by the Pipeline whenever no output
+     * is ready, so that buffered output does not wait for the next batch.
+     */
+    virtual void flush() { }
+
+    /**
+     * Flushes and releases the underlying resource. Called once by the
+     * Pipeline after the consumer finishes.
+     */
+    virtual void close() {
+        flush();
+    }
+};
+
+/**
+ * Wait strategy of the producer and consumer threads of a Pipeline when there
+ * is nothing to do: spin briefly with a pause instruction, then yield, then
+ * sleep for exponentially longer intervals up to a maximum, so that an idle
+ * pipeline does not burn a core while a busy one never sleeps.
+ */
+class Backoff {
+public:
+    explicit Backoff(std::chrono::microseconds max_sleep = std::chrono::microseconds(1000)) :
+        _max_sleep(max_sleep),
+        _iteration(0) { }
+
+    void wait() {
+        if (_iteration < SPIN_ITERATIONS) {
+#if defined(__SSE2__)
+            _mm_pause();
+#endif
+        } else if (_iteration < SPIN_ITERATIONS + YIELD_ITERATIONS) {
+            std::this_thread::yield();
+        } else {
+            unsigned int shift = _iteration - SPIN_ITERATIONS - YIELD_ITERATIONS;
+            std::chrono::microseconds sleep(shift < 10 ? (1 << shift) : _max_sleep.count());
+            std::this_thread::sleep_for(sleep < _max_sleep ? sleep : _max_sleep);
+        }
+        _iteration++;
+    }
+
+    AE_FORCEINLINE void reset() {
+        _iteration = 0;
+    }
+
+    AE_FORCEINLINE bool idle() const {
+        return _iteration > 0;
+    }
+
+private:
+    static const unsigned int SPIN_ITERATIONS = 64, YIELD_ITERATIONS = 16;
+
+    std::chrono::microseconds _max_sleep;
+    unsigned int _iteration;
+};
+
+/**
+ * Runtime driving a Parser between a Source and a Sink.
+ *
+ * A Pipeline owns a producer thread, which reads batches from the source and
+ * pushes them onto the parser, and a consumer thread, which pops batches off
+ * the parser and writes them to the sink. Both back off with a Backoff when
+ * there is nothing to do. Translators then only supply a source, a conversion
+ * function and a sink:
+ *
+ *     libilf::Parser<Data, libilf::ILF> parser(data_to_ilf, 4, 4096);
+ *     libilf::Pipeline<Data, libilf::ILF> pipeline(parser, source, sink);
+ *     pipeline.run();
+ *
+ * End of stream is reached when the source returns 0. The consumer then
+ * writes every output still in flight, the parser is stopped, and the source
+ * and sink are closed. If the source, the sink or the push of an input throws,
+ * both threads stop early and Pipeline::wait() rethrows the first exception.
+ */
+template <class input_t, class output_t, unsigned int N = 0>
+class Pipeline {
+public:
+    /**
+     * Constructor for the Pipeline class. The parser, source and sink must
+     * outlive the pipeline and the parser must not be started.
+     *
+     * Throws a std::invalid_argument exception if batch_size is 0.
+     */
+    Pipeline(Parser<input_t, output_t, N>& parser,
+        Source<input_t>& source,
+        Sink<output_t>& sink,
+        const size_t batch_size = 256) :
+        _parser(parser),
+        _source(source),
+        _sink(sink),
+        _batch_size(batch_size),
+        _pushed(0),
+        _end_of_stream(false),
+        _failed(false),
+        _parked(false),
+        _running(false)
+    {
+        if (batch_size == 0) {
+            throw std::invalid_argument("batch size must be greater than 0");
+        }
+    }
+
+    ~Pipeline() {
+        if (_running) {
+            cancel();
+            try {
+                wait();
+            } catch (...) { }
+        }
+    }
+
+    /**
+     * Starts the parser and the producer and consumer threads.
+     */
+    void start() {
+        _running = true;
+        _parser.start();
+        _producer = std::thread(&Pipeline::producer_routine, this);
+        _consumer = std::thread(&Pipeline::consumer_routine, this);
+    }
+
+    /**
+     * Starts the pipeline like Pipeline::start(), but with the parser's,
+     * producer's and consumer's threads parked before they touch any data
+     * until Pipeline::release() is called. Pipeline::cancel() followed by
+     * Pipeline::wait() also stops parked threads.
+     */
+    void start_parked() {
+        _running = true;
+        _parked.store(true, std::memory_order_release);
+        _parser.start_parked();
+        _producer = std::thread(&Pipeline::producer_routine, this);
+        _consumer = std::thread(&Pipeline::consumer_routine, this);
+    }
+
+    /**
+     * Lets the threads started by Pipeline::start_parked() run.
+     */
+    void release() {
+        _parser.release();
+        _parked.store(false, std::memory_order_release);
+    }
+
+    /**
+     * Waits until the whole stream is written, or until an error or a call to
+     * Pipeline::cancel() stops the pipeline. Stops the parser, closes the
+     * source and the sink, and rethrows the first exception thrown by any of
+     * them.
+     */
+    void wait() {
+        _producer.join();
+        _consumer.join();
+        _parser.stop();
+        _running = false;
+        try {
+            _source.close();
+        } catch (...) {
+            fail(std::current_exception());
+        }
+        try {
+            _sink.close();
+        } catch (...) {
+            fail(std::current_exception());
+        }
+        if (_error) {
+            std::exception_ptr error = _error;
+            _error = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+
+    /**
+     * Equivalent to Pipeline::start() followed by Pipeline::wait().
+     */
+    void run() {
+        start();
+        wait();
+    }
+
+    /**
+     * Stops reading from the source and writing to the sink as soon as
+     * possible. Outputs still in flight are dropped.
+     */
+    void cancel() {
+        _failed.store(true, std::memory_order_release);
+        _source.cancel();
+    }
+
+    /**
+     * Native handles of the producer and consumer threads, valid between
+     * Pipeline::start() and Pipeline::wait(), e.g. for setting their
+     * scheduling policy or affinity.
+     */
+    std::thread::native_handle_type producer_handle() {
+        return _producer.native_handle();
+    }
+
+    std::thread::native_handle_type consumer_handle() {
+        return _consumer.native_handle();
+    }
+
+    Parser<input_t, output_t, N>& parser() {
+        return _parser;
+    }
+
+private:
+    /**
+     * Waits while the pipeline is parked, unless it is stopped.
+     */
+    void unpark() {
+        while (_parked.load(std::memory_order_acquire) && !_failed.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+    }
+
+    void producer_routine() {
+        unpark();
+        std::vector<input_t> batch(_batch_size);
+        Backoff backoff;
+        size_t total = 0;
+
+        try {
+            while (LIKELY(!_failed.load(std::memory_order_relaxed))) {
+                size_t count = _source.read(span<input_t>(batch));
+                if (count == 0) {
+                    break;
+                }
+                size_t pushed = 0;
+                while ((pushed += _parser.push(span<const input_t>(batch.data() + pushed, count - pushed))) < count) {
+                    // Only fails if memory allocation fails, in which case
+                    // the consumer must first drain some outputs
+                    //
+                    if (_failed.load(std::memory_order_relaxed)) {
+                        return;
+                    }
+                    backoff.wait();
+                }
+                backoff.reset();
+                total += count;
+                _pushed.store(total, std::memory_order_release);
+            }
+        } catch (...) {
+            fail(std::current_exception());
+        }
+        _end_of_stream.store(true, std::memory_order_release);
+    }
+
+    void consumer_routine() {
+        unpark();
+        std::vector<output_t> batch(_batch_size);
+        Backoff backoff;
+        size_t total = 0;
+
+        try {
+            while (LIKELY(!_failed.load(std::memory_order_relaxed))) {
+                size_t count = _parser.pop(span<output_t>(batch));
+                if (count != 0) {
+                    _sink.write_mutable(span<output_t>(batch.data(), count));
+                    total += count;
+                    backoff.reset();
+                    continue;
+                }
+                // Read the end of stream flag before the number of inputs,
+                // which is final once the flag is set
+                //
+                if (_end_of_stream.load(std::memory_order_acquire) &&
+                    total == _pushed.load(std::memory_order_acquire)) {
+                    break;
+                }
+                if (!backoff.idle()) {
+                    _sink.flush();
+                }
+                backoff.wait();
+            }
+        } catch (...) {
+            fail(std::current_exception());
+        }
+    }
+
+    void fail(std::exception_ptr error) {
+        {
+            std::lock_guard<std::mutex> lock(_error_mutex);
+            if (!_error) {
+                _error = error;
+            }
+        }
+        _failed.store(true, std::memory_order_release);
+        _source.cancel();
+    }
+
+    Parser<input_t, output_t, N>& _parser;
+    Source<input_t>& _source;
+    Sink<output_t>& _sink;
+    const size_t _batch_size;
+    std::thread _producer, _consumer;
+    std::atomic<size_t> _pushed;
+    std::atomic<bool> _end_of_stream, _failed, _parked;
+    std::mutex _error_mutex;
+    std::exception_ptr _error;
+    bool _running;
+};
+
+/**
+ * Default output format of the sinks below: one output per line, written with
+ * operator<<(std::ostream&, output_t const&).
+ */
+template <class output_t>
+struct LineFormat {
+    void operator()(output_t const& output, std::string& out) {
+        _stream.str(std::string());
+        _stream << output;
+        out += _stream.str();
+        out += '\n';
+    }
+
+    std::ostringstream _stream;
+};
+
+template <>
+struct LineFormat<std::string> {
+    void operator()(std::string const& output, std::string& out) {
+        out += output;
+        out += '\n';
+    }
+};
+
+/**
+ * Source of lines read from a std::istream, without their line terminators.
+ */
+class StreamSource : public Source<std::string> {
+public:
+    explicit StreamSource(std::istream& stream) : _stream(stream) { }
+
+    size_t read(span<std::string> lines) override {
+        size_t count = 0;
+        while (count < lines.size() && std::getline(_stream, lines[count])) {
+            count++;
+        }
+        if (_stream.bad()) {
+            throw std::runtime_error("failed to read from input stream");
+        }
+        return count;
+    }
+
+private:
+    std::istream& _stream;
+};
+
+/**
+ * Source reading from a vector of inputs, e.g. for replaying recorded inputs.
+ */
+template <class input_t>
+class VectorSource : public Source<input_t> {
+public:
+    explicit VectorSource(std::vector<input_t> const& inputs) :
+        _inputs(inputs),
+        _next(0) { }
+
+    size_t read(span<input_t> inputs) override {
+        size_t count = 0;
+        while (count < inputs.size() && _next < _inputs.size()) {
+            inputs[count++] = _inputs[_next++];
+        }
+        return count;
+    }
+
+private:
+    std::vector<input_t> const& _inputs;
+    size_t _next;
+};
+
+/**
+ * Sink appending outputs to a vector.
+ */
+template <class output_t>
+class VectorSink : public Sink<output_t> {
+public:
+    explicit VectorSink(std::vector<output_t>& outputs) : _outputs(outputs) { }
+
+    void write(span<const output_t> outputs) override {
+        _outputs.insert(_outputs.end(), outputs.begin(), outputs.end());
+    }
+
+private:
+    std::vector<output_t>& _outputs;
+};
+
+/**
+ * Sink formatting outputs into a buffer with format_t and writing the buffer
+ * to a std::ostream, such as a std::ofstream, once it holds buffer_size bytes.
+ */
+template <class output_t, class format_t = LineFormat<output_t> >
+class StreamSink : public Sink<output_t> {
+public:
+    StreamSink(std::ostream& stream,
+        format_t format = format_t(),
+        const size_t buffer_size = 1 << 16) :
+        _stream(stream),
+        _format(std::move(format)),
+        _buffer_size(buffer_size)
+    {
+        _buffer.reserve(buffer_size * 2);
+    }
+
+    void write(span<const output_t> outputs) override {
+        for (size_t i = 0; i < outputs.size(); i++) {
+            _format(outputs[i], _buffer);
+            if (_buffer.size() >= _buffer_size) {
+                write_buffer();
+            }
+        }
+    }
+
+    void flush() override {
+        write_buffer();
+        _stream.flush();
+        if (!_stream) {
+            throw std::runtime_error("failed to write to output stream");
+        }
+    }
+
+private:
+    void write_buffer() {
+        _stream.write(_buffer.data(), _buffer.size());
+        _buffer.clear();
+    }
+
+    std::ostream& _stream;
+    format_t _format;
+    const size_t _buffer_size;
+    std::string _buffer;
+};
+
+/**
+ * Sink formatting outputs into a buffer with format_t and writing the buffer
+ * to a file descriptor, such as a connected socket or a pipe, with write(2)
+ * once it holds buffer_size bytes.
+ *
+ * If owns_fd is set, the file descriptor is closed by FdSink::close().
+ * Write errors throw a std::system_error exception.
+ */
+template <class output_t, class format_t = LineFormat<output_t> >
+class FdSink : public Sink<output_t> {
+public:
+    FdSink(int fd,
+        bool owns_fd = false,
+        format_t format = format_t(),
+        const size_t buffer_size = 1 << 16) :
+        _fd(fd),
+        _owns_fd(owns_fd),
+        _format(std::move(format)),
+        _buffer_size(buffer_size)
+    {
+        _buffer.reserve(buffer_size * 2);
+    }
+
+    void write(span<const output_t> outputs) override {
+        for (size_t i = 0; i < outputs.size(); i++) {
+            _format(outputs[i], _buffer);
+            if (_buffer.size() >= _buffer_size) {
+                flush();
+            }
+        }
+    }
+
+    void flush() override {
+        size_t written = 0;
+        while (written < _buffer.size()) {
+            ssize_t count = ::write(_fd, _buffer.data() + written, _buffer.size() - written);
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::system_category(), "write");
+            }
+            written += count;
+        }
+        _buffer.clear();
+    }
+
+    /**
+     * Flushes the buffer and closes an owned descriptor, which is closed even
+     * if the flush fails.
+     */
+    void close() override {
+        try {
+            flush();
+        } catch (...) {
+            close_fd();
+            throw;
+        }
+        close_fd();
+    }
+
+private:
+    void close_fd() {
+        if (_owns_fd && _fd >= 0) {
+            ::close(_fd);
+            _fd = -1;
+        }
+    }
+
+    int _fd;
+    bool _owns_fd;
+    format_t _format;
+    const size_t _buffer_size;
+    std::string _buffer;
+};
+
+} // namespace libilf
@@ -0,0 +1,281 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <new>
+#include <stdexcept>
+#include <cstdint>
+#include <cstdlib>
+
+#include "atomicops.h"
+
+namespace libilf {
+
+/**
+ * Quiescent-state-based reclamation (QSBR) domain shared by a fixed set of
+ * readers, such as the threads of a Parser.
+ *
+ * Readers announce quiescent points, at which they hold no references to
+ * shared versions, by copying a global epoch into their own slot: one load
+ * and one store, with no atomic read-modify-write and no shared cache line
+ * written. Updaters advance the epoch after unpublishing a version and may
+ * reclaim it once every online reader has announced that epoch or a later one.
+ *
+ * A reader is offline until its first quiescent point and after
+ * QsbrDomain::offline(), and offline readers do not hold reclamation back. A
+ * reader must therefore announce a quiescent point before its first read.
+ * Coming back online takes a full fence (see QsbrDomain::online()), so only
+ * quiescent points of online readers are a plain load and store.
+ *
+ * Each reader index is used by at most one thread at a time.
+ */
+class QsbrDomain {
+public:
+    /**
+     * Throws a std::invalid_argument exception if the number of readers is 0.
+     */
+    explicit QsbrDomain(unsigned int num_readers) :
+        _epoch(1),
+        _readers(nullptr),
+        _num_readers(num_readers)
+    {
+        if (num_readers == 0) {
+            throw std::invalid_argument("number of readers must be greater than 0");
+        }
+        // Readers on their own cache lines, which operator new does not
+        // guarantee before C++17
+        //
+        void *memory;
+        if (posix_memalign(&memory, alignof(Reader), num_readers * sizeof(Reader)) != 0) {
+            throw std::bad_alloc();
+        }
+        _readers = static_cast<Reader*>(memory);
+        for (unsigned int i = 0; i < num_readers; i++) {
+            new (&_readers[i]) Reader();
+        }
+    }
+
+    ~QsbrDomain() {
+        free(_readers);
+    }
+
+    QsbrDomain(QsbrDomain const&) = delete;
+    QsbrDomain& operator=(QsbrDomain const&) = delete;
+
+    AE_FORCEINLINE unsigned int num_readers() const {
+        return _num_readers;
+    }
+
+    /**
+     * Announces that a reader holds no references to shared versions, and
+     * brings it online with QsbrDomain::online() if it was offline.
+     */
+    AE_FORCEINLINE void quiescent(unsigned int reader) {
+        std::atomic<uint64_t>& seen = _readers[reader]._epoch;
+        if (seen.load(std::memory_order_relaxed) == 0) {
+            online(reader);
+            return;
+        }
+        seen.store(_epoch.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    /**
+     * Brings a reader online. The store of its epoch is followed by a full
+     * fence, so that it is visible to updaters before the reader loads any
+     * version: with a release store alone, the load could be ordered first,
+     * and an updater that still sees the reader offline could reclaim the
+     * version it loaded.
+     */
+    void online(unsigned int reader) {
+        _readers[reader]._epoch.store(_epoch.load(std::memory_order_acquire), std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    /**
+     * Takes a reader offline, e.g. before it blocks or exits.
+     */
+    AE_FORCEINLINE void offline(unsigned int reader) {
+        _readers[reader]._epoch.store(0, std::memory_order_release);
+    }
+
+    /**
+     * Iteration function for Parser::set_iteration_function() with a
+     * QsbrDomain as context and one reader per thread of the parser.
+     */
+    static void parser_hook(void *domain, unsigned int index, bool stopping) {
+        QsbrDomain *self = static_cast<QsbrDomain*>(domain);
+        if (stopping) {
+            self->offline(index);
+        } else {
+            self->quiescent(index);
+        }
+    }
+
+    /**
+     * Advances the global epoch and returns it. Versions unpublished before
+     * the call may be reclaimed once QsbrDomain::passed() holds for it.
+     */
+    uint64_t advance() {
+        return _epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+    }
+
+    /**
+     * Returns whether every online reader has announced epoch or a later one.
+     */
+    bool passed(uint64_t epoch) const {
+        // Pairs with the fence of QsbrDomain::online()
+        //
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        for (size_t i = 0; i < _num_readers; i++) {
+            const uint64_t seen = _readers[i]._epoch.load(std::memory_order_acquire);
+            if (seen != 0 && seen < epoch) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Blocks until every reader has passed a quiescent point, or gone
+     * offline, since the call. Must not be called by an online reader.
+     */
+    void synchronize() {
+        const uint64_t epoch = advance();
+        while (!passed(epoch)) {
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    struct alignas(MOODYCAMEL_CACHE_LINE_SIZE) Reader {
+        Reader() : _epoch(0) { }
+
+        std::atomic<uint64_t> _epoch;
+    };
+
+    std::atomic<uint64_t> _epoch;
+    char _padding[MOODYCAMEL_CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)];
+    Reader *_readers;
+    const unsigned int _num_readers;
+};
+
+/**
+ * Holder of the current version of a read-mostly object, such as a lookup
+ * table, that can be replaced while readers of a QsbrDomain use it.
+ *
+ * Readers get the current version with RcuTable::read(), a single
+ * pointer-sized load, and may use it until their next quiescent point.
+ * Versions are immutable once published. RcuTable::publish() swaps in a new
+ * version and retires the old one, which is deleted by a later
+ * RcuTable::publish() or RcuTable::reclaim() once all readers have passed a
+ * quiescent point, so updaters never wait for readers.
+ *
+ * Updaters are serialized by a mutex and may run on any thread that is not
+ * an online reader of the domain.
+ */
+template <class T>
+class RcuTable {
+public:
+    /**
+     * Takes ownership of the initial version, which may be null.
+     */
+    RcuTable(QsbrDomain& domain, std::unique_ptr<T const> initial) :
+        _domain(domain),
+        _current(initial.release()) { }
+
+    RcuTable(RcuTable const&) = delete;
+    RcuTable& operator=(RcuTable const&) = delete;
+
+    /**
+     * Deletes the current and all retired versions. There must be no
+     * remaining readers.
+     */
+    ~RcuTable() {
+        delete _current.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < _retired.size(); i++) {
+            delete _retired[i]._version;
+        }
+    }
+
+    /**
+     * Returns the current version, valid until the reader's next quiescent
+     * point.
+     */
+    AE_FORCEINLINE T const* read() const {
+        return _current.load(std::memory_order_acquire);
+    }
+
+    /**
+     * Makes next the current version, retires the previous one, and reclaims
+     * retired versions that no reader can still use.
+     */
+    void publish(std::unique_ptr<T const> next) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        T const* previous = _current.exchange(next.release(), std::memory_order_seq_cst);
+        if (previous != nullptr) {
+            _retired.push_back(Retired(previous, _domain.advance()));
+        }
+        reclaim_locked();
+    }
+
+    /**
+     * Deletes retired versions that no reader can still use and returns the
+     * number of versions left retired.
+     */
+    size_t reclaim() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return reclaim_locked();
+    }
+
+    /**
+     * Waits for all readers to pass a quiescent point and deletes all retired
+     * versions. Must not be called by an online reader.
+     */
+    void barrier() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _domain.synchronize();
+        reclaim_locked();
+    }
+
+private:
+    struct Retired {
+        Retired(T const* version, uint64_t epoch) : _version(version), _epoch(epoch) { }
+
+        T const* _version;
+        uint64_t _epoch;
+    };
+
+    size_t reclaim_locked() {
+        // Retired in increasing epochs, so the oldest are reclaimed first
+        //
+        size_t count = 0;
+        while (count < _retired.size() && _domain.passed(_retired[count]._epoch)) {
+            delete _retired[count]._version;
+            count++;
+        }
+        _retired.erase(_retired.begin(), _retired.begin() + count);
+        return _retired.size();
+    }
+
+    QsbrDomain& _domain;
+    std::atomic<T const*> _current;
+    std::vector<Retired> _retired;
+    std::mutex _mutex;
+};
+
+} // namespace libilf
@@ -0,0 +1,129 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstring>
+
+#include "atomicops.h"
+#include "ilf.h"
+
+namespace libilf {
+
+namespace detail {
+
+AE_FORCEINLINE char const* find_char(char const* p, char const* end, char c) {
+    char const* found = static_cast<char const*>(memchr(p, c, end - p));
+    return found != nullptr ? found : end;
+}
+
+/**
+ * Finds the first of two characters, or end.
+ */
+AE_FORCEINLINE char const* find_either(char const* p, char const* end, char a, char b) {
+    while (p < end && *p != a && *p != b) {
+        p++;
+    }
+    return p;
+}
+
+} // namespace detail
+
+/**
+ * Parses one line of ILF text, as printed by operator<<(std::ostream&,
+ * ILF const&) and written by ILFWriter, into ilf:
+ *
+ *     event_t[sender,receiver,time,(key=value;key="value")]
+ *
+ * Like the writers, the reader knows no escaping: quoted values end at the
+ * next double quote, unquoted values at the next ; or ), and the sender,
+ * receiver and time at the next comma. Trailing whitespace, such as the
+ * space appended by operator<<(std::string&, ILF const&) or a carriage
+ * return, is ignored.
+ *
+ * The strings and pairs of ilf are assigned rather than replaced, so an ILF
+ * reused across lines stops allocating once its capacity suffices. Returns
+ * false if the line is malformed, in which case ilf holds what was parsed.
+ */
+inline bool parse_ilf(char const* data, size_t len, ILF& ilf) {
+    char const* p = data, *end = data + len;
+    while (end > p && (end[-1] == ' ' || end[-1] == '\r' || end[-1] == '\n' || end[-1] == '\t')) {
+        end--;
+    }
+    if (end - p < 2 || end[-1] != ']') {
+        return false;
+    }
+    end--;
+    char const* q = detail::find_char(p, end, '[');
+    if (q == end) {
+        return false;
+    }
+    ilf._event_t.assign(p, q);
+    std::string* fields[3] = {&ilf._sender, &ilf._receiver, &ilf._time};
+    p = q + 1;
+    for (int i = 0; i < 3; i++) {
+        q = detail::find_char(p, end, ',');
+        if (q == end) {
+            return false;
+        }
+        fields[i]->assign(p, q);
+        p = q + 1;
+    }
+    if (p == end || *p != '(' || end[-1] != ')') {
+        return false;
+    }
+    p++;
+    end--;
+    size_t count = 0;
+    while (p < end) {
+        q = detail::find_char(p, end, '=');
+        if (q == end) {
+            return false;
+        }
+        if (count == ilf._pairs.size()) {
+            ilf._pairs.push_back(KeyValue());
+        }
+        KeyValue& pair = ilf._pairs[count++];
+        pair._key.assign(p, q);
+        p = q + 1;
+        if (p < end && *p == '"') {
+            q = detail::find_char(p + 1, end, '"');
+            if (q == end) {
+                return false;
+            }
+            pair._value.assign(p + 1, q);
+            pair._has_quotes = true;
+            p = q + 1;
+        } else {
+            q = detail::find_either(p, end, ';', ')');
+            pair._value.assign(p, q);
+            pair._has_quotes = false;
+            p = q;
+        }
+        if (p < end) {
+            if (*p != ';') {
+                return false;
+            }
+            p++;
+        }
+    }
+    ilf._pairs.resize(count);
+    return true;
+}
+
+AE_FORCEINLINE bool parse_ilf(std::string const& line, ILF& ilf) {
+    return parse_ilf(line.data(), line.size(), ilf);
+}
+
+} // namespace libilf
@@ -0,0 +1,282 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cassert>
+#include <new>
+#include <utility>
+#include <type_traits>
+
+#include "atomicops.h"
+
+namespace libilf {
+
+namespace detail {
+
+/**
+ * Index of type T in the list Ts. Fails to compile if T is not in Ts.
+ */
+template <class T, class... Ts>
+struct IndexOf;
+
+template <class T, class... Ts>
+struct IndexOf<T, T, Ts...> : std::integral_constant<size_t, 0> { };
+
+template <class T, class U, class... Ts>
+struct IndexOf<T, U, Ts...> : std::integral_constant<size_t, 1 + IndexOf<T, Ts...>::value> { };
+
+/**
+ * Whether type T is in the list Ts.
+ */
+template <class T, class... Ts>
+struct Contains : std::false_type { };
+
+template <class T, class U, class... Ts>
+struct Contains<T, U, Ts...> : std::integral_constant<bool,
+    std::is_same<T, U>::value || Contains<T, Ts...>::value> { };
+
+} // namespace detail
+
+/**
+ * Compact tagged union of the record types Ts, for use as the input_t of a
+ * Parser translating several record types at once.
+ *
+ * A Record holds at most one value of one of the types Ts in place, next to a
+ * one byte tag giving the index of its type in Ts. An empty Record has the tag
+ * Record::EMPTY.
+ */
+template <class... Ts>
+class Record {
+    static_assert(sizeof...(Ts) > 0 && sizeof...(Ts) < 255,
+        "a record must have between 1 and 254 types");
+
+public:
+    typedef uint8_t tag_t;
+
+    static const tag_t EMPTY = sizeof...(Ts);
+
+    /**
+     * Returns the tag of type T, which is its index in Ts.
+     */
+    template <class T>
+    static constexpr tag_t tag_of() {
+        return static_cast<tag_t>(detail::IndexOf<T, Ts...>::value);
+    }
+
+    Record() : _tag(EMPTY) { }
+
+    template <class T, class U = typename std::decay<T>::type,
+        class = typename std::enable_if<detail::Contains<U, Ts...>::value>::type>
+    Record(T&& value) : _tag(tag_of<U>()) {
+        new (&_storage) U(std::forward<T>(value));
+    }
+
+    Record(Record const& other) : _tag(EMPTY) {
+        copy_from(other);
+    }
+
+    Record(Record&& other) : _tag(EMPTY) {
+        move_from(other);
+    }
+
+    Record& operator=(Record const& other) {
+        if (this != &other) {
+            reset();
+            copy_from(other);
+        }
+        return *this;
+    }
+
+    Record& operator=(Record&& other) {
+        if (this != &other) {
+            reset();
+            move_from(other);
+        }
+        return *this;
+    }
+
+    ~Record() {
+        reset();
+    }
+
+    AE_FORCEINLINE tag_t tag() const {
+        return _tag;
+    }
+
+    template <class T>
+    AE_FORCEINLINE bool holds() const {
+        return _tag == tag_of<T>();
+    }
+
+    /**
+     * Returns the held value. The record must hold a value of type T.
+     */
+    template <class T>
+    AE_FORCEINLINE T const& get() const {
+        assert(holds<T>());
+        return *reinterpret_cast<T const*>(&_storage);
+    }
+
+    template <class T>
+    AE_FORCEINLINE T& get() {
+        assert(holds<T>());
+        return *reinterpret_cast<T*>(&_storage);
+    }
+
+    /**
+     * Returns a pointer to the held value, or to uninitialized storage if the
+     * record is empty.
+     */
+    AE_FORCEINLINE void const* data() const {
+        return &_storage;
+    }
+
+    /**
+     * Destroys the held value, if any, leaving the record empty.
+     */
+    void reset() {
+        if (_tag != EMPTY) {
+            static void (* const destroy[])(void*) = { &destroy_as<Ts>... };
+            destroy[_tag](&_storage);
+            _tag = EMPTY;
+        }
+    }
+
+private:
+    template <class T>
+    static void destroy_as(void *p) {
+        static_cast<T*>(p)->~T();
+    }
+
+    template <class T>
+    static void copy_as(void *dst, void const* src) {
+        new (dst) T(*static_cast<T const*>(src));
+    }
+
+    template <class T>
+    static void move_as(void *dst, void *src) {
+        new (dst) T(std::move(*static_cast<T*>(src)));
+    }
+
+    void copy_from(Record const& other) {
+        if (other._tag != EMPTY) {
+            static void (* const copy[])(void*, void const*) = { &copy_as<Ts>... };
+            copy[other._tag](&_storage, &other._storage);
+            _tag = other._tag;
+        }
+    }
+
+    void move_from(Record& other) {
+        if (other._tag != EMPTY) {
+            static void (* const move[])(void*, void*) = { &move_as<Ts>... };
+            move[other._tag](&_storage, &other._storage);
+            _tag = other._tag;
+        }
+    }
+
+    typename std::aligned_union<0, Ts...>::type _storage;
+    tag_t _tag;
+};
+
+/**
+ * Registry mapping the type tag of a Record<Ts...> to the conversion function
+ * for that type, so that a single Parser can translate a mixed stream of
+ * record types while keeping their order.
+ *
+ * Registry::convert is the conversion function given to the Parser. It
+ * dispatches through a dense table indexed by the record's tag, so each
+ * record costs one indirect call and no virtual calls. Each conversion
+ * function is a template argument and is inlined into its table entry:
+ *
+ *     typedef libilf::Registry<libilf::ILF, Process, File> registry_t;
+ *     registry_t::add<Process, process_to_ilf>();
+ *     registry_t::add<File, file_to_ilf>();
+ *     libilf::Parser<registry_t::input_t, libilf::ILF> parser(registry_t::convert);
+ *
+ * Records of a type without a registered conversion function, as well as empty
+ * records, are converted to a default constructed output_t.
+ *
+ * The table is shared by all users of the same Registry type. Registering is
+ * not thread-safe and must be done before the parser is started.
+ */
+template <class output_t, class... Ts>
+class Registry {
+public:
+    typedef Record<Ts...> input_t;
+    typedef void (*dispatch_t)(void const*, output_t&);
+
+    /**
+     * Registers conversion_function as the conversion function for records
+     * holding a T.
+     */
+    template <class T, void (*conversion_function)(T const&, output_t&)>
+    static void add() {
+        table()[input_t::template tag_of<T>()] = &dispatch_as<T, conversion_function>;
+    }
+
+    /**
+     * Removes the conversion function for records holding a T.
+     */
+    template <class T>
+    static void remove() {
+        table()[input_t::template tag_of<T>()] = &unregistered;
+    }
+
+    /**
+     * Returns whether a conversion function is registered for records holding
+     * a T.
+     */
+    template <class T>
+    static bool contains() {
+        return table()[input_t::template tag_of<T>()] != &unregistered;
+    }
+
+    /**
+     * Converts a record using the conversion function registered for its type.
+     */
+    static AE_FORCEINLINE void convert(input_t const& input, output_t& output) {
+        table()[input.tag()](input.data(), output);
+    }
+
+private:
+    template <class T, void (*conversion_function)(T const&, output_t&)>
+    static void dispatch_as(void const* input, output_t& output) {
+        conversion_function(*static_cast<T const*>(input), output);
+    }
+
+    static void unregistered(void const*, output_t& output) {
+        output = output_t();
+    }
+
+    // One entry per type plus one for empty records, which is never
+    // overwritten
+    //
+    struct Table {
+        Table() {
+            for (size_t i = 0; i <= sizeof...(Ts); i++) {
+                _entries[i] = &unregistered;
+            }
+        }
+
+        dispatch_t _entries[sizeof...(Ts) + 1];
+    };
+
+    static AE_FORCEINLINE dispatch_t* table() {
+        static Table table;
+        return table._entries;
+    }
+};
+
+} // namespace libilf
@@ -0,0 +1,299 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <stdexcept>
+#include <system_error>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "atomicops.h"
+#include "pipeline.h"
+
+namespace libilf {
+
+/**
+ * A chunk of one file read by a FileScheduler: whole records, ending at the
+ * delimiter, except in the last chunk of a file that does not end with one.
+ *
+ * The buffer behind _data counts against the memory budget of the scheduler
+ * until every copy of _owner is destroyed, so a conversion function that
+ * copies _owner into its output extends the budget to outputs not yet
+ * written.
+ */
+struct FileChunk {
+    FileChunk() : _file(0), _sequence(0), _last(false), _data(nullptr), _size(0) { }
+
+    size_t _file;
+    uint64_t _sequence;
+    bool _last;
+    std::shared_ptr<const char> _owner;
+    char const* _data;
+    size_t _size;
+};
+
+/**
+ * Settings of a FileScheduler. Besides the chunks in the Parser's queues,
+ * the Pipeline's batches hold on to up to a batch of chunks and, if outputs
+ * keep their chunk's _owner, a batch of outputs, so _max_buffered_bytes must
+ * leave room for a few batches of chunks or read() waits for memory that is
+ * never released.
+ */
+struct FileSchedulerConfig {
+    FileSchedulerConfig() :
+        _chunk_size(1 << 20),
+        _max_open_files(16),
+        _max_buffered_bytes(64 << 20),
+        _largest_first(true),
+        _delimiter('\n') { }
+
+    size_t _chunk_size;
+    size_t _max_open_files;
+    size_t _max_buffered_bytes;
+    bool _largest_first;
+    char _delimiter;
+};
+
+/**
+ * Source of chunks of many files, for backfills that run one Pipeline over
+ * all of them instead of one Parser per file, which leaves the threads idle
+ * whenever a small file drains.
+ *
+ * Up to _max_open_files files are open at a time and read one chunk each in
+ * turn, opening the largest files first so that the biggest ones do not
+ * start last and straggle at the end of the job. Since a Parser pops outputs
+ * in the order their inputs were pushed, the chunks of each file come out in
+ * order, interleaved with those of other files; _file and _sequence tell
+ * them apart and the one chunk per file with _last set, empty for an empty
+ * file, marks its end.
+ *
+ * read() blocks while the chunks alive hold _max_buffered_bytes or more, on
+ * top of which each chunk may exceed _chunk_size by the partial record
+ * carried over from the previous one.
+ *
+ * Throws a std::system_error exception from read() if a file cannot be
+ * opened or read.
+ */
+class FileScheduler : public Source<FileChunk> {
+public:
+    /**
+     * Throws a std::invalid_argument exception if the chunk size, the number
+     * of open files or the memory budget is 0.
+     */
+    explicit FileScheduler(std::vector<std::string> const& paths,
+        FileSchedulerConfig const& config = FileSchedulerConfig()) :
+        _paths(paths),
+        _config(config),
+        _sizes(paths.size(), 0),
+        _next(0),
+        _turn(0),
+        _buffered(std::make_shared<std::atomic<size_t>>(0)),
+        _cancelled(false),
+        _bytes(0),
+        _files_done(0)
+    {
+        if (config._chunk_size == 0 || config._max_open_files == 0 || config._max_buffered_bytes == 0) {
+            throw std::invalid_argument("chunk size, open files and buffered bytes must be greater than 0");
+        }
+        for (size_t i = 0; i < paths.size(); i++) {
+            struct stat st;
+            if (stat(paths[i].c_str(), &st) == 0) {
+                _sizes[i] = st.st_size;
+            }
+            _order.push_back(i);
+        }
+        if (config._largest_first) {
+            std::stable_sort(_order.begin(), _order.end(), [this](size_t a, size_t b) {
+                return _sizes[a] > _sizes[b];
+            });
+        }
+    }
+
+    ~FileScheduler() {
+        close();
+    }
+
+    FileScheduler(FileScheduler const&) = delete;
+    FileScheduler& operator=(FileScheduler const&) = delete;
+
+    size_t read(span<FileChunk> chunks) override {
+        // The chunks of the previous call, which were pushed already, must not
+        // hold the budget
+        //
+        for (size_t i = 0; i < chunks.size(); i++) {
+            chunks[i]._owner.reset();
+        }
+        size_t count = 0;
+        Backoff backoff;
+        while (count < chunks.size()) {
+            while (_open.size() < _config._max_open_files && _next < _order.size()) {
+                open(_order[_next++]);
+            }
+            if (_open.empty()) {
+                break;
+            }
+            while (_buffered->load(std::memory_order_acquire) >= _config._max_buffered_bytes) {
+                if (count != 0 || _cancelled.load(std::memory_order_acquire)) {
+                    return count;
+                }
+                backoff.wait();
+            }
+            backoff.reset();
+            _turn %= _open.size();
+            OpenFile& file = _open[_turn];
+            if (!next_chunk(file, chunks[count])) {
+                _turn++;
+                continue;
+            }
+            _bytes += chunks[count]._size;
+            if (chunks[count]._last) {
+                ::close(file._fd);
+                _open.erase(_open.begin() + _turn);
+                _files_done++;
+            } else {
+                _turn++;
+            }
+            count++;
+        }
+        return count;
+    }
+
+    void cancel() override {
+        _cancelled.store(true, std::memory_order_release);
+    }
+
+    void close() override {
+        for (size_t i = 0; i < _open.size(); i++) {
+            ::close(_open[i]._fd);
+        }
+        _open.clear();
+    }
+
+    std::string const& path(size_t file) const {
+        return _paths[file];
+    }
+
+    /**
+     * Bytes of all chunks read so far.
+     */
+    uint64_t bytes() const {
+        return _bytes;
+    }
+
+    /**
+     * Number of files whose last chunk was read.
+     */
+    size_t files_done() const {
+        return _files_done;
+    }
+
+    /**
+     * Bytes held by chunks still alive, the quantity bounded by
+     * _max_buffered_bytes.
+     */
+    size_t buffered_bytes() const {
+        return _buffered->load(std::memory_order_acquire);
+    }
+
+private:
+    struct OpenFile {
+        size_t _file;
+        int _fd;
+        uint64_t _sequence;
+        std::string _carry;
+    };
+
+    void open(size_t file) {
+        OpenFile open_file;
+        open_file._file = file;
+        open_file._fd = ::open(_paths[file].c_str(), O_RDONLY | O_CLOEXEC);
+        open_file._sequence = 0;
+        if (open_file._fd < 0) {
+            throw std::system_error(errno, std::system_category(), _paths[file]);
+        }
+        posix_fadvise(open_file._fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        _open.push_back(std::move(open_file));
+    }
+
+    /**
+     * Reads the carried partial record and up to _chunk_size more bytes, and
+     * makes a chunk of everything up to the last delimiter. Returns false
+     * without a chunk if no delimiter was found, in which case everything is
+     * carried to the next turn of the file.
+     */
+    bool next_chunk(OpenFile& file, FileChunk& chunk) {
+        const size_t capacity = file._carry.size() + _config._chunk_size;
+        std::shared_ptr<std::atomic<size_t>> buffered = _buffered;
+        buffered->fetch_add(capacity, std::memory_order_acq_rel);
+        std::shared_ptr<char> buffer(new char[capacity], [buffered, capacity](char *p) {
+            delete[] p;
+            buffered->fetch_sub(capacity, std::memory_order_acq_rel);
+        });
+        memcpy(buffer.get(), file._carry.data(), file._carry.size());
+        size_t size = file._carry.size();
+        bool end_of_file = false;
+        while (size < capacity) {
+            ssize_t count = ::read(file._fd, buffer.get() + size, capacity - size);
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::system_category(), _paths[file._file]);
+            }
+            if (count == 0) {
+                end_of_file = true;
+                break;
+            }
+            size += count;
+        }
+        size_t cut = size;
+        if (!end_of_file) {
+            char const* delimiter = static_cast<char const*>(memrchr(buffer.get(), _config._delimiter, size));
+            cut = delimiter == nullptr ? 0 : delimiter - buffer.get() + 1;
+        }
+        file._carry.assign(buffer.get() + cut, size - cut);
+        if (cut == 0 && !end_of_file) {
+            return false;
+        }
+        chunk._file = file._file;
+        chunk._sequence = file._sequence++;
+        chunk._last = end_of_file;
+        chunk._owner = buffer;
+        chunk._data = buffer.get();
+        chunk._size = cut;
+        return true;
+    }
+
+    std::vector<std::string> _paths;
+    const FileSchedulerConfig _config;
+    std::vector<uint64_t> _sizes;
+    std::vector<size_t> _order;
+    size_t _next;
+    std::vector<OpenFile> _open;
+    size_t _turn;
+    std::shared_ptr<std::atomic<size_t>> _buffered;
+    std::atomic<bool> _cancelled;
+    uint64_t _bytes;
+    size_t _files_done;
+};
+
+} // namespace libilf
@@ -0,0 +1,358 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <stdexcept>
+#include <system_error>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "parser.h"
+#include "span.h"
+
+namespace libilf {
+
+/**
+ * Consecutive records serialized by one thread of a SerializingParser,
+ * packed back to back, with the end offset of each record.
+ */
+struct Chunk {
+    std::string _bytes;
+    std::vector<uint32_t> _ends;
+};
+
+/**
+ * Parser variant in which the threads serialize their outputs themselves.
+ *
+ * Instead of converting each input into an output object that a single
+ * consumer then serializes, each thread serializes its inputs straight into
+ * large per-thread chunks of bytes and records where each record ends. A
+ * thread hands a chunk over once it holds chunk_size bytes. When its input
+ * queue runs empty, it hands over a partial chunk only once the chunk holds
+ * min_flush_size bytes or its first record has waited max_delay, so that a
+ * slow producer does not cost a chunk per record. The consumer only stitches
+ * records together: with N threads, record i is in the chunks of thread i
+ * mod N, so SerializingParser::gather() walks the threads in round robin
+ * order and appends one iovec per record, pointing into the chunks, without
+ * copying. The resulting iovec list can be written with writev(2) or
+ * sendmsg(2). Serialization thus scales with the number of threads and the
+ * consumer becomes a gather step.
+ *
+ * Chunks referenced by gathered iovecs stay valid until
+ * SerializingParser::release() is called, which recycles them to their
+ * threads.
+ *
+ * The same rules as for Parser apply: one thread pushes, one thread gathers,
+ * and the number of threads is a power of 2.
+ */
+template <class input_t, unsigned int N = 0>
+class SerializingParser {
+    static_assert((N & (N - 1)) == 0, "number of threads must be a power of 2");
+
+public:
+    /**
+     * Constructor for the SerializingParser class.
+     *
+     * As parameters, it takes a serialization function appending the
+     * serialized form of an input to a string, the number of threads to
+     * spawn, the initial size for each thread's input queue, the size from
+     * which a thread hands its chunk over, and the size and age from which an
+     * idle thread hands a partial chunk over.
+     *
+     * Throws a std::invalid_argument exception if the number of threads is 0
+     * or not a power of 2, or if N is not 0 and the number of threads is not N.
+     */
+    SerializingParser(void (*serialize_function)(input_t const&, std::string&),
+        const unsigned int num_threads,
+        const unsigned int init_size,
+        const size_t chunk_size = 1 << 16,
+        const size_t min_flush_size = 1 << 12,
+        const std::chrono::microseconds max_delay = std::chrono::microseconds(1000)) :
+        _threads(num_threads),
+        _input_queues(num_threads, init_size),
+        _chunk_queues(num_threads),
+        _free_queues(num_threads),
+        _cursors(num_threads),
+        _cur_output_index(0),
+        _serialize_function(serialize_function),
+        _chunk_size(chunk_size),
+        _min_flush_size(min_flush_size),
+        _max_delay(max_delay),
+        _threads_active(false) { }
+
+    ~SerializingParser() {
+        release();
+        for (unsigned int i = 0; i < num_threads(); i++) {
+            Chunk *chunk;
+            while (_chunk_queues[i].try_dequeue(chunk)) {
+                delete chunk;
+            }
+            while (_free_queues[i].try_dequeue(chunk)) {
+                delete chunk;
+            }
+            delete _cursors[i]._chunk;
+        }
+    }
+
+    AE_FORCEINLINE unsigned int num_threads() const {
+        return _input_queues.num_threads();
+    }
+
+    /**
+     * Attempts to push an element onto the parser.
+     *
+     * Returns false if memory allocation fails.
+     */
+    AE_FORCEINLINE bool push(input_t const& input) {
+        return _input_queues.push(input);
+    }
+
+    size_t push(span<const input_t> inputs) {
+        return _input_queues.push(inputs);
+    }
+
+    /**
+     * Returns the number of inputs that are yet to be serialized.
+     */
+    size_t input_size() {
+        return _input_queues.size();
+    }
+
+    /**
+     * Appends one iovec per record to iov for up to max_records of the next
+     * serialized records, in the order their inputs were pushed, and returns
+     * the number of records gathered. Consecutive records that are adjacent
+     * in the same chunk share an iovec.
+     *
+     * Stops early at the first record that has not been handed over yet,
+     * which may be held back for up to max_delay while its thread is idle.
+     */
+    size_t gather(std::vector<struct iovec>& iov, size_t max_records) {
+        size_t count = 0;
+        while (count < max_records) {
+            Cursor& cursor = _cursors[_cur_output_index._val];
+            if (cursor._chunk == nullptr &&
+                !_chunk_queues[_cur_output_index._val].try_dequeue(cursor._chunk)) {
+                break;
+            }
+            Chunk *chunk = cursor._chunk;
+            const uint32_t begin = cursor._record == 0 ? 0 : chunk->_ends[cursor._record - 1],
+                end = chunk->_ends[cursor._record];
+            char *base = &chunk->_bytes[0];
+            if (!iov.empty() &&
+                static_cast<char*>(iov.back().iov_base) + iov.back().iov_len == base + begin) {
+                iov.back().iov_len += end - begin;
+            } else {
+                struct iovec record;
+                record.iov_base = base + begin;
+                record.iov_len = end - begin;
+                iov.push_back(record);
+            }
+            if (++cursor._record == chunk->_ends.size()) {
+                _retired.push_back(Retired(chunk, _cur_output_index._val));
+                cursor._chunk = nullptr;
+                cursor._record = 0;
+            }
+            _cur_output_index._val = (_cur_output_index._val + 1) & (num_threads() - 1);
+            count++;
+        }
+        return count;
+    }
+
+    /**
+     * Recycles every chunk whose records have all been gathered. Call once the
+     * iovecs returned by SerializingParser::gather() are no longer used.
+     */
+    void release() {
+        for (size_t i = 0; i < _retired.size(); i++) {
+            if (!_free_queues[_retired[i]._index].enqueue(_retired[i]._chunk)) {
+                delete _retired[i]._chunk;
+            }
+        }
+        _retired.clear();
+    }
+
+    /**
+     * Gathers up to max_records records, writes them to a file descriptor with
+     * writev(2), and releases their chunks. Returns the number of records
+     * written.
+     *
+     * Throws a std::system_error exception if writing fails.
+     */
+    size_t write(int fd, size_t max_records = IOV_MAX) {
+        _iov.clear();
+        size_t count = gather(_iov, max_records < IOV_MAX ? max_records : IOV_MAX);
+        struct iovec *iov = _iov.data();
+        size_t iov_count = _iov.size();
+        while (iov_count > 0) {
+            ssize_t written = ::writev(fd, iov, static_cast<int>(iov_count));
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::system_category(), "writev");
+            }
+            while (iov_count > 0 && static_cast<size_t>(written) >= iov->iov_len) {
+                written -= iov->iov_len;
+                iov++;
+                iov_count--;
+            }
+            if (iov_count > 0) {
+                iov->iov_base = static_cast<char*>(iov->iov_base) + written;
+                iov->iov_len -= written;
+            }
+        }
+        release();
+        return count;
+    }
+
+    /**
+     * Starts the parser, see Parser::start().
+     */
+    void start() {
+        _threads_active = true;
+        for (unsigned int i = 0; i < num_threads(); i++) {
+            _threads[i] = std::thread(&SerializingParser::thread_routine, this, i, false);
+        }
+    }
+
+    /**
+     * Starts the parser for measuring throughput, see Parser::start_wait().
+     */
+    void start_wait() {
+        for (unsigned int i = 0; i < num_threads(); i++) {
+            _threads[i] = std::thread(&SerializingParser::thread_routine, this, i, true);
+        }
+    }
+
+    /**
+     * Stops the parser. Every thread hands over its last chunk before exiting.
+     */
+    void stop() {
+        _threads_active = false;
+        for (unsigned int i = 0; i < num_threads(); i++) {
+            _threads[i].join();
+        }
+    }
+
+    void stop_wait() {
+        stop();
+    }
+
+private:
+    /**
+     * Serializes inputs into the current chunk, handing it over when it is
+     * full, or when the input queue is empty and the chunk holds
+     * min_flush_size bytes or is older than max_delay. If wait is set, the
+     * thread exits when its input queue is empty, as in
+     * Parser::start_wait(). The last chunk is handed over on exit.
+     */
+    void thread_routine(int index, bool wait) {
+        moodycamel::ReaderWriterQueue<input_t>& my_input_queue = _input_queues[index];
+        input_t cur_input;
+        Chunk *chunk = nullptr;
+        std::chrono::steady_clock::time_point chunk_start;
+
+        while (wait || LIKELY(_threads_active)) {
+            if (!my_input_queue.try_dequeue(cur_input)) {
+                if (wait) {
+                    break;
+                }
+                if (chunk != nullptr && (chunk->_bytes.size() >= _min_flush_size ||
+                    std::chrono::steady_clock::now() - chunk_start >= _max_delay)) {
+                    hand_over(index, chunk);
+                }
+                continue;
+            }
+            if (chunk == nullptr) {
+                chunk = take_chunk(index);
+                chunk_start = std::chrono::steady_clock::now();
+            }
+            _serialize_function(cur_input, chunk->_bytes);
+            chunk->_ends.push_back(static_cast<uint32_t>(chunk->_bytes.size()));
+            if (chunk->_bytes.size() >= _chunk_size) {
+                hand_over(index, chunk);
+            }
+        }
+        hand_over(index, chunk);
+    }
+
+    /**
+     * Returns a recycled chunk, whose buffers keep their capacity, or a new
+     * one if none was recycled yet.
+     */
+    Chunk* take_chunk(int index) {
+        Chunk *chunk;
+        if (_free_queues[index].try_dequeue(chunk)) {
+            chunk->_bytes.clear();
+            chunk->_ends.clear();
+            return chunk;
+        }
+        chunk = new Chunk();
+        chunk->_bytes.reserve(_chunk_size + (_chunk_size >> 2));
+        return chunk;
+    }
+
+    void hand_over(int index, Chunk *&chunk) {
+        if (chunk == nullptr) {
+            return;
+        }
+        if (UNLIKELY(!_chunk_queues[index].enqueue(chunk))) {
+            std::cerr << "WARNING (template): thread " << std::this_thread::get_id() <<
+                " failed to push data onto output queue" << std::endl;
+            return;
+        }
+        chunk = nullptr;
+    }
+
+    /**
+     * Position of the consumer in the chunks of one thread.
+     */
+    struct Cursor {
+        Cursor() : _chunk(nullptr), _record(0) { }
+
+        Chunk *_chunk;
+        size_t _record;
+    };
+
+    struct Retired {
+        Retired(Chunk *chunk, unsigned int index) : _chunk(chunk), _index(index) { }
+
+        Chunk *_chunk;
+        unsigned int _index;
+    };
+
+    detail::SlotArray<std::thread, N> _threads;
+    detail::InputQueues<input_t, N> _input_queues;
+    // Full chunks from the threads to the consumer, and released chunks
+    // back from the consumer to the threads
+    //
+    detail::SlotArray<moodycamel::ReaderWriterQueue<Chunk*>, N> _chunk_queues, _free_queues;
+    detail::SlotArray<Cursor, N> _cursors;
+    std::vector<Retired> _retired;
+    std::vector<struct iovec> _iov;
+    detail::PaddedValue<unsigned int> _cur_output_index;
+    void (*_serialize_function)(input_t const&, std::string&);
+    const size_t _chunk_size, _min_flush_size;
+    const std::chrono::microseconds _max_delay;
+    bool _threads_active;
+};
+
+} // namespace libilf
@@ -0,0 +1,842 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <utility>
+#include <stdexcept>
+#include <cstdint>
+
+#include "parser.h"
+#include "pipeline.h"
+#include "readerwriterqueue.h"
+#include "perfect_hash.h"
+#include "decimal.h"
+#include "ilf.h"
+
+namespace libilf {
+
+/**
+ * Hierarchical timer wheel (Varghese and Lauck, "Hashed and Hierarchical
+ * Timing Wheels", 1987) over ids 0, 1, 2, ... with deadlines in ticks.
+ *
+ * Four levels of 256 slots each cover 2^32 ticks. A timer lands in the
+ * lowest level whose span covers its distance from the current tick, and
+ * timers of a higher level slot are cascaded down a level whenever the level
+ * below wraps around, so scheduling costs O(1) and every timer is touched at
+ * most once per level.
+ *
+ * Each id may be scheduled at most once at a time. Timers cannot be
+ * cancelled; owners that push deadlines back instead check, when a timer
+ * fires, whether it is really due and schedule it again if not, which keeps
+ * updates off the wheel entirely.
+ */
+class TimerWheel {
+public:
+    TimerWheel() :
+        _slots(LEVELS * SLOTS, NONE),
+        _now(0),
+        _size(0) { }
+
+    /**
+     * Schedules id to fire at deadline, or at the next tick if deadline has
+     * passed.
+     */
+    void schedule(uint32_t id, uint64_t deadline) {
+        if (id >= _timers.size()) {
+            _timers.resize(id + 1);
+        }
+        if (deadline <= _now) {
+            deadline = _now + 1;
+        } else if (deadline - _now > MAX_DISTANCE) {
+            deadline = _now + MAX_DISTANCE;
+        }
+        _timers[id]._deadline = deadline;
+        insert(id);
+        _size++;
+    }
+
+    /**
+     * Advances to tick now, calling fire(id) for every timer due at or before
+     * it. fire() may schedule timers again. Ticks are skipped in one step
+     * while no timer is scheduled.
+     */
+    template <class fire_t>
+    void advance(uint64_t now, fire_t fire) {
+        while (_now < now) {
+            if (_size == 0) {
+                _now = now;
+                break;
+            }
+            _now++;
+            if ((_now & MASK) == 0) {
+                for (unsigned int level = 1; level < LEVELS; level++) {
+                    const uint32_t index = (_now >> (BITS * level)) & MASK;
+                    cascade(level, index);
+                    if (index != 0) {
+                        break;
+                    }
+                }
+            }
+            uint32_t& slot = _slots[_now & MASK];
+            uint32_t id = slot;
+            slot = NONE;
+            while (id != NONE) {
+                const uint32_t next = _timers[id]._next;
+                _size--;
+                fire(id);
+                id = next;
+            }
+        }
+    }
+
+    AE_FORCEINLINE uint64_t now() const {
+        return _now;
+    }
+
+    /**
+     * Returns the number of scheduled timers.
+     */
+    AE_FORCEINLINE size_t size() const {
+        return _size;
+    }
+
+private:
+    enum : uint32_t {
+        LEVELS = 4,
+        BITS = 8,
+        SLOTS = 1u << BITS,
+        MASK = SLOTS - 1,
+        NONE = UINT32_MAX,
+        MAX_DISTANCE = UINT32_MAX - (1u << 24)
+    };
+
+    struct Timer {
+        uint64_t _deadline;
+        uint32_t _next;
+    };
+
+    AE_FORCEINLINE void insert(uint32_t id) {
+        const uint64_t deadline = _timers[id]._deadline, distance = deadline - _now;
+        unsigned int level = 0;
+        while (level + 1 < LEVELS && distance >= (1ULL << (BITS * (level + 1)))) {
+            level++;
+        }
+        uint32_t& slot = _slots[level * SLOTS + ((deadline >> (BITS * level)) & MASK)];
+        _timers[id]._next = slot;
+        slot = id;
+    }
+
+    /**
+     * Moves the timers of a slot to the levels their distance now calls for.
+     */
+    void cascade(unsigned int level, uint32_t index) {
+        uint32_t& slot = _slots[level * SLOTS + index];
+        uint32_t id = slot;
+        slot = NONE;
+        while (id != NONE) {
+            const uint32_t next = _timers[id]._next;
+            insert(id);
+            id = next;
+        }
+    }
+
+    std::vector<uint32_t> _slots;
+    std::vector<Timer> _timers;
+    uint64_t _now;
+    size_t _size;
+};
+
+/**
+ * Options of flow sessionization:
+ *
+ * - _key_fields: keys of the pairs that, together with the sender and the
+ *   receiver, identify a flow, e.g. {"src_port", "dst_port", "proto"} for a
+ *   5-tuple. Empty by default, i.e. flows are keyed by sender and receiver.
+ * - _bytes_field, _packets_field: keys of the pairs summed into the totals
+ *   of a flow. A record without a packets pair counts as one packet.
+ * - _event_t: event type of the summary ILFs.
+ * - _idle_timeout_ms: a flow ends once no record of it arrived for this long.
+ * - _active_timeout_ms: a flow also ends once it lasted this long, so that a
+ *   long-lived flow is reported periodically. Its next record starts a new
+ *   flow.
+ * - _tick_ms: resolution of the timer wheel.
+ */
+struct SessionConfig {
+    SessionConfig() :
+        _bytes_field("bytes"),
+        _packets_field("packets"),
+        _event_t("FlowSummary"),
+        _idle_timeout_ms(15000),
+        _active_timeout_ms(1800000),
+        _tick_ms(100) { }
+
+    std::vector<std::string> _key_fields;
+    std::string _bytes_field, _packets_field, _event_t;
+    uint64_t _idle_timeout_ms, _active_timeout_ms, _tick_ms;
+};
+
+namespace detail {
+
+/**
+ * Parses an ILF time of seconds since the epoch, with an optional fraction,
+ * into milliseconds.
+ */
+inline bool parse_time_ms(std::string const& time, uint64_t *ms) {
+    char const* p = time.data(), *end = p + time.size();
+    if (p == end || *p < '0' || *p > '9') {
+        return false;
+    }
+    uint64_t seconds = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        seconds = seconds * 10 + (*p++ - '0');
+    }
+    uint64_t fraction = 0, scale = 100;
+    if (p < end && *p == '.') {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++) {
+            fraction += (*p - '0') * scale;
+            scale /= 10;
+        }
+    }
+    *ms = seconds * 1000 + fraction;
+    return p == end;
+}
+
+/**
+ * Parses an unsigned decimal count, or returns false.
+ */
+inline bool parse_count(std::string const& value, uint64_t *count) {
+    if (value.empty() || value.size() > 19) {
+        return false;
+    }
+    uint64_t result = 0;
+    for (size_t i = 0; i < value.size(); i++) {
+        if (value[i] < '0' || value[i] > '9') {
+            return false;
+        }
+        result = result * 10 + (value[i] - '0');
+    }
+    *count = result;
+    return true;
+}
+
+/**
+ * Pairs of a record that a flow table looks at, found in one pass.
+ */
+struct FlowFields {
+    enum : size_t { MAX_KEY_FIELDS = 8 };
+
+    KeyValue const* _keys[MAX_KEY_FIELDS];
+    KeyValue const* _bytes, *_packets;
+};
+
+/**
+ * Finds the pairs named by a SessionConfig and builds flow keys from them.
+ */
+class FlowKeys {
+public:
+    /**
+     * Throws a std::invalid_argument exception if there are more than
+     * FlowFields::MAX_KEY_FIELDS key fields.
+     */
+    explicit FlowKeys(SessionConfig const& config) :
+        _config(config)
+    {
+        if (config._key_fields.size() > FlowFields::MAX_KEY_FIELDS) {
+            throw std::invalid_argument("too many flow key fields");
+        }
+    }
+
+    void scan(ILF const& ilf, FlowFields& fields) const {
+        const size_t num_keys = _config._key_fields.size();
+        for (size_t i = 0; i < num_keys; i++) {
+            fields._keys[i] = nullptr;
+        }
+        fields._bytes = fields._packets = nullptr;
+        for (size_t i = 0; i < ilf._pairs.size(); i++) {
+            KeyValue const& pair = ilf._pairs[i];
+            if (pair._key == _config._bytes_field) {
+                fields._bytes = &pair;
+            } else if (pair._key == _config._packets_field) {
+                fields._packets = &pair;
+            } else {
+                for (size_t j = 0; j < num_keys; j++) {
+                    if (fields._keys[j] == nullptr && pair._key == _config._key_fields[j]) {
+                        fields._keys[j] = &pair;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    /**
+     * Writes the key of a record to key and returns its hash. Missing key
+     * fields count as empty.
+     */
+    uint32_t key(ILF const& ilf, FlowFields const& fields, std::string& key) const {
+        key.assign(ilf._sender);
+        key.push_back('\x1f');
+        key.append(ilf._receiver);
+        for (size_t i = 0; i < _config._key_fields.size(); i++) {
+            key.push_back('\x1f');
+            if (fields._keys[i] != nullptr) {
+                key.append(fields._keys[i]->_value);
+            }
+        }
+        return hash_bytes(key.data(), key.size());
+    }
+
+    SessionConfig const& config() const {
+        return _config;
+    }
+
+private:
+    SessionConfig _config;
+};
+
+} // namespace detail
+
+/**
+ * Table of the open flows of a stream of records, e.g. FlowStart ILFs, which
+ * folds the records of each flow into one summary ILF.
+ *
+ * A summary has the event type of the configuration, the sender, receiver
+ * and time of the first record of its flow, the key fields of the flow, and
+ * the unquoted pairs bytes, packets, duration (in seconds, with
+ * milliseconds) and reason, which is "idle" or "active" after the respective
+ * timeout, or "end" for flows still open when the table is flushed.
+ *
+ * Time is the time of the records: FlowTable::add() and FlowTable::advance()
+ * move the clock of the table forward, and expired flows are found by a
+ * TimerWheel. Records should arrive in time order; a record older than the
+ * clock counts as arriving at the clock.
+ *
+ * Flows are held in a vector with a free list, indexed by an open addressing
+ * hash table with linear probing and backward shift deletion. A flow table
+ * is not thread-safe; Sessionizer runs one per thread.
+ */
+class FlowTable {
+public:
+    /**
+     * Throws a std::invalid_argument exception if the tick is 0 or there are
+     * too many key fields.
+     */
+    explicit FlowTable(SessionConfig const& config) :
+        _keys(config),
+        _index(MIN_CAPACITY, Slot()),
+        _now_ms(0),
+        _size(0)
+    {
+        if (config._tick_ms == 0) {
+            throw std::invalid_argument("tick must be greater than 0");
+        }
+    }
+
+    /**
+     * Adds a record at time_ms, first calling emit(ILF&&) with the summaries
+     * of every flow that expired by then.
+     */
+    template <class emit_t>
+    void add(ILF const& ilf, uint64_t time_ms, emit_t emit) {
+        detail::FlowFields fields;
+        _keys.scan(ilf, fields);
+        const uint32_t hash = _keys.key(ilf, fields, _key);
+        add(ilf, fields, _key, hash, time_ms, emit);
+    }
+
+    /**
+     * Same as above, for a record whose fields, key and key hash were
+     * already found with the detail::FlowKeys of the same configuration.
+     */
+    template <class emit_t>
+    void add(ILF const& ilf, detail::FlowFields const& fields, std::string const& key, uint32_t hash,
+        uint64_t time_ms, emit_t emit) {
+        advance(time_ms, emit);
+        if (time_ms < _now_ms) {
+            time_ms = _now_ms;
+        }
+        uint32_t id = find(hash, key);
+        if (id == NONE) {
+            id = open(ilf, fields, key, hash, time_ms);
+        } else if (deadline(_flows[id]) <= time_ms) {
+            // Expired within the current tick, before its timer fired. The
+            // timer is still on the wheel, so the flow restarts in place
+            //
+            summarize(_flows[id], false, emit);
+            restart(_flows[id], ilf, fields, time_ms);
+        }
+        Flow& flow = _flows[id];
+        uint64_t count;
+        if (fields._bytes != nullptr && detail::parse_count(fields._bytes->_value, &count)) {
+            flow._bytes += count;
+        }
+        if (fields._packets == nullptr || !detail::parse_count(fields._packets->_value, &count)) {
+            count = 1;
+        }
+        flow._packets += count;
+        flow._last_ms = time_ms;
+    }
+
+    /**
+     * Moves the clock to now_ms, calling emit(ILF&&) with the summaries of
+     * every flow that expired by then.
+     */
+    template <class emit_t>
+    void advance(uint64_t now_ms, emit_t emit) {
+        if (now_ms <= _now_ms) {
+            return;
+        }
+        _now_ms = now_ms;
+        _wheel.advance(now_ms / _keys.config()._tick_ms, [&](uint32_t id) {
+            const uint64_t due_ms = deadline(_flows[id]);
+            if (due_ms <= _now_ms) {
+                summarize(_flows[id], false, emit);
+                close(id);
+            } else {
+                _wheel.schedule(id, ticks(due_ms));
+            }
+        });
+    }
+
+    /**
+     * Calls emit(ILF&&) with the summaries of every open flow, which end with
+     * reason "end" unless they expired by the clock, and empties the table.
+     */
+    template <class emit_t>
+    void flush(emit_t emit) {
+        for (uint32_t id = 0; id < _flows.size(); id++) {
+            if (_flows[id]._live) {
+                summarize(_flows[id], deadline(_flows[id]) > _now_ms, emit);
+                close(id);
+            }
+        }
+        _wheel = TimerWheel();
+        _free.clear();
+        for (uint32_t id = static_cast<uint32_t>(_flows.size()); id > 0; id--) {
+            _free.push_back(id - 1);
+        }
+    }
+
+    /**
+     * Returns the number of open flows.
+     */
+    AE_FORCEINLINE size_t size() const {
+        return _size;
+    }
+
+    AE_FORCEINLINE uint64_t now_ms() const {
+        return _now_ms;
+    }
+
+private:
+    enum : uint32_t {
+        NONE = UINT32_MAX,
+        MIN_CAPACITY = 1024
+    };
+
+    struct Flow {
+        Flow() : _bytes(0), _packets(0), _first_ms(0), _last_ms(0), _hash(0), _live(false) { }
+
+        std::string _key;
+        // Event type, sender, receiver, time and key fields of the summary,
+        // filled in from the first record
+        //
+        ILF _summary;
+        uint64_t _bytes, _packets, _first_ms, _last_ms;
+        uint32_t _hash;
+        bool _live;
+    };
+
+    struct Slot {
+        Slot() : _hash(0), _id(NONE) { }
+
+        uint32_t _hash, _id;
+    };
+
+    AE_FORCEINLINE uint64_t deadline(Flow const& flow) const {
+        const uint64_t idle = flow._last_ms + _keys.config()._idle_timeout_ms,
+            active = flow._first_ms + _keys.config()._active_timeout_ms;
+        return idle < active ? idle : active;
+    }
+
+    AE_FORCEINLINE uint64_t ticks(uint64_t ms) const {
+        return (ms + _keys.config()._tick_ms - 1) / _keys.config()._tick_ms;
+    }
+
+    uint32_t find(uint32_t hash, std::string const& key) const {
+        const size_t mask = _index.size() - 1;
+        for (size_t i = hash & mask; _index[i]._id != NONE; i = (i + 1) & mask) {
+            if (_index[i]._hash == hash && _flows[_index[i]._id]._key == key) {
+                return _index[i]._id;
+            }
+        }
+        return NONE;
+    }
+
+    uint32_t open(ILF const& ilf, detail::FlowFields const& fields, std::string const& key, uint32_t hash,
+        uint64_t time_ms) {
+        if (2 * (_size + 1) > _index.size()) {
+            grow();
+        }
+        uint32_t id;
+        if (!_free.empty()) {
+            id = _free.back();
+            _free.pop_back();
+        } else {
+            id = static_cast<uint32_t>(_flows.size());
+            _flows.push_back(Flow());
+        }
+        Flow& flow = _flows[id];
+        flow._key.assign(key);
+        flow._hash = hash;
+        flow._live = true;
+        restart(flow, ilf, fields, time_ms);
+        insert(hash, id);
+        _size++;
+        _wheel.schedule(id, ticks(deadline(flow)));
+        return id;
+    }
+
+    /**
+     * Starts a flow over at the first record of its next session.
+     */
+    void restart(Flow& flow, ILF const& ilf, detail::FlowFields const& fields, uint64_t time_ms) {
+        ILF& summary = flow._summary;
+        summary._event_t.assign(_keys.config()._event_t);
+        summary._sender.assign(ilf._sender);
+        summary._receiver.assign(ilf._receiver);
+        summary._time.assign(ilf._time);
+        summary._pairs.clear();
+        for (size_t i = 0; i < _keys.config()._key_fields.size(); i++) {
+            if (fields._keys[i] != nullptr) {
+                summary._pairs.push_back(*fields._keys[i]);
+            }
+        }
+        flow._bytes = flow._packets = 0;
+        flow._first_ms = flow._last_ms = time_ms;
+    }
+
+    /**
+     * Emits the summary of a flow, with reason "end" if ended is set or else
+     * with the timeout that ends it first.
+     */
+    template <class emit_t>
+    void summarize(Flow& flow, bool ended, emit_t& emit) {
+        const SessionConfig& config = _keys.config();
+        char const* reason = ended ? "end" :
+            flow._first_ms + config._active_timeout_ms <= flow._last_ms + config._idle_timeout_ms ? "active" : "idle";
+        ILF summary(std::move(flow._summary));
+        flow._summary = ILF();
+        summary._pairs.push_back(KeyValue("bytes", decimal(flow._bytes), false));
+        summary._pairs.push_back(KeyValue("packets", decimal(flow._packets), false));
+        const uint64_t duration_ms = flow._last_ms - flow._first_ms;
+        std::string duration = decimal(duration_ms / 1000);
+        duration.push_back('.');
+        duration.push_back('0' + duration_ms % 1000 / 100);
+        duration.push_back('0' + duration_ms % 100 / 10);
+        duration.push_back('0' + duration_ms % 10);
+        summary._pairs.push_back(KeyValue("duration", duration, false));
+        summary._pairs.push_back(KeyValue("reason", reason, false));
+        emit(std::move(summary));
+    }
+
+    /**
+     * Frees a flow whose timer is no longer on the wheel.
+     */
+    void close(uint32_t id) {
+        erase(_flows[id]._hash, id);
+        _flows[id]._live = false;
+        _free.push_back(id);
+        _size--;
+    }
+
+    static std::string decimal(uint64_t value) {
+        char buf[MAX_DECIMAL_LENGTH + 16];
+        return std::string(buf, format_decimal(value, buf));
+    }
+
+    void insert(uint32_t hash, uint32_t id) {
+        const size_t mask = _index.size() - 1;
+        size_t i = hash & mask;
+        while (_index[i]._id != NONE) {
+            i = (i + 1) & mask;
+        }
+        _index[i]._hash = hash;
+        _index[i]._id = id;
+    }
+
+    /**
+     * Removes an id from the index, shifting back the entries after it that
+     * may move closer to their home slot so that no tombstones are needed.
+     */
+    void erase(uint32_t hash, uint32_t id) {
+        const size_t mask = _index.size() - 1;
+        size_t i = hash & mask;
+        while (_index[i]._id != id) {
+            i = (i + 1) & mask;
+        }
+        for (size_t j = (i + 1) & mask; _index[j]._id != NONE; j = (j + 1) & mask) {
+            const size_t home = _index[j]._hash & mask;
+            if (((j - home) & mask) >= ((j - i) & mask)) {
+                _index[i] = _index[j];
+                i = j;
+            }
+        }
+        _index[i] = Slot();
+    }
+
+    void grow() {
+        std::vector<Slot> old(2 * _index.size(), Slot());
+        old.swap(_index);
+        for (size_t i = 0; i < old.size(); i++) {
+            if (old[i]._id != NONE) {
+                insert(old[i]._hash, old[i]._id);
+            }
+        }
+    }
+
+    detail::FlowKeys _keys;
+    std::vector<Flow> _flows;
+    std::vector<uint32_t> _free;
+    std::vector<Slot> _index;
+    TimerWheel _wheel;
+    std::string _key;
+    uint64_t _now_ms;
+    size_t _size;
+};
+
+/**
+ * Sessionization stage: folds a stream of records into one summary ILF per
+ * flow (see FlowTable) on a number of threads.
+ *
+ * Sessionizer::push() routes each record by the hash of its flow key to the
+ * input queue of one thread, which owns the flow table holding all flows of
+ * that hash. Since the records of a flow are not spread across threads, the
+ * threads share nothing. Every tick of record time, the producer also sends
+ * a time mark to all threads so that flows expire on threads that receive no
+ * records. Summaries are popped from the threads' output queues in turn, so
+ * unlike with a Parser their order is not the order of the records.
+ *
+ * Threads back off with a Backoff when idle. Sessionizer::stop() converts
+ * every record still queued and flushes every flow, after which the
+ * remaining summaries can still be popped.
+ */
+class Sessionizer {
+public:
+    /**
+     * Constructor for the Sessionizer class.
+     *
+     * Throws a std::invalid_argument exception if the number of threads is 0
+     * or not a power of 2, the tick is 0, or there are too many key fields.
+     *
+     * Throws a std::bad_alloc exception if memory allocation fails.
+     */
+    Sessionizer(SessionConfig const& config,
+        const unsigned int num_threads,
+        const unsigned int init_size) :
+        _keys(config),
+        _threads(num_threads),
+        _input_queues(num_threads),
+        _output_queues(num_threads),
+        _num_threads(num_threads),
+        _route_shift(32),
+        _cur_output_index(0),
+        _clock_ms(0),
+        _marked_tick(0),
+        _threads_active(false)
+    {
+        if (num_threads == 0 || (num_threads & (num_threads - 1)) != 0) {
+            throw std::invalid_argument(
+                "number of threads must be greater than 0 and a power of 2"
+            );
+        }
+        if (config._tick_ms == 0) {
+            throw std::invalid_argument("tick must be greater than 0");
+        }
+        for (unsigned int n = num_threads; n > 1; n >>= 1) {
+            _route_shift--;
+        }
+        for (unsigned int i = 0; i < num_threads; i++) {
+            _input_queues[i] = moodycamel::ReaderWriterQueue<Input>(init_size);
+            _output_queues[i] = moodycamel::ReaderWriterQueue<ILF>(init_size);
+        }
+    }
+
+    /**
+     * Attempts to push a record onto the sessionizer. A record without a
+     * valid time counts as arriving at the latest time seen.
+     *
+     * Returns false if memory allocation fails.
+     */
+    bool push(ILF const& ilf) {
+        Input input;
+        input._ilf = ilf;
+        return push(input);
+    }
+
+    bool push(ILF&& ilf) {
+        Input input;
+        input._ilf = std::move(ilf);
+        return push(input);
+    }
+
+    /**
+     * Moves the clock of every thread to now_ms, e.g. from a wall clock while
+     * no records arrive, so that idle flows still expire.
+     *
+     * Returns false if memory allocation fails.
+     */
+    bool advance(uint64_t now_ms) {
+        if (now_ms > _clock_ms) {
+            _clock_ms = now_ms;
+        }
+        _marked_tick = _clock_ms / _keys.config()._tick_ms;
+        bool success = true;
+        for (unsigned int i = 0; i < _num_threads; i++) {
+            Input mark;
+            mark._time_ms = _clock_ms;
+            mark._mark = true;
+            success = _input_queues[i].enqueue(std::move(mark)) && success;
+        }
+        return success;
+    }
+
+    /**
+     * Attempts to pop a summary, trying every thread's output queue once.
+     */
+    bool pop(ILF& summary) {
+        for (unsigned int i = 0; i < _num_threads; i++) {
+            moodycamel::ReaderWriterQueue<ILF>& queue = _output_queues[_cur_output_index];
+            _cur_output_index = (_cur_output_index + 1) & (_num_threads - 1);
+            if (queue.try_dequeue(summary)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void start() {
+        _threads_active = true;
+        for (unsigned int i = 0; i < _num_threads; i++) {
+            _threads[i] = std::thread(&Sessionizer::thread_routine, this, i);
+        }
+    }
+
+    /**
+     * Stops the sessionizer once every thread has taken in the records
+     * pushed so far and flushed its flows.
+     */
+    void stop() {
+        advance(_clock_ms);
+        _threads_active = false;
+        for (unsigned int i = 0; i < _num_threads; i++) {
+            _threads[i].join();
+        }
+    }
+
+    AE_FORCEINLINE unsigned int num_threads() const {
+        return _num_threads;
+    }
+
+private:
+    struct Input {
+        Input() : _time_ms(0), _hash(0), _mark(false) { }
+
+        ILF _ilf;
+        uint64_t _time_ms;
+        uint32_t _hash;
+        bool _mark;
+    };
+
+    bool push(Input& input) {
+        uint64_t time_ms;
+        if (detail::parse_time_ms(input._ilf._time, &time_ms) && time_ms > _clock_ms) {
+            _clock_ms = time_ms;
+        }
+        input._time_ms = _clock_ms;
+        if (_clock_ms / _keys.config()._tick_ms > _marked_tick && !advance(_clock_ms)) {
+            return false;
+        }
+        detail::FlowFields fields;
+        _keys.scan(input._ilf, fields);
+        input._hash = _keys.key(input._ilf, fields, _key);
+        const unsigned int index = static_cast<unsigned int>(static_cast<uint64_t>(input._hash) >> _route_shift);
+        return _input_queues[index].enqueue(std::move(input));
+    }
+
+    /**
+     * The routine of every thread: takes records and time marks off its
+     * input queue into its flow table and pushes summaries onto its output
+     * queue until the sessionizer is stopped, then drains the input queue
+     * and flushes the table.
+     */
+    void thread_routine(unsigned int index) {
+        FlowTable table(_keys.config());
+        detail::FlowKeys keys(_keys.config());
+        detail::FlowFields fields;
+        std::string key;
+        moodycamel::ReaderWriterQueue<Input>& input_queue = _input_queues[index];
+        moodycamel::ReaderWriterQueue<ILF>& output_queue = _output_queues[index];
+        const auto emit = [&](ILF&& summary) {
+            if (UNLIKELY(!output_queue.enqueue(std::move(summary)))) {
+                std::cerr << "WARNING (template): thread " << std::this_thread::get_id() <<
+                    " failed to push data onto output queue" << std::endl;
+            }
+        };
+        Input input;
+        Backoff backoff;
+        bool active = true;
+        while (true) {
+            if (input_queue.try_dequeue(input)) {
+                if (input._mark) {
+                    table.advance(input._time_ms, emit);
+                } else {
+                    // The key was hashed by the producer, but the table
+                    // still compares whole keys
+                    //
+                    keys.scan(input._ilf, fields);
+                    keys.key(input._ilf, fields, key);
+                    table.add(input._ilf, fields, key, input._hash, input._time_ms, emit);
+                }
+                backoff.reset();
+            } else if (!active) {
+                break;
+            } else {
+                // Checked only while idle, and once more after it flips, so
+                // that records pushed before Sessionizer::stop() are taken
+                //
+                active = _threads_active;
+                if (active) {
+                    backoff.wait();
+                }
+            }
+        }
+        table.flush(emit);
+    }
+
+    detail::FlowKeys _keys;
+    std::vector<std::thread> _threads;
+    std::vector<moodycamel::ReaderWriterQueue<Input> > _input_queues;
+    std::vector<moodycamel::ReaderWriterQueue<ILF> > _output_queues;
+    const unsigned int _num_threads;
+    unsigned int _route_shift, _cur_output_index;
+    std::string _key;
+    uint64_t _clock_ms, _marked_tick;
+    std::atomic<bool> _threads_active;
+};
+
+} // namespace libilf
@@ -0,0 +1,377 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <stdexcept>
+#include <cstring>
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "atomicops.h"
+#include "ilf.h"
+
+namespace libilf {
+
+namespace detail {
+
+/**
+ * Escapes up to four special characters with a backslash, writing newlines,
+ * carriage returns and tabs as \n, \r and \t.
+ *
+ * With SSE2, text is scanned 16 bytes at a time for special characters, so
+ * text without any is appended with a single copy.
+ */
+class Escaper {
+public:
+    explicit Escaper(char const* specials) {
+        const size_t count = strlen(specials);
+        if (count == 0 || count > 4) {
+            throw std::invalid_argument("an escaper takes 1 to 4 special characters");
+        }
+        memset(_special, 0, sizeof(_special));
+        for (size_t i = 0; i < 4; i++) {
+            _specials[i] = specials[i < count ? i : 0];
+            _special[static_cast<unsigned char>(_specials[i])] = true;
+        }
+    }
+
+    void append(std::string& out, char const* data, size_t len) const {
+        size_t begin = 0, i;
+        while ((i = find(data, begin, len)) < len) {
+            out.append(data + begin, i - begin);
+            out.push_back('\\');
+            out.push_back(data[i] == '\n' ? 'n' : data[i] == '\r' ? 'r' : data[i] == '\t' ? 't' : data[i]);
+            begin = i + 1;
+        }
+        out.append(data + begin, len - begin);
+    }
+
+    AE_FORCEINLINE void append(std::string& out, std::string const& str) const {
+        append(out, str.data(), str.size());
+    }
+
+private:
+    /**
+     * Returns the offset of the first special character at or after begin,
+     * or len if there is none.
+     */
+    AE_FORCEINLINE size_t find(char const* data, size_t begin, size_t len) const {
+        size_t i = begin;
+#if defined(__SSE2__)
+        const __m128i s0 = _mm_set1_epi8(_specials[0]), s1 = _mm_set1_epi8(_specials[1]),
+            s2 = _mm_set1_epi8(_specials[2]), s3 = _mm_set1_epi8(_specials[3]);
+        for (; i + 16 <= len; i += 16) {
+            const __m128i block = _mm_loadu_si128(reinterpret_cast<__m128i const*>(data + i));
+            const int mask = _mm_movemask_epi8(_mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(block, s0), _mm_cmpeq_epi8(block, s1)),
+                _mm_or_si128(_mm_cmpeq_epi8(block, s2), _mm_cmpeq_epi8(block, s3))));
+            if (mask != 0) {
+                return i + __builtin_ctz(mask);
+            }
+        }
+#endif
+        for (; i < len; i++) {
+            if (_special[static_cast<unsigned char>(data[i])]) {
+                return i;
+            }
+        }
+        return len;
+    }
+
+    char _specials[4];
+    bool _special[256];
+};
+
+} // namespace detail
+
+/**
+ * How the records of one ILF event type appear in CEF and LEEF: the
+ * signature ID (CEF) or event ID (LEEF), the event name, and the severity
+ * from 0 to 10.
+ */
+struct SiemEventType {
+    SiemEventType() : _severity(5) { }
+
+    SiemEventType(std::string const& id, std::string const& name, int severity) :
+        _id(id),
+        _name(name),
+        _severity(severity) { }
+
+    std::string _id, _name;
+    int _severity;
+};
+
+/**
+ * Field mapping of the CEF and LEEF serializers:
+ *
+ * - _vendor, _product, _version: the device fields of every header.
+ * - _event_types: mapping of ILF event types. Unmapped event types use the
+ *   ILF event type as ID and name, and _default_severity.
+ * - _sender_key, _receiver_key, _time_key: keys holding the ILF sender,
+ *   receiver and time, or empty to leave them out. ILF times in seconds since
+ *   the epoch, with up to three decimals, are written in milliseconds since
+ *   the epoch, as CEF rt and LEEF devTime expect; other times are kept.
+ * - _keys: renaming of ILF keys, e.g. from "pid" to "spid". Unmapped keys are
+ *   kept.
+ */
+struct SiemConfig {
+    SiemConfig() :
+        _vendor("MITRE"),
+        _product("libilf"),
+        _version("1.0"),
+        _default_severity(5),
+        _sender_key("src"),
+        _receiver_key("dst"),
+        _time_key("rt") { }
+
+    std::string _vendor, _product, _version;
+    std::unordered_map<std::string, SiemEventType> _event_types;
+    int _default_severity;
+    std::string _sender_key, _receiver_key, _time_key;
+    std::unordered_map<std::string, std::string> _keys;
+};
+
+namespace detail {
+
+/**
+ * Parts shared by the CEF and LEEF serializers: the configuration and the
+ * header of each event type, built and escaped the first time the event type
+ * is seen.
+ */
+class SiemFormat {
+protected:
+    explicit SiemFormat(SiemConfig config) : _config(std::move(config)) { }
+
+    SiemEventType event_type(std::string const& event_t) const {
+        std::unordered_map<std::string, SiemEventType>::const_iterator it = _config._event_types.find(event_t);
+        if (it != _config._event_types.end()) {
+            return it->second;
+        }
+        return SiemEventType(event_t, event_t, _config._default_severity);
+    }
+
+    AE_FORCEINLINE std::string const& key(std::string const& ilf_key) const {
+        std::unordered_map<std::string, std::string>::const_iterator it = _config._keys.find(ilf_key);
+        return it == _config._keys.end() ? ilf_key : it->second;
+    }
+
+    /**
+     * Strips a key of every character but letters and digits, which keeps
+     * delimiters, '=' and newlines out of the extension or attribute list.
+     */
+    static std::string sanitize_key(std::string const& key) {
+        std::string sanitized;
+        for (size_t i = 0; i < key.size(); i++) {
+            const char c = key[i];
+            if ((c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')) {
+                sanitized += c;
+            }
+        }
+        return sanitized;
+    }
+
+    /**
+     * Returns the renamed and sanitized key of an ILF key, built the first
+     * time the key is seen.
+     */
+    AE_FORCEINLINE std::string const& siem_key(std::string const& ilf_key) {
+        std::unordered_map<std::string, std::string>::iterator it = _keys.find(ilf_key);
+        if (it != _keys.end()) {
+            return it->second;
+        }
+        return _keys.insert(std::make_pair(ilf_key, sanitize_key(key(ilf_key)))).first->second;
+    }
+
+    /**
+     * Returns an ILF time in seconds since the epoch, with up to three
+     * decimals, in milliseconds since the epoch, or the time as is if it is
+     * in any other form.
+     */
+    std::string const& epoch_millis(std::string const& time) {
+        size_t i = 0;
+        uint64_t seconds = 0, millis = 0;
+        for (; i < time.size() && i < 16 && time[i] >= '0' && time[i] <= '9'; i++) {
+            seconds = seconds * 10 + (time[i] - '0');
+        }
+        if (i == 0) {
+            return time;
+        }
+        int decimals = 0;
+        if (i < time.size() && time[i] == '.') {
+            for (i++; i < time.size() && time[i] >= '0' && time[i] <= '9'; i++) {
+                if (decimals < 3) {
+                    millis = millis * 10 + (time[i] - '0');
+                    decimals++;
+                }
+            }
+        }
+        if (i != time.size()) {
+            return time;
+        }
+        for (; decimals < 3; decimals++) {
+            millis *= 10;
+        }
+        _millis = std::to_string(seconds * 1000 + millis);
+        return _millis;
+    }
+
+    SiemConfig _config;
+    std::unordered_map<std::string, std::string> _headers, _keys;
+    std::string _millis;
+};
+
+} // namespace detail
+
+/**
+ * Serializer of ILFs into CEF (ArcSight Common Event Format) lines:
+ *
+ *     CEF:0|vendor|product|version|id|name|severity|src=... dst=... rt=... key=value ...
+ *
+ * Header fields escape | and \, extension values escape = and \ and write
+ * newlines as \n. Extension keys, which CEF restricts to letters and digits,
+ * are stripped of any other character, e.g. "user.name" becomes "username",
+ * and fields whose key ends up empty are left out. Usable as the format_t of
+ * StreamSink and FdSink.
+ */
+class CefFormat : private detail::SiemFormat {
+public:
+    explicit CefFormat(SiemConfig config = SiemConfig()) :
+        SiemFormat(std::move(config)),
+        _header_escaper("|\\\n\r"),
+        _value_escaper("=\\\n\r")
+    {
+        _config._sender_key = sanitize_key(_config._sender_key);
+        _config._receiver_key = sanitize_key(_config._receiver_key);
+        _config._time_key = sanitize_key(_config._time_key);
+    }
+
+    void operator()(ILF const& ilf, std::string& out) {
+        out += header(ilf._event_t);
+        bool first = true;
+        field(out, _config._sender_key, ilf._sender, first);
+        field(out, _config._receiver_key, ilf._receiver, first);
+        field(out, _config._time_key, epoch_millis(ilf._time), first);
+        for (size_t i = 0; i < ilf._pairs.size(); i++) {
+            field(out, siem_key(ilf._pairs[i]._key), ilf._pairs[i]._value, first);
+        }
+        out += '\n';
+    }
+
+private:
+    std::string const& header(std::string const& event_t) {
+        std::unordered_map<std::string, std::string>::iterator it = _headers.find(event_t);
+        if (it != _headers.end()) {
+            return it->second;
+        }
+        SiemEventType type = event_type(event_t);
+        std::string header("CEF:0|");
+        std::string const* fields[] = {&_config._vendor, &_config._product, &_config._version, &type._id, &type._name};
+        for (size_t i = 0; i < 5; i++) {
+            _header_escaper.append(header, *fields[i]);
+            header += '|';
+        }
+        header += std::to_string(type._severity) + "|";
+        return _headers.insert(std::make_pair(event_t, std::move(header))).first->second;
+    }
+
+    AE_FORCEINLINE void field(std::string& out, std::string const& key, std::string const& value, bool& first) {
+        if (key.empty()) {
+            return;
+        }
+        if (!first) {
+            out += ' ';
+        }
+        first = false;
+        out += key;
+        out += '=';
+        _value_escaper.append(out, value);
+    }
+
+    detail::Escaper _header_escaper, _value_escaper;
+};
+
+/**
+ * Serializer of ILFs into LEEF 1.0 (IBM QRadar Log Event Extended Format)
+ * lines, with the default tab delimiter:
+ *
+ *     LEEF:1.0|vendor|product|version|id|sev=severity<tab>src=...<tab>key=value ...
+ *
+ * The event name is not part of LEEF 1.0 and is left out. Header fields
+ * escape | and \, attribute values escape \ and write tabs and newlines as
+ * \t and \n. Attribute keys are stripped of any character but letters and
+ * digits like CEF keys, so that a tab, = or newline in a key cannot split an
+ * attribute or the line. Usable as the format_t of StreamSink and FdSink.
+ */
+class LeefFormat : private detail::SiemFormat {
+public:
+    explicit LeefFormat(SiemConfig config = SiemConfig()) :
+        SiemFormat(std::move(config)),
+        _header_escaper("|\\\n\r"),
+        _value_escaper("\t\\\n\r")
+    {
+        if (_config._time_key == "rt") {
+            _config._time_key = "devTime";
+        }
+        _config._sender_key = sanitize_key(_config._sender_key);
+        _config._receiver_key = sanitize_key(_config._receiver_key);
+        _config._time_key = sanitize_key(_config._time_key);
+    }
+
+    void operator()(ILF const& ilf, std::string& out) {
+        out += header(ilf._event_t);
+        field(out, _config._sender_key, ilf._sender);
+        field(out, _config._receiver_key, ilf._receiver);
+        field(out, _config._time_key, epoch_millis(ilf._time));
+        for (size_t i = 0; i < ilf._pairs.size(); i++) {
+            field(out, siem_key(ilf._pairs[i]._key), ilf._pairs[i]._value);
+        }
+        out += '\n';
+    }
+
+private:
+    std::string const& header(std::string const& event_t) {
+        std::unordered_map<std::string, std::string>::iterator it = _headers.find(event_t);
+        if (it != _headers.end()) {
+            return it->second;
+        }
+        SiemEventType type = event_type(event_t);
+        std::string header("LEEF:1.0|");
+        std::string const* fields[] = {&_config._vendor, &_config._product, &_config._version, &type._id};
+        for (size_t i = 0; i < 4; i++) {
+            _header_escaper.append(header, *fields[i]);
+            header += '|';
+        }
+        header += "sev=" + std::to_string(type._severity);
+        return _headers.insert(std::make_pair(event_t, std::move(header))).first->second;
+    }
+
+    AE_FORCEINLINE void field(std::string& out, std::string const& key, std::string const& value) {
+        if (key.empty()) {
+            return;
+        }
+        out += '\t';
+        out += key;
+        out += '=';
+        _value_escaper.append(out, value);
+    }
+
+    detail::Escaper _header_escaper, _value_escaper;
+};
+
+} // namespace libilf
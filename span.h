@@ -0,0 +1,99 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cassert>
+#include <vector>
+#include <type_traits>
+
+namespace libilf {
+
+/**
+ * Non-owning view over a contiguous sequence of T, standing in for
+ * std::span (C++20) in batch interfaces.
+ */
+template <class T>
+class span {
+public:
+    typedef T element_type;
+    typedef typename std::remove_cv<T>::type value_type;
+    typedef T* iterator;
+
+    span() : _data(nullptr), _size(0) { }
+
+    span(T *data, size_t size) : _data(data), _size(size) { }
+
+    template <size_t M>
+    span(T (&array)[M]) : _data(array), _size(M) { }
+
+    // Allows span<T const> from span<T>
+    //
+    template <class U, class = typename std::enable_if<
+        std::is_convertible<U(*)[], T(*)[]>::value>::type>
+    span(span<U> const& other) : _data(other.data()), _size(other.size()) { }
+
+    template <class U, class A, class = typename std::enable_if<
+        std::is_convertible<U(*)[], T(*)[]>::value>::type>
+    span(std::vector<U, A>& vec) : _data(vec.data()), _size(vec.size()) { }
+
+    template <class U, class A, class = typename std::enable_if<
+        std::is_convertible<U const(*)[], T(*)[]>::value>::type>
+    span(std::vector<U, A> const& vec) : _data(vec.data()), _size(vec.size()) { }
+
+    T* data() const {
+        return _data;
+    }
+
+    size_t size() const {
+        return _size;
+    }
+
+    bool empty() const {
+        return _size == 0;
+    }
+
+    T& operator[](size_t i) const {
+        assert(i < _size);
+        return _data[i];
+    }
+
+    iterator begin() const {
+        return _data;
+    }
+
+    iterator end() const {
+        return _data + _size;
+    }
+
+    span first(size_t count) const {
+        assert(count <= _size);
+        return span(_data, count);
+    }
+
+    span subspan(size_t offset) const {
+        assert(offset <= _size);
+        return span(_data + offset, _size - offset);
+    }
+
+    span subspan(size_t offset, size_t count) const {
+        assert(offset + count <= _size);
+        return span(_data + offset, count);
+    }
+
+private:
+    T *_data;
+    size_t _size;
+};
+
+} // namespace libilf
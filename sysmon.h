@@ -0,0 +1,382 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <initializer_list>
+#include <cstring>
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "atomicops.h"
+#include "ilf.h"
+#include "perfect_hash.h"
+
+namespace libilf {
+
+namespace detail {
+
+/**
+ * Returns a pointer to the first c in [begin, end), or end, looking at 16
+ * bytes at a time.
+ */
+AE_FORCEINLINE char const* find_byte(char const* begin, char const* end, char c) {
+#if defined(__SSE2__)
+    const __m128i pattern = _mm_set1_epi8(c);
+    for (; begin + 16 <= end; begin += 16) {
+        const int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(
+            _mm_loadu_si128(reinterpret_cast<__m128i const*>(begin)), pattern));
+        if (mask != 0) {
+            return begin + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for (; begin < end; begin++) {
+        if (*begin == c) {
+            return begin;
+        }
+    }
+    return end;
+}
+
+AE_FORCEINLINE void append_utf8(std::string& out, uint32_t code_point) {
+    if (code_point < 0x80) {
+        out += static_cast<char>(code_point);
+    } else if (code_point < 0x800) {
+        out += static_cast<char>(0xC0 | (code_point >> 6));
+        out += static_cast<char>(0x80 | (code_point & 0x3F));
+    } else if (code_point < 0x10000) {
+        out += static_cast<char>(0xE0 | (code_point >> 12));
+        out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code_point & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (code_point >> 18));
+        out += static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code_point & 0x3F));
+    }
+}
+
+/**
+ * Sets out to XML character data, decoding the predefined and numeric
+ * entities. Text without & is copied as is. Unknown entities are kept.
+ */
+inline void decode_xml_text(char const* begin, char const* end, std::string& out) {
+    char const* amp = find_byte(begin, end, '&');
+    out.assign(begin, amp);
+    while (amp != end) {
+        char const* semicolon = find_byte(amp, end, ';');
+        const size_t len = semicolon - amp - 1;
+        char const* name = amp + 1;
+        if (semicolon == end) {
+            out.append(amp, end);
+            return;
+        }
+        if (len == 2 && memcmp(name, "lt", 2) == 0) {
+            out += '<';
+        } else if (len == 2 && memcmp(name, "gt", 2) == 0) {
+            out += '>';
+        } else if (len == 3 && memcmp(name, "amp", 3) == 0) {
+            out += '&';
+        } else if (len == 4 && memcmp(name, "quot", 4) == 0) {
+            out += '"';
+        } else if (len == 4 && memcmp(name, "apos", 4) == 0) {
+            out += '\'';
+        } else if (len >= 2 && name[0] == '#') {
+            const bool hex = name[1] == 'x';
+            uint32_t code_point = 0;
+            bool valid = len > 1u + hex;
+            for (char const* p = name + 1 + hex; p < semicolon && valid; p++) {
+                const char lower = *p | 0x20;
+                if (*p >= '0' && *p <= '9') {
+                    code_point = code_point * (hex ? 16 : 10) + (*p - '0');
+                } else if (hex && lower >= 'a' && lower <= 'f') {
+                    code_point = code_point * 16 + (lower - 'a' + 10);
+                } else {
+                    valid = false;
+                }
+                valid = valid && code_point <= 0x10FFFF;
+            }
+            if (valid) {
+                append_utf8(out, code_point);
+            } else {
+                out.append(amp, semicolon + 1);
+            }
+        } else {
+            out.append(amp, semicolon + 1);
+        }
+        begin = semicolon + 1;
+        amp = find_byte(begin, end, '&');
+        out.append(begin, amp);
+    }
+}
+
+/**
+ * Returns a pointer to the > closing a tag, skipping quoted attribute values,
+ * or end.
+ */
+AE_FORCEINLINE char const* find_tag_end(char const* p, char const* end) {
+    while (p < end) {
+        if (*p == '>') {
+            return p;
+        }
+        if (*p == '"' || *p == '\'') {
+            p = find_byte(p + 1, end, *p);
+            if (p == end) {
+                return end;
+            }
+        }
+        p++;
+    }
+    return end;
+}
+
+/**
+ * Finds the value of an attribute within the attributes of a tag, [p, end).
+ */
+inline bool find_attribute(char const* p, char const* end, char const* name, size_t name_len,
+    char const** value, char const** value_end) {
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+            p++;
+        }
+        char const* attr = p;
+        while (p < end && *p != '=' && *p != ' ' && *p != '/') {
+            p++;
+        }
+        const size_t attr_len = p - attr;
+        while (p < end && *p != '\'' && *p != '"') {
+            if (*p == '/') {
+                return false;
+            }
+            p++;
+        }
+        if (p == end) {
+            return false;
+        }
+        char const* close = find_byte(p + 1, end, *p);
+        if (attr_len == name_len && memcmp(attr, name, name_len) == 0) {
+            *value = p + 1;
+            *value_end = close;
+            return true;
+        }
+        p = close + 1;
+    }
+    return false;
+}
+
+} // namespace detail
+
+/**
+ * How the records of one Sysmon event ID become ILFs: their ILF event type,
+ * and the Data fields holding their sender and receiver.
+ */
+struct SysmonEventType {
+    SysmonEventType() { }
+
+    SysmonEventType(std::string const& event_t, std::string const& sender_field,
+        std::string const& receiver_field) :
+        _event_t(event_t),
+        _sender_field(sender_field),
+        _receiver_field(receiver_field) { }
+
+    std::string _event_t, _sender_field, _receiver_field;
+};
+
+/**
+ * Specialized, non-validating scanner of Windows events rendered as XML,
+ * such as Sysmon events, into ILFs. It looks for <EventID>,
+ * <TimeCreated SystemTime="..."> and <Data Name="...">...</Data> elements
+ * only, finding tags with 16-byte SIMD scans, and decodes entities only in
+ * values that contain one.
+ *
+ * Data fields are looked up in a perfect hash table mapping their names to
+ * ILF keys; fields that are not in the table are skipped. The ILF time is
+ * the SystemTime attribute as is. Event IDs without an event type become
+ * "Sysmon<ID>" ILFs with an empty sender and receiver.
+ *
+ * The default tables cover process creation (1), network connections (3)
+ * and file creation (11).
+ */
+class SysmonScanner {
+public:
+    SysmonScanner() : SysmonScanner({
+        {1, SysmonEventType("ProcessCreate", "ParentImage", "Image")},
+        {3, SysmonEventType("FlowStart", "SourceIp", "DestinationIp")},
+        {11, SysmonEventType("FileCreate", "Image", "TargetFilename")}
+    }, {
+        {"Image", "image"}, {"CommandLine", "command_line"}, {"ParentImage", "parent_image"},
+        {"ParentCommandLine", "parent_command_line"}, {"ProcessId", "pid"},
+        {"ParentProcessId", "ppid"}, {"ProcessGuid", "process_guid"},
+        {"ParentProcessGuid", "parent_process_guid"}, {"User", "user"},
+        {"IntegrityLevel", "integrity_level"}, {"Hashes", "hashes"},
+        {"CurrentDirectory", "current_directory"}, {"LogonId", "logon_id"},
+        {"TargetFilename", "file_path"}, {"SourceIp", "src_ip"}, {"SourcePort", "src_port"},
+        {"DestinationIp", "dest_ip"}, {"DestinationPort", "dest_port"}, {"Protocol", "protocol"}
+    }) { }
+
+    /**
+     * Takes the event types by event ID, and the mapping of Data field names
+     * to ILF keys. A field with an empty key is only used as a sender or
+     * receiver.
+     */
+    SysmonScanner(std::initializer_list<std::pair<unsigned int, SysmonEventType>> event_types,
+        std::initializer_list<std::pair<char const*, char const*>> fields) :
+        _fields(field_names(fields, event_types))
+    {
+        for (auto const& field : fields) {
+            _keys.push_back(field.second);
+        }
+        _keys.resize(_fields.size());
+        for (auto const& event_type : event_types) {
+            if (event_type.first >= _event_types.size()) {
+                _event_types.resize(event_type.first + 1);
+            }
+            EventType& type = _event_types[event_type.first];
+            type._event_t = event_type.second._event_t;
+            type._sender = _fields.find(event_type.second._sender_field);
+            type._receiver = _fields.find(event_type.second._receiver_field);
+        }
+    }
+
+    /**
+     * Scans one event into an ILF. Returns false, leaving an empty event
+     * type, if the event has no EventID.
+     */
+    bool scan(char const* xml, size_t len, ILF& ilf) const {
+        ilf._event_t.clear();
+        ilf._sender.clear();
+        ilf._receiver.clear();
+        ilf._time.clear();
+        ilf._pairs.clear();
+        EventType const* type = nullptr;
+        bool found_id = false;
+        char const* end = xml + len, *p = xml;
+        for (;;) {
+            p = detail::find_byte(p, end, '<');
+            if (end - p < 2) {
+                break;
+            }
+            p++;
+            if (*p == '/' || *p == '?' || *p == '!') {
+                p = detail::find_byte(p, end, '>');
+                continue;
+            }
+            char const* name = p;
+            while (p < end && *p != '>' && *p != '/' && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r') {
+                p++;
+            }
+            const size_t name_len = p - name;
+            char const* tag_end = detail::find_tag_end(p, end);
+            if (tag_end == end) {
+                break;
+            }
+            const bool empty = tag_end[-1] == '/';
+            char const* text = tag_end + 1, *text_end = empty ? text : detail::find_byte(text, end, '<');
+            char const* value, *value_end;
+            if (name_len == 4 && memcmp(name, "Data", 4) == 0) {
+                if (!detail::find_attribute(p, tag_end, "Name", 4, &value, &value_end)) {
+                    continue;
+                }
+                int field = _fields.find(value, value_end - value);
+                if (field == PerfectHash::NOT_FOUND) {
+                    continue;
+                }
+                if (type != nullptr && field == type->_sender) {
+                    detail::decode_xml_text(text, text_end, ilf._sender);
+                }
+                if (type != nullptr && field == type->_receiver) {
+                    detail::decode_xml_text(text, text_end, ilf._receiver);
+                }
+                if (!_keys[field].empty()) {
+                    ilf._pairs.push_back(KeyValue(_keys[field], std::string(), true));
+                    detail::decode_xml_text(text, text_end, ilf._pairs.back()._value);
+                }
+            } else if (name_len == 7 && memcmp(name, "EventID", 7) == 0) {
+                unsigned int id = 0;
+                for (char const* digit = text; digit < text_end && *digit >= '0' && *digit <= '9'; digit++) {
+                    id = id * 10 + (*digit - '0');
+                }
+                found_id = true;
+                if (id < _event_types.size() && !_event_types[id]._event_t.empty()) {
+                    type = &_event_types[id];
+                    ilf._event_t = type->_event_t;
+                } else {
+                    ilf._event_t = "Sysmon" + std::to_string(id);
+                }
+            } else if (name_len == 11 && memcmp(name, "TimeCreated", 11) == 0) {
+                if (detail::find_attribute(p, tag_end, "SystemTime", 10, &value, &value_end)) {
+                    detail::decode_xml_text(value, value_end, ilf._time);
+                }
+            }
+            p = text_end;
+        }
+        return found_id;
+    }
+
+    AE_FORCEINLINE bool scan(std::string const& xml, ILF& ilf) const {
+        return scan(xml.data(), xml.size(), ilf);
+    }
+
+private:
+    struct EventType {
+        EventType() : _sender(PerfectHash::NOT_FOUND), _receiver(PerfectHash::NOT_FOUND) { }
+
+        std::string _event_t;
+        int _sender, _receiver;
+    };
+
+    /**
+     * Returns the names of the fields, followed by the sender and receiver
+     * fields that are not mapped to keys.
+     */
+    static std::vector<std::string> field_names(
+        std::initializer_list<std::pair<char const*, char const*>> fields,
+        std::initializer_list<std::pair<unsigned int, SysmonEventType>> event_types) {
+        std::vector<std::string> names;
+        for (auto const& field : fields) {
+            names.push_back(field.first);
+        }
+        for (auto const& event_type : event_types) {
+            std::string const* extra[] = {&event_type.second._sender_field, &event_type.second._receiver_field};
+            for (size_t i = 0; i < 2; i++) {
+                if (!extra[i]->empty() && std::find(names.begin(), names.end(), *extra[i]) == names.end()) {
+                    names.push_back(*extra[i]);
+                }
+            }
+        }
+        return names;
+    }
+
+    PerfectHash _fields;
+    std::vector<std::string> _keys;
+    std::vector<EventType> _event_types;
+};
+
+/**
+ * Parser conversion function from one rendered Sysmon event to an ILF, using
+ * the default tables. Events without an EventID give an ILF with an empty
+ * event type.
+ */
+inline void sysmon_to_ilf(std::string const& xml, ILF& ilf) {
+    static const SysmonScanner scanner;
+    scanner.scan(xml, ilf);
+}
+
+} // namespace libilf
@@ -0,0 +1,137 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#include <iostream>
+#include <cassert>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "parser.h"
+#include "pipeline.h"
+#include "auditd.h"
+
+std::string header(char const* type, int serial, int seconds) {
+    return std::string("type=") + type + " msg=audit(" + std::to_string(1700000000 + seconds) + ".123:" + std::to_string(serial) + "): ";
+}
+
+// Lines of an execve event, with a hex-encoded argument and proctitle
+//
+std::vector<std::string> execve_event(int serial, int seconds) {
+    std::vector<std::string> lines;
+    lines.push_back(header("SYSCALL", serial, seconds) + "arch=c000003e syscall=59 success=yes exit=0 a0=55d5 a1=55d6 "
+        "a2=55d7 a3=0 items=2 ppid=" + std::to_string(serial % 1000) + " pid=" + std::to_string(serial) + " auid=1000 uid=1000 gid=1000 "
+        "euid=1000 tty=pts0 ses=3 comm=\"cat\" exe=\"/usr/bin/cat\" key=(null)");
+    lines.push_back(header("EXECVE", serial, seconds) + "argc=3 a0=\"cat\" a1=2F746D702F6D792066696C65 a2=\"-n\"");
+    lines.push_back(header("CWD", serial, seconds) + "cwd=\"/home/user\"");
+    lines.push_back(header("PATH", serial, seconds) + "item=0 name=\"/usr/bin/cat\" inode=1234 dev=08:01 mode=0100755");
+    lines.push_back(header("PATH", serial, seconds) + "item=1 name=\"/lib64/ld-linux-x86-64.so.2\" inode=99");
+    lines.push_back(header("PROCTITLE", serial, seconds) + "proctitle=636174002F746D702F6D792066696C65002D6E");
+    lines.push_back(header("EOE", serial, seconds));
+    return lines;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        std::cerr << "usage: <num_events> <num_threads>" << std::endl;
+        return -1;
+    }
+    const int NUM_EVENTS = std::stoi(argv[1]), NUM_THREADS = std::stoi(argv[2]);
+
+    // Interleaves the lines of pairs of events
+    //
+    std::vector<std::string> lines;
+    for (int i = 0; i < NUM_EVENTS; i += 2) {
+        std::vector<std::string> first = execve_event(i + 1, i / 1000), second = execve_event(i + 2, i / 1000);
+        for (size_t j = 0; j < first.size(); j++) {
+            lines.push_back(first[j]);
+            if (i + 1 < NUM_EVENTS) {
+                lines.push_back(second[j]);
+            }
+        }
+    }
+    // A user space event without an EOE line, a line without a header, and
+    // an event whose EOE line never comes
+    //
+    lines.push_back(header("USER_LOGIN", 900000001, NUM_EVENTS / 1000) + "pid=1 uid=0 msg='op=login acct=\"root\" res=success'");
+    lines.push_back("not an audit line");
+    lines.push_back(header("SYSCALL", 900000002, NUM_EVENTS / 1000) + "syscall=2 ppid=1 pid=7 comm=\"vi\" exe=\"/usr/bin/vi\"");
+
+    libilf::ILF ilf;
+    libilf::AuditEvent event;
+    event._lines = execve_event(42, 0);
+    event._lines.pop_back();
+    event._time = "1700000000.123";
+    libilf::auditd_to_ilf(event, ilf);
+    assert(ilf._event_t == "ProcessCreate" && ilf._sender == "42" && ilf._receiver == "/usr/bin/cat");
+    assert(ilf._time == "1700000000.123");
+    libilf::ILF expected("ProcessCreate", "42", "/usr/bin/cat", "1700000000.123");
+    const char *pairs[][2] = {
+        {"syscall", "59"}, {"success", "yes"}, {"ppid", "42"}, {"pid", "42"}, {"auid", "1000"},
+        {"uid", "1000"}, {"tty", "pts0"}, {"comm", "cat"}, {"exe", "/usr/bin/cat"}, {"key", "(null)"},
+        {"cwd", "/home/user"}, {"command_line", "cat /tmp/my file -n"}, {"path", "/usr/bin/cat"}
+    };
+    for (size_t i = 0; i < sizeof(pairs) / sizeof(pairs[0]); i++) {
+        expected._pairs.push_back(libilf::KeyValue(pairs[i][0], pairs[i][1], true));
+    }
+    assert(ilf == expected);
+
+    // Single-record events are handed over as soon as they are read, ahead
+    // of an event still waiting for its EOE line, while a kernel anomaly is
+    // grouped with its system call
+    //
+    {
+        std::vector<std::string> few;
+        few.push_back(header("SYSCALL", 7, 0) + "syscall=59 pid=7");
+        few.push_back(header("USER_AUTH", 8, 0) + "pid=1 msg='op=PAM:authentication acct=\"root\" res=success'");
+        few.push_back(header("CRED_ACQ", 9, 0) + "pid=1 msg='op=PAM:setcred acct=\"root\" res=success'");
+        few.push_back(header("ANOM_ABEND", 10, 0) + "pid=11 sig=11");
+        few.push_back(header("SYSCALL", 10, 0) + "syscall=62 pid=11");
+        few.push_back(header("EOE", 10, 0));
+        libilf::VectorSource<std::string> few_source(few);
+        libilf::AuditdSource source(few_source, 64, 2000, 3);
+        std::vector<libilf::AuditEvent> events(4);
+        assert(source.read(events) == 2);
+        assert(events[0]._serial == 8 && events[1]._serial == 9 && events[1]._lines.size() == 1);
+        assert(source.pending() == 1);
+        assert(source.read(events) == 1 && events[0]._serial == 10 && events[0]._lines.size() == 2);
+        assert(source.read(events) == 1 && events[0]._serial == 7);
+        assert(source.read(events) == 0);
+    }
+
+    libilf::VectorSource<std::string> line_source(lines);
+    libilf::AuditdSource source(line_source, 64, 2000);
+    libilf::Parser<libilf::AuditEvent, libilf::ILF> parser(libilf::auditd_to_ilf, NUM_THREADS, 4096);
+    std::vector<libilf::ILF> ilfs;
+    libilf::VectorSink<libilf::ILF> sink(ilfs);
+    libilf::Pipeline<libilf::AuditEvent, libilf::ILF> pipeline(parser, source, sink);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    pipeline.run();
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    assert(ilfs.size() == static_cast<size_t>(NUM_EVENTS) + 3);
+    std::vector<bool> seen(NUM_EVENTS + 1, false);
+    for (size_t i = 0; i < ilfs.size(); i++) {
+        if (ilfs[i]._event_t == "ProcessCreate") {
+            int pid = std::stoi(ilfs[i]._pairs[3]._value);
+            assert(!seen[pid] && ilfs[i]._pairs.size() == 13);
+            assert(ilfs[i]._pairs[11]._value == "cat /tmp/my file -n");
+            seen[pid] = true;
+        } else {
+            assert(ilfs[i]._event_t == "USER_LOGIN" || ilfs[i]._event_t == "SYSCALL" || ilfs[i]._event_t.empty());
+        }
+    }
+
+    std::chrono::duration<double> elapsed_time = end - start;
+    std::cout << "Assembled and converted " << NUM_EVENTS << " events (" << lines.size() << " lines) in " << elapsed_time.count() << " seconds using " << NUM_THREADS << " threads" << std::endl;
+    std::cout << "Throughput: " << (double) NUM_EVENTS / elapsed_time.count() << " events per second" << std::endl;
+    return 0;
+}
@@ -0,0 +1,283 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cassert>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "backfill.h"
+
+struct Piece {
+    Piece() : _file(0), _sequence(0), _last(false) { }
+
+    size_t _file;
+    uint64_t _sequence;
+    bool _last;
+    std::string _text;
+};
+
+void chunk_to_piece(libilf::FileChunk const& chunk, Piece& piece) {
+    piece._file = chunk._file;
+    piece._sequence = chunk._sequence;
+    piece._last = chunk._last;
+    piece._text.assign(chunk._data, chunk._size);
+}
+
+// Counts the lines of a chunk, keeping the chunk until it is written
+//
+struct Count {
+    Count() : _lines(0) { }
+
+    size_t _lines;
+    std::shared_ptr<const char> _owner;
+};
+
+void chunk_to_count(libilf::FileChunk const& chunk, Count& count) {
+    count._lines = 0;
+    for (char const* p = chunk._data, *end = chunk._data + chunk._size;
+        (p = static_cast<char const*>(memchr(p, '\n', end - p))) != nullptr; p++) {
+        count._lines++;
+    }
+    count._owner = chunk._owner;
+}
+
+// Rebuilds the files from their chunks, which must be whole lines in order
+//
+class RebuildSink : public libilf::Sink<Piece> {
+public:
+    explicit RebuildSink(size_t num_files) :
+        _texts(num_files),
+        _sequences(num_files, 0),
+        _done(num_files, false) { }
+
+    void write(libilf::span<const Piece> pieces) override {
+        for (size_t i = 0; i < pieces.size(); i++) {
+            Piece const& piece = pieces[i];
+            assert(!_done[piece._file]);
+            assert(piece._sequence == _sequences[piece._file]++);
+            assert(piece._last || (!piece._text.empty() && piece._text.back() == '\n'));
+            _texts[piece._file] += piece._text;
+            _done[piece._file] = piece._last;
+        }
+    }
+
+    std::vector<std::string> _texts;
+    std::vector<uint64_t> _sequences;
+    std::vector<bool> _done;
+};
+
+class CountSink : public libilf::Sink<Count> {
+public:
+    explicit CountSink(size_t fail_after = 0) : _lines(0), _fail_after(fail_after), _writes(0) { }
+
+    void write(libilf::span<const Count> counts) override {
+        if (_fail_after != 0 && ++_writes == _fail_after) {
+            throw std::runtime_error("sink failed");
+        }
+        for (size_t i = 0; i < counts.size(); i++) {
+            _lines += counts[i]._lines;
+        }
+    }
+
+    size_t _lines, _fail_after, _writes;
+};
+
+std::string read_file(std::string const& path) {
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+void evict(std::vector<std::string> const& paths) {
+    for (size_t i = 0; i < paths.size(); i++) {
+        int fd = open(paths[i].c_str(), O_RDONLY);
+        assert(fd >= 0);
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+// Fraction of the pages of the files in the page cache
+//
+double resident(std::vector<std::string> const& paths) {
+    const size_t page = sysconf(_SC_PAGESIZE);
+    size_t pages = 0, cached = 0;
+    for (size_t i = 0; i < paths.size(); i++) {
+        int fd = open(paths[i].c_str(), O_RDONLY);
+        off_t size = lseek(fd, 0, SEEK_END);
+        if (size > 0) {
+            void *mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            std::vector<unsigned char> vec((size + page - 1) / page);
+            mincore(mapping, size, vec.data());
+            for (size_t j = 0; j < vec.size(); j++) {
+                cached += vec[j] & 1;
+            }
+            pages += vec.size();
+            munmap(mapping, size);
+        }
+        close(fd);
+    }
+    return pages == 0 ? 0 : (double) cached / pages;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        std::cerr << "usage: <num_megabytes> <num_threads>" << std::endl;
+        return -1;
+    }
+    const int NUM_MEGABYTES = std::stoi(argv[1]);
+    const int NUM_THREADS = std::stoi(argv[2]);
+
+    // In the working directory rather than /tmp, which may not support
+    // O_DIRECT
+    //
+    char dir[] = "backfillXXXXXX";
+    assert(mkdtemp(dir) != nullptr);
+    std::vector<std::string> paths;
+    std::vector<std::string> texts;
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> len_dist(20, 300);
+    for (int i = 0; i < 12; i++) {
+        std::string text;
+        size_t size = i == 0 ? 0 : i == 1 ? 65536 : i < 4 ? 200000 : std::uniform_int_distribution<int>(1, 400000)(gen);
+        while (text.size() < size) {
+            text += std::to_string(i) + " " + std::string(std::min<size_t>(len_dist(gen), size - text.size()), 'x');
+            text += '\n';
+        }
+        if (i == 1) {
+            text.resize(65536);
+            text.back() = '\n';
+        } else if (i == 2) {
+            // No trailing newline
+            //
+            text.resize(text.size() - 1);
+        } else if (i == 3) {
+            // A line longer than a chunk and the space for carrying it
+            //
+            text.insert(1000, std::string(150000, 'y'));
+        }
+        paths.push_back(std::string(dir) + "/" + std::to_string(i) + ".log");
+        texts.push_back(text);
+        std::ofstream(paths.back(), std::ios::binary) << text;
+    }
+
+    for (int mode = 0; mode < 3; mode++) {
+        libilf::BackfillConfig config;
+        config._chunk_size = 64 << 10;
+        config._max_carry = 4 << 10;
+        config._buffers = 24;
+        config._direct = mode == 0;
+        config._drop_cache = mode == 1;
+        libilf::Parser<libilf::FileChunk, Piece> parser(chunk_to_piece, NUM_THREADS, 64);
+        libilf::BackfillReader reader(paths, config);
+        RebuildSink sink(paths.size());
+        libilf::Pipeline<libilf::FileChunk, Piece> pipeline(parser, reader, sink, 4);
+        pipeline.run();
+        assert(reader.files_done() == paths.size());
+        for (size_t i = 0; i < paths.size(); i++) {
+            assert(sink._done[i] && sink._texts[i] == texts[i]);
+        }
+    }
+
+    // A failing sink, with the buffers held by outputs, and a missing file
+    //
+    {
+        libilf::BackfillConfig config;
+        config._chunk_size = 64 << 10;
+        config._buffers = 16;
+        libilf::Parser<libilf::FileChunk, Count> parser(chunk_to_count, NUM_THREADS, 64);
+        libilf::BackfillReader reader(paths, config);
+        CountSink sink(2);
+        libilf::Pipeline<libilf::FileChunk, Count> pipeline(parser, reader, sink, 4);
+        bool thrown = false;
+        try {
+            pipeline.run();
+        } catch (std::runtime_error const&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+    {
+        std::vector<std::string> missing(1, std::string(dir) + "/missing.log");
+        libilf::Parser<libilf::FileChunk, Count> parser(chunk_to_count, NUM_THREADS, 64);
+        libilf::BackfillReader reader(missing);
+        CountSink sink;
+        libilf::Pipeline<libilf::FileChunk, Count> pipeline(parser, reader, sink);
+        bool thrown = false;
+        try {
+            pipeline.run();
+        } catch (std::system_error const&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+    for (size_t i = 0; i < paths.size(); i++) {
+        unlink(paths[i].c_str());
+    }
+
+    // Throughput and page cache footprint of each mode against plain buffered
+    // reads through FileScheduler
+    //
+    paths.clear();
+    size_t num_lines = 0;
+    for (int i = 0; i < NUM_MEGABYTES / 16; i++) {
+        paths.push_back(std::string(dir) + "/big" + std::to_string(i) + ".log");
+        std::ofstream file(paths.back(), std::ios::binary);
+        std::string line = "ProcessCreate[10.0.0.1,host,1700000000,(image=\"C:\\Windows\\System32\\svchost.exe\";"
+            "cmd=\"svchost.exe -k netsvcs -p -s Schedule\")]\n";
+        for (size_t written = 0; written < (16 << 20); written += line.size()) {
+            file << line;
+            num_lines++;
+        }
+    }
+    char const* names[] = {"O_DIRECT", "DONTNEED", "FileScheduler"};
+    for (int mode = 0; mode < 3; mode++) {
+        evict(paths);
+        libilf::Parser<libilf::FileChunk, Count> parser(chunk_to_count, NUM_THREADS, 64);
+        CountSink sink;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        uint64_t bytes;
+        if (mode < 2) {
+            libilf::BackfillConfig config;
+            config._direct = mode == 0;
+            libilf::BackfillReader reader(paths, config);
+            libilf::Pipeline<libilf::FileChunk, Count> pipeline(parser, reader, sink, 8);
+            pipeline.run();
+            bytes = reader.bytes();
+        } else {
+            libilf::FileScheduler scheduler(paths);
+            libilf::Pipeline<libilf::FileChunk, Count> pipeline(parser, scheduler, sink, 8);
+            pipeline.run();
+            bytes = scheduler.bytes();
+        }
+        std::chrono::duration<double> elapsed_time = std::chrono::steady_clock::now() - start;
+        assert(sink._lines == num_lines);
+        std::cout << names[mode] << ": read " << bytes << " bytes in " << elapsed_time.count() << " seconds (" <<
+            bytes / elapsed_time.count() / 1e6 << " MB per second), leaving " << resident(paths) * 100 <<
+            "% in the page cache" << std::endl;
+    }
+    for (size_t i = 0; i < paths.size(); i++) {
+        unlink(paths[i].c_str());
+    }
+    rmdir(dir);
+    return 0;
+}
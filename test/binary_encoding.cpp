@@ -0,0 +1,110 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <cassert>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <random>
+#include "encoding.h"
+#include "writer.h"
+
+// The way conversion functions used to encode hashes
+//
+std::string hex_with_stream(std::vector<uint8_t> const& bytes) {
+    std::ostringstream stream;
+    for (size_t i = 0; i < bytes.size(); i++) {
+        stream << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(bytes[i]);
+    }
+    return stream.str();
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        std::cerr << "usage: <num_hashes>" << std::endl;
+        return -1;
+    }
+    const int NUM_HASHES = std::stoi(argv[1]);
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> byte_dist(0, 255), len_dist(0, 100);
+
+    // Round trips at every length around the vector block sizes
+    //
+    for (int i = 0; i < 20000; i++) {
+        std::vector<uint8_t> bytes(i < 100 ? i : len_dist(gen));
+        for (size_t j = 0; j < bytes.size(); j++) {
+            bytes[j] = static_cast<uint8_t>(byte_dist(gen));
+        }
+        std::string hex, base64;
+        libilf::append_hex(hex, bytes.data(), bytes.size());
+        assert(hex == hex_with_stream(bytes));
+        std::vector<uint8_t> decoded(bytes.size() + 1);
+        assert(libilf::hex_decode(hex.data(), hex.size(), decoded.data()));
+        assert(std::equal(bytes.begin(), bytes.end(), decoded.begin()));
+        std::string upper;
+        libilf::append_hex(upper, bytes.data(), bytes.size(), true);
+        assert(libilf::hex_decode(upper.data(), upper.size(), decoded.data()));
+        assert(std::equal(bytes.begin(), bytes.end(), decoded.begin()));
+
+        libilf::append_base64(base64, bytes.data(), bytes.size());
+        assert(libilf::base64_decoded_length(base64.data(), base64.size()) == bytes.size());
+        assert(libilf::base64_decode(base64.data(), base64.size(), decoded.data()));
+        assert(std::equal(bytes.begin(), bytes.end(), decoded.begin()));
+        if (!base64.empty()) {
+            std::string corrupt = base64;
+            corrupt[byte_dist(gen) % corrupt.size()] = "!-_ \x80"[i % 5];
+            assert(!libilf::base64_decode(corrupt.data(), corrupt.size(), decoded.data()));
+            corrupt = hex;
+            corrupt[byte_dist(gen) % corrupt.size()] = "g:/G\x80"[i % 5];
+            assert(!libilf::hex_decode(corrupt.data(), corrupt.size(), decoded.data()));
+        }
+    }
+    std::string base64;
+    libilf::append_base64(base64, "foobar", 6);
+    libilf::append_base64(base64, "fo", 2);
+    assert(base64 == "Zm9vYmFyZm8=");
+    std::string text;
+    libilf::ILFWriter(text).begin("FileCreate", "a", "b", "0").kv_hex("sha1", "\x01\xAB", 2, true).kv_base64("blob", "fo", 2).end();
+    assert(text == "FileCreate[a,b,0,(sha1=\"01AB\";blob=\"Zm8=\")]");
+
+    // SHA-256 hashes
+    //
+    std::vector<std::vector<uint8_t>> hashes(1024, std::vector<uint8_t>(32));
+    for (size_t i = 0; i < hashes.size(); i++) {
+        for (size_t j = 0; j < 32; j++) {
+            hashes[i][j] = static_cast<uint8_t>(byte_dist(gen));
+        }
+    }
+    size_t stream_length = 0, hex_length = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < NUM_HASHES; i++) {
+        stream_length += hex_with_stream(hashes[i & 1023]).size();
+    }
+    std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+    std::string value;
+    for (int i = 0; i < NUM_HASHES; i++) {
+        value.clear();
+        libilf::append_hex(value, hashes[i & 1023].data(), 32);
+        hex_length += value.size();
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    assert(stream_length == hex_length);
+
+    std::chrono::duration<double> stream_time = middle - start, hex_time = end - middle;
+    std::cout << "Encoded " << NUM_HASHES << " hashes in " << stream_time.count() << " seconds with std::ostringstream" << std::endl;
+    std::cout << "Encoded " << NUM_HASHES << " hashes in " << hex_time.count() << " seconds with append_hex()" << std::endl;
+    std::cout << "Throughput: " << (double) NUM_HASHES / hex_time.count() << " hashes per second" << std::endl;
+    return 0;
+}
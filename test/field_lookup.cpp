@@ -0,0 +1,111 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#include <iostream>
+#include <cassert>
+#include <chrono>
+#include <string>
+#include <map>
+#include <random>
+#include "perfect_hash.h"
+
+static_assert(libilf::hash_name("Image") == libilf::hash_name("Image", 5), "constexpr hash");
+
+// Fields of Sysmon events
+//
+const char *SYSMON_FIELDS[] = {
+    "RuleName", "UtcTime", "ProcessGuid", "ProcessId", "Image", "FileVersion",
+    "Description", "Product", "Company", "OriginalFileName", "CommandLine",
+    "CurrentDirectory", "User", "LogonGuid", "LogonId", "TerminalSessionId",
+    "IntegrityLevel", "Hashes", "ParentProcessGuid", "ParentProcessId",
+    "ParentImage", "ParentCommandLine", "ParentUser", "TargetFilename",
+    "CreationUtcTime", "Protocol", "Initiated", "SourceIsIpv6", "SourceIp",
+    "SourceHostname", "SourcePort", "DestinationIsIpv6", "DestinationIp",
+    "DestinationHostname", "DestinationPort", "QueryName", "QueryStatus"
+};
+const int NUM_FIELDS = sizeof(SYSMON_FIELDS) / sizeof(SYSMON_FIELDS[0]);
+
+int classify(char const* key, size_t len) {
+    switch (libilf::hash_bytes(key, len)) {
+    case libilf::hash_name("Image"):
+        return 0;
+    case libilf::hash_name("ParentImage"):
+        return 1;
+    default:
+        return -1;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        std::cerr << "usage: <num_lookups>" << std::endl;
+        return -1;
+    }
+    const int NUM_LOOKUPS = std::stoi(argv[1]);
+    std::vector<std::string> fields(SYSMON_FIELDS, SYSMON_FIELDS + NUM_FIELDS);
+    libilf::PerfectHash hash(fields);
+    std::map<std::string, int> map;
+    for (int i = 0; i < NUM_FIELDS; i++) {
+        map[fields[i]] = i;
+        assert(hash.find(fields[i]) == i);
+        assert(libilf::hash_bytes(fields[i].data(), fields[i].size()) ==
+            libilf::hash_name(fields[i].data(), fields[i].size()));
+    }
+    assert(hash.find("Imag", 4) == libilf::PerfectHash::NOT_FOUND);
+    assert(hash.find("ImageX", 6) == libilf::PerfectHash::NOT_FOUND);
+    assert(hash.find("", 0) == libilf::PerfectHash::NOT_FOUND);
+    assert(classify("ParentImage", 11) == 1 && classify("User", 4) == -1);
+
+    bool threw = false;
+    try {
+        libilf::PerfectHash duplicate({"Image", "User", "Image"});
+    } catch (std::invalid_argument const&) {
+        threw = true;
+    }
+    assert(threw);
+
+    static const libilf::NameMap<std::string> keys({
+        {"Image", "image"}, {"ParentImage", "parent_image"}, {"CommandLine", "cmd"}
+    });
+    assert(*keys.find("CommandLine") == "cmd" && keys.find("User") == nullptr);
+    static const libilf::EventTypes event_types({"ProcessCreate", "FileCreate", "FlowStart"});
+    assert(event_types.id("FlowStart") == 2 && event_types.name(1) == "FileCreate");
+    assert(event_types.id("LogOn") == libilf::PerfectHash::NOT_FOUND);
+
+    // Lookups of field names, a quarter of which are unknown
+    //
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> field_dist(0, NUM_FIELDS * 4 / 3);
+    std::vector<std::string> keys_vec;
+    for (int i = 0; i < 4096; i++) {
+        int field = field_dist(gen);
+        keys_vec.push_back(field < NUM_FIELDS ? fields[field] : "Unknown" + std::to_string(field));
+    }
+    long long map_sum = 0, hash_sum = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < NUM_LOOKUPS; i++) {
+        std::map<std::string, int>::const_iterator it = map.find(keys_vec[i & 4095]);
+        map_sum += it == map.end() ? -1 : it->second;
+    }
+    std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+    for (int i = 0; i < NUM_LOOKUPS; i++) {
+        hash_sum += hash.find(keys_vec[i & 4095]);
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    assert(map_sum == hash_sum);
+
+    std::chrono::duration<double> map_time = middle - start, hash_time = end - middle;
+    std::cout << "Looked up " << NUM_LOOKUPS << " field names in " << map_time.count() << " seconds with std::map" << std::endl;
+    std::cout << "Looked up " << NUM_LOOKUPS << " field names in " << hash_time.count() << " seconds with PerfectHash (" << hash.capacity() << " slots)" << std::endl;
+    std::cout << "Throughput: " << (double) NUM_LOOKUPS / hash_time.count() << " lookups per second" << std::endl;
+    return 0;
+}
@@ -0,0 +1,94 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#include <iostream>
+#include <cassert>
+#include <chrono>
+#include <string>
+#include <stdexcept>
+#include <cstdint>
+#include "parser.h"
+
+void square(uint64_t const& input, uint64_t& output) {
+    output = input * input + 1;
+}
+
+// Pushes every input before starting, so that each queue outgrows its initial
+// capacity of init_size elements, then converts and pops them in order
+//
+template <unsigned int N>
+double run_batch(libilf::Parser<uint64_t, uint64_t, N>& parser, const uint64_t num_inputs) {
+    for (uint64_t i = 0; i < num_inputs; i++) {
+        assert(parser.push(i));
+    }
+    assert(parser.input_size() == num_inputs);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    parser.start_wait();
+    parser.stop_wait();
+    std::chrono::duration<double> elapsed_time = std::chrono::steady_clock::now() - start;
+    uint64_t output;
+    for (uint64_t i = 0; i < num_inputs; i++) {
+        assert(parser.pop(output) && output == i * i + 1);
+    }
+    assert(!parser.pop(output));
+    assert(parser.input_size() == 0 && parser.output_size() == 0);
+    return elapsed_time.count();
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        std::cerr << "usage: <num_inputs>" << std::endl;
+        return -1;
+    }
+    const uint64_t NUM_INPUTS = std::stoull(argv[1]);
+    const unsigned int INIT_SIZE = 16;
+
+    // The thread count must match N
+    //
+    bool thrown = false;
+    try {
+        libilf::Parser<uint64_t, uint64_t, 4> parser(square, 2, INIT_SIZE);
+    } catch (std::invalid_argument const&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    libilf::Parser<uint64_t, uint64_t, 4> fixed(square, INIT_SIZE);
+    assert(fixed.num_threads() == 4);
+    double fixed_time = run_batch(fixed, NUM_INPUTS);
+    libilf::Parser<uint64_t, uint64_t> runtime(square, 4, INIT_SIZE);
+    double runtime_time = run_batch(runtime, NUM_INPUTS);
+
+    // Live, with the consumer trailing the producer by more than the initial
+    // capacity of the queues
+    //
+    libilf::Parser<uint64_t, uint64_t, 4> live(square, INIT_SIZE);
+    live.start();
+    uint64_t pushed = 0, popped = 0, output;
+    while (popped < NUM_INPUTS) {
+        while (pushed < NUM_INPUTS && pushed - popped < 64 * INIT_SIZE) {
+            assert(live.push(pushed));
+            pushed++;
+        }
+        while (live.pop(output)) {
+            assert(output == popped * popped + 1);
+            popped++;
+        }
+    }
+    live.stop();
+    assert(live.input_size() == 0 && live.output_size() == 0);
+
+    std::cout << "Processed " << NUM_INPUTS << " integers in " << fixed_time << " seconds with N = 4 and in " <<
+        runtime_time << " seconds with 4 threads given at runtime" << std::endl;
+    std::cout << "Throughput: " << (double) NUM_INPUTS / fixed_time << " integers per second" << std::endl;
+    return 0;
+}
@@ -0,0 +1,245 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#include <iostream>
+#include <sstream>
+#include <cassert>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <random>
+#include <cstdio>
+#include "session.h"
+
+const uint64_t START_MS = 1697712345000ULL;
+
+std::string format_time(uint64_t ms) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%llu.%03llu", (unsigned long long) (ms / 1000), (unsigned long long) (ms % 1000));
+    return buf;
+}
+
+std::string to_string(libilf::ILF const& ilf) {
+    std::ostringstream stream;
+    stream << ilf;
+    return stream.str();
+}
+
+// FlowStart records of a pool of 5-tuples, at an average of one record per
+// millisecond
+//
+std::vector<libilf::ILF> make_records(std::mt19937& gen, int num_records, int num_flows) {
+    std::vector<libilf::ILF> records;
+    uint64_t time_ms = START_MS;
+    for (int i = 0; i < num_records; i++) {
+        const unsigned int flow = gen() % num_flows;
+        time_ms += gen() % 3;
+        libilf::ILF ilf("FlowStart", "10.0." + std::to_string(flow % 256) + "." + std::to_string(flow / 256 % 256),
+            "192.168.1." + std::to_string(flow % 7), format_time(time_ms));
+        ilf._pairs.push_back(libilf::KeyValue("src_port", std::to_string(1024 + flow % 5), false));
+        ilf._pairs.push_back(libilf::KeyValue("dst_port", "443", false));
+        ilf._pairs.push_back(libilf::KeyValue("proto", "tcp", true));
+        ilf._pairs.push_back(libilf::KeyValue("bytes", std::to_string(gen() % 1500), false));
+        if (i % 3 != 0) {
+            ilf._pairs.push_back(libilf::KeyValue("packets", std::to_string(1 + gen() % 4), false));
+        }
+        records.push_back(ilf);
+    }
+    return records;
+}
+
+// Sessionizes by keeping every open flow in a map and checking it on each
+// record of the same key
+//
+std::vector<std::string> sessionize_slowly(libilf::SessionConfig const& config, std::vector<libilf::ILF> const& records) {
+    struct Open {
+        libilf::ILF _summary;
+        uint64_t _bytes, _packets, _first_ms, _last_ms;
+    };
+    std::map<std::string, Open> flows;
+    std::vector<std::string> summaries;
+    const auto summarize = [&](Open& flow, bool ended) {
+        const bool active = flow._first_ms + config._active_timeout_ms <= flow._last_ms + config._idle_timeout_ms;
+        libilf::ILF summary = flow._summary;
+        summary._pairs.push_back(libilf::KeyValue("bytes", std::to_string(flow._bytes), false));
+        summary._pairs.push_back(libilf::KeyValue("packets", std::to_string(flow._packets), false));
+        summary._pairs.push_back(libilf::KeyValue("duration", format_time(flow._last_ms - flow._first_ms), false));
+        summary._pairs.push_back(libilf::KeyValue("reason", ended ? "end" : active ? "active" : "idle", false));
+        summaries.push_back(to_string(summary));
+    };
+    const auto deadline = [&](Open const& flow) {
+        return std::min(flow._last_ms + config._idle_timeout_ms, flow._first_ms + config._active_timeout_ms);
+    };
+    uint64_t now_ms = 0;
+    for (size_t i = 0; i < records.size(); i++) {
+        libilf::ILF const& record = records[i];
+        uint64_t time_ms;
+        assert(libilf::detail::parse_time_ms(record._time, &time_ms));
+        now_ms = time_ms;
+        std::string key = record._sender + " " + record._receiver;
+        for (size_t j = 0; j < 3; j++) {
+            key += " " + record._pairs[j]._value;
+        }
+        std::map<std::string, Open>::iterator it = flows.find(key);
+        if (it != flows.end() && deadline(it->second) <= time_ms) {
+            summarize(it->second, false);
+            flows.erase(it);
+            it = flows.end();
+        }
+        if (it == flows.end()) {
+            Open& flow = flows[key];
+            flow._summary = libilf::ILF(config._event_t, record._sender, record._receiver, record._time);
+            flow._summary._pairs.assign(record._pairs.begin(), record._pairs.begin() + 3);
+            flow._bytes = flow._packets = 0;
+            flow._first_ms = time_ms;
+            it = flows.find(key);
+        }
+        it->second._bytes += std::stoull(record._pairs[3]._value);
+        it->second._packets += record._pairs.size() > 4 ? std::stoull(record._pairs[4]._value) : 1;
+        it->second._last_ms = time_ms;
+    }
+    for (std::map<std::string, Open>::iterator it = flows.begin(); it != flows.end(); ++it) {
+        summarize(it->second, deadline(it->second) > now_ms);
+    }
+    std::sort(summaries.begin(), summaries.end());
+    return summaries;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 4) {
+        std::cerr << "usage: <num_records> <num_flows> <num_threads>" << std::endl;
+        return -1;
+    }
+    const int NUM_RECORDS = std::stoi(argv[1]), NUM_FLOWS = std::stoi(argv[2]), NUM_THREADS = std::stoi(argv[3]);
+    std::mt19937 gen(42);
+
+    // Timers beyond every level of the wheel, cascading down, and rescheduled
+    //
+    libilf::TimerWheel wheel;
+    std::vector<uint64_t> deadlines;
+    for (uint32_t id = 0; id < 2000; id++) {
+        deadlines.push_back(1 + (id < 1000 ? gen() % 300 : gen() % 20000000));
+        wheel.schedule(id, deadlines.back());
+    }
+    std::vector<uint64_t> fired(2000, 0);
+    for (uint64_t now = 0; now < 20000000; now += 1 + gen() % 5000) {
+        wheel.advance(now, [&](uint32_t id) {
+            assert(fired[id] == 0 && deadlines[id] <= wheel.now() && wheel.now() == deadlines[id]);
+            fired[id] = wheel.now();
+        });
+    }
+    wheel.advance(20000000, [&](uint32_t id) {
+        fired[id] = wheel.now();
+    });
+    assert(wheel.size() == 0);
+    for (uint32_t id = 0; id < 2000; id++) {
+        assert(fired[id] == deadlines[id]);
+    }
+
+    // Idle and active timeouts of a single flow
+    //
+    libilf::SessionConfig config;
+    config._idle_timeout_ms = 10000;
+    config._active_timeout_ms = 60000;
+    std::vector<libilf::ILF> summaries;
+    const auto collect = [&](libilf::ILF&& summary) {
+        summaries.push_back(std::move(summary));
+    };
+    libilf::FlowTable table(config);
+    for (int i = 0; i < 3; i++) {
+        libilf::ILF record("FlowStart", "10.0.0.1", "10.0.0.2", format_time(START_MS + 1000 * i));
+        record._pairs.push_back(libilf::KeyValue("bytes", "100", false));
+        table.add(record, START_MS + 1000 * i, collect);
+    }
+    table.advance(START_MS + 11999, collect);
+    assert(summaries.empty() && table.size() == 1);
+    table.advance(START_MS + 12000, collect);
+    assert(summaries.size() == 1 && table.size() == 0);
+    assert(to_string(summaries[0]) == "FlowSummary[10.0.0.1,10.0.0.2,1697712345.000,(bytes=300;packets=3;duration=2.000;reason=idle)]");
+    for (int i = 0; i <= 14; i++) {
+        const uint64_t time_ms = START_MS + 100000 + 5000 * i;
+        table.add(libilf::ILF("FlowStart", "10.0.0.1", "10.0.0.2", format_time(time_ms)), time_ms, collect);
+    }
+    assert(summaries.size() == 2 && table.size() == 1);
+    assert(to_string(summaries[1]) == "FlowSummary[10.0.0.1,10.0.0.2,1697712445.000,(bytes=0;packets=12;duration=55.000;reason=active)]");
+    table.flush(collect);
+    assert(summaries.size() == 3 && table.size() == 0);
+    assert(to_string(summaries[2]) == "FlowSummary[10.0.0.1,10.0.0.2,1697712505.000,(bytes=0;packets=3;duration=10.000;reason=end)]");
+
+    // 5-tuples against the map, on one table and on the threads
+    //
+    config._key_fields = {"src_port", "dst_port", "proto"};
+    config._idle_timeout_ms = 2000;
+    config._active_timeout_ms = 30000;
+    std::vector<libilf::ILF> records = make_records(gen, 200000, 500);
+    std::vector<std::string> expected = sessionize_slowly(config, records), actual;
+    libilf::FlowTable checked(config);
+    summaries.clear();
+    for (size_t i = 0; i < records.size(); i++) {
+        uint64_t time_ms;
+        assert(libilf::detail::parse_time_ms(records[i]._time, &time_ms));
+        checked.add(records[i], time_ms, collect);
+    }
+    checked.flush(collect);
+    for (size_t i = 0; i < summaries.size(); i++) {
+        actual.push_back(to_string(summaries[i]));
+    }
+    std::sort(actual.begin(), actual.end());
+    assert(actual == expected);
+
+    libilf::Sessionizer small(config, NUM_THREADS, 4096);
+    libilf::ILF summary;
+    actual.clear();
+    small.start();
+    for (size_t i = 0; i < records.size(); i++) {
+        assert(small.push(records[i]));
+        while (small.pop(summary)) {
+            actual.push_back(to_string(summary));
+        }
+    }
+    small.stop();
+    while (small.pop(summary)) {
+        actual.push_back(to_string(summary));
+    }
+    std::sort(actual.begin(), actual.end());
+    assert(actual == expected);
+
+    // Throughput
+    //
+    records = make_records(gen, NUM_RECORDS, NUM_FLOWS);
+    libilf::Sessionizer sessionizer(config, NUM_THREADS, 4096);
+    sessionizer.start();
+    size_t num_summaries = 0;
+    uint64_t packets = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < records.size(); i++) {
+        while (!sessionizer.push(std::move(records[i]))) { }
+        while (sessionizer.pop(summary)) {
+            packets += std::stoull(summary._pairs[4]._value);
+            num_summaries++;
+        }
+    }
+    sessionizer.stop();
+    while (sessionizer.pop(summary)) {
+        packets += std::stoull(summary._pairs[4]._value);
+        num_summaries++;
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    assert(num_summaries > 0 && packets >= (uint64_t) NUM_RECORDS);
+
+    std::chrono::duration<double> elapsed_time = end - start;
+    std::cout << "Sessionized " << NUM_RECORDS << " records into " << num_summaries << " flows in " << elapsed_time.count() << " seconds using " << NUM_THREADS << " threads" << std::endl;
+    std::cout << "Throughput: " << (double) NUM_RECORDS / elapsed_time.count() << " records per second" << std::endl;
+    return 0;
+}
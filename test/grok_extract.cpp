@@ -0,0 +1,219 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#include <iostream>
+#include <cassert>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <random>
+#include <regex>
+#include <stdexcept>
+#include "parser.h"
+#include "grok.h"
+
+libilf::GrokMatcher matcher;
+
+void line_to_ilf(std::string const& line, libilf::ILF& ilf) {
+    matcher.match(line, ilf);
+}
+
+// The same patterns as std::regex, with the fields of each capture group
+// and whether they are quoted
+//
+struct RegexPattern {
+    std::string _event_t;
+    std::regex _regex;
+    std::vector<std::string> _fields;
+    std::vector<bool> _quoted;
+};
+
+void regex_to_ilf(std::vector<RegexPattern> const& patterns, std::string const& line, libilf::ILF& ilf) {
+    std::smatch match;
+    ilf = libilf::ILF();
+    for (size_t i = 0; i < patterns.size(); i++) {
+        if (!std::regex_match(line, match, patterns[i]._regex)) {
+            continue;
+        }
+        ilf._event_t = patterns[i]._event_t;
+        for (size_t j = 0; j < patterns[i]._fields.size(); j++) {
+            std::string const& field = patterns[i]._fields[j];
+            if (field == "sender") {
+                ilf._sender = match[j + 1];
+            } else if (field == "receiver") {
+                ilf._receiver = match[j + 1];
+            } else if (field == "time") {
+                ilf._time = match[j + 1];
+            } else {
+                ilf._pairs.push_back(libilf::KeyValue(field, match[j + 1], patterns[i]._quoted[j]));
+            }
+        }
+        return;
+    }
+    ilf._pairs.push_back(libilf::KeyValue("message", line, true));
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        std::cerr << "usage: <num_lines> <num_threads>" << std::endl;
+        return -1;
+    }
+    const int NUM_LINES = std::stoi(argv[1]), NUM_THREADS = std::stoi(argv[2]);
+
+    matcher.define("SSHD", "%{SYSLOGTIMESTAMP:time} %{HOSTNAME:receiver} sshd\\[%{POSINT:pid:int}\\]:");
+    matcher.add("LogOn", "%{SSHD} Accepted %{WORD:method} for %{USERNAME:user} from %{IP:sender} port %{POSINT:port:int} %{WORD:protocol}");
+    matcher.add("LogOnFailure", "%{SSHD} Failed %{WORD:method} for %{DATA:user} from %{IP:sender} port %{POSINT:port:int} %{WORD:protocol}");
+    matcher.add("HttpRequest", "%{IPORHOST:sender} %{USER:ident} %{USER:auth} \\[%{HTTPDATE:time}\\] \"%{WORD:verb} %{NOTSPACE:request} HTTP/%{NUMBER:http_version}\" %{INT:status:int} %{INT:bytes:int}");
+    matcher.add("AppEvent", "%{TIMESTAMP_ISO8601:time} %{LOGLEVEL:level} \\[%{UUID:request_id}\\] %{GREEDYDATA:message}");
+    assert(matcher.size() == 4);
+
+    std::vector<RegexPattern> regexes = {
+        {"LogOn", std::regex("([A-Za-z]{3}  ?\\d{1,2} \\d\\d:\\d\\d:\\d\\d) ([A-Za-z0-9._-]+) sshd\\[(\\d+)\\]: "
+            "Accepted (\\w+) for ([A-Za-z0-9._-]+) from ([0-9A-Fa-f:.]+) port (\\d+) (\\w+)"),
+            {"time", "receiver", "pid", "method", "user", "sender", "port", "protocol"},
+            {true, true, false, true, true, true, false, true}},
+        {"LogOnFailure", std::regex("([A-Za-z]{3}  ?\\d{1,2} \\d\\d:\\d\\d:\\d\\d) ([A-Za-z0-9._-]+) sshd\\[(\\d+)\\]: "
+            "Failed (\\w+) for (.*?) from ([0-9A-Fa-f:.]+) port (\\d+) (\\w+)"),
+            {"time", "receiver", "pid", "method", "user", "sender", "port", "protocol"},
+            {true, true, false, true, true, true, false, true}},
+        {"HttpRequest", std::regex("([A-Za-z0-9._-]+) ([A-Za-z0-9._-]+) ([A-Za-z0-9._-]+) "
+            "\\[(\\d+/[A-Za-z]+/\\d+:\\d\\d:\\d\\d:\\d\\d [+-]?\\d+)\\] \"(\\w+) (\\S+) HTTP/([\\d.]+)\" ([+-]?\\d+) ([+-]?\\d+)"),
+            {"sender", "ident", "auth", "time", "verb", "request", "http_version", "status", "bytes"},
+            {true, true, true, true, true, true, true, false, false}},
+        {"AppEvent", std::regex("(\\d{4}-\\d\\d-\\d\\dT\\d\\d:\\d\\d:\\d\\d(?:\\.\\d+)?(?:Z|[+-]\\d\\d:?\\d\\d)?) "
+            "([A-Za-z]+) \\[([0-9a-fA-F-]{36})\\] (.*)"),
+            {"time", "level", "request_id", "message"},
+            {true, true, true, true}}
+    };
+
+    // Fields, roles and types
+    //
+    libilf::ILF ilf;
+    assert(matcher.match("Oct  5 06:25:43 gw1 sshd[4721]: Accepted publickey for alice from 10.0.0.7 port 51234 ssh2", ilf) == 0);
+    assert(ilf._event_t == "LogOn" && ilf._time == "Oct  5 06:25:43" && ilf._receiver == "gw1" && ilf._sender == "10.0.0.7");
+    assert(ilf._pairs.size() == 5 && ilf._pairs[0]._key == "pid" && ilf._pairs[0]._value == "4721" && !ilf._pairs[0]._has_quotes);
+    assert(ilf._pairs[2]._key == "user" && ilf._pairs[2]._value == "alice" && ilf._pairs[2]._has_quotes);
+    assert(matcher.match("Oct 15 06:25:43 gw1 sshd[4721]: Failed password for invalid user admin from 2001:db8::1 port 22 ssh2", ilf) == 1);
+    assert(ilf._pairs[2]._value == "invalid user admin" && ilf._sender == "2001:db8::1");
+    assert(matcher.match("10.1.2.3 - frank [10/Oct/2023:13:55:36 -0700] \"GET /a.gif?x=1 HTTP/1.1\" 200 2326", ilf) == 2);
+    assert(ilf._time == "10/Oct/2023:13:55:36 -0700" && ilf._pairs[3]._value == "/a.gif?x=1" && ilf._pairs[5]._value == "200");
+    assert(matcher.match("2023-10-05T06:25:43.123Z INFO [123e4567-e89b-12d3-a456-426614174000] user [x] logged in", ilf) == 3);
+    assert(ilf._pairs[2]._key == "message" && ilf._pairs[2]._value == "user [x] logged in");
+
+    // Anchored at both ends, and validated primitives
+    //
+    assert(matcher.match("Oct  5 06:25:43 gw1 sshd[4721]: Accepted publickey for alice from 10.0.0.7 port 51234 ssh2 x", ilf) == libilf::GrokMatcher::NO_MATCH);
+    assert(ilf._event_t.empty() && ilf._pairs.size() == 1 && ilf._pairs[0]._key == "message");
+    assert(matcher.match("Oct  5 06:25:43 gw1 sshd[4721]: Accepted publickey for alice from 10.0.0.300 port 51234 ssh2", ilf) == libilf::GrokMatcher::NO_MATCH);
+    assert(matcher.match("", ilf) == libilf::GrokMatcher::NO_MATCH);
+
+    // No patterns at all
+    //
+    libilf::GrokMatcher other;
+    assert(other.match("abc", ilf) == libilf::GrokMatcher::NO_MATCH);
+    assert(ilf._event_t.empty() && ilf._pairs.size() == 1 && ilf._pairs[0]._key == "message" && ilf._pairs[0]._value == "abc");
+    assert(other.match("", ilf) == libilf::GrokMatcher::NO_MATCH);
+
+    other.define("LOOP", "x%{LOOP}");
+    bool thrown = false;
+    try {
+        other.add("Loop", "%{LOOP}");
+    } catch (std::invalid_argument const&) {
+        thrown = true;
+    }
+    assert(thrown);
+    thrown = false;
+    try {
+        other.add("Unknown", "%{NOPE:x}");
+    } catch (std::invalid_argument const&) {
+        thrown = true;
+    }
+    assert(thrown);
+    other.add("Quoted", "%{QUOTEDSTRING:a} %{NUMBER:b:float}%{SPACE}%{DATA:c}=%{GREEDYDATA:d}=%{INT:e}");
+    assert(other.match("\"a \\\" b\" -1.5   k=v=w=7", ilf) == 0);
+    assert(ilf._pairs[0]._value == "\"a \\\" b\"" && ilf._pairs[1]._value == "-1.5" && ilf._pairs[2]._value == "k" && ilf._pairs[3]._value == "v=w");
+
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> dist(0, 999);
+    std::vector<std::string> lines;
+    char const* users[] = {"alice", "bob", "invalid user root", "svc_backup"};
+    for (int i = 0; i < NUM_LINES; i++) {
+        const std::string ip = std::to_string(dist(gen) % 256) + "." + std::to_string(dist(gen) % 256) + ".0." + std::to_string(dist(gen) % 256);
+        switch (i % 5) {
+        case 0:
+            lines.push_back("Oct " + std::to_string(1 + dist(gen) % 28) + " 06:25:" + std::to_string(10 + dist(gen) % 50) +
+                " host" + std::to_string(dist(gen)) + " sshd[" + std::to_string(dist(gen)) + "]: Accepted publickey for " +
+                users[dist(gen) % 2] + " from " + ip + " port " + std::to_string(1024 + dist(gen)) + " ssh2");
+            break;
+        case 1:
+            lines.push_back("Oct " + std::to_string(1 + dist(gen) % 28) + " 06:25:" + std::to_string(10 + dist(gen) % 50) +
+                " host" + std::to_string(dist(gen)) + " sshd[" + std::to_string(dist(gen)) + "]: Failed password for " +
+                users[dist(gen) % 4] + " from " + ip + " port " + std::to_string(1024 + dist(gen)) + " ssh2");
+            break;
+        case 2:
+            lines.push_back(ip + " - user" + std::to_string(dist(gen)) + " [10/Oct/2023:13:55:" + std::to_string(10 + dist(gen) % 50) +
+                " -0700] \"GET /index" + std::to_string(dist(gen)) + ".html HTTP/1.1\" " + std::to_string(200 + dist(gen) % 300) + " " +
+                std::to_string(dist(gen) * 100));
+            break;
+        case 3:
+            lines.push_back("2023-10-05T06:25:" + std::to_string(10 + dist(gen) % 50) + ".123Z WARN [123e4567-e89b-12d3-a456-42661417" +
+                std::to_string(1000 + dist(gen)) + "] request " + std::to_string(dist(gen)) + " took too long");
+            break;
+        default:
+            lines.push_back("kernel: [" + std::to_string(dist(gen)) + ".123] eth0: link up, 1000Mbps, full-duplex");
+        }
+    }
+
+    // Same ILFs as std::regex, and timing of both
+    //
+    libilf::ILF expected;
+    for (size_t i = 0; i < lines.size() && i < 5000; i++) {
+        matcher.match(lines[i], ilf);
+        regex_to_ilf(regexes, lines[i], expected);
+        assert(ilf == expected);
+    }
+    const int NUM_REGEX_LINES = NUM_LINES < 20000 ? NUM_LINES : 20000;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < NUM_REGEX_LINES; i++) {
+        regex_to_ilf(regexes, lines[i], expected);
+    }
+    std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+    for (int i = 0; i < NUM_LINES; i++) {
+        matcher.match(lines[i], ilf);
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    std::chrono::duration<double> regex_time = middle - start, grok_time = end - middle;
+    const double regex_rate = NUM_REGEX_LINES / regex_time.count(), grok_rate = NUM_LINES / grok_time.count();
+
+    // As a Parser conversion stage
+    //
+    libilf::Parser<std::string, libilf::ILF> parser(line_to_ilf, NUM_THREADS, 4096);
+    for (int i = 0; i < NUM_LINES; i++) {
+        parser.push(lines[i]);
+    }
+    start = std::chrono::steady_clock::now();
+    parser.start_wait();
+    parser.stop_wait();
+    end = std::chrono::steady_clock::now();
+    for (int i = 0; i < NUM_LINES; i++) {
+        assert(parser.pop(ilf));
+        matcher.match(lines[i], expected);
+        assert(ilf == expected);
+    }
+    std::chrono::duration<double> parser_time = end - start;
+
+    std::cout << "std::regex: " << regex_rate << " lines per second" << std::endl;
+    std::cout << "GrokMatcher: " << grok_rate << " lines per second (" << grok_rate / regex_rate << "x)" << std::endl;
+    std::cout << "Processed " << NUM_LINES << " lines in " << parser_time.count() << " seconds using " << NUM_THREADS << " threads" << std::endl;
+    std::cout << "Throughput: " << (double) NUM_LINES / parser_time.count() << " lines per second" << std::endl;
+    return 0;
+}
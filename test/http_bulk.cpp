@@ -0,0 +1,377 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#include <iostream>
+#include <cassert>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <arpa/inet.h>
+#include "http_sink.h"
+
+// Stand-in for a bulk endpoint: parses bulk requests, optionally gzip
+// compressed, and answers with the status of every item. With failures
+// injected, some requests get a 503 or no response at all, item seq is
+// rejected if it is a multiple of 1009, and throttled with a 429 the first
+// time if it is a multiple of 97. Bodies larger than max_body get a 413, and
+// with refuse_status set every request gets that status.
+//
+class StandInServer {
+public:
+    StandInServer(size_t num_items, bool inject_failures, size_t max_body = SIZE_MAX, int refuse_status = 0) :
+        _accepted(num_items, 0),
+        _throttled(num_items, false),
+        _inject_failures(inject_failures),
+        _max_body(max_body),
+        _refuse_status(refuse_status),
+        _requests(0)
+    {
+        _fd = socket(AF_INET, SOCK_STREAM, 0);
+        assert(_fd >= 0);
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(address);
+        assert(bind(_fd, (struct sockaddr*) &address, len) == 0 && listen(_fd, 64) == 0);
+        assert(getsockname(_fd, (struct sockaddr*) &address, &len) == 0);
+        _port = ntohs(address.sin_port);
+        _acceptor = std::thread(&StandInServer::accept_routine, this);
+    }
+
+    // Returns once the clients closed their connections
+    //
+    void stop() {
+        shutdown(_fd, SHUT_RDWR);
+        _acceptor.join();
+        close(_fd);
+        for (size_t i = 0; i < _handlers.size(); i++) {
+            _handlers[i].join();
+        }
+    }
+
+    uint16_t port() const {
+        return _port;
+    }
+
+    std::vector<int> _accepted;
+
+private:
+    void accept_routine() {
+        int fd;
+        while ((fd = accept(_fd, nullptr, nullptr)) >= 0) {
+            _handlers.push_back(std::thread(&StandInServer::handle, this, fd));
+        }
+    }
+
+    void handle(int fd) {
+        std::string in, body, response;
+        char buf[1 << 16];
+        while (true) {
+            size_t head_end;
+            while ((head_end = in.find("\r\n\r\n")) == std::string::npos) {
+                ssize_t count = read(fd, buf, sizeof(buf));
+                if (count <= 0) {
+                    close(fd);
+                    return;
+                }
+                in.append(buf, count);
+            }
+            const std::string head = in.substr(0, head_end);
+            const size_t length = std::stoul(head.substr(head.find("Content-Length: ") + 16));
+            while (in.size() < head_end + 4 + length) {
+                ssize_t count = read(fd, buf, sizeof(buf));
+                assert(count > 0);
+                in.append(buf, count);
+            }
+            body.assign(in, head_end + 4, length);
+            in.erase(0, head_end + 4 + length);
+            if (head.find("Content-Encoding: gzip") != std::string::npos) {
+                body = gunzip(body);
+            }
+            const unsigned int request = _requests++;
+            if (_inject_failures && request % 71 == 70) {
+                close(fd);
+                return;
+            }
+            std::string status_line = "HTTP/1.1 200 OK";
+            if (_inject_failures && request % 50 == 49) {
+                status_line = "HTTP/1.1 503 Service Unavailable";
+                response = "{}";
+            } else if (_refuse_status != 0) {
+                status_line = "HTTP/1.1 " + std::to_string(_refuse_status) + " Refused";
+                response = "{}";
+            } else if (body.size() > _max_body) {
+                status_line = "HTTP/1.1 413 Payload Too Large";
+                response = "{}";
+            } else {
+                response = answer(body);
+            }
+            response = status_line + "\r\nContent-Type: application/json\r\nContent-Length: " +
+                std::to_string(response.size()) + "\r\n\r\n" + response;
+            assert(write(fd, response.data(), response.size()) == (ssize_t) response.size());
+        }
+    }
+
+    std::string answer(std::string const& body) {
+        std::string items;
+        bool errors = false;
+        std::unique_lock<std::mutex> lock(_mutex);
+        for (size_t line = 0; line < body.size(); line = body.find('\n', line) + 1) {
+            assert(body.compare(line, 10, "{\"index\":{") == 0);
+            line = body.find('\n', line) + 1;
+            const size_t seq = strtoul(body.c_str() + body.find("\"seq\":", line) + 6, nullptr, 10);
+            int status = 201;
+            if (_inject_failures && seq % 1009 == 0) {
+                status = 400;
+            } else if (_inject_failures && seq % 97 == 0 && !_throttled[seq]) {
+                _throttled[seq] = true;
+                status = 429;
+            } else {
+                _accepted[seq]++;
+            }
+            errors = errors || status != 201;
+            items += std::string(items.empty() ? "" : ",") + "{\"index\":{\"_index\":\"ilf\",\"_id\":\"" +
+                std::to_string(seq) + "\",\"status\":" + std::to_string(status) +
+                (status == 201 ? "}}" : ",\"error\":{\"type\":\"x\",\"reason\":\"a \\\"quoted\\\" [reason]\"}}}");
+        }
+        return std::string("{\"took\":3,\"errors\":") + (errors ? "true" : "false") + ",\"items\":[" + items + "]}";
+    }
+
+    std::string gunzip(std::string const& compressed) {
+#if defined(LIBILF_WITH_ZLIB)
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        assert(inflateInit2(&stream, 15 + 16) == Z_OK);
+        std::string out(compressed.size() * 4 + 1024, '\0');
+        stream.next_in = (Bytef*) compressed.data();
+        stream.avail_in = compressed.size();
+        int result;
+        do {
+            if (stream.total_out == out.size()) {
+                out.resize(out.size() * 2);
+            }
+            stream.next_out = (Bytef*) &out[stream.total_out];
+            stream.avail_out = out.size() - stream.total_out;
+            result = inflate(&stream, Z_NO_FLUSH);
+            assert(result == Z_OK || result == Z_STREAM_END);
+        } while (result != Z_STREAM_END);
+        out.resize(stream.total_out);
+        inflateEnd(&stream);
+        return out;
+#else
+        assert(false);
+        return compressed;
+#endif
+    }
+
+    int _fd;
+    uint16_t _port;
+    std::thread _acceptor;
+    std::vector<std::thread> _handlers;
+    std::mutex _mutex;
+    std::vector<bool> _throttled;
+    const bool _inject_failures;
+    const size_t _max_body;
+    const int _refuse_status;
+    std::atomic<unsigned int> _requests;
+};
+
+std::vector<libilf::ILF> make_records(size_t num_records) {
+    std::vector<libilf::ILF> records;
+    for (size_t i = 0; i < num_records; i++) {
+        libilf::ILF ilf("FlowStart", "10.0.0." + std::to_string(i % 256), "192.168.1.1", std::to_string(1697712345 + i / 1000));
+        ilf._pairs.push_back(libilf::KeyValue("seq", std::to_string(i), false));
+        ilf._pairs.push_back(libilf::KeyValue("bytes", std::to_string(i * 7 % 1500), false));
+        ilf._pairs.push_back(libilf::KeyValue("image", "C:\\Windows\\System32\\svchost.exe", true));
+        ilf._pairs.push_back(libilf::KeyValue("cmdline", "svchost.exe -k \"netsvcs\" -p\t-s Schedule", true));
+        records.push_back(ilf);
+    }
+    return records;
+}
+
+// Writes the records in batches, as a Pipeline would, and returns the time
+// taken until the sink is closed
+//
+double send(libilf::HttpBulkSink& sink, std::vector<libilf::ILF> const& records) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < records.size(); i += 1024) {
+        sink.write(libilf::span<const libilf::ILF>(records.data() + i, std::min<size_t>(1024, records.size() - i)));
+    }
+    sink.close();
+    std::chrono::duration<double> elapsed_time = std::chrono::steady_clock::now() - start;
+    return elapsed_time.count();
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        std::cerr << "usage: <num_records> <num_connections>" << std::endl;
+        return -1;
+    }
+    const size_t NUM_RECORDS = std::stoul(argv[1]);
+    const unsigned int NUM_CONNECTIONS = std::stoul(argv[2]);
+
+    // Escaping, numbers, and a response with errors
+    //
+    libilf::ILF ilf("ProcessCreate", "host\"1\"", "", "1697712345.5");
+    ilf._pairs.push_back(libilf::KeyValue("pid", "4242", false));
+    ilf._pairs.push_back(libilf::KeyValue("ratio", "0.5e3", false));
+    ilf._pairs.push_back(libilf::KeyValue("flag", "yes", false));
+    ilf._pairs.push_back(libilf::KeyValue("path", std::string("C:\\a\\b\n\x01\x7f and a long enough tail"), true));
+    std::string json;
+    libilf::JsonFormat()(ilf, json);
+    assert(json == "{\"event_t\":\"ProcessCreate\",\"sender\":\"host\\\"1\\\"\",\"receiver\":\"\",\"time\":\"1697712345.5\","
+        "\"pid\":4242,\"ratio\":0.5e3,\"flag\":\"yes\",\"path\":\"C:\\\\a\\\\b\\n\\u0001\x7f and a long enough tail\"}\n");
+    bool errors;
+    std::vector<int> statuses;
+    assert(libilf::detail::parse_bulk_response("{\"took\":3, \"errors\": true, \"items\": [{\"index\":{\"_id\":\"a]}\","
+        "\"status\":201}}, {\"create\":{\"error\":{\"caused_by\":[1,{\"x\":null}]},\"status\":429}}]}", &errors, statuses));
+    assert(errors && statuses.size() == 2 && statuses[0] == 201 && statuses[1] == 429);
+    assert(!libilf::detail::parse_bulk_response("{\"errors\":true,\"items\":[{\"index\":{\"status\":201}", &errors, statuses));
+    assert(!libilf::detail::parse_bulk_response("{\"errors\":true,\"items\":[{\"index\":{\"_id\":\"a\\", &errors, statuses));
+
+    // Retries only what failed, and delivers everything else exactly once
+    //
+    std::vector<libilf::ILF> records = make_records(NUM_RECORDS);
+    StandInServer server(NUM_RECORDS, true);
+    libilf::HttpBulkConfig config;
+    config._port = server.port();
+    config._index = "ilf";
+    config._max_body_bytes = 1 << 16;
+    config._max_in_flight = NUM_CONNECTIONS;
+    config._retry_backoff_ms = 1;
+    libilf::HttpBulkSink checked(config);
+    send(checked, records);
+    server.stop();
+    libilf::HttpBulkStats stats = checked.stats();
+    size_t rejected = 0;
+    for (size_t i = 0; i < NUM_RECORDS; i++) {
+        assert(server._accepted[i] == (i % 1009 == 0 ? 0 : 1));
+        rejected += i % 1009 == 0;
+    }
+    assert(stats._items == NUM_RECORDS - rejected && stats._rejected == rejected && stats._failed == 0);
+    assert(stats._retried > 0);
+
+    // Unreachable endpoints fail once the retries run out
+    //
+    config._port = 1;
+    config._max_retries = 1;
+    libilf::HttpBulkSink unreachable(config);
+    bool failed = false;
+    try {
+        send(unreachable, std::vector<libilf::ILF>(records.begin(), records.begin() + 10));
+    } catch (std::runtime_error const&) {
+        failed = true;
+    }
+    assert(failed && unreachable.stats()._failed == 10);
+
+    // Bodies too large for the server are split until they fit, and a
+    // request refused as a whole is an error
+    //
+    {
+        StandInServer limited(NUM_RECORDS, false, 5000);
+        config = libilf::HttpBulkConfig();
+        config._port = limited.port();
+        config._max_body_bytes = 1 << 16;
+        libilf::HttpBulkSink split(config);
+        send(split, records);
+        limited.stop();
+        for (size_t i = 0; i < NUM_RECORDS; i++) {
+            assert(limited._accepted[i] == 1);
+        }
+        assert(split.stats()._items == NUM_RECORDS && split.stats()._retried > 0 && split.stats()._failed == 0);
+    }
+    for (int status = 401; status <= 413; status += 12) {
+        StandInServer refusing(NUM_RECORDS, false, status == 413 ? 0 : SIZE_MAX, status == 413 ? 0 : status);
+        config = libilf::HttpBulkConfig();
+        config._port = refusing.port();
+        libilf::HttpBulkSink refused(config);
+        failed = false;
+        try {
+            send(refused, std::vector<libilf::ILF>(records.begin(), records.begin() + 10));
+        } catch (std::runtime_error const&) {
+            failed = true;
+        }
+        refusing.stop();
+        assert(failed && refused.stats()._failed == 10 && refused.stats()._items == 0);
+    }
+
+    // A failure is reported by the next write, even one that does not fill a
+    // body
+    //
+    {
+        StandInServer refusing(NUM_RECORDS, false, SIZE_MAX, 401);
+        config = libilf::HttpBulkConfig();
+        config._port = refusing.port();
+        libilf::HttpBulkSink refused(config);
+        refused.write(libilf::span<const libilf::ILF>(&records[0], 1));
+        refused.flush();
+        while (refused.stats()._failed == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        failed = false;
+        try {
+            refused.write(libilf::span<const libilf::ILF>(&records[1], 1));
+        } catch (std::runtime_error const&) {
+            failed = true;
+        }
+        assert(failed);
+        refused.close();
+        refusing.stop();
+    }
+
+    // One request per few records on one connection, against large bodies
+    // on several
+    //
+    StandInServer small_server(NUM_RECORDS, false);
+    config = libilf::HttpBulkConfig();
+    config._port = small_server.port();
+    config._max_body_bytes = 1024;
+    config._max_in_flight = 1;
+    libilf::HttpBulkSink small(config);
+    const double small_time = send(small, records);
+    small_server.stop();
+    const libilf::HttpBulkStats small_stats = small.stats();
+    assert(small_stats._items == NUM_RECORDS);
+
+    StandInServer bulk_server(NUM_RECORDS, false);
+    config._port = bulk_server.port();
+    config._max_body_bytes = 1 << 22;
+    config._max_in_flight = NUM_CONNECTIONS;
+    libilf::HttpBulkSink bulk(config);
+    const double bulk_time = send(bulk, records);
+    bulk_server.stop();
+    stats = bulk.stats();
+    assert(stats._items == NUM_RECORDS);
+
+    std::cout << "Posted " << NUM_RECORDS << " ILFs in " << small_stats._requests << " requests in " << small_time << " seconds" << std::endl;
+    std::cout << "Throughput: " << (double) NUM_RECORDS / small_time << " ILFs per second" << std::endl;
+    std::cout << "Posted " << NUM_RECORDS << " ILFs in " << stats._requests << " requests (" << stats._body_bytes << " bytes) in " << bulk_time << " seconds using " << NUM_CONNECTIONS << " connections" << std::endl;
+    std::cout << "Throughput: " << (double) NUM_RECORDS / bulk_time << " ILFs per second" << std::endl;
+#if defined(LIBILF_WITH_ZLIB)
+    StandInServer gzip_server(NUM_RECORDS, false);
+    config._port = gzip_server.port();
+    config._gzip = true;
+    libilf::HttpBulkSink gzip(config);
+    const double gzip_time = send(gzip, records);
+    gzip_server.stop();
+    stats = gzip.stats();
+    assert(stats._items == NUM_RECORDS);
+    std::cout << "Posted " << NUM_RECORDS << " ILFs in " << stats._requests << " gzip requests (" << stats._body_bytes << " bytes) in " << gzip_time << " seconds using " << NUM_CONNECTIONS << " connections" << std::endl;
+    std::cout << "Throughput: " << (double) NUM_RECORDS / gzip_time << " ILFs per second" << std::endl;
+#endif
+    return 0;
+}
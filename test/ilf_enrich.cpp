@@ -0,0 +1,245 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#include <iostream>
+#include <cassert>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <random>
+#include <fstream>
+#include <stdexcept>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include "lpm.h"
+
+struct Network {
+    uint32_t _prefix;
+    unsigned int _length;
+};
+
+// Longest prefix match by scanning every network, later ones winning ties
+//
+uint32_t lookup_slowly(std::vector<Network> const& networks, uint32_t address) {
+    uint32_t value = 0;
+    int best = -1;
+    for (size_t i = 0; i < networks.size(); i++) {
+        const uint32_t mask = networks[i]._length == 0 ? 0 : ~0u << (32 - networks[i]._length);
+        if ((address & mask) == (networks[i]._prefix & mask) && static_cast<int>(networks[i]._length) >= best) {
+            best = networks[i]._length;
+            value = i + 1;
+        }
+    }
+    return value;
+}
+
+// Resident set size of the process in bytes
+//
+size_t resident() {
+    size_t pages = 0, resident_pages = 0;
+    std::ifstream("/proc/self/statm") >> pages >> resident_pages;
+    return resident_pages * sysconf(_SC_PAGESIZE);
+}
+
+// Counts the pairs of the ILFs written to it
+//
+class CountingSink : public libilf::Sink<libilf::ILF> {
+public:
+    CountingSink() : _pairs(0) { }
+
+    void write(libilf::span<const libilf::ILF> ilfs) override {
+        for (size_t i = 0; i < ilfs.size(); i++) {
+            _pairs += ilfs[i]._pairs.size();
+        }
+    }
+
+    size_t _pairs;
+};
+
+std::string to_string(uint32_t address) {
+    return std::to_string(address >> 24) + "." + std::to_string((address >> 16) & 0xFF) + "." +
+        std::to_string((address >> 8) & 0xFF) + "." + std::to_string(address & 0xFF);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        std::cerr << "usage: <num_networks> <num_lookups>" << std::endl;
+        return -1;
+    }
+    const int NUM_NETWORKS = std::stoi(argv[1]), NUM_LOOKUPS = std::stoi(argv[2]);
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<uint32_t> address_dist(0, UINT32_MAX);
+    std::uniform_int_distribution<unsigned int> length_dist(8, 32);
+
+    // Only the pages of the top-level table that prefixes are painted on are
+    // backed by memory
+    //
+    {
+        const size_t before = resident();
+        libilf::Ipv4Table table;
+        table.add(0x0A010200, 24, 1);
+        table.add(0xC0A80000, 16, 2);
+        table.build();
+        assert(table.lookup(0x0A010203) == 1 && table.lookup(0xC0A8FFFF) == 2 && table.lookup(0x08080808) == 0);
+        assert(resident() - before < (16 << 20));
+    }
+
+    // Prefix lengths are digits within the range of the address family
+    //
+    const char *malformed[] = {"10.0.0.0/33", "10.0.0.0/", "10.0.0.0/+8", "10.0.0.0/ 8", "10.0.0.0/8x",
+        "10.0.0.0/-1", "10.0.0.0/0008", "2001:db8::/129", "2001:db8::/1e2", "10.0.0.0/4294967304"};
+    for (size_t i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++) {
+        libilf::Enricher bad;
+        bool thrown = false;
+        try {
+            bad.add(malformed[i], {libilf::KeyValue("zone", "z", true)});
+        } catch (std::invalid_argument const&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+
+    // Networks nested within a few /8s so that lookups hit all lengths
+    //
+    libilf::Enricher enricher;
+    std::vector<Network> networks;
+    for (int i = 0; i < NUM_NETWORKS; i++) {
+        Network network = {(address_dist(gen) & 0x03FFFFFF) | (10u << 24), length_dist(gen)};
+        if (i % 4 == 0) {
+            network._length = 8 + i % 17;
+        }
+        networks.push_back(network);
+        enricher.add(to_string(network._prefix) + "/" + std::to_string(network._length),
+            {libilf::KeyValue("zone", "z" + std::to_string(i), true)});
+    }
+    enricher.add("2001:db8::/32", {libilf::KeyValue("zone", "v6", true)});
+    enricher.add("2001:db8:1:2::/64", {libilf::KeyValue("zone", "v6lan", true), libilf::KeyValue("site", "hq", true)});
+    enricher.add("2001:db8:1:2::7", {libilf::KeyValue("asset", "db1", true)});
+    enricher.add("2001:db8:1:2:0:0:0:8/126", {libilf::KeyValue("zone", "v6tiny", true)});
+    enricher.build();
+
+    std::vector<uint32_t> addresses;
+    for (int i = 0; i < 100000; i++) {
+        uint32_t address = address_dist(gen);
+        addresses.push_back(i % 3 == 0 ? address : (address & 0x03FFFFFF) | (10u << 24));
+        assert(enricher.lookup(to_string(addresses.back())) == lookup_slowly(networks, addresses.back()));
+    }
+    assert(enricher.lookup("2001:db8:ffff::1") == static_cast<uint32_t>(NUM_NETWORKS + 1));
+    assert(enricher.lookup("2001:db8:1:2::1") == static_cast<uint32_t>(NUM_NETWORKS + 2));
+    assert(enricher.lookup("2001:db8:1:2::7") == static_cast<uint32_t>(NUM_NETWORKS + 3));
+    assert(enricher.lookup("2001:db8:1:2::b") == static_cast<uint32_t>(NUM_NETWORKS + 4));
+    assert(enricher.lookup("2001:db8:1:2::c") == static_cast<uint32_t>(NUM_NETWORKS + 2));
+    assert(enricher.lookup("2001:db9::1") == 0 && enricher.lookup("host.example.com") == 0);
+    assert(enricher.lookup("10.1.2.256") == 0 && enricher.lookup("10.1.2") == 0);
+
+    libilf::ILF ilf("FlowStart", "2001:db8:1:2::7", "hostname", "0");
+    enricher.enrich(ilf);
+    assert(ilf._pairs.size() == 1 && ilf._pairs[0]._key == "sender_asset" && ilf._pairs[0]._value == "db1");
+
+    // Batches give the same pairs as single lookups
+    //
+    std::vector<libilf::ILF> ilfs, expected;
+    for (int i = 0; i < 4096; i++) {
+        ilfs.push_back(libilf::ILF("FlowStart", to_string(addresses[i]), i % 5 == 0 ? "2001:db8::9" : to_string(addresses[i + 1]), "0"));
+        expected.push_back(ilfs.back());
+        enricher.enrich(expected.back());
+    }
+    std::vector<libilf::ILF> sunk;
+    libilf::VectorSink<libilf::ILF> vector_sink(sunk);
+    libilf::EnrichingSink sink(enricher, vector_sink);
+    sink.write(ilfs);
+    assert(sunk == expected);
+
+    // Through a pipeline, batches are enriched in place
+    //
+    {
+        std::vector<libilf::ILF> piped;
+        libilf::VectorSource<libilf::ILF> source(ilfs);
+        libilf::VectorSink<libilf::ILF> piped_sink(piped);
+        libilf::EnrichingSink enriching(enricher, piped_sink);
+        libilf::Parser<libilf::ILF, libilf::ILF> parser([](libilf::ILF const& in, libilf::ILF& out) { out = in; }, 2, 1024);
+        libilf::Pipeline<libilf::ILF, libilf::ILF> pipeline(parser, source, enriching);
+        pipeline.run();
+        assert(piped == expected);
+    }
+
+    // Enrichment of const batches, which are copied, against enrichment in
+    // place, each batch being copied out of the inputs first as a Pipeline
+    // pops its outputs
+    //
+    std::vector<libilf::ILF> many;
+    for (size_t i = 0; i < (1 << 18); i++) {
+        many.push_back(ilfs[i % ilfs.size()]);
+        many.back()._pairs.push_back(libilf::KeyValue("image", "C:\\Windows\\System32\\svchost.exe", true));
+        many.back()._pairs.push_back(libilf::KeyValue("cmd", "svchost.exe -k netsvcs -p -s Schedule", true));
+        many.back()._pairs.push_back(libilf::KeyValue("bytes", std::to_string(i), false));
+    }
+    const size_t BATCH_SIZE = 256;
+    CountingSink copied_count, in_place_count;
+    libilf::EnrichingSink copying(enricher, copied_count), in_place(enricher, in_place_count);
+    CountingSink popped_count;
+    std::chrono::duration<double> pop_time(0), copy_time(0), in_place_time(0);
+    for (int round = 0; round < 3; round++) {
+        std::chrono::steady_clock::time_point pop_start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < many.size(); i += BATCH_SIZE) {
+            std::vector<libilf::ILF> batch(many.begin() + i, many.begin() + i + BATCH_SIZE);
+            popped_count.write(batch);
+        }
+        std::chrono::steady_clock::time_point enrich_start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < many.size(); i += BATCH_SIZE) {
+            std::vector<libilf::ILF> batch(many.begin() + i, many.begin() + i + BATCH_SIZE);
+            copying.write(batch);
+        }
+        std::chrono::steady_clock::time_point enrich_middle = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < many.size(); i += BATCH_SIZE) {
+            std::vector<libilf::ILF> batch(many.begin() + i, many.begin() + i + BATCH_SIZE);
+            in_place.write_mutable(batch);
+        }
+        std::chrono::steady_clock::time_point enrich_end = std::chrono::steady_clock::now();
+        pop_time += enrich_start - pop_start;
+        copy_time += enrich_middle - enrich_start;
+        in_place_time += enrich_end - enrich_middle;
+    }
+    assert(copied_count._pairs == in_place_count._pairs && in_place_count._pairs > 0);
+
+    std::vector<uint32_t> values(addresses.size());
+    uint32_t single_sum = 0, batch_sum = 0;
+    libilf::Ipv4Table table;
+    for (size_t i = 0; i < networks.size(); i++) {
+        table.add(networks[i]._prefix, networks[i]._length, i + 1);
+    }
+    table.build();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < NUM_LOOKUPS; i++) {
+        single_sum += table.lookup(addresses[i % addresses.size()] * 2654435761u);
+    }
+    std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < addresses.size(); i++) {
+        addresses[i] *= 2654435761u;
+    }
+    for (int i = 0; i < NUM_LOOKUPS; i += addresses.size()) {
+        table.lookup(addresses, values);
+        for (size_t j = 0; j < values.size() && i + j < static_cast<size_t>(NUM_LOOKUPS); j++) {
+            batch_sum += values[j];
+        }
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    assert(single_sum == batch_sum);
+
+    std::chrono::duration<double> single_time = middle - start, batch_time = end - middle;
+    std::cout << "Enriched " << 3 * many.size() << " ILFs in " << (copy_time - pop_time).count() <<
+        " seconds copied and in " << (in_place_time - pop_time).count() << " seconds in place" << std::endl;
+    std::cout << "Looked up " << NUM_LOOKUPS << " IPv4 addresses in " << single_time.count() << " seconds one by one" << std::endl;
+    std::cout << "Looked up " << NUM_LOOKUPS << " IPv4 addresses in " << batch_time.count() << " seconds in batches" << std::endl;
+    std::cout << "Throughput: " << (double) NUM_LOOKUPS / batch_time.count() << " lookups per second" << std::endl;
+    return 0;
+}
@@ -0,0 +1,110 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#include <iostream>
+#include <sstream>
+#include <cassert>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "reader.h"
+#include "binary.h"
+
+bool same(libilf::ILF const& a, libilf::ILF const& b) {
+    if (a._event_t != b._event_t || a._sender != b._sender || a._receiver != b._receiver ||
+        a._time != b._time || a._pairs.size() != b._pairs.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a._pairs.size(); i++) {
+        if (!(a._pairs[i] == b._pairs[i]) || a._pairs[i]._has_quotes != b._pairs[i]._has_quotes) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        std::cerr << "usage: <num_inputs>" << std::endl;
+        return -1;
+    }
+    const int NUM_INPUTS = std::stoi(argv[1]);
+
+    std::vector<libilf::ILF> ilfs;
+    for (int i = 0; i < NUM_INPUTS; i++) {
+        libilf::ILF ilf("ProcessCreate", "10.0.0." + std::to_string(i % 256), "host" + std::to_string(i % 7),
+            std::to_string(1700000000 + i));
+        for (int j = 0; j < i % 5; j++) {
+            ilf._pairs.push_back(libilf::KeyValue("key" + std::to_string(j),
+                j % 2 == 0 ? "C:\\Windows\\a b;c)=d" : std::to_string(i * j), j % 2 == 0));
+        }
+        ilfs.push_back(ilf);
+    }
+
+    // Both operator<< overloads, the latter with its trailing space
+    //
+    libilf::ILF parsed;
+    for (size_t i = 0; i < ilfs.size(); i++) {
+        std::ostringstream os;
+        os << ilfs[i];
+        assert(libilf::parse_ilf(os.str(), parsed) && same(parsed, ilfs[i]));
+        std::string str;
+        str << ilfs[i];
+        assert(libilf::parse_ilf(str + "\r\n", parsed) && same(parsed, ilfs[i]));
+    }
+    char const* malformed[] = {"", "]", "a[b,c,d,()", "a[b,c,()]", "a[b,c,d,(k)]", "a[b,c,d,(k=\"v)]",
+        "a[b,c,d,(k=\"v\"x)]", "a[b,c,d,k=v]"};
+    for (size_t i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++) {
+        assert(!libilf::parse_ilf(malformed[i], parsed));
+    }
+    assert(libilf::parse_ilf("a[b,c,d,(k=;j=\"\")]", parsed) && parsed._pairs.size() == 2 &&
+        parsed._pairs[0]._value.empty() && !parsed._pairs[0]._has_quotes && parsed._pairs[1]._has_quotes);
+
+    // Binary records, including truncated ones
+    //
+    std::string binary;
+    libilf::BinaryFormat format;
+    for (size_t i = 0; i < ilfs.size(); i++) {
+        format(ilfs[i], binary);
+    }
+    char const* p = binary.data(), *end = binary.data() + binary.size();
+    for (size_t i = 0; i < ilfs.size(); i++) {
+        assert(libilf::read_binary_ilf(p, end, parsed) && same(parsed, ilfs[i]));
+    }
+    assert(p == end);
+    if (!ilfs.empty()) {
+        std::string one;
+        format(ilfs.back(), one);
+        for (size_t len = 0; len < one.size(); len++) {
+            p = one.data();
+            assert(!libilf::read_binary_ilf(p, one.data() + len, parsed) && p == one.data());
+        }
+    }
+
+    std::string text;
+    for (size_t i = 0; i < ilfs.size(); i++) {
+        text << ilfs[i];
+        text += '\n';
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    size_t count = 0;
+    for (char const* line = text.data(), *text_end = text.data() + text.size(); line < text_end; ) {
+        char const* line_end = static_cast<char const*>(memchr(line, '\n', text_end - line));
+        count += libilf::parse_ilf(line, line_end - line, parsed);
+        line = line_end + 1;
+    }
+    std::chrono::duration<double> elapsed_time = std::chrono::steady_clock::now() - start;
+    assert(count == ilfs.size());
+    std::cout << "Parsed " << NUM_INPUTS << " ILF lines in " << elapsed_time.count() << " seconds" << std::endl;
+    std::cout << "Throughput: " << (double) NUM_INPUTS / elapsed_time.count() << " ILFs per second" << std::endl;
+    return 0;
+}
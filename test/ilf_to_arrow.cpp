@@ -0,0 +1,125 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#include <iostream>
+#include <sstream>
+#include <cassert>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <random>
+#include <climits>
+#include "parser.h"
+#include "arrow.h"
+
+std::string event_t_mapping[] = {"ProcessCreate", "FileCreate", "FlowStart", "LogOn"};
+
+AE_FORCEINLINE void int_to_ilf(unsigned int const& value, libilf::ILF& ilf) {
+    ilf = libilf::ILF(event_t_mapping[value % 4], "10.0.0." + std::to_string(value % 256),
+        "host" + std::to_string(value % 7), value % 10 == 0 ? "" : std::to_string(value));
+    for (unsigned int i = 0; i < value % 3; i++) {
+        ilf._pairs.push_back(libilf::KeyValue("k" + std::to_string(i), std::to_string(value >> i), i == 0));
+    }
+}
+
+std::string string_at(ArrowArray const* array, int64_t i) {
+    int32_t const* offsets = static_cast<int32_t const*>(array->buffers[1]);
+    char const* chars = static_cast<char const*>(array->buffers[2]);
+    return std::string(chars + offsets[i], offsets[i + 1] - offsets[i]);
+}
+
+// Reads record i back the way an Arrow consumer would
+//
+libilf::ILF ilf_at(ArrowArray const* batch, int64_t i) {
+    ArrowArray const* event_t = batch->children[0], *time = batch->children[3], *pairs = batch->children[4];
+    libilf::ILF ilf(string_at(event_t->dictionary, static_cast<int32_t const*>(event_t->buffers[1])[i]),
+        string_at(batch->children[1], i), string_at(batch->children[2], i), "");
+    uint8_t const* validity = static_cast<uint8_t const*>(time->buffers[0]);
+    if (validity == nullptr || (validity[i / 8] >> (i % 8)) & 1) {
+        ilf._time = std::to_string(static_cast<int64_t const*>(time->buffers[1])[i]);
+    }
+    int32_t const* offsets = static_cast<int32_t const*>(pairs->buffers[1]);
+    ArrowArray const* entries = pairs->children[0];
+    for (int32_t j = offsets[i]; j < offsets[i + 1]; j++) {
+        ilf._pairs.push_back(libilf::KeyValue(string_at(entries->children[0], j), string_at(entries->children[1], j), true));
+    }
+    return ilf;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        std::cerr << "usage: <num_inputs> <batch_size>" << std::endl;
+        return -1;
+    }
+    const int NUM_INPUTS = std::stoi(argv[1]), BATCH_SIZE = std::stoi(argv[2]);
+
+    ArrowSchema schema;
+    libilf::export_ilf_schema(&schema);
+    assert(strcmp(schema.format, "+s") == 0 && schema.n_children == 5);
+    assert(strcmp(schema.children[0]->format, "i") == 0 && strcmp(schema.children[0]->dictionary->format, "u") == 0);
+    assert(strcmp(schema.children[3]->name, "time") == 0 && schema.children[3]->flags == ARROW_FLAG_NULLABLE);
+    assert(strcmp(schema.children[4]->format, "+m") == 0 && schema.children[4]->children[0]->n_children == 2);
+    schema.release(&schema);
+    assert(schema.release == nullptr);
+
+    libilf::Parser<unsigned int, libilf::ILF> parser(int_to_ilf, 1, 4096);
+    std::vector<libilf::ILF> expected;
+    for (int i = 0; i < NUM_INPUTS; i++) {
+        assert(parser.push(i));
+        expected.push_back(libilf::ILF());
+        int_to_ilf(i, expected.back());
+    }
+    parser.start_wait();
+    parser.stop_wait();
+
+    libilf::ArrowBatchBuilder builder;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<ArrowArray> batches;
+    while (builder.pop_from(parser, BATCH_SIZE) > 0) {
+        batches.push_back(ArrowArray());
+        builder.export_batch(&batches.back());
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    assert(builder.size() == 0);
+
+    int row = 0;
+    for (size_t b = 0; b < batches.size(); b++) {
+        ArrowArray& batch = batches[b];
+        assert(batch.n_children == 5 && batch.n_buffers == 1 && batch.null_count == 0);
+        for (int64_t i = 0; i < batch.length; i++, row++) {
+            libilf::ILF ilf = ilf_at(&batch, i);
+            assert(ilf == expected[row]);
+            assert((ilf._time.empty() ? std::string() : ilf._time) == expected[row]._time);
+        }
+        // Consumers may move a child out and release it on their own
+        //
+        ArrowArray sender = *batch.children[1];
+        batch.children[1]->release = nullptr;
+        batch.release(&batch);
+        assert(batch.release == nullptr);
+        sender.release(&sender);
+    }
+    assert(row == NUM_INPUTS);
+
+    std::chrono::steady_clock::time_point text_start = std::chrono::steady_clock::now();
+    std::ostringstream text;
+    for (int i = 0; i < NUM_INPUTS; i++) {
+        text << expected[i] << "\n";
+    }
+    std::chrono::steady_clock::time_point text_end = std::chrono::steady_clock::now();
+
+    std::chrono::duration<double> elapsed_time = end - start, text_time = text_end - text_start;
+    std::cout << "Exported " << NUM_INPUTS << " ILFs in " << batches.size() << " batches in " << elapsed_time.count() << " seconds" << std::endl;
+    std::cout << "Serialized " << NUM_INPUTS << " ILFs as text in " << text_time.count() << " seconds" << std::endl;
+    std::cout << "Throughput: " << (double) NUM_INPUTS / elapsed_time.count() << " ILFs per second" << std::endl;
+    return 0;
+}
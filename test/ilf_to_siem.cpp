@@ -0,0 +1,150 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cassert>
+#include <chrono>
+#include <string>
+#include <random>
+#include <cstdio>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include "pipeline.h"
+#include "siem.h"
+
+// Escapes one character at a time, as the SIMD fast path must
+//
+std::string escape_slowly(std::string const& value, std::string const& specials) {
+    std::string out;
+    for (size_t i = 0; i < value.size(); i++) {
+        if (specials.find(value[i]) != std::string::npos) {
+            out += '\\';
+            out += value[i] == '\n' ? 'n' : value[i] == '\r' ? 'r' : value[i] == '\t' ? 't' : value[i];
+        } else {
+            out += value[i];
+        }
+    }
+    return out;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        std::cerr << "usage: <num_inputs>" << std::endl;
+        return -1;
+    }
+    const int NUM_INPUTS = std::stoi(argv[1]);
+
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> char_dist(0, 15), len_dist(0, 70);
+    const char alphabet[] = "ab=|\\\n\r\tcdefgh =:";
+    libilf::detail::Escaper escaper("=\\\n\r");
+    for (int i = 0; i < 100000; i++) {
+        std::string value, out("x");
+        int len = len_dist(gen);
+        for (int j = 0; j < len; j++) {
+            value += alphabet[char_dist(gen) * (j % 5 == 0)];
+        }
+        escaper.append(out, value);
+        assert(out == "x" + escape_slowly(value, "=\\\n\r"));
+    }
+
+    libilf::SiemConfig config;
+    config._vendor = "MITRE";
+    config._product = "CAR|ILF";
+    config._event_types["ProcessCreate"] = libilf::SiemEventType("4688", "Process created", 3);
+    config._keys["image"] = "sproc";
+    libilf::ILF ilf("ProcessCreate", "10.0.0.1", "host", "1700000000");
+    ilf._pairs.push_back(libilf::KeyValue("image", "C:\\cmd.exe", true));
+    ilf._pairs.push_back(libilf::KeyValue("args", "a=b\tc\nd", true));
+    std::string cef, leef;
+    libilf::CefFormat cef_format(config);
+    libilf::LeefFormat leef_format(config);
+    cef_format(ilf, cef);
+    leef_format(ilf, leef);
+    assert(cef == "CEF:0|MITRE|CAR\\|ILF|1.0|4688|Process created|3|"
+        "src=10.0.0.1 dst=host rt=1700000000000 sproc=C:\\\\cmd.exe args=a\\=b\tc\\nd\n");
+    assert(leef == "LEEF:1.0|MITRE|CAR\\|ILF|1.0|4688|sev=3"
+        "\tsrc=10.0.0.1\tdst=host\tdevTime=1700000000000\tsproc=C:\\\\cmd.exe\targs=a=b\\tc\\nd\n");
+    cef.clear();
+    cef_format(libilf::ILF("LogOn", "a", "b", "0"), cef);
+    assert(cef == "CEF:0|MITRE|CAR\\|ILF|1.0|LogOn|LogOn|5|src=a dst=b rt=0\n");
+
+    // Times in milliseconds, fractions of seconds included, and extension
+    // and attribute keys stripped to letters and digits, delimiters included
+    //
+    libilf::ILF fraction("LogOn", "a", "b", "1700000000.5");
+    fraction._pairs.push_back(libilf::KeyValue("user.name", "alice", true));
+    fraction._pairs.push_back(libilf::KeyValue("_", "dropped", true));
+    fraction._pairs.push_back(libilf::KeyValue("logon_id", "0x3e7", true));
+    fraction._pairs.push_back(libilf::KeyValue("a\tb=c\nd", "x", true));
+    cef.clear();
+    leef.clear();
+    cef_format(fraction, cef);
+    leef_format(fraction, leef);
+    assert(cef == "CEF:0|MITRE|CAR\\|ILF|1.0|LogOn|LogOn|5|src=a dst=b rt=1700000000500 username=alice logonid=0x3e7 abcd=x\n");
+    assert(leef == "LEEF:1.0|MITRE|CAR\\|ILF|1.0|LogOn|sev=5"
+        "\tsrc=a\tdst=b\tdevTime=1700000000500\tusername=alice\tlogonid=0x3e7\tabcd=x\n");
+    const char *kept[] = {"2023-11-14T22:13:20Z", "1700000000.1234", "-1", "12345678901234567890", ""};
+    const char *kept_millis[] = {"2023-11-14T22:13:20Z", "1700000000123", "-1", "12345678901234567890", ""};
+    for (size_t i = 0; i < 5; i++) {
+        cef.clear();
+        cef_format(libilf::ILF("LogOn", "a", "b", kept[i]), cef);
+        assert(cef == std::string("CEF:0|MITRE|CAR\\|ILF|1.0|LogOn|LogOn|5|src=a dst=b rt=") + kept_millis[i] + "\n");
+    }
+
+    // Batch output through the file sink
+    //
+    std::vector<libilf::ILF> ilfs;
+    std::string expected;
+    for (int i = 0; i < NUM_INPUTS; i++) {
+        libilf::ILF cur("ProcessCreate", "10.0.0." + std::to_string(i % 256), "host", std::to_string(i));
+        cur._pairs.push_back(libilf::KeyValue("image", "C:\\Windows\\System32\\svchost.exe", true));
+        cur._pairs.push_back(libilf::KeyValue("cmd", "svchost.exe -k netsvcs -p -s Schedule", true));
+        cef_format(cur, expected);
+        ilfs.push_back(cur);
+    }
+    char path[] = "/tmp/ilf_to_siemXXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    libilf::FdSink<libilf::ILF, libilf::CefFormat> sink(fd, true, libilf::CefFormat(config));
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    sink.write(ilfs);
+    sink.close();
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    unlink(path);
+    assert(contents.str() == expected);
+
+    // An owned descriptor is closed even if the last flush fails
+    //
+    int read_only = open("/dev/null", O_RDONLY);
+    assert(read_only >= 0);
+    libilf::FdSink<libilf::ILF, libilf::CefFormat> failing(read_only, true, libilf::CefFormat(config));
+    failing.write(libilf::span<const libilf::ILF>(ilfs.data(), 1));
+    bool thrown = false;
+    try {
+        failing.close();
+    } catch (std::system_error const&) {
+        thrown = true;
+    }
+    assert(thrown && fcntl(read_only, F_GETFD) == -1 && errno == EBADF);
+
+    std::chrono::duration<double> elapsed_time = end - start;
+    std::cout << "Wrote " << NUM_INPUTS << " ILFs as CEF in " << elapsed_time.count() << " seconds" << std::endl;
+    std::cout << "Throughput: " << (double) NUM_INPUTS / elapsed_time.count() << " ILFs per second" << std::endl;
+    return 0;
+}
@@ -0,0 +1,153 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#include <iostream>
+#include <cassert>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <random>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+#include "parser.h"
+#include "decimal.h"
+#include "atomicops.h"
+
+// Each input is a chunk of integers and each output the arena holding
+// their decimal strings, so no string is allocated per integer
+//
+AE_FORCEINLINE void ints_to_arena(std::vector<long long> const& ns, libilf::StringArena& arena) {
+    arena.clear();
+    libilf::format_decimals(libilf::span<const long long>(ns), arena);
+}
+
+void check(long long n) {
+    libilf::StringArena arena;
+    libilf::format_decimals(libilf::span<const long long>(&n, 1), arena);
+    assert(arena.size() == 1 && arena.str(0) == std::to_string(n));
+}
+
+void check_unsigned(unsigned long long n) {
+    libilf::StringArena arena;
+    libilf::format_decimals(libilf::span<const unsigned long long>(&n, 1), arena);
+    assert(arena.size() == 1 && arena.str(0) == std::to_string(n));
+}
+
+int main() {
+    const int N = 10000000, CHUNK_SIZE = 1024;
+    // Edge cases around every power of 10 and the limits of each type
+    //
+    unsigned long long power = 1;
+    for (int i = 0; i < 20; i++) {
+        check_unsigned(power - 1);
+        check_unsigned(power);
+        check_unsigned(power + 1);
+        if (i < 19) {
+            check(static_cast<long long>(power));
+            check(-static_cast<long long>(power));
+            power *= 10;
+        }
+    }
+    check_unsigned(std::numeric_limits<unsigned long long>::max());
+    check(std::numeric_limits<long long>::max());
+    check(std::numeric_limits<long long>::min());
+    for (long long n = 0; n < 1000000; n++) {
+        check(n);
+    }
+
+    // Copies of empty and filled arenas
+    //
+    libilf::StringArena empty, filled;
+    libilf::StringArena empty_copy(empty);
+    assert(empty_copy.size() == 0 && empty_copy.bytes() == 0);
+    long long one = 1;
+    libilf::format_decimals(libilf::span<const long long>(&one, 1), filled);
+    libilf::StringArena filled_copy(filled);
+    assert(filled_copy.size() == 1 && filled_copy.str(0) == "1");
+    filled_copy = empty;
+    assert(filled_copy.size() == 0 && filled_copy.bytes() == 0);
+    empty_copy = filled;
+    assert(empty_copy.size() == 1 && empty_copy.str(0) == "1");
+
+    std::mt19937_64 gen(42);
+    for (int i = 0; i < 1000000; i++) {
+        unsigned long long n = gen() >> (gen() % 64);
+        check_unsigned(n);
+        check(static_cast<long long>(n));
+    }
+
+    libilf::Parser<std::vector<long long>,libilf::StringArena> *parser;
+    try {
+        parser = new libilf::Parser<std::vector<long long>,libilf::StringArena>(ints_to_arena);
+    } catch (std::bad_alloc const& e) {
+        std::cerr << "ERROR: parser initialization failed" << std::endl;
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::vector<long long> chunk;
+    for (int i = 0; i < N; i++) {
+        chunk.push_back(i);
+        if (chunk.size() == CHUNK_SIZE || i == N - 1) {
+            parser->push(chunk);
+            chunk.clear();
+        }
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    parser->start_wait();
+    parser->stop_wait();
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    size_t total_bytes = 0;
+    int expected = 0;
+    libilf::StringArena cur_output;
+    while (expected < N) {
+        assert(parser->pop(cur_output));
+        for (size_t i = 0; i < cur_output.size(); i++, expected++) {
+            assert(cur_output.str(i) == std::to_string(expected));
+        }
+        total_bytes += cur_output.bytes();
+    }
+    assert(parser->input_size() == 0 && parser->output_size() == 0);
+    std::chrono::duration<double> elapsed_time = end - start;
+    std::cout << "Processed " << N << " integers in " << elapsed_time.count() << " seconds" << std::endl;
+    std::cout << "Throughput: " << (double) N / elapsed_time.count() << " integers per second, " <<
+        (double) total_bytes / elapsed_time.count() / 1e9 << " GB/s" << std::endl;
+
+    // Formatting alone, without the parser
+    //
+    std::vector<unsigned int> values(N);
+    for (int i = 0; i < N; i++) {
+        values[i] = static_cast<unsigned int>(gen());
+    }
+    libilf::StringArena arena;
+    total_bytes = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < N; i += CHUNK_SIZE) {
+        arena.clear();
+        libilf::format_decimals(libilf::span<const unsigned int>(values).subspan(i, std::min(CHUNK_SIZE, N - i)), arena);
+        total_bytes += arena.bytes();
+    }
+    end = std::chrono::steady_clock::now();
+    elapsed_time = end - start;
+    std::cout << "Formatted " << N << " random 32-bit integers in " << elapsed_time.count() << " seconds, " <<
+        (double) total_bytes / elapsed_time.count() / 1e9 << " GB/s" << std::endl;
+    std::vector<std::string> strings(N);
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < N; i++) {
+        strings[i] = std::to_string(values[i]);
+    }
+    end = std::chrono::steady_clock::now();
+    elapsed_time = end - start;
+    std::cout << "std::to_string: " << elapsed_time.count() << " seconds, " <<
+        (double) total_bytes / elapsed_time.count() / 1e9 << " GB/s" << std::endl;
+    return 0;
+}
@@ -23,11 +23,26 @@ AE_FORCEINLINE void int_to_string(int const& n, std::string& str) {
     str = std::to_string(n);
 }
 
-int main() {
-    const int N = 10000000;
+AE_FORCEINLINE void ints_to_strings(libilf::span<const int> ns, libilf::span<std::string> strs) {
+    for (size_t i = 0; i < ns.size(); i++) {
+        strs[i] = std::to_string(ns[i]);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 2) {
+        std::cerr << "usage: [batch_size]" << std::endl;
+        return -1;
+    }
+    const int N = 10000000, BATCH_SIZE = argc == 2 ? std::stoi(argv[1]) : 0;
     libilf::Parser<int,std::string> *parser;
     try {
-        parser = new libilf::Parser<int,std::string>(int_to_string);
+        if (BATCH_SIZE > 0) {
+            parser = new libilf::Parser<int,std::string>(ints_to_strings, 
+                std::thread::hardware_concurrency(), 4096, BATCH_SIZE);
+        } else {
+            parser = new libilf::Parser<int,std::string>(int_to_string);
+        }
     } catch (std::bad_alloc const& e) {
         std::cerr << "ERROR: parser initialization failed" << std::endl;
         std::cerr << e.what() << std::endl;
@@ -37,8 +52,8 @@ int main() {
         parser->push(i);
     }
     std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
-    // parser->start_max_throughput();
-    // parser->stop_max_throughput();
+    parser->start_wait();
+    parser->stop_wait();
     std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
     for (int expected = 0; expected < N; expected++) {
         std::string cur_output;
@@ -47,7 +62,7 @@ int main() {
     }
     assert(parser->input_size() == 0 && parser->output_size() == 0);
     std::chrono::duration<double> elapsed_time = end - start;
-    std::cout << "Processed " << N << " integers in " << elapsed_time.count() << " seconds" << std::endl;
+    std::cout << "Processed " << N << " integers in " << elapsed_time.count() << " seconds with batch size " << BATCH_SIZE << std::endl;
     std::cout << "Throughput: " << (double) N / elapsed_time.count() << " integers per second" << std::endl;
     return 0;
 }
@@ -0,0 +1,190 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#include <iostream>
+#include <cassert>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <set>
+#include <random>
+#include "parser.h"
+#include "rcu.h"
+#include "ioc.h"
+
+libilf::RcuTable<libilf::IocSet> *iocs;
+
+// Stands in for a real conversion followed by IOC tagging
+//
+void ilf_to_tagged(libilf::ILF const& input, libilf::ILF& ilf) {
+    ilf = input;
+    iocs->read()->tag(ilf);
+}
+
+std::string random_name(std::mt19937& gen, size_t len) {
+    static const char letters[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+    std::string name;
+    for (size_t i = 0; i < len; i++) {
+        name += letters[gen() % 36];
+    }
+    return name;
+}
+
+// Indicators within a value by checking each one
+//
+std::set<std::string> match_slowly(std::vector<std::string> const& substrings, std::vector<std::string> const& exacts,
+    std::string value) {
+    std::set<std::string> found;
+    for (size_t i = 0; i < value.size(); i++) {
+        value[i] = tolower(value[i]);
+    }
+    for (size_t i = 0; i < substrings.size(); i++) {
+        if (value.find(substrings[i]) != std::string::npos) {
+            found.insert(substrings[i]);
+        }
+    }
+    for (size_t i = 0; i < exacts.size(); i++) {
+        if (value == exacts[i]) {
+            found.insert(exacts[i]);
+        }
+    }
+    return found;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 4) {
+        std::cerr << "usage: <num_indicators> <num_ilfs> <num_threads>" << std::endl;
+        return -1;
+    }
+    const int NUM_INDICATORS = std::stoi(argv[1]), NUM_ILFS = std::stoi(argv[2]), NUM_THREADS = std::stoi(argv[3]);
+    std::mt19937 gen(42);
+
+    // Overlapping indicators, found through failure and dictionary links
+    //
+    libilf::IocSet small;
+    small.add_substring("he", "t-he");
+    small.add_substring("she");
+    small.add_substring("hers");
+    small.add_substring("EVIL.example.com", "evil");
+    small.add_exact("d41d8cd98f00b204e9800998ecf8427e", "empty-md5");
+    small.build();
+    assert(small.size() == 5);
+    uint32_t hits[libilf::IocSet::MAX_HITS];
+    assert(small.match("ushers", 6, hits) == 3);
+    assert(small.tag(hits[0]) == "she" && small.tag(hits[1]) == "t-he" && small.tag(hits[2]) == "hers");
+    assert(small.match("xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxh", 58, hits) == 0);
+    libilf::ILF ilf("FlowStart", "10.0.0.1", "cdn.evil.EXAMPLE.com", "0");
+    ilf._pairs.push_back(libilf::KeyValue("md5", "D41D8CD98F00B204E9800998ECF8427E", true));
+    ilf._pairs.push_back(libilf::KeyValue("path", "/tmp/d41d8cd98f00b204e9800998ecf8427e.bin", true));
+    assert(small.tag(ilf) == 2);
+    assert(ilf._pairs.size() == 4 && ilf._pairs[2]._key == "ioc_receiver" && ilf._pairs[2]._value == "evil");
+    assert(ilf._pairs[3]._key == "ioc_md5" && ilf._pairs[3]._value == "empty-md5");
+
+    // Random indicators against naive matching
+    //
+    std::vector<std::string> substrings, exacts;
+    libilf::IocSet checked;
+    for (int i = 0; i < 500; i++) {
+        substrings.push_back(random_name(gen, 3 + gen() % 6) + (i % 2 == 0 ? ".com" : ""));
+        checked.add_substring(substrings.back());
+        exacts.push_back(random_name(gen, 32));
+        checked.add_exact(exacts.back());
+    }
+    checked.build();
+    for (int i = 0; i < 20000; i++) {
+        std::string value = random_name(gen, gen() % 40);
+        if (i % 3 == 0) {
+            value += substrings[gen() % substrings.size()] + random_name(gen, gen() % 5);
+        } else if (i % 7 == 0) {
+            value = exacts[gen() % exacts.size()];
+        }
+        if (i % 11 == 0) {
+            value[0] = toupper(value[0]);
+        }
+        std::set<std::string> found;
+        const size_t count = checked.match(value.data(), value.size(), hits);
+        for (size_t j = 0; j < count; j++) {
+            found.insert(checked.tag(hits[j]));
+        }
+        assert(found == match_slowly(substrings, exacts, value));
+    }
+
+    // Throughput with many indicators, on values that mostly match nothing
+    //
+    libilf::QsbrDomain domain(NUM_THREADS);
+    std::unique_ptr<libilf::IocSet> first(new libilf::IocSet());
+    std::vector<std::string> domains;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < NUM_INDICATORS; i++) {
+        domains.push_back(random_name(gen, 6 + gen() % 10) + ".bad");
+        first->add_substring(domains.back(), "v1");
+        first->add_exact(random_name(gen, 64), "v1");
+    }
+    first->build();
+    std::chrono::steady_clock::time_point built = std::chrono::steady_clock::now();
+    iocs = new libilf::RcuTable<libilf::IocSet>(domain, std::unique_ptr<libilf::IocSet const>(first.release()));
+
+    std::vector<libilf::ILF> inputs;
+    size_t bytes = 0;
+    for (int i = 0; i < NUM_ILFS; i++) {
+        libilf::ILF input("DnsQuery", "10.0.0." + std::to_string(i % 256), "resolver.corp.example.com", std::to_string(i));
+        input._pairs.push_back(libilf::KeyValue("query", (i % 100 == 0 ? "www." + domains[i % domains.size()] :
+            "www." + random_name(gen, 12) + ".com"), true));
+        input._pairs.push_back(libilf::KeyValue("image", "C:\\Windows\\System32\\svchost.exe", true));
+        input._pairs.push_back(libilf::KeyValue("sha256", random_name(gen, 64), true));
+        for (size_t j = 0; j < input._pairs.size(); j++) {
+            bytes += input._pairs[j]._value.size();
+        }
+        bytes += input._sender.size() + input._receiver.size();
+        inputs.push_back(input);
+    }
+
+    // Tags on the parser's threads, reloading the set halfway through
+    //
+    std::unique_ptr<libilf::IocSet> second(new libilf::IocSet());
+    for (size_t i = 0; i < domains.size(); i++) {
+        second->add_substring(domains[i], "v2");
+    }
+    second->build();
+    libilf::Parser<libilf::ILF, libilf::ILF> parser(ilf_to_tagged, NUM_THREADS, 4096);
+    parser.set_iteration_function(libilf::QsbrDomain::parser_hook, &domain);
+    parser.start();
+    std::chrono::steady_clock::time_point tag_start = std::chrono::steady_clock::now();
+    int pushed = 0, popped = 0, tagged = 0;
+    while (popped < NUM_ILFS) {
+        if (pushed < NUM_ILFS && parser.push(inputs[pushed])) {
+            pushed++;
+            if (pushed == NUM_ILFS / 2) {
+                iocs->publish(std::unique_ptr<libilf::IocSet const>(second.release()));
+            }
+        }
+        while (parser.pop(ilf)) {
+            assert(ilf._sender == inputs[popped]._sender);
+            if (ilf._pairs.size() > 3) {
+                assert(ilf._pairs.size() == 4 && ilf._pairs[3]._key == "ioc_query");
+                assert(ilf._pairs[3]._value == "v1" || ilf._pairs[3]._value == "v2");
+                tagged++;
+            }
+            popped++;
+        }
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    parser.stop();
+    assert(tagged == (NUM_ILFS + 99) / 100);
+    delete iocs;
+
+    std::chrono::duration<double> build_time = built - start, tag_time = end - tag_start;
+    std::cout << "Built " << 2 * NUM_INDICATORS << " indicators in " << build_time.count() << " seconds" << std::endl;
+    std::cout << "Tagged " << NUM_ILFS << " ILFs (" << bytes << " bytes of values) in " << tag_time.count() << " seconds using " << NUM_THREADS << " threads" << std::endl;
+    std::cout << "Throughput: " << (double) NUM_ILFS / tag_time.count() << " ILFs per second" << std::endl;
+    return 0;
+}
@@ -0,0 +1,85 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#include <iostream>
+#include <sstream>
+#include <cassert>
+#include <chrono>
+#include <string>
+#include <stdexcept>
+#include "parser.h"
+#include "pipeline.h"
+#include "atomicops.h"
+#include "ilf.h"
+
+// Converts a "sender,receiver,time,user" line into a LogOn ILF
+//
+AE_FORCEINLINE void line_to_ilf(std::string const& line, libilf::ILF& ilf) {
+    size_t first = line.find(','), second = line.find(',', first + 1), third = line.find(',', second + 1);
+    ilf = libilf::ILF("LogOn", line.substr(0, first), line.substr(first + 1, second - first - 1),
+        line.substr(second + 1, third - second - 1));
+    ilf._pairs.push_back(libilf::KeyValue("user", line.substr(third + 1), true));
+}
+
+class FailingSink : public libilf::Sink<libilf::ILF> {
+public:
+    void write(libilf::span<const libilf::ILF>) override {
+        throw std::runtime_error("sink failed");
+    }
+};
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        std::cerr << "usage: <num_inputs> <num_threads>" << std::endl;
+        return -1;
+    }
+    const int NUM_INPUTS = std::stoi(argv[1]), NUM_THREADS = std::stoi(argv[2]);
+    std::stringstream input, expected_output;
+    for (int i = 0; i < NUM_INPUTS; i++) {
+        std::string line = "10.0.0." + std::to_string(i % 256) + ",10.0.1.1," + std::to_string(i) + ",user" + std::to_string(i);
+        libilf::ILF expected;
+        line_to_ilf(line, expected);
+        input << line << "\n";
+        expected_output << expected << "\n";
+    }
+
+    libilf::Parser<std::string,libilf::ILF> parser(line_to_ilf, NUM_THREADS, 4096);
+    libilf::StreamSource source(input);
+    std::ostringstream output;
+    libilf::StreamSink<libilf::ILF> sink(output);
+    libilf::Pipeline<std::string,libilf::ILF> pipeline(parser, source, sink);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    pipeline.run();
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    assert(output.str() == expected_output.str());
+    assert(parser.input_size() == 0 && parser.output_size() == 0);
+
+    // Errors stop the pipeline and are rethrown by wait()
+    //
+    input.clear();
+    input.seekg(0);
+    libilf::Parser<std::string,libilf::ILF> failing_parser(line_to_ilf, NUM_THREADS, 4096);
+    FailingSink failing_sink;
+    libilf::Pipeline<std::string,libilf::ILF> failing_pipeline(failing_parser, source, failing_sink);
+    bool caught = false;
+    try {
+        failing_pipeline.run();
+    } catch (std::runtime_error const& e) {
+        caught = std::string(e.what()) == "sink failed";
+    }
+    assert(caught);
+
+    std::chrono::duration<double> elapsed_time = end - start;
+    std::cout << "Processed " << NUM_INPUTS << " lines in " << elapsed_time.count() << " seconds using " << NUM_THREADS << " threads" << std::endl;
+    std::cout << "Throughput: " << (double) NUM_INPUTS / elapsed_time.count() << " lines per second" << std::endl;
+    return 0;
+}
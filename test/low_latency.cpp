@@ -0,0 +1,122 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#include <iostream>
+#include <cassert>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <system_error>
+#include <cstdint>
+#include <algorithm>
+#include "lowlatency.h"
+
+void square(uint64_t const& input, uint64_t& output) {
+    output = input * input;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        std::cerr << "usage: <num_inputs> <num_threads>" << std::endl;
+        return -1;
+    }
+    const uint64_t NUM_INPUTS = std::stoull(argv[1]);
+    const unsigned int NUM_THREADS = std::stoi(argv[2]);
+
+    assert((libilf::parse_cpu_list("2-4,7\n") == std::vector<int>{2, 3, 4, 7}));
+    assert(libilf::parse_cpu_list("\n").empty());
+
+    // mlockall(2) may be refused here, so memory is not locked
+    //
+    libilf::LowLatencyConfig config;
+    config._lock_memory = false;
+
+    // A policy that cannot be applied stops the parser, whose parked threads
+    // have not taken any input
+    //
+    libilf::LowLatencyConfig bad_config = config;
+    bad_config._workers.push_back(libilf::ThreadPolicy(SCHED_OTHER, 0, CPU_SETSIZE - 1));
+    {
+        libilf::Parser<uint64_t, uint64_t> parser(square, NUM_THREADS, 1024);
+        for (uint64_t i = 0; i < 1000; i++) {
+            parser.push(i);
+        }
+        bool thrown = false;
+        try {
+            libilf::start_low_latency(parser, bad_config);
+        } catch (std::system_error const&) {
+            thrown = true;
+        }
+        assert(thrown);
+        assert(parser.output_size() == 0 && parser.input_size() == 1000);
+    }
+    {
+        std::vector<uint64_t> inputs(1000, 1), outputs;
+        libilf::Parser<uint64_t, uint64_t> parser(square, NUM_THREADS, 1024);
+        libilf::VectorSource<uint64_t> source(inputs);
+        libilf::VectorSink<uint64_t> sink(outputs);
+        libilf::Pipeline<uint64_t, uint64_t> pipeline(parser, source, sink);
+        libilf::LowLatencyConfig bad_producer = config;
+        bad_producer._producer = libilf::ThreadPolicy(SCHED_OTHER, 0, CPU_SETSIZE - 1);
+        bool thrown = false;
+        try {
+            libilf::start_low_latency(pipeline, bad_producer);
+        } catch (std::system_error const&) {
+            thrown = true;
+        }
+        assert(thrown && outputs.empty());
+    }
+
+    // Every thread pinned to the first CPU
+    //
+    config._workers.push_back(libilf::ThreadPolicy(SCHED_OTHER, 0, 0));
+    config._producer = config._consumer = libilf::ThreadPolicy(SCHED_OTHER, 0, 0);
+    {
+        std::vector<uint64_t> inputs, outputs;
+        for (uint64_t i = 0; i < NUM_INPUTS; i++) {
+            inputs.push_back(i);
+        }
+        libilf::Parser<uint64_t, uint64_t> parser(square, NUM_THREADS, 1024);
+        libilf::VectorSource<uint64_t> source(inputs);
+        libilf::VectorSink<uint64_t> sink(outputs);
+        libilf::Pipeline<uint64_t, uint64_t> pipeline(parser, source, sink);
+        libilf::start_low_latency(pipeline, config);
+        pipeline.wait();
+        assert(outputs.size() == NUM_INPUTS);
+        for (uint64_t i = 0; i < NUM_INPUTS; i++) {
+            assert(outputs[i] == i * i);
+        }
+    }
+
+    // Round trips through a started parser, one input at a time, which are
+    // slow wherever the threads share CPUs
+    //
+    const uint64_t NUM_ROUND_TRIPS = std::min<uint64_t>(NUM_INPUTS, 1000);
+    libilf::Parser<uint64_t, uint64_t> parser(square, NUM_THREADS, 1024);
+    libilf::start_low_latency(parser, config);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    uint64_t output;
+    for (uint64_t i = 0; i < NUM_ROUND_TRIPS; i++) {
+        assert(parser.push(i));
+        while (!parser.pop(output)) {
+            std::this_thread::yield();
+        }
+        assert(output == i * i);
+    }
+    std::chrono::duration<double> elapsed_time = std::chrono::steady_clock::now() - start;
+    parser.stop();
+
+    std::cout << "Made " << NUM_ROUND_TRIPS << " round trips in " << elapsed_time.count() << " seconds using " <<
+        NUM_THREADS << " threads" << std::endl;
+    std::cout << "Latency: " << elapsed_time.count() / NUM_ROUND_TRIPS * 1e6 << " microseconds per round trip" << std::endl;
+    return 0;
+}
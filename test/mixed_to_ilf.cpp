@@ -0,0 +1,182 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#include <iostream>
+#include <cassert>
+#include <chrono>
+#include <string>
+#include <stdexcept>
+#include <random>
+#include <ctime>
+#include <climits>
+#include <arpa/inet.h>
+#include "parser.h"
+#include "registry.h"
+#include "atomicops.h"
+#include "ilf.h"
+
+struct Process {
+    unsigned int _host;
+    std::time_t _time;
+    unsigned int _pid;
+    std::string _image;
+};
+
+struct File {
+    unsigned int _host;
+    std::time_t _time;
+    std::string _path;
+};
+
+struct Flow {
+    unsigned int _src, _dst;
+    std::time_t _time;
+    unsigned short _src_port, _dst_port;
+};
+
+struct Logon {
+    unsigned int _host;
+    std::time_t _time;
+    std::string _user;
+};
+
+typedef libilf::Registry<libilf::ILF, Process, File, Flow, Logon> registry_t;
+
+std::string ip_to_string(unsigned int ip) {
+    char ip_buf[32];
+    assert(inet_ntop(AF_INET, &ip, ip_buf, 32));
+    return std::string(ip_buf);
+}
+
+AE_FORCEINLINE void process_to_ilf(Process const& process, libilf::ILF& ilf) {
+    ilf = libilf::ILF("ProcessCreate", ip_to_string(process._host), ip_to_string(process._host),
+        std::to_string(process._time));
+    ilf._pairs.push_back(libilf::KeyValue("pid", std::to_string(process._pid), false));
+    ilf._pairs.push_back(libilf::KeyValue("image", process._image, true));
+}
+
+AE_FORCEINLINE void file_to_ilf(File const& file, libilf::ILF& ilf) {
+    ilf = libilf::ILF("FileCreate", ip_to_string(file._host), ip_to_string(file._host),
+        std::to_string(file._time));
+    ilf._pairs.push_back(libilf::KeyValue("path", file._path, true));
+}
+
+AE_FORCEINLINE void flow_to_ilf(Flow const& flow, libilf::ILF& ilf) {
+    ilf = libilf::ILF("FlowStart", ip_to_string(flow._src), ip_to_string(flow._dst),
+        std::to_string(flow._time));
+    ilf._pairs.push_back(libilf::KeyValue("src_port", std::to_string(flow._src_port), false));
+    ilf._pairs.push_back(libilf::KeyValue("dst_port", std::to_string(flow._dst_port), false));
+}
+
+AE_FORCEINLINE void logon_to_ilf(Logon const& logon, libilf::ILF& ilf) {
+    ilf = libilf::ILF("LogOn", ip_to_string(logon._host), ip_to_string(logon._host),
+        std::to_string(logon._time));
+    ilf._pairs.push_back(libilf::KeyValue("user", logon._user, true));
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        std::cerr << "usage: <num_inputs> <num_threads>" << std::endl;
+        return -1;
+    }
+    const int NUM_INPUTS = std::stoi(argv[1]), NUM_THREADS = std::stoi(argv[2]);
+    registry_t::add<Process, process_to_ilf>();
+    registry_t::add<File, file_to_ilf>();
+    registry_t::add<Flow, flow_to_ilf>();
+    registry_t::add<Logon, logon_to_ilf>();
+    libilf::Parser<registry_t::input_t,libilf::ILF> *parser;
+    try {
+        parser = new libilf::Parser<registry_t::input_t,libilf::ILF>(registry_t::convert, NUM_THREADS, 4096);
+    } catch (std::bad_alloc const& e) {
+        std::cerr << "ERROR: parser initialization failed" << std::endl;
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_int_distribution<unsigned int> global_dist(0, UINT_MAX);
+    std::uniform_int_distribution<int> type_dist(0, 3);
+    // The expected outputs come from the per-type conversion functions, not
+    // from the registry under test
+    //
+    std::vector<libilf::ILF> expected_outputs(NUM_INPUTS);
+    for (int i = 0; i < NUM_INPUTS; i++) {
+        registry_t::input_t cur_data;
+        switch (type_dist(gen)) {
+        case 0: {
+            Process process{global_dist(gen), std::time(0), global_dist(gen), "C:\\Windows\\System32\\cmd.exe"};
+            process_to_ilf(process, expected_outputs[i]);
+            cur_data = process;
+            break;
+        }
+        case 1: {
+            File file{global_dist(gen), std::time(0), "C:\\Users\\" + std::to_string(global_dist(gen))};
+            file_to_ilf(file, expected_outputs[i]);
+            cur_data = file;
+            break;
+        }
+        case 2: {
+            Flow flow{global_dist(gen), global_dist(gen), std::time(0),
+                static_cast<unsigned short>(global_dist(gen)), 443};
+            flow_to_ilf(flow, expected_outputs[i]);
+            cur_data = flow;
+            break;
+        }
+        default: {
+            Logon logon{global_dist(gen), std::time(0), "user" + std::to_string(i)};
+            logon_to_ilf(logon, expected_outputs[i]);
+            cur_data = logon;
+            break;
+        }
+        }
+        parser->push(cur_data);
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    parser->start_wait();
+    parser->stop_wait();
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    for (int i = 0; i < NUM_INPUTS; i++) {
+        libilf::ILF cur_output;
+        assert(parser->pop(cur_output));
+        assert(expected_outputs[i] == cur_output);
+        assert(!cur_output._event_t.empty());
+    }
+    assert(parser->input_size() == 0 && parser->output_size() == 0);
+    // One record of each type against literal ILFs
+    //
+    libilf::ILF literal_output;
+    std::string literal_text;
+    registry_t::convert(Process{0x0100007f, 1700000000, 4, "cmd.exe"}, literal_output);
+    literal_text << literal_output;
+    registry_t::convert(File{0x0100007f, 1700000001, "a.txt"}, literal_output);
+    literal_text << literal_output;
+    registry_t::convert(Flow{0x0100000a, 0x0200000a, 1700000002, 1234, 443}, literal_output);
+    literal_text << literal_output;
+    registry_t::convert(Logon{0x0100007f, 1700000003, "alice"}, literal_output);
+    literal_text << literal_output;
+    assert(literal_text ==
+        "ProcessCreate[127.0.0.1,127.0.0.1,1700000000,(pid=4;image=\"cmd.exe\")] "
+        "FileCreate[127.0.0.1,127.0.0.1,1700000001,(path=\"a.txt\")] "
+        "FlowStart[10.0.0.1,10.0.0.2,1700000002,(src_port=1234;dst_port=443)] "
+        "LogOn[127.0.0.1,127.0.0.1,1700000003,(user=\"alice\")] ");
+
+    // Records of types without a conversion function convert to an empty ILF
+    //
+    registry_t::remove<Logon>();
+    libilf::ILF unregistered_output;
+    registry_t::convert(Logon{0, 0, "user"}, unregistered_output);
+    assert(unregistered_output == libilf::ILF());
+    std::chrono::duration<double> elapsed_time = end - start;
+    std::cout << "Processed " << NUM_INPUTS << " records in " << elapsed_time.count() << " seconds using " << NUM_THREADS << " threads" << std::endl;
+    std::cout << "Throughput: " << (double) NUM_INPUTS / elapsed_time.count() << " records per second" << std::endl;
+    return 0;
+}
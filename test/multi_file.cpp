@@ -0,0 +1,217 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#include <iostream>
+#include <fstream>
+#include <cassert>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdlib>
+#include <unistd.h>
+#include "scheduler.h"
+
+// Line numbers of a chunk, whose lines are "<file> <line>"
+//
+struct Lines {
+    Lines() : _file(0), _sequence(0), _last(false), _prefix(-1), _first(-1), _end(-1) { }
+
+    size_t _file;
+    uint64_t _sequence;
+    bool _last;
+    long _prefix, _first, _end;
+    std::shared_ptr<const char> _owner;
+};
+
+void chunk_to_lines(libilf::FileChunk const& chunk, Lines& lines) {
+    lines._file = chunk._file;
+    lines._sequence = chunk._sequence;
+    lines._last = chunk._last;
+    lines._prefix = lines._first = lines._end = -1;
+    char const* p = chunk._data, *end = chunk._data + chunk._size;
+    while (p < end) {
+        char const* line_end = static_cast<char const*>(memchr(p, '\n', end - p));
+        if (line_end == nullptr) {
+            line_end = end;
+        }
+        char *number;
+        long prefix = strtol(p, &number, 10), line = strtol(number, nullptr, 10);
+        assert(lines._first == -1 || (prefix == lines._prefix && line == lines._end));
+        if (lines._first == -1) {
+            lines._prefix = prefix;
+            lines._first = line;
+        }
+        lines._end = line + 1;
+        p = line_end + 1;
+    }
+}
+
+void chunk_to_held_lines(libilf::FileChunk const& chunk, Lines& lines) {
+    chunk_to_lines(chunk, lines);
+    lines._owner = chunk._owner;
+}
+
+// Checks that the chunks of each file arrive in order and cover its lines
+//
+class CheckSink : public libilf::Sink<Lines> {
+public:
+    CheckSink(std::vector<long> const& num_lines, libilf::FileScheduler& scheduler, long first_file = 0,
+        size_t fail_after = 0) :
+        _num_lines(num_lines),
+        _first_file(first_file),
+        _scheduler(scheduler),
+        _sequences(num_lines.size(), 0),
+        _next_lines(num_lines.size(), 0),
+        _done(num_lines.size(), false),
+        _fail_after(fail_after),
+        _writes(0),
+        _peak_buffered(0) { }
+
+    void write(libilf::span<const Lines> outputs) override {
+        if (_fail_after != 0 && ++_writes == _fail_after) {
+            throw std::runtime_error("sink failed");
+        }
+        _peak_buffered = std::max(_peak_buffered, _scheduler.buffered_bytes());
+        for (size_t i = 0; i < outputs.size(); i++) {
+            Lines const& lines = outputs[i];
+            assert(!_done[lines._file]);
+            assert(lines._sequence == _sequences[lines._file]++);
+            if (lines._first != -1) {
+                assert(lines._prefix == _first_file + static_cast<long>(lines._file));
+                assert(lines._first == _next_lines[lines._file]);
+                _next_lines[lines._file] = lines._end;
+            }
+            if (lines._last) {
+                assert(_next_lines[lines._file] == _num_lines[lines._file]);
+                _done[lines._file] = true;
+            }
+        }
+    }
+
+    bool all_done() const {
+        return std::find(_done.begin(), _done.end(), false) == _done.end();
+    }
+
+    std::vector<long> _num_lines;
+    long _first_file;
+    libilf::FileScheduler& _scheduler;
+    std::vector<uint64_t> _sequences;
+    std::vector<long> _next_lines;
+    std::vector<bool> _done;
+    size_t _fail_after, _writes, _peak_buffered;
+};
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        std::cerr << "usage: <num_files> <num_threads>" << std::endl;
+        return -1;
+    }
+    const int NUM_FILES = std::stoi(argv[1]);
+    const int NUM_THREADS = std::stoi(argv[2]);
+
+    // A few large files among many small ones, an empty file and one without
+    // a trailing newline
+    //
+    char dir[] = "/tmp/multi_fileXXXXXX";
+    assert(mkdtemp(dir) != nullptr);
+    std::mt19937 gen(42);
+    std::vector<std::string> paths;
+    std::vector<long> num_lines;
+    for (int i = 0; i < NUM_FILES; i++) {
+        long lines = i == 0 ? 0 : i % 50 == 1 ? 200000 : std::uniform_int_distribution<long>(1, 3000)(gen);
+        paths.push_back(std::string(dir) + "/" + std::to_string(i) + ".log");
+        num_lines.push_back(lines);
+        std::ofstream file(paths.back(), std::ios::binary);
+        for (long j = 0; j < lines; j++) {
+            file << i << " " << j << " user=\"u" << j % 13 << "\" bytes=" << j * 7;
+            if (i != 2 || j + 1 != lines) {
+                file << "\n";
+            }
+        }
+    }
+
+    libilf::FileSchedulerConfig config;
+    config._chunk_size = 64 << 10;
+    config._max_open_files = 8;
+    config._max_buffered_bytes = 4 << 20;
+
+    // A failing sink must not leave the scheduler waiting for memory held by
+    // outputs that are never written
+    //
+    {
+        libilf::Parser<libilf::FileChunk, Lines> parser(chunk_to_held_lines, NUM_THREADS, 64);
+        libilf::FileScheduler scheduler(paths, config);
+        CheckSink sink(num_lines, scheduler, 0, 3);
+        libilf::Pipeline<libilf::FileChunk, Lines> pipeline(parser, scheduler, sink, 4);
+        bool thrown = false;
+        try {
+            pipeline.run();
+        } catch (std::runtime_error const&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+    {
+        std::vector<std::string> missing(1, std::string(dir) + "/missing.log");
+        libilf::Parser<libilf::FileChunk, Lines> parser(chunk_to_lines, NUM_THREADS, 64);
+        libilf::FileScheduler scheduler(missing, config);
+        CheckSink sink(num_lines, scheduler);
+        libilf::Pipeline<libilf::FileChunk, Lines> pipeline(parser, scheduler, sink);
+        bool thrown = false;
+        try {
+            pipeline.run();
+        } catch (std::system_error const&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+
+    // One pipeline per file, then all files through one scheduler, which
+    // holds the outputs' chunks until they are written
+    //
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < NUM_FILES; i++) {
+        std::vector<std::string> one(1, paths[i]);
+        std::vector<long> one_lines(1, num_lines[i]);
+        libilf::Parser<libilf::FileChunk, Lines> parser(chunk_to_lines, NUM_THREADS, 64);
+        libilf::FileScheduler scheduler(one, config);
+        CheckSink sink(one_lines, scheduler, i);
+        libilf::Pipeline<libilf::FileChunk, Lines> pipeline(parser, scheduler, sink, 16);
+        pipeline.run();
+        assert(sink.all_done());
+    }
+    std::chrono::duration<double> serial_time = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    libilf::Parser<libilf::FileChunk, Lines> parser(chunk_to_held_lines, NUM_THREADS, 64);
+    libilf::FileScheduler scheduler(paths, config);
+    CheckSink sink(num_lines, scheduler);
+    libilf::Pipeline<libilf::FileChunk, Lines> pipeline(parser, scheduler, sink, 16);
+    pipeline.run();
+    std::chrono::duration<double> elapsed_time = std::chrono::steady_clock::now() - start;
+    assert(sink.all_done());
+    assert(scheduler.files_done() == paths.size());
+    assert(sink._peak_buffered <= config._max_buffered_bytes + config._chunk_size + 64);
+    assert(scheduler.buffered_bytes() == 0);
+
+    for (size_t i = 0; i < paths.size(); i++) {
+        unlink(paths[i].c_str());
+    }
+    rmdir(dir);
+
+    std::cout << "Read " << NUM_FILES << " files (" << scheduler.bytes() << " bytes) one pipeline per file in " <<
+        serial_time.count() << " seconds and through one scheduler in " << elapsed_time.count() << " seconds" <<
+        std::endl;
+    std::cout << "Throughput: " << scheduler.bytes() / elapsed_time.count() / 1e6 << " MB per second" << std::endl;
+    return 0;
+}
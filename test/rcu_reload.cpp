@@ -0,0 +1,133 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#include <iostream>
+#include <cassert>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include "parser.h"
+#include "ilf.h"
+#include "rcu.h"
+
+// Event type names tagged with the version they belong to. Deleted versions
+// are poisoned so that a reader using one after reclamation trips an assert,
+// or AddressSanitizer
+//
+struct EventNames {
+    EventNames(uint64_t version) : _version(version) {
+        char const* names[4] = {"ProcessCreate", "FileCreate", "FlowStart", "LogOn"};
+        for (int i = 0; i < 4; i++) {
+            _names.push_back(std::string(names[i]) + "." + std::to_string(version));
+        }
+    }
+
+    ~EventNames() {
+        _version = UINT64_MAX;
+        _names.clear();
+    }
+
+    uint64_t _version;
+    std::vector<std::string> _names;
+};
+
+libilf::RcuTable<EventNames> *event_names;
+
+void int_to_ilf(int const& input, libilf::ILF& ilf) {
+    EventNames const* names = event_names->read();
+    assert(names->_version != UINT64_MAX);
+    ilf._event_t = names->_names[input & 3];
+    ilf._sender = std::to_string(input);
+    ilf._receiver = std::to_string(names->_version);
+    ilf._time = "0";
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        std::cerr << "usage: <num_inputs> <num_threads>" << std::endl;
+        return -1;
+    }
+    const int NUM_INPUTS = std::stoi(argv[1]), NUM_THREADS = std::stoi(argv[2]);
+    libilf::QsbrDomain domain(NUM_THREADS);
+    event_names = new libilf::RcuTable<EventNames>(domain,
+        std::unique_ptr<EventNames const>(new EventNames(0)));
+
+    // Offline readers do not hold reclamation back
+    //
+    event_names->publish(std::unique_ptr<EventNames const>(new EventNames(1)));
+    assert(event_names->reclaim() == 0);
+    domain.quiescent(0);
+    event_names->publish(std::unique_ptr<EventNames const>(new EventNames(2)));
+    assert(event_names->reclaim() == 1);
+    domain.quiescent(0);
+    assert(event_names->reclaim() == 0);
+    domain.offline(0);
+
+    // A reader brought back online holds reclamation back again
+    //
+    domain.online(0);
+    event_names->publish(std::unique_ptr<EventNames const>(new EventNames(2)));
+    assert(event_names->reclaim() == 1);
+    domain.offline(0);
+    assert(event_names->reclaim() == 0);
+
+    libilf::Parser<int, libilf::ILF> parser(int_to_ilf, NUM_THREADS, 4096);
+    parser.set_iteration_function(libilf::QsbrDomain::parser_hook, &domain);
+    parser.start();
+
+    // Republishes the table as fast as possible while the threads convert
+    //
+    std::atomic<bool> updating(true);
+    std::atomic<uint64_t> published(2);
+    std::thread updater([&]() {
+        while (updating.load()) {
+            uint64_t version = published.load() + 1;
+            published.store(version);
+            event_names->publish(std::unique_ptr<EventNames const>(new EventNames(version)));
+            std::this_thread::yield();
+        }
+    });
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    int pushed = 0, popped = 0;
+    libilf::ILF output;
+    while (popped < NUM_INPUTS) {
+        if (pushed < NUM_INPUTS && parser.push(pushed)) {
+            pushed++;
+        }
+        while (parser.pop(output)) {
+            // Every field comes from the one version read for the record
+            //
+            assert(output._sender == std::to_string(popped));
+            assert(output._event_t.substr(output._event_t.find('.') + 1) == output._receiver);
+            assert(std::stoull(output._receiver) <= published.load());
+            popped++;
+        }
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    updating.store(false);
+    updater.join();
+    parser.stop();
+
+    // Stopped threads are offline, so everything retired can go
+    //
+    assert(event_names->reclaim() == 0);
+    event_names->barrier();
+    delete event_names;
+
+    std::chrono::duration<double> elapsed_time = end - start;
+    std::cout << "Processed " << NUM_INPUTS << " inputs in " << elapsed_time.count() << " seconds using " << NUM_THREADS << " threads while publishing " << published.load() - 2 << " versions" << std::endl;
+    std::cout << "Throughput: " << (double) NUM_INPUTS / elapsed_time.count() << " inputs per second" << std::endl;
+    return 0;
+}
@@ -0,0 +1,147 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cassert>
+#include <chrono>
+#include <string>
+#include <random>
+#include <ctime>
+#include <climits>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include "serializing_parser.h"
+#include "ilf.h"
+
+std::string event_t_mapping[] = {"ProcessCreate", "FileCreate", "FlowStart", "LogOn"};
+
+struct Data {
+    unsigned int _type, _src, _dst;
+    std::time_t _time;
+    double _val1;
+    bool _val2;
+    std::string _val3;
+};
+
+AE_FORCEINLINE void data_to_ilf(Data const& data, libilf::ILF& ilf) {
+    char ip_buf[32];
+    ilf._event_t = event_t_mapping[data._type];
+    assert(inet_ntop(AF_INET, &data._src, ip_buf, 32));
+    ilf._sender = std::string(ip_buf);
+    assert(inet_ntop(AF_INET, &data._dst, ip_buf, 32));
+    ilf._receiver = std::string(ip_buf);
+    ilf._time = std::to_string(data._time);
+    ilf._pairs.push_back(libilf::KeyValue("val1", std::to_string(data._val1), true));
+    ilf._pairs.push_back(libilf::KeyValue("val2", std::to_string(data._val2), true));
+    ilf._pairs.push_back(libilf::KeyValue("val3", data._val3, true));
+}
+
+// Converts and serializes in the worker, so the consumer never touches an ILF
+//
+void serialize_data(Data const& data, std::string& out) {
+    libilf::ILF ilf;
+    data_to_ilf(data, ilf);
+    out << ilf;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3 && argc != 4) {
+        std::cerr << "usage: <num_inputs> <num_threads> [chunk_size]" << std::endl;
+        return -1;
+    }
+    const int NUM_INPUTS = std::stoi(argv[1]), NUM_THREADS = std::stoi(argv[2]);
+    const size_t CHUNK_SIZE = argc == 4 ? std::stoul(argv[3]) : 1 << 16;
+    libilf::SerializingParser<Data> parser(serialize_data, NUM_THREADS, 4096, CHUNK_SIZE);
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<unsigned int> global_dist(0, UINT_MAX);
+    std::uniform_int_distribution<int> event_t_dist(0, 3);
+    std::uniform_real_distribution<double> real_dist(0, 1024);
+    std::string expected;
+    for (int i = 0; i < NUM_INPUTS; i++) {
+        Data data = {
+            static_cast<unsigned int>(event_t_dist(gen)), global_dist(gen), global_dist(gen),
+            std::time(0), real_dist(gen), i % 2 == 0, std::to_string(global_dist(gen))
+        };
+        serialize_data(data, expected);
+        assert(parser.push(data));
+    }
+
+    char path[] = "/tmp/struct_to_chunksXXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    parser.start_wait();
+    parser.stop_wait();
+    size_t written = 0, count;
+    while ((count = parser.write(fd)) > 0) {
+        written += count;
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    close(fd);
+    assert(written == static_cast<size_t>(NUM_INPUTS));
+
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    unlink(path);
+    assert(contents.str() == expected);
+
+    // Records only become visible once their chunk is handed over
+    //
+    parser.start();
+    Data data = {0, 1, 2, 3, 4.0, true, "5"};
+    assert(parser.push(data));
+    std::vector<struct iovec> iov;
+    while (parser.gather(iov, 1) == 0) { }
+    std::string record(static_cast<char*>(iov[0].iov_base), iov[0].iov_len), single;
+    serialize_data(data, single);
+    assert(record == single);
+    parser.release();
+    parser.stop();
+
+    // An idle thread holds a partial chunk back until it is old enough, so
+    // that inputs trickling in share a chunk, which is reused once released
+    //
+    libilf::SerializingParser<Data> trickle(serialize_data, 1, 64, 1 << 16, 1 << 16, std::chrono::seconds(60));
+    char *first_base = nullptr;
+    for (int round = 0; round < 2; round++) {
+        trickle.start();
+        std::string trickled;
+        for (int i = 0; i < 100; i++) {
+            data._src = i;
+            serialize_data(data, trickled);
+            assert(trickle.push(data));
+            std::this_thread::yield();
+        }
+        while (trickle.input_size() > 0) { }
+        iov.clear();
+        assert(trickle.gather(iov, 100) == 0);
+        trickle.stop();
+        assert(trickle.gather(iov, 100) == 100 && iov.size() == 1);
+        assert(std::string(static_cast<char*>(iov[0].iov_base), iov[0].iov_len) == trickled);
+        if (round == 0) {
+            first_base = static_cast<char*>(iov[0].iov_base);
+        } else {
+            assert(static_cast<char*>(iov[0].iov_base) == first_base);
+        }
+        trickle.release();
+    }
+
+    std::chrono::duration<double> elapsed_time = end - start;
+    std::cout << "Serialized " << NUM_INPUTS << " structs in " << elapsed_time.count() << " seconds using " << NUM_THREADS << " threads and chunk size " << CHUNK_SIZE << std::endl;
+    std::cout << "Throughput: " << (double) NUM_INPUTS / elapsed_time.count() << " structs per second" << std::endl;
+    return 0;
+}
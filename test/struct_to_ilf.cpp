@@ -67,12 +67,20 @@ AE_FORCEINLINE void data_to_ilf(Data const& data, libilf::ILF& ilf) {
     ilf._pairs.push_back(libilf::KeyValue("val3", data._val3, true));
 }
 
+// Prefetches the heap payload of the next inputs while the current one 
+// is being converted
+//
+AE_FORCEINLINE void prefetch_data(Data const& data) {
+    PREFETCH(data._val3.data());
+}
+
 int main(int argc, char *argv[]) {
-    if (argc != 3) {
-        std::cerr << "usage: <num_inputs> <num_threads>" << std::endl;
+    if (argc != 3 && argc != 4) {
+        std::cerr << "usage: <num_inputs> <num_threads> [prefetch_distance]" << std::endl;
         return -1;
     }
     const int NUM_INPUTS = std::stoi(argv[1]), NUM_THREADS = std::stoi(argv[2]), NUM_EVENT_TYPES = 4;
+    const int PREFETCH_DISTANCE = argc == 4 ? std::stoi(argv[3]) : 0;
     libilf::Parser<Data,libilf::ILF> *parser;
     try {
         parser = new libilf::Parser<Data,libilf::ILF>(data_to_ilf, NUM_THREADS, 4096);
@@ -82,6 +90,7 @@ int main(int argc, char *argv[]) {
         std::cerr << e.what() << std::endl;
         return EXIT_FAILURE;
     }
+    parser->set_prefetch_function(prefetch_data, PREFETCH_DISTANCE);
     event_t_mapping = new std::string[NUM_EVENT_TYPES];
     event_t_mapping[0] = std::string("ProcessCreate");
     event_t_mapping[1] = std::string("FileCreate");
@@ -107,8 +116,8 @@ int main(int argc, char *argv[]) {
         parser->push(cur_data);
     }
     std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
-    // parser->start_max_throughput();
-    // parser->stop_max_throughput();
+    parser->start_wait();
+    parser->stop_wait();
     std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
     for (int i = 0; i < NUM_INPUTS; i++) {
         libilf::ILF cur_output, expected_output;
@@ -119,7 +128,7 @@ int main(int argc, char *argv[]) {
     }
     assert(parser->input_size() == 0 && parser->output_size() == 0);
     std::chrono::duration<double> elapsed_time = end - start;
-    std::cout << "Processed " << NUM_INPUTS << " integers in " << elapsed_time.count() << " seconds using " << NUM_THREADS << " threads" << std::endl;
+    std::cout << "Processed " << NUM_INPUTS << " integers in " << elapsed_time.count() << " seconds using " << NUM_THREADS << " threads and prefetch distance " << PREFETCH_DISTANCE << std::endl;
     std::cout << "Throughput: " << (double) NUM_INPUTS / elapsed_time.count() << " integers per second" << std::endl;
     return 0;
 }
@@ -0,0 +1,137 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#include <iostream>
+#include <sstream>
+#include <cassert>
+#include <chrono>
+#include <string>
+#include <random>
+#include <climits>
+#include <arpa/inet.h>
+#include "ilf.h"
+#include "writer.h"
+
+std::string event_t_mapping[] = {"ProcessCreate", "FileCreate", "FlowStart", "LogOn"};
+
+struct Data {
+    unsigned int _type, _src, _dst;
+    int64_t _time;
+    double _val1;
+    bool _val2;
+    std::string _val3;
+    int _val4;
+};
+
+void data_to_ilf(Data const& data, libilf::ILF& ilf) {
+    char ip_buf[32];
+    ilf._event_t = event_t_mapping[data._type];
+    assert(inet_ntop(AF_INET, &data._src, ip_buf, 32));
+    ilf._sender = std::string(ip_buf);
+    assert(inet_ntop(AF_INET, &data._dst, ip_buf, 32));
+    ilf._receiver = std::string(ip_buf);
+    ilf._time = std::to_string(data._time);
+    ilf._pairs.clear();
+    ilf._pairs.push_back(libilf::KeyValue("val1", std::to_string(data._val1), false));
+    ilf._pairs.push_back(libilf::KeyValue("val2", std::to_string(data._val2), false));
+    ilf._pairs.push_back(libilf::KeyValue("val3", data._val3, true));
+    ilf._pairs.push_back(libilf::KeyValue("val4", std::to_string(data._val4), false));
+}
+
+void write_data(Data const& data, libilf::ILFWriter& writer) {
+    char src_buf[32], dst_buf[32];
+    assert(inet_ntop(AF_INET, &data._src, src_buf, 32));
+    assert(inet_ntop(AF_INET, &data._dst, dst_buf, 32));
+    writer.begin(event_t_mapping[data._type], src_buf, dst_buf, data._time)
+        .kv("val1", data._val1)
+        .kv("val2", data._val2)
+        .kv("val3", data._val3)
+        .kv("val4", data._val4)
+        .end();
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        std::cerr << "usage: <num_inputs>" << std::endl;
+        return -1;
+    }
+    const int NUM_INPUTS = std::stoi(argv[1]);
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<unsigned int> global_dist(0, UINT_MAX);
+    std::uniform_int_distribution<int> event_t_dist(0, 3);
+    std::uniform_int_distribution<int64_t> time_dist(-(1LL << 40), 1LL << 40);
+    std::uniform_real_distribution<double> real_dist(-1024, 1024);
+    std::vector<Data> data_vec;
+    for (int i = 0; i < NUM_INPUTS; i++) {
+        Data data = {
+            static_cast<unsigned int>(event_t_dist(gen)), global_dist(gen), global_dist(gen),
+            time_dist(gen), real_dist(gen), i % 2 == 0, std::to_string(global_dist(gen)),
+            static_cast<int>(global_dist(gen))
+        };
+        data_vec.push_back(data);
+    }
+
+    // Byte for byte identical to operator<<, including without pairs
+    //
+    std::string text;
+    libilf::ILFWriter writer(text);
+    for (int i = 0; i < NUM_INPUTS && i < 10000; i++) {
+        libilf::ILF ilf;
+        data_to_ilf(data_vec[i], ilf);
+        std::ostringstream expected;
+        expected << ilf;
+        text.clear();
+        write_data(data_vec[i], writer);
+        assert(text == expected.str());
+    }
+    std::ostringstream empty;
+    empty << libilf::ILF("LogOn", "a", "b", "0");
+    text.clear();
+    writer.begin("LogOn", "a", "b", "0").end();
+    assert(text == empty.str());
+
+    // Every integer type formats as std::to_string() does
+    //
+    text.clear();
+    writer.begin("LogOn", "a", "b", "0")
+        .kv("ll", LLONG_MIN)
+        .kv("ull", ULLONG_MAX)
+        .kv("l", -1L)
+        .kv("size", static_cast<size_t>(1) << 40)
+        .kv("short", static_cast<short>(-7))
+        .kv("byte", static_cast<unsigned char>(200))
+        .end();
+    assert(text == "LogOn[a,b,0,(ll=" + std::to_string(LLONG_MIN) + ";ull=" + std::to_string(ULLONG_MAX) +
+        ";l=-1;size=" + std::to_string(static_cast<size_t>(1) << 40) + ";short=-7;byte=200)]");
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::ostringstream stream;
+    libilf::ILF ilf;
+    for (int i = 0; i < NUM_INPUTS; i++) {
+        data_to_ilf(data_vec[i], ilf);
+        stream << ilf << "\n";
+    }
+    std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+    text.clear();
+    for (int i = 0; i < NUM_INPUTS; i++) {
+        write_data(data_vec[i], writer);
+        text.push_back('\n');
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    assert(text == stream.str());
+
+    std::chrono::duration<double> ilf_time = middle - start, writer_time = end - middle;
+    std::cout << "Serialized " << NUM_INPUTS << " structs in " << ilf_time.count() << " seconds through ILF and operator<<" << std::endl;
+    std::cout << "Serialized " << NUM_INPUTS << " structs in " << writer_time.count() << " seconds with ILFWriter" << std::endl;
+    std::cout << "Throughput: " << (double) NUM_INPUTS / writer_time.count() << " structs per second" << std::endl;
+    return 0;
+}
@@ -0,0 +1,89 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#include <iostream>
+#include <cassert>
+#include <chrono>
+#include <string>
+#include <random>
+#include "parser.h"
+#include "sysmon.h"
+
+std::string process_create(int i) {
+    return "<Event xmlns='http://schemas.microsoft.com/win/2004/08/events/event'><System>"
+        "<Provider Name='Microsoft-Windows-Sysmon' Guid='{5770385f-c22a-43e0-bf4c-06f5698ffbd9}'/>"
+        "<EventID>1</EventID><Version>5</Version><Level>4</Level><Task>1</Task><Opcode>0</Opcode>"
+        "<Keywords>0x8000000000000000</Keywords><TimeCreated SystemTime='2023-05-01T12:00:00." + std::to_string(100000 + i) + "Z'/>"
+        "<EventRecordID>" + std::to_string(i) + "</EventRecordID><Correlation/><Execution ProcessID='3216' ThreadID='3964'/>"
+        "<Channel>Microsoft-Windows-Sysmon/Operational</Channel><Computer>host.example.com</Computer>"
+        "<Security UserID='S-1-5-18'/></System><EventData><Data Name='RuleName'>-</Data>"
+        "<Data Name='UtcTime'>2023-05-01 12:00:00.100</Data><Data Name='ProcessGuid'>{a23eae89-bd56-5903-0000-0010e9d95e00}</Data>"
+        "<Data Name='ProcessId'>" + std::to_string(1000 + i % 5000) + "</Data><Data Name='Image'>C:\\Windows\\System32\\cmd.exe</Data>"
+        "<Data Name='CommandLine'>cmd.exe /c \"echo &lt;" + std::to_string(i) + "&gt; &amp;&amp; dir\"</Data>"
+        "<Data Name='CurrentDirectory'>C:\\Users\\user\\</Data><Data Name='User'>CORP\\user</Data>"
+        "<Data Name='IntegrityLevel'>Medium</Data><Data Name='Hashes'>SHA256=2B40C98ED0F7A3B8DAE6B7D4F9F4B4E6A1B2C3D4E5F60718293A4B5C6D7E8F90</Data>"
+        "<Data Name='ParentProcessGuid'>{a23eae89-bd28-5903-0000-00102f345d00}</Data><Data Name='ParentProcessId'>3216</Data>"
+        "<Data Name='ParentImage'>C:\\Windows\\explorer.exe</Data><Data Name='ParentCommandLine'>C:\\Windows\\Explorer.EXE</Data>"
+        "</EventData></Event>";
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        std::cerr << "usage: <num_inputs> <num_threads>" << std::endl;
+        return -1;
+    }
+    const int NUM_INPUTS = std::stoi(argv[1]), NUM_THREADS = std::stoi(argv[2]);
+
+    libilf::ILF ilf;
+    assert(libilf::SysmonScanner().scan(process_create(7), ilf));
+    assert(ilf._event_t == "ProcessCreate" && ilf._time == "2023-05-01T12:00:00.100007Z");
+    assert(ilf._sender == "C:\\Windows\\explorer.exe" && ilf._receiver == "C:\\Windows\\System32\\cmd.exe");
+    assert(ilf._pairs.size() == 12 && ilf._pairs[0]._key == "process_guid");
+    assert(ilf._pairs[3]._key == "command_line" && ilf._pairs[3]._value == "cmd.exe /c \"echo <7> && dir\"");
+
+    const std::string file_create =
+        "<Event><System><EventID Qualifiers=\"0\">11</EventID><TimeCreated SystemTime=\"2023-05-01T12:00:01Z\"/></System>"
+        "<EventData><Data Name=\"Image\">C:\\a&#x20AC;&#233;&#x1F600;&bogus;.exe</Data><Data Name=\"TargetFilename\"/>"
+        "<Data Name=\"Unmapped\">x</Data></EventData></Event>";
+    assert(libilf::SysmonScanner().scan(file_create, ilf));
+    assert(ilf._event_t == "FileCreate" && ilf._time == "2023-05-01T12:00:01Z" && ilf._receiver.empty());
+    assert(ilf._sender == "C:\\a\xE2\x82\xAC\xC3\xA9\xF0\x9F\x98\x80&bogus;.exe" && ilf._pairs.size() == 2);
+    assert(libilf::SysmonScanner().scan("<Event><EventID>4688</EventID></Event>", ilf) && ilf._event_t == "Sysmon4688");
+    assert(!libilf::SysmonScanner().scan("<Event><Data Name='Image'>x", ilf) && ilf._event_t.empty());
+    assert(!libilf::SysmonScanner().scan("", ilf));
+
+    libilf::SysmonScanner custom({{1, libilf::SysmonEventType("Exec", "User", "ProcessId")}}, {{"Image", "exe"}});
+    assert(custom.scan(process_create(1), ilf));
+    assert(ilf._event_t == "Exec" && ilf._sender == "CORP\\user" && ilf._receiver == "1001");
+    assert(ilf._pairs.size() == 1 && ilf._pairs[0]._key == "exe");
+
+    libilf::Parser<std::string, libilf::ILF> parser(libilf::sysmon_to_ilf, NUM_THREADS, 4096);
+    size_t bytes = 0;
+    for (int i = 0; i < NUM_INPUTS; i++) {
+        std::string event = process_create(i);
+        bytes += event.size();
+        assert(parser.push(event));
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    parser.start_wait();
+    parser.stop_wait();
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    for (int i = 0; i < NUM_INPUTS; i++) {
+        assert(parser.pop(ilf));
+        assert(ilf._event_t == "ProcessCreate" && ilf._pairs[1]._value == std::to_string(1000 + i % 5000));
+    }
+
+    std::chrono::duration<double> elapsed_time = end - start;
+    std::cout << "Scanned " << NUM_INPUTS << " events in " << elapsed_time.count() << " seconds using " << NUM_THREADS << " threads" << std::endl;
+    std::cout << "Throughput: " << (double) NUM_INPUTS / elapsed_time.count() << " events per second, " << bytes / elapsed_time.count() / 1e6 << " MB/s" << std::endl;
+    return 0;
+}
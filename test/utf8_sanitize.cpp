@@ -0,0 +1,119 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#include <iostream>
+#include <cassert>
+#include <chrono>
+#include <string>
+#include <random>
+#include "utf8.h"
+
+// Valid UTF-8 and invalid sequences to build test values from
+//
+const char *PIECES[] = {
+    "a", "cmd.exe /c", "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\x98\x80", "\xED\x9F\xBF",
+    "\xEF\xBF\xBF", "\xF4\x8F\xBF\xBF", "\t", "\x7F", "\x80", "\xC0\xAF", "\xC3",
+    "\xE2\x82", "\xED\xA0\x80", "\xF4\x90\x80\x80", "\xF0\x82\x82\xAC", "\xFF", "\xF8\x88\x80\x80\x80"
+};
+const int NUM_PIECES = sizeof(PIECES) / sizeof(PIECES[0]);
+
+// Reverses Utf8Repair::ESCAPE
+//
+std::string unescape(std::string const& escaped) {
+    std::string value;
+    for (size_t i = 0; i < escaped.size(); i++) {
+        if (escaped[i] == '\\') {
+            assert(i + 3 < escaped.size() && escaped[i + 1] == 'x');
+            value.push_back(static_cast<char>(std::stoi(escaped.substr(i + 2, 2), nullptr, 16)));
+            i += 3;
+        } else {
+            value.push_back(escaped[i]);
+        }
+    }
+    return value;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        std::cerr << "usage: <num_bytes>" << std::endl;
+        return -1;
+    }
+    const size_t NUM_BYTES = std::stoul(argv[1]);
+
+    // The vectorized checks agree with the scalar reference on random values,
+    // including sequences split across 16-byte blocks
+    //
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> piece_dist(0, NUM_PIECES - 1), byte_dist(0, 255), len_dist(0, 40);
+    for (int i = 0; i < 200000; i++) {
+        std::string value;
+        int len = len_dist(gen);
+        for (int j = 0; j < len; j++) {
+            if (i % 4 == 0) {
+                value.push_back(static_cast<char>(byte_dist(gen)));
+            } else {
+                value += PIECES[piece_dist(gen) * (j % 3 != 0)];
+            }
+        }
+        assert(libilf::utf8_valid(value) == (libilf::detail::utf8_scan_scalar(value.data(), value.size(), false) == value.size()));
+        assert(libilf::utf8_clean(value) == (libilf::detail::utf8_scan_scalar(value.data(), value.size(), true) == value.size()));
+        std::string sanitized = value;
+        assert(libilf::sanitize_utf8(sanitized) != libilf::utf8_clean(value));
+        assert(libilf::utf8_clean(sanitized));
+        std::string escaped;
+        libilf::append_sanitized_utf8(escaped, value.data(), value.size(), libilf::Utf8Repair::ESCAPE);
+        assert(libilf::utf8_clean(escaped) && unescape(escaped) == value);
+    }
+
+    std::string value("a\xE2\x82z\xC0\xAF\n\xF0\x9F\x98\x80");
+    std::string replaced = value, escaped;
+    libilf::sanitize_utf8(replaced);
+    assert(replaced == "a\xEF\xBF\xBDz\xEF\xBF\xBD\xEF\xBF\xBD\xEF\xBF\xBD\xF0\x9F\x98\x80");
+    libilf::append_sanitized_utf8(escaped, value.data(), value.size(), libilf::Utf8Repair::ESCAPE);
+    assert(escaped == "a\\xE2\\x82z\\xC0\\xAF\\x0A\xF0\x9F\x98\x80");
+    std::string clean("C:\\Windows\\System32\\cmd.exe /c \xE2\x82\xAC");
+    char const* before = clean.data();
+    assert(!libilf::sanitize_utf8(clean) && clean.data() == before);
+
+    // Backslashes are escaped too, so that a literal \x41 differs from an
+    // escaped byte
+    //
+    std::string literal("\\x41\x80"), literal_escaped = literal;
+    assert(libilf::sanitize_utf8(literal_escaped, libilf::Utf8Repair::ESCAPE) && literal_escaped == "\\x5Cx41\\x80");
+    escaped.clear();
+    libilf::append_sanitized_utf8(escaped, clean.data(), clean.size(), libilf::Utf8Repair::ESCAPE);
+    assert(escaped == "C:\\x5CWindows\\x5CSystem32\\x5Ccmd.exe /c \xE2\x82\xAC" && unescape(escaped) == clean);
+
+    // Throughput on clean command lines, mostly ASCII
+    //
+    std::string text;
+    while (text.size() < NUM_BYTES) {
+        text += "C:\\Windows\\system32\\svchost.exe -k netsvcs -p -s Schedule ";
+        text += text.size() % 7 == 0 ? "\xC3\xA9t\xC3\xA9 " : "";
+    }
+    bool clean_text = true;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 10; i++) {
+        clean_text &= libilf::utf8_clean(text);
+    }
+    std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+    for (int i = 0; i < 10; i++) {
+        clean_text &= libilf::detail::utf8_scan_scalar(text.data(), text.size(), true) == text.size();
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    assert(clean_text);
+
+    std::chrono::duration<double> simd_time = middle - start, scalar_time = end - middle;
+    std::cout << "Checked " << 10 * text.size() << " bytes in " << simd_time.count() << " seconds" << std::endl;
+    std::cout << "Throughput: " << 10 * text.size() / simd_time.count() / 1e9 << " GB/s (scalar: " << 10 * text.size() / scalar_time.count() / 1e9 << " GB/s)" << std::endl;
+    return 0;
+}
@@ -0,0 +1,611 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+// ilfcat: converts, filters, samples and counts ILF text from files or
+// stdin on the threads of a Parser.
+//
+// Input is cut into blocks of whole lines, read from a mapping of each
+// regular file or with large reads from anything else, and every block is
+// parsed, filtered and formatted by one worker. When stdout is a pipe and
+// ILF is passed through, the kept lines of a mapped file are handed to the
+// pipe with vmsplice(2) straight from the mapping instead of being copied by
+// the worker and again by write(2). The mapping is read-only and the pipe
+// keeps its own references to the pages, so it can be unmapped right after.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+#include <system_error>
+#include <cerrno>
+#include <cstring>
+#include <csignal>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <climits>
+#include "parser.h"
+#include "pipeline.h"
+#include "perfect_hash.h"
+#include "reader.h"
+#include "binary.h"
+#include "http_sink.h"
+#include "siem.h"
+#include "ilf.h"
+
+enum OutputFormat { FORMAT_ILF, FORMAT_JSON, FORMAT_BINARY, FORMAT_CEF, FORMAT_LEEF };
+
+struct Options {
+    Options() : _format(FORMAT_ILF), _sample(1), _count(false), _stats(false), _threads(0) { }
+
+    OutputFormat _format;
+    std::vector<std::string> _events;
+    std::vector<std::pair<std::string, std::string> > _where;
+    unsigned int _sample;
+    bool _count, _stats;
+    unsigned int _threads;
+};
+
+Options options;
+std::atomic<bool> to_pipe(false);
+
+const size_t BLOCK_SIZE = 1 << 20;
+
+// Whole lines of input. Blocks of a mapped file point into the mapping and
+// blocks read from a stream into their own buffer, which owner keeps alive
+//
+struct Block {
+    Block() : _data(nullptr), _size(0), _mapped(false) { }
+
+    std::shared_ptr<const char> _owner;
+    char const* _data;
+    size_t _size;
+    bool _mapped;
+};
+
+// Either text, or runs of lines of a mapped block for vmsplice(2), which owner
+// keeps mapped until they are written
+//
+struct Output {
+    Output() : _records(0), _matched(0), _malformed(0) { }
+
+    std::string _text;
+    std::shared_ptr<const char> _owner;
+    std::vector<struct iovec> _lines;
+    uint64_t _records, _matched, _malformed;
+    std::vector<std::pair<std::string, uint64_t> > _events;
+};
+
+AE_FORCEINLINE bool keep(libilf::ILF const& ilf, char const* line, size_t len) {
+    if (!options._events.empty() &&
+        std::find(options._events.begin(), options._events.end(), ilf._event_t) == options._events.end()) {
+        return false;
+    }
+    for (size_t i = 0; i < options._where.size(); i++) {
+        std::string const& key = options._where[i].first, &value = options._where[i].second;
+        bool found = false;
+        if (key == "sender" || key == "receiver" || key == "time" || key == "event_t") {
+            found = (key == "sender" ? ilf._sender : key == "receiver" ? ilf._receiver :
+                key == "time" ? ilf._time : ilf._event_t) == value;
+        } else {
+            for (size_t j = 0; j < ilf._pairs.size() && !found; j++) {
+                found = ilf._pairs[j]._key == key && ilf._pairs[j]._value == value;
+            }
+        }
+        if (!found) {
+            return false;
+        }
+    }
+    return options._sample <= 1 || libilf::hash_bytes(line, len) % options._sample == 0;
+}
+
+void splice_line(Output& output, char const* line, size_t len) {
+    if (!output._lines.empty() && static_cast<char const*>(output._lines.back().iov_base) + output._lines.back().iov_len == line) {
+        output._lines.back().iov_len += len;
+    } else {
+        struct iovec iov;
+        iov.iov_base = const_cast<char*>(line);
+        iov.iov_len = len;
+        output._lines.push_back(iov);
+    }
+}
+
+void block_to_output(Block const& block, Output& output) {
+    static thread_local libilf::ILF ilf;
+    static thread_local libilf::JsonFormat json;
+    static thread_local libilf::BinaryFormat binary;
+    static thread_local libilf::CefFormat cef;
+    static thread_local libilf::LeefFormat leef;
+    output = Output();
+    const bool splice = to_pipe.load(std::memory_order_relaxed) && block._mapped && options._format == FORMAT_ILF;
+    if (splice) {
+        output._owner = block._owner;
+    } else {
+        output._text.reserve(options._count ? 0 : block._size + block._size / 2);
+    }
+    char const* p = block._data, *end = block._data + block._size;
+    while (p < end) {
+        char const* line_end = static_cast<char const*>(memchr(p, '\n', end - p));
+        if (line_end == nullptr) {
+            line_end = end;
+        }
+        char const* line = p;
+        const size_t len = line_end - p;
+        p = line_end + 1;
+        if (len == 0 || (len == 1 && *line == '\r')) {
+            continue;
+        }
+        if (!libilf::parse_ilf(line, len, ilf)) {
+            output._malformed++;
+            continue;
+        }
+        output._records++;
+        if (!keep(ilf, line, len)) {
+            continue;
+        }
+        output._matched++;
+        if (options._stats) {
+            size_t i = 0;
+            while (i < output._events.size() && output._events[i].first != ilf._event_t) {
+                i++;
+            }
+            if (i == output._events.size()) {
+                output._events.push_back(std::make_pair(ilf._event_t, 0));
+            }
+            output._events[i].second++;
+        }
+        if (options._count) {
+            continue;
+        }
+        switch (options._format) {
+        case FORMAT_ILF:
+            // Lines are passed through as they are, and adjacent ones are
+            // spliced together
+            //
+            if (!splice) {
+                output._text.append(line, len);
+                output._text.push_back('\n');
+            } else {
+                splice_line(output, line, std::min(p, end) - line);
+                if (p > end) {
+                    // The last line of a file without a newline
+                    //
+                    splice_line(output, "\n", 1);
+                }
+            }
+            break;
+        case FORMAT_JSON:
+            json(ilf, output._text);
+            break;
+        case FORMAT_BINARY:
+            binary(ilf, output._text);
+            break;
+        case FORMAT_CEF:
+            cef(ilf, output._text);
+            break;
+        case FORMAT_LEEF:
+            leef(ilf, output._text);
+            break;
+        }
+    }
+}
+
+// Number of blocks read and not yet written, which bounds the memory held by
+// a fast reader in front of a slow writer
+//
+struct Throttle {
+    Throttle() : _in_flight(0) { }
+
+    std::atomic<size_t> _in_flight;
+};
+
+// Blocks of the given files in order, "-" being stdin. At most max_in_flight
+// blocks are pushed and not yet written at any time
+//
+class BlockSource : public libilf::Source<Block> {
+public:
+    BlockSource(std::vector<std::string> const& paths, Throttle& throttle, size_t max_in_flight) :
+        _paths(paths),
+        _throttle(throttle),
+        _max_in_flight(max_in_flight),
+        _next_path(0),
+        _fd(-1),
+        _size(0),
+        _offset(0),
+        _bytes(0),
+        _cancelled(false) { }
+
+    size_t read(libilf::span<Block> blocks) override {
+        size_t count = 0;
+        while (count < blocks.size()) {
+            while (_throttle._in_flight.load(std::memory_order_acquire) >= _max_in_flight) {
+                if (_cancelled.load(std::memory_order_acquire)) {
+                    return 0;
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+            if (_fd < 0 && !_mapping && !open_next()) {
+                break;
+            }
+            if (!(_mapping ? next_mapped(blocks[count]) : next_read(blocks[count]))) {
+                close_current();
+                continue;
+            }
+            _bytes += blocks[count]._size;
+            _throttle._in_flight.fetch_add(1, std::memory_order_acq_rel);
+            count++;
+            if (!_mapping) {
+                // Do not hold back a block of a slow stream
+                //
+                break;
+            }
+        }
+        return count;
+    }
+
+    // The pipeline stops early, e.g. when the sink fails, and the blocks in
+    // flight will never be written
+    //
+    void cancel() override {
+        _cancelled.store(true, std::memory_order_release);
+    }
+
+    void close() override {
+        close_current();
+    }
+
+    uint64_t bytes() const {
+        return _bytes;
+    }
+
+private:
+    bool open_next() {
+        if (_next_path == _paths.size()) {
+            return false;
+        }
+        std::string const& path = _paths[_next_path++];
+        _fd = path == "-" ? STDIN_FILENO : open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (_fd < 0) {
+            throw std::system_error(errno, std::system_category(), path);
+        }
+        struct stat st;
+        if (fstat(_fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            void *mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, _fd, 0);
+            if (mapping != MAP_FAILED) {
+                madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+                madvise(mapping, st.st_size, MADV_WILLNEED);
+                const size_t size = st.st_size;
+                _mapping = std::shared_ptr<const char>(static_cast<char const*>(mapping), [size](char const* p) {
+                    munmap(const_cast<char*>(p), size);
+                });
+                _size = size;
+                _offset = 0;
+                if (_fd != STDIN_FILENO) {
+                    ::close(_fd);
+                }
+                _fd = -1;
+            }
+        }
+        return true;
+    }
+
+    void close_current() {
+        _mapping.reset();
+        if (_fd > STDIN_FILENO) {
+            ::close(_fd);
+        }
+        _fd = -1;
+        _carry.clear();
+    }
+
+    // Up to BLOCK_SIZE bytes of the mapping, extended to the end of the line
+    //
+    bool next_mapped(Block& block) {
+        if (_offset == _size) {
+            return false;
+        }
+        char const* data = _mapping.get();
+        size_t end = std::min(_size, _offset + BLOCK_SIZE);
+        if (end < _size) {
+            char const* newline = static_cast<char const*>(memchr(data + end, '\n', _size - end));
+            end = newline == nullptr ? _size : newline - data + 1;
+        }
+        block._owner = _mapping;
+        block._mapped = true;
+        block._data = data + _offset;
+        block._size = end - _offset;
+        _offset = end;
+        return true;
+    }
+
+    // The carried partial line followed by one large read, cut after its
+    // last newline
+    //
+    bool next_read(Block& block) {
+        while (true) {
+            std::shared_ptr<char> buffer(new char[BLOCK_SIZE + _carry.size()], std::default_delete<char[]>());
+            memcpy(buffer.get(), _carry.data(), _carry.size());
+            size_t size = _carry.size();
+            ssize_t count;
+            while ((count = ::read(_fd, buffer.get() + size, BLOCK_SIZE)) < 0 && errno == EINTR) { }
+            if (count < 0) {
+                throw std::system_error(errno, std::system_category(), "read");
+            }
+            size += count;
+            if (size == 0) {
+                return false;
+            }
+            char const* data = buffer.get();
+            size_t cut = size;
+            if (count > 0) {
+                char const* newline = static_cast<char const*>(memrchr(data, '\n', size));
+                cut = newline == nullptr ? 0 : newline - data + 1;
+            }
+            _carry.assign(data + cut, size - cut);
+            if (cut == 0) {
+                continue;
+            }
+            block._owner = buffer;
+            block._mapped = false;
+            block._data = data;
+            block._size = cut;
+            return true;
+        }
+    }
+
+    std::vector<std::string> _paths;
+    Throttle& _throttle;
+    const size_t _max_in_flight;
+    size_t _next_path;
+    int _fd;
+    std::shared_ptr<const char> _mapping;
+    size_t _size, _offset;
+    std::string _carry;
+    uint64_t _bytes;
+    std::atomic<bool> _cancelled;
+};
+
+// Writes outputs to stdout, through vmsplice(2) for lines of mapped blocks,
+// and adds up their counts
+//
+class StdoutSink : public libilf::Sink<Output> {
+public:
+    explicit StdoutSink(Throttle& throttle) :
+        _throttle(throttle),
+        _records(0),
+        _matched(0),
+        _malformed(0) { }
+
+    void write(libilf::span<const Output> outputs) override {
+        for (size_t i = 0; i < outputs.size(); i++) {
+            Output const& output = outputs[i];
+            if (!output._lines.empty()) {
+                write_lines(output._lines);
+            } else {
+                write_all(output._text.data(), output._text.size());
+            }
+            _records += output._records;
+            _matched += output._matched;
+            _malformed += output._malformed;
+            for (size_t j = 0; j < output._events.size(); j++) {
+                _events[output._events[j].first] += output._events[j].second;
+            }
+            _throttle._in_flight.fetch_sub(1, std::memory_order_acq_rel);
+        }
+    }
+
+private:
+    // Falls back to writev(2) for good if vmsplice(2) turns out not to be
+    // supported
+    //
+    void write_lines(std::vector<struct iovec> const& lines) {
+        struct iovec iov[IOV_MAX];
+        size_t next = 0, count = 0;
+        while (next < lines.size() || count > 0) {
+            while (next < lines.size() && count < IOV_MAX) {
+                iov[count++] = lines[next++];
+            }
+            const bool splice = to_pipe.load(std::memory_order_relaxed);
+            ssize_t written = splice ? vmsplice(STDOUT_FILENO, iov, count, 0) : writev(STDOUT_FILENO, iov, count);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (!splice || errno == EPIPE) {
+                    throw std::system_error(errno, std::system_category(), splice ? "vmsplice" : "writev");
+                }
+                to_pipe.store(false, std::memory_order_relaxed);
+                continue;
+            }
+            size_t first = 0;
+            while (first < count && static_cast<size_t>(written) >= iov[first].iov_len) {
+                written -= iov[first++].iov_len;
+            }
+            if (first < count) {
+                iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + written;
+                iov[first].iov_len -= written;
+            }
+            std::copy(iov + first, iov + count, iov);
+            count -= first;
+        }
+    }
+
+    void write_all(char const* data, size_t size) {
+        while (size > 0) {
+            ssize_t count = ::write(STDOUT_FILENO, data, size);
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::system_category(), "write");
+            }
+            data += count;
+            size -= count;
+        }
+    }
+
+    Throttle& _throttle;
+
+public:
+    uint64_t _records, _matched, _malformed;
+    std::map<std::string, uint64_t> _events;
+};
+
+void usage() {
+    std::cerr <<
+        "usage: ilfcat [options] [file...]\n"
+        "\n"
+        "Reads ILF text from the files, or stdin if there are none or for -, and\n"
+        "writes the records that pass the filters to stdout.\n"
+        "\n"
+        "  -f, --format FORMAT    ilf (default), json, binary, cef or leef\n"
+        "  -e, --event TYPE       keep records of event type TYPE; repeatable\n"
+        "  -w, --where KEY=VALUE  keep records whose KEY (a pair key, or sender,\n"
+        "                         receiver, time or event_t) is VALUE; repeatable,\n"
+        "                         all must hold\n"
+        "  -s, --sample N         keep about 1 in N records, chosen by a hash of\n"
+        "                         the record, so that reruns keep the same ones\n"
+        "  -c, --count            print the number of records kept instead\n"
+        "  -S, --stats            print counts per event type and throughput to\n"
+        "                         stderr\n"
+        "  -t, --threads N        number of worker threads, a power of 2\n";
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option long_options[] = {
+        {"format", required_argument, nullptr, 'f'},
+        {"event", required_argument, nullptr, 'e'},
+        {"where", required_argument, nullptr, 'w'},
+        {"sample", required_argument, nullptr, 's'},
+        {"count", no_argument, nullptr, 'c'},
+        {"stats", no_argument, nullptr, 'S'},
+        {"threads", required_argument, nullptr, 't'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}
+    };
+    int option;
+    while ((option = getopt_long(argc, argv, "f:e:w:s:cSt:h", long_options, nullptr)) != -1) {
+        std::string value = optarg != nullptr ? optarg : "";
+        switch (option) {
+        case 'f':
+            if (value == "ilf") {
+                options._format = FORMAT_ILF;
+            } else if (value == "json") {
+                options._format = FORMAT_JSON;
+            } else if (value == "binary") {
+                options._format = FORMAT_BINARY;
+            } else if (value == "cef") {
+                options._format = FORMAT_CEF;
+            } else if (value == "leef") {
+                options._format = FORMAT_LEEF;
+            } else {
+                std::cerr << "ilfcat: unknown format " << value << std::endl;
+                return 2;
+            }
+            break;
+        case 'e':
+            options._events.push_back(value);
+            break;
+        case 'w':
+            if (value.find('=') == std::string::npos) {
+                std::cerr << "ilfcat: expected KEY=VALUE, got " << value << std::endl;
+                return 2;
+            }
+            options._where.push_back(std::make_pair(value.substr(0, value.find('=')), value.substr(value.find('=') + 1)));
+            break;
+        case 's':
+            options._sample = std::max(1, atoi(value.c_str()));
+            break;
+        case 'c':
+            options._count = true;
+            break;
+        case 'S':
+            options._stats = true;
+            break;
+        case 't':
+            options._threads = atoi(value.c_str());
+            break;
+        default:
+            usage();
+            return option == 'h' ? 0 : 2;
+        }
+    }
+    std::vector<std::string> paths(argv + optind, argv + argc);
+    if (paths.empty()) {
+        paths.push_back("-");
+    }
+    if (options._threads == 0) {
+        options._threads = 1;
+        while (options._threads * 2 <= std::thread::hardware_concurrency()) {
+            options._threads *= 2;
+        }
+    }
+
+    // Counts are written at the end anyway
+    //
+    struct stat st;
+    if (!options._count && fstat(STDOUT_FILENO, &st) == 0 && S_ISFIFO(st.st_mode)) {
+        to_pipe = true;
+        fcntl(STDOUT_FILENO, F_SETPIPE_SZ, 1 << 20);
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    Throttle throttle;
+    try {
+        libilf::Parser<Block, Output> parser(block_to_output, options._threads, 64);
+        BlockSource source(paths, throttle, 4 * options._threads + 4);
+        StdoutSink sink(throttle);
+        libilf::Pipeline<Block, Output> pipeline(parser, source, sink, 8);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        pipeline.run();
+        std::chrono::duration<double> elapsed_time = std::chrono::steady_clock::now() - start;
+        if (options._count) {
+            std::cout << sink._matched << std::endl;
+        }
+        if (options._stats) {
+            std::vector<std::pair<uint64_t, std::string> > events;
+            for (std::map<std::string, uint64_t>::const_iterator it = sink._events.begin(); it != sink._events.end(); ++it) {
+                events.push_back(std::make_pair(it->second, it->first));
+            }
+            std::sort(events.rbegin(), events.rend());
+            for (size_t i = 0; i < events.size(); i++) {
+                std::cerr << events[i].first << "\t" << events[i].second << std::endl;
+            }
+            std::cerr << "Read " << sink._records << " records (" << source.bytes() << " bytes, " << sink._malformed <<
+                " malformed lines), kept " << sink._matched << " in " << elapsed_time.count() << " seconds using " <<
+                options._threads << " threads" << std::endl;
+            std::cerr << "Throughput: " << sink._records / elapsed_time.count() << " records per second, " <<
+                source.bytes() / elapsed_time.count() / 1e6 << " MB per second" << std::endl;
+        }
+    } catch (std::system_error const& e) {
+        if (e.code().value() == EPIPE) {
+            // The reader went away, e.g. head(1)
+            //
+            return 0;
+        }
+        std::cerr << "ilfcat: " << e.what() << std::endl;
+        return 1;
+    } catch (std::exception const& e) {
+        std::cerr << "ilfcat: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
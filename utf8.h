@@ -0,0 +1,353 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#pragma once
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+#include "atomicops.h"
+
+namespace libilf {
+
+/**
+ * How sanitize_utf8() repairs a value:
+ *
+ * - REPLACE writes U+FFFD for each maximal invalid subsequence (as
+ *   recommended by the Unicode standard) and for each control byte.
+ * - ESCAPE writes each invalid or control byte as \xNN, and each backslash
+ *   as \x5C, so that the original bytes can be recovered unambiguously.
+ */
+enum class Utf8Repair {
+    REPLACE,
+    ESCAPE
+};
+
+namespace detail {
+
+AE_FORCEINLINE bool is_control(unsigned char c) {
+    return c < 0x20 || c == 0x7F;
+}
+
+/**
+ * Returns the length of the valid UTF-8 sequence starting at str[0], or 0 if
+ * it is invalid, in which case *invalid is set to the length of its maximal
+ * invalid subsequence. Follows table 3-7 of the Unicode standard.
+ */
+AE_FORCEINLINE size_t utf8_sequence(unsigned char const* str, size_t len, size_t *invalid) {
+    const unsigned char c = str[0];
+    if (c < 0x80) {
+        return 1;
+    }
+    size_t need;
+    unsigned char low = 0x80, high = 0xBF;
+    if (c >= 0xC2 && c <= 0xDF) {
+        need = 1;
+    } else if (c == 0xE0) {
+        need = 2;
+        low = 0xA0;
+    } else if (c == 0xED) {
+        need = 2;
+        high = 0x9F;
+    } else if (c >= 0xE1 && c <= 0xEF) {
+        need = 2;
+    } else if (c == 0xF0) {
+        need = 3;
+        low = 0x90;
+    } else if (c == 0xF4) {
+        need = 3;
+        high = 0x8F;
+    } else if (c >= 0xF1 && c <= 0xF3) {
+        need = 3;
+    } else {
+        *invalid = 1;
+        return 0;
+    }
+    size_t i = 1;
+    for (; i <= need && i < len; i++) {
+        if (str[i] < low || str[i] > high) {
+            break;
+        }
+        low = 0x80;
+        high = 0xBF;
+    }
+    if (i == need + 1) {
+        return i;
+    }
+    *invalid = i;
+    return 0;
+}
+
+/**
+ * Returns the offset of the first invalid sequence, or of the first control
+ * byte if controls is set, or len if there is none.
+ */
+inline size_t utf8_scan_scalar(char const* data, size_t len, bool controls) {
+    unsigned char const* str = reinterpret_cast<unsigned char const*>(data);
+    size_t i = 0, invalid;
+    while (i < len) {
+        if (str[i] < 0x80) {
+            if (controls && is_control(str[i])) {
+                return i;
+            }
+            i++;
+            continue;
+        }
+        size_t seq = utf8_sequence(str + i, len - i, &invalid);
+        if (seq == 0) {
+            return i;
+        }
+        i += seq;
+    }
+    return len;
+}
+
+#if defined(__SSSE3__)
+
+/**
+ * UTF-8 validation with the lookup algorithm of Keiser and Lemire
+ * ("Validating UTF-8 in less than one instruction per byte", 2021).
+ *
+ * Three 16-entry tables indexed by the high and low nibbles of the previous
+ * byte and the high nibble of the current byte give, for each pair of bytes,
+ * the set of errors it may be part of; their intersection is the set of
+ * errors it is part of. The only error found this way that is not one is a
+ * continuation byte following another, which is valid as the third or fourth
+ * byte of a sequence, and is cancelled out by looking two and three bytes
+ * back.
+ */
+class Utf8Checker {
+public:
+    Utf8Checker() :
+        _error(_mm_setzero_si128()),
+        _prev(_mm_setzero_si128()),
+        _prev_incomplete(_mm_setzero_si128()) { }
+
+    AE_FORCEINLINE void step(__m128i input, bool controls) {
+        if (controls) {
+            const __m128i below = _mm_cmpeq_epi8(_mm_max_epu8(input, _mm_set1_epi8(0x1F)), _mm_set1_epi8(0x1F));
+            _error = _mm_or_si128(_error, _mm_or_si128(below, _mm_cmpeq_epi8(input, _mm_set1_epi8(0x7F))));
+        }
+        if (_mm_movemask_epi8(input) == 0) {
+            _error = _mm_or_si128(_error, _prev_incomplete);
+            _prev_incomplete = _mm_setzero_si128();
+        } else {
+            _error = _mm_or_si128(_error, check_pairs(input));
+            _prev_incomplete = _mm_subs_epu8(input, _mm_setr_epi8(
+                -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                static_cast<char>(0xF0 - 1), static_cast<char>(0xE0 - 1), static_cast<char>(0xC0 - 1)));
+        }
+        _prev = input;
+    }
+
+    /**
+     * Returns whether any error was found, counting a sequence cut off by the
+     * end of the input.
+     */
+    AE_FORCEINLINE bool failed() const {
+        const __m128i error = _mm_or_si128(_error, _prev_incomplete);
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) != 0xFFFF;
+    }
+
+private:
+    AE_FORCEINLINE __m128i check_pairs(__m128i input) const {
+        const char TOO_SHORT = 1 << 0, TOO_LONG = 1 << 1, OVERLONG_3 = 1 << 2,
+            TOO_LARGE = 1 << 3, SURROGATE = 1 << 4, OVERLONG_2 = 1 << 5,
+            TOO_LARGE_1000 = 1 << 6, OVERLONG_4 = 1 << 6;
+        const char TWO_CONTS = static_cast<char>(1 << 7);
+        const char CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+        const __m128i low_nibbles = _mm_set1_epi8(0x0F);
+
+        const __m128i prev1 = _mm_alignr_epi8(input, _prev, 15);
+        const __m128i byte_1_high = _mm_shuffle_epi8(_mm_setr_epi8(
+            TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+            TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+            TOO_SHORT | OVERLONG_2,
+            TOO_SHORT,
+            TOO_SHORT | OVERLONG_3 | SURROGATE,
+            TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4),
+            _mm_and_si128(_mm_srli_epi16(prev1, 4), low_nibbles));
+        const __m128i byte_1_low = _mm_shuffle_epi8(_mm_setr_epi8(
+            CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+            CARRY | OVERLONG_2,
+            CARRY,
+            CARRY,
+            CARRY | TOO_LARGE,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000),
+            _mm_and_si128(prev1, low_nibbles));
+        const __m128i byte_2_high = _mm_shuffle_epi8(_mm_setr_epi8(
+            TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+            TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT),
+            _mm_and_si128(_mm_srli_epi16(input, 4), low_nibbles));
+        const __m128i special = _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low), byte_2_high);
+
+        // Continuation bytes that are the third or fourth of a sequence
+        //
+        const __m128i prev2 = _mm_alignr_epi8(input, _prev, 14),
+            prev3 = _mm_alignr_epi8(input, _prev, 13);
+        const __m128i third = _mm_subs_epu8(prev2, _mm_set1_epi8(static_cast<char>(0xE0 - 1))),
+            fourth = _mm_subs_epu8(prev3, _mm_set1_epi8(static_cast<char>(0xF0 - 1)));
+        const __m128i must_be_cont = _mm_and_si128(
+            _mm_cmpgt_epi8(_mm_or_si128(third, fourth), _mm_setzero_si128()),
+            _mm_set1_epi8(TWO_CONTS));
+        return _mm_xor_si128(must_be_cont, special);
+    }
+
+    __m128i _error, _prev, _prev_incomplete;
+};
+
+/**
+ * Returns whether a value is valid UTF-8, and free of control bytes if
+ * controls is set, 16 bytes at a time.
+ */
+inline bool utf8_check(char const* data, size_t len, bool controls) {
+    Utf8Checker checker;
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        checker.step(_mm_loadu_si128(reinterpret_cast<__m128i const*>(data + i)), controls);
+    }
+    if (i < len) {
+        // Pads with spaces, which are neither control bytes nor part of a
+        // sequence
+        //
+        char tail[16];
+        memset(tail, ' ', sizeof(tail));
+        memcpy(tail, data + i, len - i);
+        checker.step(_mm_loadu_si128(reinterpret_cast<__m128i const*>(tail)), controls);
+    }
+    return !checker.failed();
+}
+
+#else
+
+inline bool utf8_check(char const* data, size_t len, bool controls) {
+    return utf8_scan_scalar(data, len, controls) == len;
+}
+
+#endif
+
+inline void append_repaired(std::string& out, char const* data, size_t len, Utf8Repair repair) {
+    static const char hex[] = "0123456789ABCDEF";
+    unsigned char const* str = reinterpret_cast<unsigned char const*>(data);
+    size_t i = 0;
+    while (i < len) {
+        size_t clean = i + utf8_scan_scalar(data + i, len - i, true);
+        if (repair == Utf8Repair::ESCAPE) {
+            char const* backslash;
+            while ((backslash = static_cast<char const*>(memchr(data + i, '\\', clean - i))) != nullptr) {
+                out.append(data + i, backslash - data - i);
+                out.append("\\x5C", 4);
+                i = backslash - data + 1;
+            }
+        }
+        out.append(data + i, clean - i);
+        if (clean == len) {
+            return;
+        }
+        size_t bad = 1;
+        if (str[clean] >= 0x80) {
+            utf8_sequence(str + clean, len - clean, &bad);
+        }
+        if (repair == Utf8Repair::REPLACE) {
+            out.append("\xEF\xBF\xBD", 3);
+        } else {
+            for (size_t j = clean; j < clean + bad; j++) {
+                const char escape[4] = {'\\', 'x', hex[str[j] >> 4], hex[str[j] & 0x0F]};
+                out.append(escape, 4);
+            }
+        }
+        i = clean + bad;
+    }
+}
+
+/**
+ * Returns whether a value must be repaired: it is not clean UTF-8, or, when
+ * escaping, has a backslash.
+ */
+AE_FORCEINLINE bool needs_repair(char const* data, size_t len, Utf8Repair repair) {
+    return !utf8_check(data, len, true) || (repair == Utf8Repair::ESCAPE && memchr(data, '\\', len) != nullptr);
+}
+
+} // namespace detail
+
+/**
+ * Returns whether a value is valid UTF-8.
+ */
+AE_FORCEINLINE bool utf8_valid(char const* data, size_t len) {
+    return detail::utf8_check(data, len, false);
+}
+
+AE_FORCEINLINE bool utf8_valid(std::string const& value) {
+    return utf8_valid(value.data(), value.size());
+}
+
+/**
+ * Returns whether a value is valid UTF-8 without control bytes (below 0x20,
+ * and 0x7F), i.e., needs no sanitizing.
+ */
+AE_FORCEINLINE bool utf8_clean(char const* data, size_t len) {
+    return detail::utf8_check(data, len, true);
+}
+
+AE_FORCEINLINE bool utf8_clean(std::string const& value) {
+    return utf8_clean(value.data(), value.size());
+}
+
+/**
+ * Sanitizes a value in place, e.g. while building a KeyValue. A value that is
+ * already clean is detected in one pass and left untouched. Returns whether
+ * the value was modified.
+ */
+inline bool sanitize_utf8(std::string& value, Utf8Repair repair = Utf8Repair::REPLACE) {
+    if (!detail::needs_repair(value.data(), value.size(), repair)) {
+        return false;
+    }
+    std::string repaired;
+    repaired.reserve(value.size() + 16);
+    detail::append_repaired(repaired, value.data(), value.size(), repair);
+    value.swap(repaired);
+    return true;
+}
+
+/**
+ * Appends a sanitized value to out, e.g. while serializing. A clean value is
+ * appended with one copy.
+ */
+inline void append_sanitized_utf8(std::string& out, char const* data, size_t len,
+    Utf8Repair repair = Utf8Repair::REPLACE) {
+    if (!detail::needs_repair(data, len, repair)) {
+        out.append(data, len);
+        return;
+    }
+    detail::append_repaired(out, data, len, repair);
+}
+
+} // namespace libilf
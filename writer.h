@@ -0,0 +1,195 @@
+/*
+
+    Copyright (c) 2023 The MITRE Corporation.
+
+    ALL RIGHTS RESERVED. This copyright notice must
+
+    not be removed from this software, absent MITRE's
+
+    express written permission.
+
+*/
+
+#pragma once
+
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+
+#include "atomicops.h"
+#include "decimal.h"
+#include "encoding.h"
+
+namespace libilf {
+
+/**
+ * Characters that are not necessarily null-terminated, taken by the writer
+ * from a std::string, a C string, or a pointer and a length.
+ */
+struct Text {
+    Text(std::string const& str) : _data(str.data()), _size(str.size()) { }
+
+    Text(char const* str) : _data(str), _size(strlen(str)) { }
+
+    Text(char const* data, size_t size) : _data(data), _size(size) { }
+
+    char const* _data;
+    size_t _size;
+};
+
+/**
+ * Streaming writer emitting ILF text straight into a string, without building
+ * an ILF first:
+ *
+ *     writer.begin("FlowStart", sender, receiver, time)
+ *           .kv("bytes", 1024)
+ *           .kv("user", name, true)
+ *           .end();
+ *
+ * appends exactly what operator<<(std::ostream&, ILF const&) prints for the
+ * same ILF. The string keeps its capacity when cleared, so a writer reused
+ * across records stops allocating altogether.
+ *
+ * Typed overloads format values the way std::to_string() does, so that they
+ * match ILFs filled in with std::to_string(). Keys and values are written as
+ * is, with no escaping, as by operator<<.
+ */
+class ILFWriter {
+public:
+    explicit ILFWriter(std::string& out) : _out(&out), _first(true) { }
+
+    AE_FORCEINLINE std::string& str() {
+        return *_out;
+    }
+
+    /**
+     * Starts a record with its event type, sender, receiver and time.
+     */
+    AE_FORCEINLINE ILFWriter& begin(Text event_t, Text sender, Text receiver, Text time) {
+        append(event_t);
+        _out->push_back('[');
+        append(sender);
+        _out->push_back(',');
+        append(receiver);
+        _out->push_back(',');
+        append(time);
+        _out->append(",(", 2);
+        _first = true;
+        return *this;
+    }
+
+    AE_FORCEINLINE ILFWriter& begin(Text event_t, Text sender, Text receiver, int64_t time) {
+        char buf[MAX_DECIMAL_LENGTH + 16];
+        return begin(event_t, sender, receiver, Text(buf, format_decimal(time, buf) - buf));
+    }
+
+    /**
+     * Adds a key-value pair, with the value in double quotes if quoted is set.
+     */
+    AE_FORCEINLINE ILFWriter& kv(Text key, Text value, bool quoted = true) {
+        begin_pair(key);
+        if (quoted) {
+            _out->push_back('"');
+            append(value);
+            _out->push_back('"');
+        } else {
+            append(value);
+        }
+        return *this;
+    }
+
+    AE_FORCEINLINE ILFWriter& kv(Text key, std::string const& value, bool quoted = true) {
+        return kv(key, Text(value), quoted);
+    }
+
+    AE_FORCEINLINE ILFWriter& kv(Text key, char const* value, bool quoted = true) {
+        return kv(key, Text(value), quoted);
+    }
+
+    /**
+     * Adds an integer of any width and signedness, e.g. long long or size_t,
+     * widened to 64 bits.
+     */
+    template <class T>
+    AE_FORCEINLINE typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value,
+        ILFWriter&>::type kv(Text key, T value, bool quoted = false) {
+        typedef typename std::conditional<std::is_signed<T>::value, int64_t, uint64_t>::type wide_t;
+        char buf[MAX_DECIMAL_LENGTH + 16];
+        return kv(key, Text(buf, format_decimal(static_cast<wide_t>(value), buf) - buf), quoted);
+    }
+
+    /**
+     * Adds a floating-point value with six decimals, as std::to_string().
+     */
+    AE_FORCEINLINE ILFWriter& kv(Text key, double value, bool quoted = false) {
+        char buf[512];
+        int len = snprintf(buf, sizeof(buf), "%f", value);
+        return kv(key, Text(buf, static_cast<size_t>(len)), quoted);
+    }
+
+    /**
+     * Adds a boolean as 1 or 0, as std::to_string().
+     */
+    AE_FORCEINLINE ILFWriter& kv(Text key, bool value, bool quoted = false) {
+        return kv(key, Text(value ? "1" : "0", 1), quoted);
+    }
+
+    /**
+     * Adds binary data as hex digits, e.g. a hash.
+     */
+    AE_FORCEINLINE ILFWriter& kv_hex(Text key, void const* data, size_t len, bool upper = false, bool quoted = true) {
+        begin_pair(key);
+        if (quoted) {
+            _out->push_back('"');
+        }
+        append_hex(*_out, data, len, upper);
+        if (quoted) {
+            _out->push_back('"');
+        }
+        return *this;
+    }
+
+    /**
+     * Adds binary data in padded base64.
+     */
+    AE_FORCEINLINE ILFWriter& kv_base64(Text key, void const* data, size_t len, bool quoted = true) {
+        begin_pair(key);
+        if (quoted) {
+            _out->push_back('"');
+        }
+        append_base64(*_out, data, len);
+        if (quoted) {
+            _out->push_back('"');
+        }
+        return *this;
+    }
+
+    /**
+     * Ends the record.
+     */
+    AE_FORCEINLINE ILFWriter& end() {
+        _out->append(")]", 2);
+        return *this;
+    }
+
+private:
+    AE_FORCEINLINE void append(Text text) {
+        _out->append(text._data, text._size);
+    }
+
+    AE_FORCEINLINE void begin_pair(Text key) {
+        if (!_first) {
+            _out->push_back(';');
+        }
+        _first = false;
+        append(key);
+        _out->push_back('=');
+    }
+
+    std::string *_out;
+    bool _first;
+};
+
+} // namespace libilf